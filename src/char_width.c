@@ -0,0 +1,5 @@
+/* See LICENSE for license information. */
+
+#include "char_width.h"
+
+#include "char_width_table.h"
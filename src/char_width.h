@@ -0,0 +1,43 @@
+/* See LICENSE for license information. */
+
+/**
+ * Character width lookup. The table is generated at build time by
+ * char_width/gen_char_width_table.c, a lookup is two loads and no function call.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <uchar.h>
+
+#define CHAR_WIDTH_CODEPOINT_LIMIT 0x110000
+#define CHAR_WIDTH_BLOCK_SHIFT     8
+#define CHAR_WIDTH_BLOCK_SIZE      (1 << CHAR_WIDTH_BLOCK_SHIFT)
+#define CHAR_WIDTH_WIDTH_MASK      0x03
+#define CHAR_WIDTH_AMBIGUOUS_FLAG  0x04
+
+extern const uint8_t char_width_stage1[CHAR_WIDTH_CODEPOINT_LIMIT >> CHAR_WIDTH_BLOCK_SHIFT];
+extern const uint8_t char_width_stage2[][CHAR_WIDTH_BLOCK_SIZE];
+
+static inline uint8_t char_width_table_entry(char32_t codepoint)
+{
+    if (__builtin_expect(codepoint >= CHAR_WIDTH_CODEPOINT_LIMIT, 0)) {
+        return 0;
+    }
+
+    return char_width_stage2[char_width_stage1[codepoint >> CHAR_WIDTH_BLOCK_SHIFT]]
+                            [codepoint & (CHAR_WIDTH_BLOCK_SIZE - 1)];
+}
+
+/* Get the number of cells a codepoint occupies (0 for control and zero width characters) */
+static inline uint8_t char_width(char32_t codepoint)
+{
+    return char_width_table_entry(codepoint) & CHAR_WIDTH_WIDTH_MASK;
+}
+
+/* Codepoints that may be drawn with a double width glyph, but only advance the cursor by one */
+static inline bool char_is_ambiguous_width(char32_t codepoint)
+{
+    return char_width_table_entry(codepoint) & CHAR_WIDTH_AMBIGUOUS_FLAG;
+}
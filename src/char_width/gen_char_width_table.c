@@ -0,0 +1,96 @@
+/* See LICENSE for license information. */
+
+/**
+ * Generates the two-level character width lookup table (build/char_width_table.h) from the same
+ * unicode data the terminal would otherwise query at runtime (utf8proc or the bundled wcwidth).
+ *
+ * Codepoints are split into blocks of CHAR_WIDTH_BLOCK_SIZE. Stage 1 maps every block to a
+ * (deduplicated) stage 2 block holding one byte per codepoint: the width in cells in the low bits
+ * and the ambiguous width flag above them.
+ */
+
+#define _GNU_SOURCE
+
+#include "../char_width.h"
+#include "../util.h"
+
+#ifndef NOUTF8PROC
+#include <utf8proc.h>
+#else
+#include "../wcwidth/wcwidth.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define N_BLOCKS (CHAR_WIDTH_CODEPOINT_LIMIT / CHAR_WIDTH_BLOCK_SIZE)
+
+static uint8_t entry_for(char32_t codepoint)
+{
+#ifndef NOUTF8PROC
+    int width = utf8proc_charwidth(codepoint);
+#else
+    int width = wcwidth(codepoint);
+#endif
+
+    /* control characters have no width (wcwidth reports them as -1) */
+    uint8_t entry = (uint8_t)CLAMP(width, 0, (int)CHAR_WIDTH_WIDTH_MASK);
+
+    if (unicode_is_ambiguous_width(codepoint)) {
+        entry |= CHAR_WIDTH_AMBIGUOUS_FLAG;
+    }
+
+    return entry;
+}
+
+static uint8_t stage1[N_BLOCKS];
+static uint8_t stage2[N_BLOCKS][CHAR_WIDTH_BLOCK_SIZE];
+
+int main(int argc, char** argv)
+{
+    size_t n_unique = 0;
+
+    for (size_t block = 0; block < N_BLOCKS; ++block) {
+        uint8_t entries[CHAR_WIDTH_BLOCK_SIZE];
+        for (size_t i = 0; i < CHAR_WIDTH_BLOCK_SIZE; ++i) {
+            entries[i] = entry_for(block * CHAR_WIDTH_BLOCK_SIZE + i);
+        }
+
+        size_t found;
+        for (found = 0; found < n_unique; ++found) {
+            if (!memcmp(stage2[found], entries, sizeof(entries))) {
+                break;
+            }
+        }
+
+        if (found == n_unique) {
+            if (n_unique > UINT8_MAX) {
+                fprintf(stderr, "%s: too many unique blocks for an 8 bit stage 1 index\n", argv[0]);
+                return EXIT_FAILURE;
+            }
+            memcpy(stage2[n_unique++], entries, sizeof(entries));
+        }
+
+        stage1[block] = found;
+    }
+
+    printf("/* Generated by gen_char_width_table.c, do not edit */\n\n");
+    printf("const uint8_t char_width_stage1[%zu] = {", (size_t)N_BLOCKS);
+    for (size_t i = 0; i < N_BLOCKS; ++i) {
+        printf("%s%u,", i % 16 ? " " : "\n    ", stage1[i]);
+    }
+    printf("\n};\n\n");
+
+    printf("const uint8_t char_width_stage2[%zu][CHAR_WIDTH_BLOCK_SIZE] = {\n", n_unique);
+    for (size_t b = 0; b < n_unique; ++b) {
+        printf("    {");
+        for (size_t i = 0; i < CHAR_WIDTH_BLOCK_SIZE; ++i) {
+            printf("%s%u,", i % 32 ? " " : "\n        ", stage2[b][i]);
+        }
+        printf("\n    },\n");
+    }
+    printf("};\n");
+
+    return EXIT_SUCCESS;
+}
@@ -1336,7 +1336,7 @@ typedef struct
 {
     line_render_subpass_args_t* prepared_subpass;
     line_render_pass_args_t     args;
-    line_render_subpass_args_t  subpass_args[2];
+    line_render_subpass_args_t  subpass_args[VT_LINE_DAMAGE_MAX_RANGES];
 
     GLuint final_texture;
     GLuint final_depthbuffer;
@@ -1391,10 +1391,6 @@ static line_render_pass_t create_line_render_pass(const line_render_pass_args_t*
                                         .render_range_begin = 0,
                                         .render_range_end   = 0,
                                 },
-                                {
-                                        .render_range_begin = 0,
-                                        .render_range_end   = 0,
-                                },
                               } };
 
     if (!rp.args.proxy) {
@@ -1438,6 +1434,49 @@ static void line_render_pass_try_to_recover_proxies(line_render_pass_t* self)
 #endif
 }
 
+/**
+ * Get the range of cells that has to be repainted for @param range to be redrawn. Glyphs can be
+ * wider than a cell, the range is extended until it is bordered by blank cells
+ * @return half-open range */
+static line_render_subpass_args_t line_render_pass_extend_damaged_range(
+  const VtLine*          ln,
+  const Vt*              vt,
+  vt_line_damage_range_t range)
+{
+    uint16_t range_begin_idx = range.front;
+    uint16_t range_end_idx   = range.end + 1;
+
+    while (range_begin_idx > 1) {
+        const VtCell* this_cell = &ln->data.buf[range_begin_idx - 1];
+        const VtCell* prev_cell = &ln->data.buf[range_begin_idx - 2];
+
+        if (VtCell_is_blank(this_cell) && Vt_cell_width(vt, prev_cell) < 2) {
+            break;
+        }
+        --range_begin_idx;
+    }
+
+    if (range_begin_idx == 1 && !VtCell_is_blank(&ln->data.buf[range_begin_idx - 1]) &&
+        Vt_cell_width(vt, &ln->data.buf[0]) > 1) {
+        range_begin_idx = 0;
+    }
+
+    while (range_end_idx < ln->data.size && range_end_idx) {
+        const VtCell* this_cell = &ln->data.buf[range_end_idx];
+        const VtCell* prev_cell = &ln->data.buf[range_end_idx - 1];
+        ++range_end_idx;
+
+        if (VtCell_is_blank(this_cell) && Rune_width_spill(Vt_cell_rune(vt, prev_cell)) < 2) {
+            break;
+        }
+    }
+
+    return (line_render_subpass_args_t){
+        .render_range_begin = range_begin_idx,
+        .render_range_end   = range_end_idx,
+    };
+}
+
 static void line_render_pass_set_up_subpasses(line_render_pass_t* self, uint8_t buffer_age)
 {
     const uint16_t CURSOR_OVERPAINT_FWD  = 3;
@@ -1466,37 +1505,33 @@ static void line_render_pass_set_up_subpasses(line_render_pass_t* self, uint8_t
 
     } else /* not for cursor */ {
         const VtLine* const ln = self->args.vt_line;
+        const Vt* const     vt = self->args.vt;
 
         switch (self->args.damage->type) {
             case VT_LINE_DAMAGE_RANGE: {
-                uint16_t range_begin_idx = self->args.damage->front;
-                uint16_t range_end_idx   = self->args.damage->end + 1;
-
-                while (range_begin_idx > 1) {
-                    Rune* this_rune = &ln->data.buf[range_begin_idx - 1].rune;
-                    Rune* prev_rune = &ln->data.buf[range_begin_idx - 2].rune;
-
-                    if (Rune_is_blank(*this_rune) && Rune_width(*prev_rune) < 2) {
-                        break;
+                const vt_line_damage_t* dmg = self->args.damage;
+
+                /* Each damaged range gets its own subpass, ranges that grow into each other after
+                 * being extended to whole glyphs are painted together */
+                self->n_queued_subpasses = 0;
+                for (uint8_t i = 0; i < dmg->n_ranges; ++i) {
+                    line_render_subpass_args_t range =
+                      line_render_pass_extend_damaged_range(ln, vt, dmg->ranges[i]);
+
+                    line_render_subpass_args_t* prev =
+                      self->n_queued_subpasses ? &self->subpass_args[self->n_queued_subpasses - 1]
+                                               : NULL;
+
+                    if (prev && range.render_range_begin <= prev->render_range_end) {
+                        prev->render_range_end =
+                          MAX(prev->render_range_end, range.render_range_end);
+                    } else {
+                        self->subpass_args[self->n_queued_subpasses++] = range;
                     }
-                    --range_begin_idx;
-                }
-
-                if (range_begin_idx == 1 &&
-                    !Rune_is_blank(ln->data.buf[range_begin_idx - 1].rune) &&
-                    Rune_width(ln->data.buf[0].rune) > 1) {
-                    range_begin_idx = 0;
                 }
 
-                while (range_end_idx < ln->data.size && range_end_idx) {
-                    Rune this_rune = ln->data.buf[range_end_idx].rune;
-                    Rune prev_rune = ln->data.buf[range_end_idx - 1].rune;
-                    ++range_end_idx;
-
-                    if (Rune_is_blank(this_rune) && Rune_width_spill(prev_rune) < 2) {
-                        break;
-                    }
-                }
+                line_render_subpass_args_t* last =
+                  &self->subpass_args[self->n_queued_subpasses - 1];
 
                 uint32_t n_lines = self->args.gl2->line_damage.n_lines;
                 uint32_t ix      = self->args.visual_index + 1 * n_lines + (buffer_age * n_lines);
@@ -1505,19 +1540,12 @@ static void line_render_pass_set_up_subpasses(line_render_pass_t* self, uint8_t
 
                 /* This line contains garbage beyond the damaged region that needs to be cleared. */
                 if (previous_frame_id != ln->proxy.data[PROXY_INDEX_TEXTURE]) {
-                    range_end_idx          = ln->data.size;
+                    last->render_range_end = ln->data.size;
                     self->clear_cell_count = Vt_col(self->args.vt);
-                } else if (previous_frame_length > range_end_idx) {
-                    range_end_idx          = ln->data.size;
+                } else if (previous_frame_length > last->render_range_end) {
+                    last->render_range_end = ln->data.size;
                     self->clear_cell_count = previous_frame_length;
                 }
-
-                self->subpass_args[0] = (line_render_subpass_args_t){
-                    .render_range_begin = range_begin_idx,
-                    .render_range_end   = range_end_idx,
-                };
-
-                self->n_queued_subpasses = 1;
             } break;
 
             case VT_LINE_DAMAGE_SHIFT:
@@ -1563,10 +1591,11 @@ static void line_render_pass_finalize(line_render_pass_t* self)
         self->args.proxy->data[PROXY_INDEX_DEPTHBUFFER_BLINK] = self->final_depthbuffer;
 #endif
 
-        self->args.damage->type  = VT_LINE_DAMAGE_NONE;
-        self->args.damage->shift = 0;
-        self->args.damage->front = 0;
-        self->args.damage->end   = 0;
+        self->args.damage->type     = VT_LINE_DAMAGE_NONE;
+        self->args.damage->shift    = 0;
+        self->args.damage->front    = 0;
+        self->args.damage->end      = 0;
+        self->args.damage->n_ranges = 0;
     } else {
         self->args.proxy->data[PROXY_INDEX_TEXTURE] = self->final_texture;
 
@@ -1575,10 +1604,11 @@ static void line_render_pass_finalize(line_render_pass_t* self)
 #endif
 
         if (!self->has_blinking_chars) {
-            self->args.damage->type  = VT_LINE_DAMAGE_NONE;
-            self->args.damage->shift = 0;
-            self->args.damage->front = 0;
-            self->args.damage->end   = 0;
+            self->args.damage->type     = VT_LINE_DAMAGE_NONE;
+            self->args.damage->shift    = 0;
+            self->args.damage->front    = 0;
+            self->args.damage->end      = 0;
+            self->args.damage->n_ranges = 0;
         }
     }
 
@@ -1772,7 +1802,8 @@ static inline ColorRGBA rune_final_bg_blend(const Vt*     self,
                                             bool          is_for_cursor,
                                             double        blend_factor)
 {
-    if (unlikely(Vt_is_cell_selected(self, x, y))) {
+    if (unlikely(Vt_is_cell_selected(self, x, y) ||
+                 Vt_cell_search_highlight(self, x, y) == VT_SEARCH_HIGHLIGHT_CURRENT)) {
         return self->colors.highlight.bg;
     } else if (rune) {
         ColorRGBA cursor_bg = Vt_rune_cursor_bg(self, rune);
@@ -1838,15 +1869,17 @@ static void line_render_pass_run_cell_subpass(line_render_pass_t*    pass,
     GLint bg_pixels_begin = subpass->args.render_range_begin * pass->args.gl2->glyph_width_pixels,
           bg_pixels_end;
 
-    VtRune* each_rune = pass->args.vt_line->data.buf + subpass->args.render_range_begin;
-    VtRune* same_bg_block_begin_rune = each_rune;
-    VtRune* cursor_rune              = NULL;
+    VtCell*       each_rune = pass->args.vt_line->data.buf + subpass->args.render_range_begin;
+    VtCell*       same_bg_block_begin_rune = each_rune;
+    const VtRune* cursor_rune              = NULL;
 
     ColorRGBA active_bg_color;
 
     if (pass->args.is_for_cursor) {
         if (pass->args.vt_line->data.size > pass->args.cnd_cursor_column) {
-            cursor_rune = Vector_at_VtRune(&pass->args.vt_line->data, pass->args.cnd_cursor_column);
+            cursor_rune = Vt_cell_attrs(
+              pass->args.vt,
+              Vector_at_VtCell(&pass->args.vt_line->data, pass->args.cnd_cursor_column));
         }
 
         active_bg_color = Vt_rune_cursor_bg(pass->args.vt, cursor_rune);
@@ -1867,14 +1900,15 @@ static void line_render_pass_run_cell_subpass(line_render_pass_t*    pass,
         each_rune = pass->args.vt_line->data.buf + idx_each_rune;
 
         if (likely(idx_each_rune != subpass->args.render_range_end)) {
-            if (unlikely(each_rune->blinkng)) {
+            const VtRune* attrs = Vt_cell_attrs(pass->args.vt, each_rune);
+
+            if (unlikely(attrs->blinkng)) {
                 pass->has_blinking_chars = true;
             }
 
             if (!pass->has_underlined_chars &&
-                unlikely(each_rune->underlined || each_rune->strikethrough ||
-                         each_rune->doubleunderline || each_rune->curlyunderline ||
-                         each_rune->overline || each_rune->hyperlink_idx)) {
+                unlikely(attrs->underlined || attrs->strikethrough || attrs->doubleunderline ||
+                         attrs->curlyunderline || attrs->overline || each_rune->hyperlink_idx)) {
                 pass->has_underlined_chars = true;
             }
         }
@@ -1882,13 +1916,15 @@ static void line_render_pass_run_cell_subpass(line_render_pass_t*    pass,
 #define L_COLOR_BG                                                                                 \
     (pass->args.is_for_cursor && settings.animate_cursor_blink)                                    \
       ? rune_final_bg_blend(pass->args.vt,                                                         \
-                            pass->args.is_for_cursor ? cursor_rune : each_rune,                    \
+                            pass->args.is_for_cursor ? cursor_rune                                 \
+                                                     : Vt_cell_attrs(pass->args.vt, each_rune),    \
                             idx_each_rune,                                                         \
                             pass->args.visual_index,                                               \
                             pass->args.is_for_cursor,                                              \
                             pass->args.is_for_cursor->fade_fraction)                               \
       : Vt_rune_final_bg(pass->args.vt,                                                            \
-                         pass->args.is_for_cursor ? cursor_rune : each_rune,                       \
+                         pass->args.is_for_cursor ? cursor_rune                                    \
+                                                  : Vt_cell_attrs(pass->args.vt, each_rune),       \
                          idx_each_rune,                                                            \
                          pass->args.visual_index,                                                  \
                          pass->args.is_for_cursor)
@@ -1898,8 +1934,10 @@ static void line_render_pass_run_cell_subpass(line_render_pass_t*    pass,
             int32_t extra_width = 0;
 
             if (idx_each_rune > 1) {
-                extra_width =
-                  MAX(Rune_width(pass->args.vt_line->data.buf[idx_each_rune - 1].rune) - 2, 0);
+                extra_width = MAX(
+                  Vt_cell_width(pass->args.vt, &pass->args.vt_line->data.buf[idx_each_rune - 1]) -
+                    2,
+                  0);
             }
 
             bg_pixels_end = (idx_each_rune + extra_width) * pass->args.gl2->glyph_width_pixels;
@@ -1928,52 +1966,45 @@ static void line_render_pass_run_cell_subpass(line_render_pass_t*    pass,
                                                     pass->args.is_for_cursor->fade_fraction)
                     : settings.fg;
 
-                const VtRune* same_colors_block_begin_rune = same_bg_block_begin_rune;
+                const VtCell* same_colors_block_begin_rune = same_bg_block_begin_rune;
 
-                for (const VtRune* each_rune_same_bg = same_bg_block_begin_rune;
+                for (const VtCell* each_rune_same_bg = same_bg_block_begin_rune;
                      each_rune_same_bg != each_rune + 1;
                      ++each_rune_same_bg) {
 
                     if (each_rune_same_bg == each_rune ||
                         !ColorRGB_eq(
                           Vt_rune_final_fg(pass->args.vt,
-                                           each_rune_same_bg,
+                                           Vt_cell_attrs(pass->args.vt, each_rune_same_bg),
                                            each_rune_same_bg - pass->args.vt_line->data.buf,
                                            pass->args.visual_index,
                                            active_bg_color,
                                            pass->args.is_for_cursor),
                           active_fg_color)) {
 
-                        /* Dummy value with we can point to to filter out a character */
-                        VtRune        same_color_blank_space;
-                        const VtRune* each_rune_filtered_visible;
-
                         for (Vector_float* i = NULL;
                              (i = Vector_iter_Vector_float(&pass->args.gl2->float_vec, i));) {
                             Vector_clear_float(i);
                         }
 
-                        for (const VtRune* each_rune_same_colors = same_colors_block_begin_rune;
+                        for (const VtCell* each_rune_same_colors = same_colors_block_begin_rune;
                              each_rune_same_colors != each_rune_same_bg;
                              ++each_rune_same_colors) {
                             size_t column = each_rune_same_colors - pass->args.vt_line->data.buf;
+                            const VtRune* attrs =
+                              Vt_cell_attrs(pass->args.vt, each_rune_same_colors);
 
                             /* Filter out stuff that should be hidden on this pass */
-                            if (unlikely(
-                                  (pass->args.is_for_blinking && each_rune_same_colors->blinkng) ||
-                                  each_rune_same_colors->hidden)) {
-                                same_color_blank_space           = *each_rune_same_colors;
-                                same_color_blank_space.rune.code = ' ';
-                                each_rune_filtered_visible       = &same_color_blank_space;
-                            } else {
-                                each_rune_filtered_visible = each_rune_same_colors;
+                            if (unlikely((pass->args.is_for_blinking && attrs->blinkng) ||
+                                         attrs->hidden)) {
+                                continue;
                             }
 
-                            if (each_rune_filtered_visible->rune.code > ' ') {
-                                GlyphAtlasEntry* entry =
-                                  GlyphAtlas_get(pass->args.gl2,
-                                                 &pass->args.gl2->glyph_atlas,
-                                                 &each_rune_filtered_visible->rune);
+                            Rune rune = Vt_cell_rune(pass->args.vt, each_rune_same_colors);
+
+                            if (rune.code > ' ') {
+                                GlyphAtlasEntry* entry = GlyphAtlas_get(
+                                  pass->args.gl2, &pass->args.gl2->glyph_atlas, &rune);
 
                                 if (!entry) {
                                     continue;
@@ -2030,7 +2061,8 @@ static void line_render_pass_run_cell_subpass(line_render_pass_t*    pass,
 
                             uint8_t width =
                               clip_end_idx < (long)pass->args.vt_line->data.size
-                                ? Rune_width_spill(pass->args.vt_line->data.buf[clip_end_idx].rune)
+                                ? Rune_width_spill(Vt_cell_rune(
+                                    pass->args.vt, &pass->args.vt_line->data.buf[clip_end_idx]))
                                 : 0;
 
                             GLsizei clip_end =
@@ -2164,17 +2196,23 @@ static void line_render_pass_run_cell_subpass(line_render_pass_t*    pass,
 
                             if (!pass->args.is_for_cursor) {
                                 // update active fg color;
+                                size_t column =
+                                  each_rune_same_bg - pass->args.vt_line->data.buf;
                                 if (settings.highlight_change_fg &&
                                     unlikely(Vt_is_cell_selected(pass->args.vt,
-                                                                 each_rune_same_bg -
-                                                                   pass->args.vt_line->data.buf,
-                                                                 pass->args.visual_index))) {
+                                                                 column,
+                                                                 pass->args.visual_index) ||
+                                             Vt_cell_search_highlight(pass->args.vt,
+                                                                      column,
+                                                                      pass->args.visual_index) ==
+                                               VT_SEARCH_HIGHLIGHT_CURRENT)) {
                                     active_fg_color = pass->args.vt->colors.highlight.fg;
                                 } else {
                                     active_fg_color =
-                                      Vt_rune_final_fg_apply_dim(pass->args.vt,
-                                                                 each_rune_same_bg,
-                                                                 active_bg_color,
+                                      Vt_rune_final_fg_apply_dim(
+                                        pass->args.vt,
+                                        Vt_cell_attrs(pass->args.vt, each_rune_same_bg),
+                                        active_bg_color,
                                                                  pass->args.is_for_cursor);
                                 }
                             }
@@ -2194,7 +2232,7 @@ static void line_render_pass_run_cell_subpass(line_render_pass_t*    pass,
                 same_bg_block_begin_rune = each_rune;
                 if (!pass->args.is_for_cursor) {
                     active_bg_color = Vt_rune_final_bg(pass->args.vt,
-                                                       each_rune,
+                                                       Vt_cell_attrs(pass->args.vt, each_rune),
                                                        idx_each_rune,
                                                        pass->args.visual_index,
                                                        pass->args.is_for_cursor);
@@ -2203,7 +2241,7 @@ static void line_render_pass_run_cell_subpass(line_render_pass_t*    pass,
         } // end if bg color changed
 
         int w = likely(idx_each_rune != subpass->args.render_range_end)
-                  ? Rune_width(pass->args.vt_line->data.buf[idx_each_rune].rune)
+                  ? Vt_cell_width(pass->args.vt, &pass->args.vt_line->data.buf[idx_each_rune])
                   : 1;
 
         idx_each_rune = CLAMP(idx_each_rune + (unlikely(w > 1) ? w : 1),
@@ -2305,31 +2343,35 @@ static void line_render_pass_run_line_subpass(const line_render_pass_t* pass,
     }
 
     /* lines are in the same color as the character, unless the line color was explicitly set */
-    ColorRGB line_color =
-      Vt_rune_ln_clr(pass->args.vt,
-                     &pass->args.vt_line->data.buf[subpass->args.render_range_begin]);
+    const VtCell* first_cell =
+      subpass->args.render_range_begin < pass->args.vt_line->data.size
+        ? &pass->args.vt_line->data.buf[subpass->args.render_range_begin]
+        : NULL;
+    ColorRGB line_color = Vt_rune_ln_clr(pass->args.vt, Vt_cell_attrs(pass->args.vt, first_cell));
 
     glDisable(GL_SCISSOR_TEST);
 
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    for (const VtRune* each_rune = pass->args.vt_line->data.buf + subpass->args.render_range_begin;
+    for (const VtCell* each_rune = pass->args.vt_line->data.buf + subpass->args.render_range_begin;
          each_rune <= pass->args.vt_line->data.buf + subpass->args.render_range_end;
          ++each_rune) {
 
         /* text column where this should be drawn */
-        size_t   column = each_rune - pass->args.vt_line->data.buf;
-        ColorRGB nc     = { 0 };
+        size_t        column = each_rune - pass->args.vt_line->data.buf;
+        ColorRGB      nc     = { 0 };
+        const VtRune* attrs  = NULL;
         if (each_rune != pass->args.vt_line->data.buf + subpass->args.render_range_end) {
-            nc = Vt_rune_ln_clr(pass->args.vt, each_rune);
+            attrs = Vt_cell_attrs(pass->args.vt, each_rune);
+            nc    = Vt_rune_ln_clr(pass->args.vt, attrs);
         }
         /* State has changed */
         if (!ColorRGB_eq(line_color, nc) ||
             each_rune == pass->args.vt_line->data.buf + subpass->args.render_range_end ||
-            each_rune->underlined != drawing[0] || each_rune->doubleunderline != drawing[1] ||
-            each_rune->strikethrough != drawing[2] || each_rune->overline != drawing[3] ||
-            each_rune->curlyunderline != drawing[4] || each_rune->hyperlink_idx != drawing[5]) {
+            attrs->underlined != drawing[0] || attrs->doubleunderline != drawing[1] ||
+            attrs->strikethrough != drawing[2] || attrs->overline != drawing[3] ||
+            attrs->curlyunderline != drawing[4] || each_rune->hyperlink_idx != drawing[5]) {
 
             if (each_rune == pass->args.vt_line->data.buf + subpass->args.render_range_end) {
                 for (uint_fast8_t tmp = 0; tmp < n_objects; tmp++) {
@@ -2476,17 +2518,17 @@ static void line_render_pass_run_line_subpass(const line_render_pass_t* pass,
     }
 
             if (each_rune != pass->args.vt_line->data.buf + subpass->args.render_range_end) {
-                L_SET_BOUNDS_BEGIN(each_rune->underlined, 0);
-                L_SET_BOUNDS_BEGIN(each_rune->doubleunderline, 1);
-                L_SET_BOUNDS_BEGIN(each_rune->strikethrough, 2);
-                L_SET_BOUNDS_BEGIN(each_rune->overline, 3);
-                L_SET_BOUNDS_BEGIN(each_rune->curlyunderline, 4);
+                L_SET_BOUNDS_BEGIN(attrs->underlined, 0);
+                L_SET_BOUNDS_BEGIN(attrs->doubleunderline, 1);
+                L_SET_BOUNDS_BEGIN(attrs->strikethrough, 2);
+                L_SET_BOUNDS_BEGIN(attrs->overline, 3);
+                L_SET_BOUNDS_BEGIN(attrs->curlyunderline, 4);
                 L_SET_BOUNDS_BEGIN(each_rune->hyperlink_idx, 5);
-                drawing[0] = each_rune->underlined;
-                drawing[1] = each_rune->doubleunderline;
-                drawing[2] = each_rune->strikethrough;
-                drawing[3] = each_rune->overline;
-                drawing[4] = each_rune->curlyunderline;
+                drawing[0] = attrs->underlined;
+                drawing[1] = attrs->doubleunderline;
+                drawing[2] = attrs->strikethrough;
+                drawing[3] = attrs->overline;
+                drawing[4] = attrs->curlyunderline;
                 drawing[5] = each_rune->hyperlink_idx != 0;
             } else {
                 memset(drawing, false, sizeof(drawing));
@@ -2534,7 +2576,10 @@ static void line_render_subpass_run_clear_stage(const line_render_pass_t* self,
     if (self->args.damage->type == VT_LINE_DAMAGE_RANGE) {
         glEnable(GL_SCISSOR_TEST);
 
-        uint16_t width_cells = MAX(subpass->args.render_range_end, self->clear_cell_count);
+        /* only the last subpass reaches the end of the line, cells between subpasses are kept */
+        uint16_t width_cells = subpass->args.render_range_end < self->length
+                                 ? subpass->args.render_range_end
+                                 : MAX(subpass->args.render_range_end, self->clear_cell_count);
         size_t   begin_px = self->args.gl2->glyph_width_pixels * subpass->args.render_range_begin;
         size_t   width_px =
           (width_cells - subpass->args.render_range_begin) * self->args.gl2->glyph_width_pixels;
@@ -2818,11 +2863,12 @@ static void GfxOpenGL2_draw_cursor(GfxOpenGL2* gfx, Vt* vt, const Ui* ui, uint8_
             break;
     }
 
-    VtRune* cursor_rune = NULL;
+    const VtRune* cursor_rune = NULL;
 
     if (vt->lines.size > ui->cursor->row &&
         Vt_get_visible_line(vt, ui->cursor->row)->data.size > st_col) {
-        cursor_rune = &Vt_get_visible_line(vt, ui->cursor->row)->data.buf[st_col];
+        cursor_rune =
+          Vt_cell_attrs(vt, &Vt_get_visible_line(vt, ui->cursor->row)->data.buf[st_col]);
     }
 
     ColorRGBA clr = Vt_rune_cursor_bg(vt, cursor_rune);
@@ -2865,102 +2911,41 @@ static void GfxOpenGL2_draw_cursor(GfxOpenGL2* gfx, Vt* vt, const Ui* ui, uint8_
     glDisable(GL_BLEND);
 }
 
-__attribute__((cold)) static void GfxOpenGL2_draw_unicode_input(GfxOpenGL2* gfx, const Vt* vt)
+/**
+ * Draw @param text in black on a white box starting at cell @param col, @param row in screen
+ * coordinates */
+__attribute__((cold)) static void GfxOpenGL2_draw_prompt(GfxOpenGL2*     gfx,
+                                                         size_t          row,
+                                                         size_t          col,
+                                                         const char32_t* text,
+                                                         size_t          len)
 {
-    size_t begin = MIN(vt->cursor.col, vt->ws.ws_col - vt->unicode_input.buffer.size - 1);
-    size_t row   = vt->cursor.row - Vt_visual_top_line(vt);
-    size_t col   = begin;
     glEnable(GL_SCISSOR_TEST);
-    {
-        glScissor(col * gfx->glyph_width_pixels + gfx->pixel_offset_x,
-                  gfx->win_h - (row + 1) * gfx->line_height_pixels - gfx->pixel_offset_y,
-                  gfx->glyph_width_pixels * (vt->unicode_input.buffer.size + 1),
-                  gfx->line_height_pixels);
-        glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
-        glBindBuffer_(GL_ARRAY_BUFFER, gfx->flex_vbo.vbo);
-
-        Rune rune = {
-            .code    = 'u',
-            .combine = { 0 },
-            .style   = VT_RUNE_NORMAL,
-        };
-
-        GlyphAtlasEntry* entry = GlyphAtlas_get(gfx, &gfx->glyph_atlas, &rune);
-        float            h     = (float)entry->height * gfx->sy;
-        float            w     = (float)entry->width * gfx->sx;
-        float            t     = entry->top * gfx->sy;
-        float            l     = entry->left * gfx->sx;
-        float            x3    = -1.0f + (float)col * gfx->glyph_width_pixels * gfx->sx + l +
-                   gfx->pen_begin_pixels_x * gfx->sx;
-        float y3 = 1.0f - (float)(row)*gfx->line_height_pixels * gfx->sy -
-                   gfx->pen_begin_pixels_y * gfx->sy + t;
-
-#ifdef GFX_GLES
-        float buf[] = {
-            x3,     y3,     entry->tex_coords[0], entry->tex_coords[1],
-            x3 + w, y3,     entry->tex_coords[2], entry->tex_coords[1],
-            x3 + w, y3 - h, entry->tex_coords[2], entry->tex_coords[3],
-
-            x3,     y3,     entry->tex_coords[0], entry->tex_coords[1],
-            x3,     y3 - h, entry->tex_coords[0], entry->tex_coords[3],
-            x3 + w, y3 - h, entry->tex_coords[2], entry->tex_coords[3],
-        };
-#else
-        float buf[] = {
-            x3,     y3,     entry->tex_coords[0], entry->tex_coords[1],
-            x3 + w, y3,     entry->tex_coords[2], entry->tex_coords[1],
-            x3 + w, y3 - h, entry->tex_coords[2], entry->tex_coords[3],
-            x3,     y3 - h, entry->tex_coords[0], entry->tex_coords[3],
-        };
-#endif
-
-        GlyphAtlasPage* page = &gfx->glyph_atlas.pages.buf[entry->page_id];
-        glBindTexture(GL_TEXTURE_2D, page->texture_id);
-        glBindBuffer_(GL_ARRAY_BUFFER, gfx->flex_vbo.vbo);
-        size_t newsize = sizeof(buf);
-        ARRAY_BUFFER_SUB_OR_SWAP(buf, gfx->flex_vbo.size, newsize);
-        switch (page->texture_format) {
-            case TEX_FMT_RGB: {
-                glUseProgram_(gfx->font_shader.id);
-                GLuint loc = gfx->font_shader.attribs->location;
-                glVertexAttribPointer_(loc, 4, GL_FLOAT, GL_FALSE, 0, 0);
-                glUniform3f_(gfx->font_shader.uniforms[1].location, 0.0f, 0.0f, 0.0f);
-                glUniform4f_(gfx->font_shader.uniforms[2].location, 1.0f, 1.0f, 1.0f, 1.0f);
-            } break;
-            case TEX_FMT_MONO: {
-                glUseProgram_(gfx->font_shader_gray.id);
-                GLuint loc = gfx->font_shader_gray.attribs->location;
-                glVertexAttribPointer_(loc, 4, GL_FLOAT, GL_FALSE, 0, 0);
-                glUniform3f_(gfx->font_shader_gray.uniforms[1].location, 0.0f, 0.0f, 0.0f);
-
-#ifndef GFX_GLES
-                glUniform4f_(gfx->font_shader_gray.uniforms[2].location, 1.0f, 1.0f, 1.0f, 1.0f);
-#endif
-            } break;
-            default:
-                ASSERT_UNREACHABLE;
-        }
-
-        glDrawArrays(QUAD_DRAW_MODE, 0, QUAD_V_SZ);
-        ARRAY_BUFFER_ORPHAN(gfx->flex_vbo.size);
-    }
+    glScissor(col * gfx->glyph_width_pixels + gfx->pixel_offset_x,
+              gfx->win_h - (row + 1) * gfx->line_height_pixels - gfx->pixel_offset_y,
+              gfx->glyph_width_pixels * len,
+              gfx->line_height_pixels);
+    glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
 
-    for (size_t i = 0; i < vt->unicode_input.buffer.size; ++i) {
-        ++col;
+    for (size_t i = 0; i < len; ++i, ++col) {
         glBindBuffer_(GL_ARRAY_BUFFER, gfx->flex_vbo.vbo);
         Rune rune = (Rune){
-            .code    = vt->unicode_input.buffer.buf[i],
+            .code    = text[i],
             .combine = { 0 },
             .style   = VT_RUNE_NORMAL,
         };
 
         GlyphAtlasEntry* entry = GlyphAtlas_get(gfx, &gfx->glyph_atlas, &rune);
-        float            h     = (float)entry->height * gfx->sy;
-        float            w     = (float)entry->width * gfx->sx;
-        float            t     = entry->top * gfx->sy;
-        float            l     = entry->left * gfx->sx;
-        float            x3    = -1.0f + (float)col * gfx->glyph_width_pixels * gfx->sx + l +
+        if (!entry) {
+            continue;
+        }
+
+        float h  = (float)entry->height * gfx->sy;
+        float w  = (float)entry->width * gfx->sx;
+        float t  = entry->top * gfx->sy;
+        float l  = entry->left * gfx->sx;
+        float x3 = -1.0f + (float)col * gfx->glyph_width_pixels * gfx->sx + l +
                    gfx->pen_begin_pixels_x * gfx->sx;
         float y3 = 1.0f - (float)(row)*gfx->line_height_pixels * gfx->sy -
                    gfx->pen_begin_pixels_y * gfx->sy + t;
@@ -3021,6 +3006,54 @@ __attribute__((cold)) static void GfxOpenGL2_draw_unicode_input(GfxOpenGL2* gfx,
     glDisable(GL_SCISSOR_TEST);
 }
 
+__attribute__((cold)) static void GfxOpenGL2_draw_unicode_input(GfxOpenGL2* gfx, const Vt* vt)
+{
+    size_t   len = vt->unicode_input.buffer.size + 1;
+    char32_t text[len];
+    text[0] = 'u';
+    for (size_t i = 1; i < len; ++i) {
+        text[i] = vt->unicode_input.buffer.buf[i - 1];
+    }
+
+    GfxOpenGL2_draw_prompt(gfx,
+                           vt->cursor.row - Vt_visual_top_line(vt),
+                           MIN(vt->cursor.col, vt->ws.ws_col - len),
+                           text,
+                           len);
+}
+
+/**
+ * Show the search pattern being typed in the last row */
+__attribute__((cold)) static void GfxOpenGL2_draw_search_input(GfxOpenGL2* gfx, const Vt* vt)
+{
+    /* regex search is marked with a prefix and shows the number of matches found so far */
+    char   suffix[32] = "";
+    size_t prefix_len = vt->search.regex ? 2 : 1;
+    if (vt->search.regex && vt->search.pattern.size) {
+        snprintf(suffix,
+                 sizeof(suffix),
+                 " [%zu%s]",
+                 vt->search.matches.size,
+                 Vt_search_busy(vt) ? "+" : "");
+    }
+
+    size_t suffix_len  = strlen(suffix);
+    size_t len         = MIN(vt->search.pattern.size + prefix_len + suffix_len, Vt_col(vt));
+    size_t pattern_len = len > prefix_len + suffix_len ? len - prefix_len - suffix_len : 0;
+
+    char32_t text[len];
+    text[0]              = 'r';
+    text[prefix_len - 1] = vt->search.backward ? '?' : '/';
+    memcpy(text + prefix_len,
+           vt->search.pattern.buf + vt->search.pattern.size - pattern_len,
+           pattern_len * sizeof(char32_t));
+    for (size_t i = prefix_len + pattern_len; i < len; ++i) {
+        text[i] = suffix[i - prefix_len - pattern_len];
+    }
+
+    GfxOpenGL2_draw_prompt(gfx, Vt_row(vt) - 1, 0, text, len);
+}
+
 static void GfxOpenGL2_draw_scrollbar(GfxOpenGL2* self, const Scrollbar* scrollbar)
 {
     glEnable(GL_BLEND);
@@ -3144,6 +3177,10 @@ static void GfxOpenGL2_draw_overlays(GfxOpenGL2* self, Vt* vt, const Ui* ui, uin
         GfxOpenGL2_draw_cursor(self, vt, ui, buffer_age);
     }
 
+    if (vt->search.input_active) {
+        GfxOpenGL2_draw_search_input(self, vt);
+    }
+
     if (ui->scrollbar.visible) {
         GfxOpenGL2_draw_scrollbar(self, &ui->scrollbar);
     }
@@ -3286,7 +3323,7 @@ static void GfxOpenGL2_draw_image_view(GfxOpenGL2* self, const Vt* vt, VtImageSu
     Shader_use(&self->image_shader);
     glBindTexture(GL_TEXTURE_2D, surf->proxy.data[IMG_PROXY_INDEX_TEXTURE_ID]);
 
-    int64_t y_index = view->anchor_global_index - Vt_visual_top_line(vt);
+    int64_t y_index = Vt_line_id_to_row(vt, view->anchor_line_id) - Vt_visual_top_line(vt);
 
     float offset_x =
       self->sx * (view->anchor_cell_idx * self->glyph_width_pixels + view->anchor_offset_px.first);
@@ -3347,7 +3384,8 @@ void GfxOpenGL2_load_sixel(GfxOpenGL2* self, const Vt* vt, VtSixelSurface* srf,
 
 void GfxOpenGL2_draw_images(GfxOpenGL2* self, const Vt* vt, bool up_to_zero_z)
 {
-    for (VtLine* l = NULL; (l = Vector_iter_VtLine((Vector_VtLine*)&vt->lines, l));) {
+    for (size_t idx = 0; idx < vt->lines.size; ++idx) {
+        VtLine* l = Ring_at_VtLine(&vt->lines, idx);
         if (l->graphic_attachments && l->graphic_attachments->images) {
             for (RcPtr_VtImageSurfaceView* i = NULL;
                  (i = Vector_iter_RcPtr_VtImageSurfaceView(l->graphic_attachments->images, i));) {
@@ -3922,7 +3960,7 @@ window_partial_swap_request_t* GfxOpenGL2_draw(Gfx* self, Vt* vt, Ui* ui, uint8_
         retval = NULL;
     }
 
-    VtLine *begin, *end;
+    size_t begin, end;
     Vt_get_visible_lines(vt, &begin, &end);
     glDisable(GL_SCISSOR_TEST);
 
@@ -3938,14 +3976,15 @@ window_partial_swap_request_t* GfxOpenGL2_draw(Gfx* self, Vt* vt, Ui* ui, uint8_
 
     glClear(GL_COLOR_BUFFER_BIT);
 
-    for (VtLine* i = begin; i < end; ++i) {
+    for (size_t idx = begin; idx < end; ++idx) {
+        VtLine* i = Vt_get_visible_line(vt, idx);
         line_render_pass_args_t rp_args = {
             .gl2             = gfx,
             .vt              = vt,
             .vt_line         = i,
             .proxy           = NULL,
             .damage          = NULL,
-            .visual_index    = i - begin,
+            .visual_index    = idx - begin,
             .is_for_cursor   = false,
             .is_for_blinking = false,
         };
@@ -3966,7 +4005,7 @@ window_partial_swap_request_t* GfxOpenGL2_draw(Gfx* self, Vt* vt, Ui* ui, uint8_
                                                               : (damage.second - damage.first) + 1;
 
             bool surface_fragment_repaint =
-              GfxOpenGL2_get_accumulated_line_damaged(gfx, i - begin, buffer_age);
+              GfxOpenGL2_get_accumulated_line_damaged(gfx, idx - begin, buffer_age);
 
             bool length_in_limit = dam_len < CELL_DAMAGE_TO_SURF_LIMIT;
 
@@ -4001,8 +4040,9 @@ window_partial_swap_request_t* GfxOpenGL2_draw(Gfx* self, Vt* vt, Ui* ui, uint8_
         }
     }
 
-    for (VtLine* i = begin; i < end; ++i) {
-        ptrdiff_t visual_index = i - begin;
+    for (size_t idx = begin; idx < end; ++idx) {
+        VtLine*   i            = Vt_get_visible_line(vt, idx);
+        ptrdiff_t visual_index = idx - begin;
         if (retval) {
             retval = GfxOpenGL2_process_line_position_change_damage(gfx,
                                                                     retval,
@@ -4013,11 +4053,12 @@ window_partial_swap_request_t* GfxOpenGL2_draw(Gfx* self, Vt* vt, Ui* ui, uint8_
         }
 
         /* update damage history data */
-        if (gfx->line_damage.n_lines > i - begin) {
+        if (gfx->line_damage.n_lines > idx - begin) {
             // printf(TERMCOLOR_RED "> update color record of %ld to : %d!\n" TERMCOLOR_RESET, i -
             // begin, i->proxy.data[PROXY_INDEX_TEXTURE]);
-            gfx->line_damage.proxy_color_component[i - begin] = i->proxy.data[PROXY_INDEX_TEXTURE];
-            gfx->line_damage.line_length[i - begin]           = i->data.size;
+            gfx->line_damage.proxy_color_component[visual_index] =
+              i->proxy.data[PROXY_INDEX_TEXTURE];
+            gfx->line_damage.line_length[visual_index] = i->data.size;
         }
     }
 
@@ -4047,8 +4088,9 @@ window_partial_swap_request_t* GfxOpenGL2_draw(Gfx* self, Vt* vt, Ui* ui, uint8_
     glVertexAttribPointer_(gfx->image_shader.attribs->location, 4, GL_FLOAT, GL_FALSE, 0, 0);
     glViewport(gfx->pixel_offset_x, -gfx->pixel_offset_y, gfx->win_w, gfx->win_h);
 
-    for (VtLine* i = begin; i < end; ++i) {
-        uint32_t vis_idx = i - begin;
+    for (size_t idx = begin; idx < end; ++idx) {
+        VtLine*  i       = Vt_get_visible_line(vt, idx);
+        uint32_t vis_idx = idx - begin;
         // TODO: maybe this is up to date and we can get away without drawing?
         GfxOpenGL2_draw_line_quads(gfx, ui, i, vis_idx);
     }
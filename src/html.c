@@ -6,7 +6,6 @@
 
 #include "stb_image/stb_image.h"
 #include "stb_image/stb_image_write.h"
-#include "wcwidth/wcwidth.h"
 
 #include "base64.h"
 #include "colors.h"
@@ -34,7 +33,7 @@ typedef struct
     bool             blink;
 } HtmlRuneState;
 
-HtmlRuneState HtmlRuneState_from_vt_rune(const Vt* vt, VtRune* rune)
+HtmlRuneState HtmlRuneState_from_vt_rune(const Vt* vt, const VtRune* rune)
 {
     HtmlRuneState ret = {
         .bg            = ColorRGB_from_RGBA(Vt_rune_bg(vt, rune)),
@@ -262,11 +261,12 @@ void write_html_screen_dump(const Vt* vt, FILE* file)
 
     Vector_char lines = Vector_new_with_capacity_char(2048);
 
-    VtLine *begin, *end;
+    size_t begin, end;
     Vt_get_visible_lines(vt, &begin, &end);
 
-    for (VtLine* line = begin; line < end; ++line) {
-        char* spanclass = ((line - begin) % 2) ? "ev" : "od";
+    for (size_t idx = begin; idx < end; ++idx) {
+        VtLine* line      = Vt_get_visible_line(vt, idx);
+        char*   spanclass = ((idx - begin) % 2) ? "ev" : "od";
 
         start_span(&lines,
                    spanclass,
@@ -291,16 +291,18 @@ void write_html_screen_dump(const Vt* vt, FILE* file)
         size_t line_limit = MIN(Vt_col(vt), line->data.size);
 
         for (size_t c_idx = 0; c_idx < line_limit; c_idx += MAX(1, width)) {
-            VtRune*       rune           = &line->data.buf[c_idx];
-            HtmlRuneState new_rune_state = HtmlRuneState_from_vt_rune(vt, rune);
+            const VtCell* cell           = &line->data.buf[c_idx];
+            const VtRune* attrs          = Vt_cell_attrs(vt, cell);
+            Rune          rune           = Vt_cell_rune(vt, cell);
+            HtmlRuneState new_rune_state = HtmlRuneState_from_vt_rune(vt, attrs);
 
             if (memcmp(&old_rune_state, &new_rune_state, sizeof(new_rune_state))) {
                 end_span(&lines);
                 start_span(&lines,
                            NULL,
-                           VtRune_bg_is_default(rune) ? NULL : &new_rune_state.bg,
-                           VtRune_fg_is_default(rune) ? NULL : &new_rune_state.fg,
-                           rune->line_color_not_default ? &new_rune_state.ul : NULL,
+                           VtRune_bg_is_default(attrs) ? NULL : &new_rune_state.bg,
+                           VtRune_fg_is_default(attrs) ? NULL : &new_rune_state.fg,
+                           attrs->line_color_not_default ? &new_rune_state.ul : NULL,
                            new_rune_state.rstyle,
                            new_rune_state.ulstyle,
                            new_rune_state.strikethrough,
@@ -308,30 +310,30 @@ void write_html_screen_dump(const Vt* vt, FILE* file)
                            new_rune_state.blink);
             }
 
-            if (rune->hidden || rune->rune.code == ' ' || !rune->rune.code) {
+            if (attrs->hidden || rune.code == ' ' || !rune.code) {
                 Vector_push_char(&lines, ' ');
             } else {
                 char      buf[5] = { 0 };
                 mbstate_t mbs    = { 0 };
-                size_t    len    = c32rtomb(buf, rune->rune.code, &mbs);
+                size_t    len    = c32rtomb(buf, rune.code, &mbs);
                 if (len > 0) {
                     Vector_pushv_char(&lines, buf, len);
                 }
-                for (uint_fast8_t i = 0; i < VT_RUNE_MAX_COMBINE && rune->rune.combine[i]; ++i) {
+                for (uint_fast8_t i = 0; i < VT_RUNE_MAX_COMBINE && rune.combine[i]; ++i) {
                     memset(&mbs, 0, sizeof(mbs));
                     memset(buf, 0, sizeof(buf));
-                    len = c32rtomb(buf, rune->rune.combine[i], &mbs);
+                    len = c32rtomb(buf, rune.combine[i], &mbs);
                     if (len > 0) {
                         Vector_pushv_char(&lines, buf, len);
                     }
                 }
             }
-            width          = wcwidth(line->data.buf[c_idx].rune.code);
+            width          = char_width(rune.code);
             old_rune_state = new_rune_state;
         }
         end_span(&lines);
 
-        if (line != end) {
+        if (idx != end) {
             Vector_push_char(&lines, '\n');
         }
     }
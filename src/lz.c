@@ -0,0 +1,154 @@
+/* See LICENSE for license information. */
+
+#define _GNU_SOURCE
+
+#include "lz.h"
+#include "util.h"
+
+#include <string.h>
+
+#define LZ_MIN_MATCH  4
+#define LZ_MAX_OFFSET UINT16_MAX
+#define LZ_HASH_BITS  12
+
+static inline uint32_t lz_read32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t lz_hash(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* lengths that do not fit in a token nibble continue in bytes, 255 means another byte follows */
+static inline uint8_t* lz_put_length(uint8_t* output, size_t length)
+{
+    for (; length >= 255; length -= 255) {
+        *output++ = 255;
+    }
+    *output++ = length;
+    return output;
+}
+
+static inline uint8_t* lz_put_literals(uint8_t*       output,
+                                       uint8_t*       token,
+                                       const uint8_t* literals,
+                                       size_t         count)
+{
+    *token = MIN(count, 15) << 4;
+    if (count >= 15) {
+        output = lz_put_length(output, count - 15);
+    }
+    memcpy(output, literals, count);
+    return output + count;
+}
+
+size_t lz_compress(const uint8_t* input, size_t size, uint8_t* output)
+{
+    /* positions of the last occurrence of a hashed 4 byte sequence */
+    uint32_t table[1 << LZ_HASH_BITS] = { 0 };
+
+    const uint8_t *ip = input, *anchor = input, *end = input + size;
+    uint8_t*       op = output;
+
+    while (size >= LZ_MIN_MATCH && ip <= end - LZ_MIN_MATCH) {
+        uint32_t       sequence = lz_read32(ip);
+        uint32_t       hash     = lz_hash(sequence);
+        const uint8_t* ref      = input + table[hash];
+        table[hash]             = ip - input;
+
+        if (ref >= ip || ip - ref > LZ_MAX_OFFSET || lz_read32(ref) != sequence) {
+            ++ip;
+            continue;
+        }
+
+        size_t         offset    = ip - ref;
+        const uint8_t* match_end = ip + LZ_MIN_MATCH;
+        while (match_end < end && *match_end == match_end[-offset]) {
+            ++match_end;
+        }
+
+        uint8_t* token = op++;
+        op             = lz_put_literals(op, token, anchor, ip - anchor);
+        *op++          = offset & 0xff;
+        *op++          = offset >> 8;
+
+        size_t match_length = match_end - ip - LZ_MIN_MATCH;
+        *token |= MIN(match_length, 15);
+        if (match_length >= 15) {
+            op = lz_put_length(op, match_length - 15);
+        }
+
+        ip = anchor = match_end;
+    }
+
+    /* the last sequence only has literals */
+    uint8_t* token = op++;
+    op             = lz_put_literals(op, token, anchor, end - anchor);
+
+    return op - output;
+}
+
+ptrdiff_t lz_decompress(const uint8_t* input, size_t size, uint8_t* output, size_t capacity)
+{
+    const uint8_t *ip = input, *end = input + size;
+    uint8_t *      op = output, *op_end = output + capacity;
+
+    while (ip < end) {
+        uint8_t token    = *ip++;
+        size_t  literals = token >> 4;
+
+        if (literals == 15) {
+            for (uint8_t b = 255; b == 255; literals += b) {
+                if (ip == end) {
+                    return -1;
+                }
+                b = *ip++;
+            }
+        }
+
+        if ((size_t)(end - ip) < literals || (size_t)(op_end - op) < literals) {
+            return -1;
+        }
+
+        memcpy(op, ip, literals);
+        op += literals;
+        ip += literals;
+
+        if (ip == end) {
+            break;
+        }
+
+        if (end - ip < 2) {
+            return -1;
+        }
+
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+
+        size_t match_length = token & 15;
+        if (match_length == 15) {
+            for (uint8_t b = 255; b == 255; match_length += b) {
+                if (ip == end) {
+                    return -1;
+                }
+                b = *ip++;
+            }
+        }
+        match_length += LZ_MIN_MATCH;
+
+        if (!offset || offset > (size_t)(op - output) || (size_t)(op_end - op) < match_length) {
+            return -1;
+        }
+
+        /* the source may overlap the output when repeating a short pattern */
+        for (const uint8_t* ref = op - offset; match_length--;) {
+            *op++ = *ref++;
+        }
+    }
+
+    return op - output;
+}
@@ -0,0 +1,28 @@
+/* See LICENSE for license information. */
+
+/* Byte oriented LZ77 codec for data that is compressed once and decompressed rarely. Sequences are
+ * a token (literal count and match length nibbles), literals and a 16 bit match offset, similar to
+ * the LZ4 block format. */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Largest possible compressed size of @param size bytes */
+static inline size_t lz_compress_bound(size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+/**
+ * Compress @param size bytes of @param input
+ * @param output - must be at least lz_compress_bound(size) bytes
+ * @return number of bytes written */
+size_t lz_compress(const uint8_t* input, size_t size, uint8_t* output);
+
+/**
+ * Decompress @param size bytes of @param input into at most @param capacity bytes
+ * @return number of bytes written or -1 if the input is malformed or does not fit */
+ptrdiff_t lz_decompress(const uint8_t* input, size_t size, uint8_t* output, size_t capacity);
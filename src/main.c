@@ -19,7 +19,10 @@
 #include <stdint.h>
 #include <inttypes.h>
 
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
+#include <threads.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -62,6 +65,56 @@
 #define AUTOSCROLL_TRIGGER_MARGIN_PX 2
 #endif
 
+/* Most data from the pty interpreted at once, the time limit is checked between these */
+#ifndef PTY_INTERPRET_SLICE_SZ
+#define PTY_INTERPRET_SLICE_SZ (64 * 1024)
+#endif
+
+typedef enum
+{
+    APP_PROXY_LINE,
+    APP_PROXY_IMAGE,
+    APP_PROXY_IMAGE_VIEW,
+    APP_PROXY_SIXEL,
+} app_proxy_type_e;
+
+/* Proxy released on the pty thread, its gl objects can only be deleted on the main thread */
+typedef struct
+{
+    app_proxy_type_e type;
+    uint32_t         data[6];
+} AppReleasedProxy;
+
+DEF_VECTOR(AppReleasedProxy, NULL)
+
+/* Vt callbacks that change window, renderer or timer state. Called on the pty thread they are
+ * queued and run by the main thread in App_handle_pty_thread_requests() */
+typedef enum
+{
+    APP_PTY_REQUEST_ACTION              = (1 << 0),
+    APP_PTY_REQUEST_REPAINT             = (1 << 1),
+    APP_PTY_REQUEST_FLASH               = (1 << 2),
+    APP_PTY_REQUEST_BUFFER_CHANGED      = (1 << 3),
+    APP_PTY_REQUEST_SET_TITLE           = (1 << 4),
+    APP_PTY_REQUEST_CLIPBOARD_SEND      = (1 << 5),
+    APP_PTY_REQUEST_CLIPBOARD_GET       = (1 << 6),
+    APP_PTY_REQUEST_MAXIMIZE            = (1 << 7),
+    APP_PTY_REQUEST_FULLSCREEN          = (1 << 8),
+    APP_PTY_REQUEST_WINDOW_SIZE         = (1 << 9),
+    APP_PTY_REQUEST_TEXT_AREA_SIZE      = (1 << 10),
+    APP_PTY_REQUEST_FONT_RELOAD         = (1 << 11),
+    APP_PTY_REQUEST_URGENT              = (1 << 12),
+    APP_PTY_REQUEST_RESTACK             = (1 << 13),
+    APP_PTY_REQUEST_POINTER_MODE        = (1 << 14),
+    APP_PTY_REQUEST_CURSOR_BLINK        = (1 << 15),
+    APP_PTY_REQUEST_VISUAL_SCROLL_RESET = (1 << 16),
+    APP_PTY_REQUEST_SCROLL_PARAMS       = (1 << 17),
+    APP_PTY_REQUEST_PROGRESS_BAR        = (1 << 18),
+} app_pty_request_e;
+
+/* set on the thread running App_pty_thread_run() */
+static _Thread_local bool on_pty_thread = false;
+
 typedef struct
 {
     WindowBase*  win;
@@ -124,6 +177,35 @@ typedef struct
     VtCursor    ksm_cursor;
     Vector_char ksm_input_buf;
     TimePoint   ksm_last_input;
+
+    /* The pty is read and interpreted on a separate thread so rendering does not limit throughput.
+     * vt_lock guards everything that thread touches. The main thread holds it except when waiting
+     * for events and swapping buffers */
+    struct AppPtyThread
+    {
+        thrd_t thread;
+        bool   running;
+        mtx_t  vt_lock;
+        cnd_t  vt_released;
+        int    stop_pipe[2];
+
+        /* main thread is waiting for vt_lock, the pty thread lets it go first */
+        _Atomic bool main_waiting;
+
+        /* vt_lock is held by the main thread, only used on the main thread */
+        bool locked;
+
+        /* with vt_lock held */
+        bool                    interpreted;
+        Vector_AppReleasedProxy released_proxies;
+
+        /* app_pty_request_e flags and arguments of the latest queued calls, with vt_lock held */
+        uint32_t      requests;
+        bool          maximize, fullscreen, cursor_blink;
+        Pair_uint32_t window_size;
+        int32_t       text_area_width, text_area_height;
+        char*         clipboard_text;
+    } pty_thread;
 } App;
 
 static void          App_update_scrollbar_dims(App* self);
@@ -131,6 +213,7 @@ static void          App_update_cursor(App* self);
 static void          App_do_autoscroll(App* self);
 static void          App_notify_content_change(void* self);
 static void          App_maybe_clamp_ksm_cursor(App* self, Pair_uint32_t chars);
+static void          App_handle_search_result(App* self, vt_search_result_e result);
 static void          App_set_monitor_callbacks(App* self);
 static void          App_set_callbacks(App* self);
 static void          App_set_up_timers(App* self);
@@ -145,6 +228,8 @@ static void          App_framebuffer_damage(void* self);
 static Pair_uint32_t App_get_char_size(void* self);
 static bool          App_fullscreen(void* self);
 static void          App_maybe_swap_window(App* self);
+static void          App_reload_font(void* self);
+static void          App_run_pty_thread_requests(App* self, uint32_t requests);
 static void          App_csd_changed(void* self, ui_csd_mode_e csd_mode);
 static void          App_primary_output_changed(void*         self,
                                                 const int32_t display_index,
@@ -381,7 +466,24 @@ static void App_init(App* self)
         }
     }
 
-    Monitor_fork_new_pty(&self->monitor, settings.cols, settings.rows);
+    if (settings.replay_path.str) {
+        if (!Monitor_start_replay(&self->monitor,
+                                  settings.replay_path.str,
+                                  !settings.replay_fast,
+                                  &settings.cols,
+                                  &settings.rows)) {
+            ERR("Failed to start replay");
+        }
+    } else {
+        Monitor_fork_new_pty(&self->monitor, settings.cols, settings.rows);
+
+        if (settings.record_path.str) {
+            Monitor_start_recording(&self->monitor,
+                                    settings.record_path.str,
+                                    settings.cols,
+                                    settings.rows);
+        }
+    }
 
     Vt_init(&self->vt, settings.cols, settings.rows);
     self->vt.master_fd = self->monitor.child_fd;
@@ -456,11 +558,241 @@ static void App_init(App* self)
     WindowSystemLaunchEnv_destroy(&launch_env);
 }
 
+static void App_flush_vt_output(App* self)
+{
+    char*  buf;
+    size_t len;
+    Vt_peek_output(&self->vt, MONITOR_INPUT_BUFFER_SZ, &buf, &len);
+    if (Monitor_write(&self->monitor, buf, len) > 0) {
+        Vt_consumed_output(&self->vt, len);
+    }
+}
+
+static void App_lock_vt(App* self)
+{
+    struct AppPtyThread* t = &self->pty_thread;
+
+    if (t->running && !t->locked) {
+        atomic_store(&t->main_waiting, true);
+        mtx_lock(&t->vt_lock);
+        atomic_store(&t->main_waiting, false);
+        t->locked = true;
+    }
+}
+
+static void App_unlock_vt(App* self)
+{
+    struct AppPtyThread* t = &self->pty_thread;
+
+    if (t->running && t->locked) {
+        t->locked = false;
+        mtx_unlock(&t->vt_lock);
+        cnd_signal(&t->vt_released);
+    }
+}
+
+/**
+ * Do what the pty thread could not */
+static void App_handle_pty_thread_requests(App* self)
+{
+    struct AppPtyThread* t = &self->pty_thread;
+
+    for (AppReleasedProxy* i = NULL; (i = Vector_iter_AppReleasedProxy(&t->released_proxies, i));) {
+        switch (i->type) {
+            case APP_PROXY_LINE:
+                Gfx_destroy_proxy(self->gfx, i->data);
+                break;
+            case APP_PROXY_IMAGE:
+                Gfx_destroy_image_proxy(self->gfx, i->data);
+                break;
+            case APP_PROXY_IMAGE_VIEW:
+                Gfx_destroy_image_view_proxy(self->gfx, i->data);
+                break;
+            case APP_PROXY_SIXEL:
+                Gfx_destroy_sixel_proxy(self->gfx, i->data);
+                break;
+        }
+    }
+    Vector_clear_AppReleasedProxy(&t->released_proxies);
+
+    uint32_t requests = t->requests;
+    t->requests       = 0;
+    App_run_pty_thread_requests(self, requests);
+}
+
+/**
+ * Callbacks changing window, renderer or timer state queue themselves on the pty thread
+ * @return @param request was queued, the caller should not do anything else */
+static bool App_defer_to_main_thread(App* self, app_pty_request_e request)
+{
+    if (!on_pty_thread) {
+        return false;
+    }
+
+    self->pty_thread.requests |= request;
+    return true;
+}
+
+/**
+ * Proxy destructors called on the pty thread defer the work to the main thread */
+static bool App_maybe_release_proxy(App* self, app_proxy_type_e type, uint32_t* data, size_t size)
+{
+    if (!on_pty_thread) {
+        return false;
+    }
+
+    AppReleasedProxy released = { .type = type };
+    memcpy(released.data, data, size);
+    memset(data, 0, size);
+    Vector_push_AppReleasedProxy(&self->pty_thread.released_proxies, released);
+    return true;
+}
+
+static int App_pty_thread_run(void* arg)
+{
+    App*                 self = arg;
+    struct AppPtyThread* t    = &self->pty_thread;
+    on_pty_thread             = true;
+
+    while (Monitor_wait_for_pty(&self->monitor, t->stop_pipe[0])) {
+        /* keep the pty drained while the main thread is drawing */
+        Monitor_read(&self->monitor);
+
+        mtx_lock(&t->vt_lock);
+        while (atomic_load(&t->main_waiting)) {
+            cnd_wait(&t->vt_released, &t->vt_lock);
+        }
+
+        bool      interpreted = false;
+        char*     buf;
+        size_t    len;
+        TimePoint start = TimePoint_now();
+        for (;;) {
+            if (!self->monitor.input.size) {
+                Monitor_read(&self->monitor);
+            }
+
+            Monitor_peek_input(&self->monitor, PTY_INTERPRET_SLICE_SZ, &buf, &len);
+            if (!len) {
+                break;
+            }
+
+            interpreted = true;
+            Vt_interpret(&self->vt, buf, len);
+            Monitor_consumed_input(&self->monitor, len);
+            App_action(self);
+
+            /* give the main thread a chance to draw what we have so far */
+            if (atomic_load(&t->main_waiting) ||
+                TimePoint_ms_in_the_past(start) > settings.pty_chunk_timeout_ms) {
+                break;
+            }
+
+            /* Wait for any following data chunks, see App_run() */
+            if (settings.pty_chunk_wait_delay_ns) {
+                usleep(settings.pty_chunk_wait_delay_ns);
+            }
+        }
+
+        if (interpreted) {
+            t->interpreted = true;
+            App_flush_vt_output(self);
+        }
+        mtx_unlock(&t->vt_lock);
+
+        if (interpreted) {
+            Monitor_wake(&self->monitor);
+        }
+    }
+
+    /* let the main thread notice the child has exited */
+    Monitor_wake(&self->monitor);
+    return 0;
+}
+
+/**
+ * Read and interpret the pty on a separate thread. Recordings and debug modes stay on the main
+ * thread. */
+static void App_start_pty_thread(App* self)
+{
+    struct AppPtyThread* t = &self->pty_thread;
+
+    if (settings.debug_vt || self->monitor.is_recording || self->monitor.is_replaying) {
+        return;
+    }
+
+    if (pipe(t->stop_pipe)) {
+        WRN("Failed to create pipe %s\n", strerror(errno));
+        return;
+    }
+
+    if (!Monitor_read_on_other_thread(&self->monitor)) {
+        close(t->stop_pipe[0]);
+        close(t->stop_pipe[1]);
+        return;
+    }
+
+    t->released_proxies = Vector_new_AppReleasedProxy();
+    mtx_init(&t->vt_lock, mtx_plain);
+    cnd_init(&t->vt_released);
+    mtx_lock(&t->vt_lock);
+    t->locked = true;
+
+    /* SIGCHLD should interrupt the main thread waiting for events */
+    sigset_t mask, old_mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    pthread_sigmask(SIG_BLOCK, &mask, &old_mask);
+    t->running = thrd_create(&t->thread, App_pty_thread_run, self) == thrd_success;
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+    if (!t->running) {
+        WRN("Failed to start pty thread\n");
+        t->locked = false;
+        mtx_unlock(&t->vt_lock);
+        cnd_destroy(&t->vt_released);
+        mtx_destroy(&t->vt_lock);
+        Vector_destroy_AppReleasedProxy(&t->released_proxies);
+        Monitor_stop_reading_on_other_thread(&self->monitor);
+        close(t->stop_pipe[0]);
+        close(t->stop_pipe[1]);
+    }
+}
+
+static void App_stop_pty_thread(App* self)
+{
+    struct AppPtyThread* t = &self->pty_thread;
+
+    if (!t->running) {
+        return;
+    }
+
+    App_unlock_vt(self);
+    if (write(t->stop_pipe[1], "", 1) < 0) {
+        WRN("Failed to stop pty thread %s\n", strerror(errno));
+    }
+    thrd_join(t->thread, NULL);
+    t->running = false;
+
+    App_handle_pty_thread_requests(self);
+    Monitor_stop_reading_on_other_thread(&self->monitor);
+    close(t->stop_pipe[0]);
+    close(t->stop_pipe[1]);
+    cnd_destroy(&t->vt_released);
+    mtx_destroy(&t->vt_lock);
+    Vector_destroy_AppReleasedProxy(&t->released_proxies);
+    free(t->clipboard_text);
+    t->clipboard_text = NULL;
+}
+
 static void App_run(App* self)
 {
+    App_start_pty_thread(self);
+
     while (!(self->exit || Window_is_closed(self->win))) {
         int timeout_ms = -1;
-        if (Vt_get_output_size(&self->vt)) {
+        if (Vt_get_output_size(&self->vt) || Vt_reflow_pending(&self->vt) ||
+            Vt_search_pending(&self->vt)) {
             timeout_ms = 0;
         } else {
             int64_t next_pending_action_ms =
@@ -474,9 +806,18 @@ static void App_run(App* self)
             } else {
                 timeout_ms = CLAMP(next_pending_action_ms, 0, INT_MAX);
             }
+
+            /* collect regex search results once per frame while the worker runs */
+            if (Vt_search_busy(&self->vt)) {
+                int frame_ms = (int)Window_get_target_frame_time_ms(self->win);
+                timeout_ms   = timeout_ms < 0 ? frame_ms : MIN(timeout_ms, frame_ms);
+            }
         }
 
+        App_unlock_vt(self);
         Monitor_wait(&self->monitor, timeout_ms);
+        App_lock_vt(self);
+        App_handle_pty_thread_requests(self);
         self->closest_pending_wakeup = NULL;
 
         if (Monitor_are_window_system_events_pending(&self->monitor)) {
@@ -489,8 +830,15 @@ static void App_run(App* self)
         }
 
         ssize_t bytes                = 0;
+        bool    idle                 = !self->pty_thread.interpreted;
         self->interpreter_start_time = TimePoint_now();
+        self->pty_thread.interpreted = false;
         do {
+            /* App_pty_thread_run() does this */
+            if (self->pty_thread.running) {
+                break;
+            }
+
             if (unlikely(settings.debug_vt)) {
                 usleep(settings.vt_debug_delay_usec);
                 App_notify_content_change(self);
@@ -501,11 +849,20 @@ static void App_run(App* self)
                 break;
             }
 
-            bytes = Monitor_read(&self->monitor);
+            if (!self->monitor.input.size) {
+                Monitor_read(&self->monitor);
+            }
+
+            char*  buf;
+            size_t len;
+            Monitor_peek_input(&self->monitor, PTY_INTERPRET_SLICE_SZ, &buf, &len);
+            bytes = len;
 
             if (bytes > 0) {
+                idle                = false;
                 self->written_bytes = 0;
-                Vt_interpret(&self->vt, self->monitor.input_buffer, bytes);
+                Vt_interpret(&self->vt, buf, len);
+                Monitor_consumed_input(&self->monitor, len);
                 App_action(self);
             } else {
                 break;
@@ -519,13 +876,22 @@ static void App_run(App* self)
             }
         } while (bytes && likely(!settings.debug_vt));
 
-        char*  buf;
-        size_t len;
-        Vt_peek_output(&self->vt, MONITOR_INPUT_BUFFER_SZ, &buf, &len);
-        if (Monitor_write(&self->monitor, buf, len) > 0) {
-            Vt_consumed_output(&self->vt, len);
+        /* finish reflowing the scrollback after a resize when there is nothing else to do */
+        if (idle) {
+            Vt_reflow_step(&self->vt);
+
+            if (Vt_search_pending(&self->vt) || Vt_search_busy(&self->vt)) {
+                size_t n_matches = self->vt.search.matches.size;
+                App_handle_search_result(self, Vt_search_step(&self->vt));
+
+                /* search prompt shows the number of matches */
+                if (self->vt.search.input_active && n_matches != self->vt.search.matches.size) {
+                    App_notify_content_change(self);
+                }
+            }
         }
 
+        App_flush_vt_output(self);
         App_maybe_resize(self, Window_size(self->win));
         TimerManager_update(&self->timer_manager);
         App_update_cursor(self);
@@ -556,7 +922,9 @@ static void App_run(App* self)
         App_maybe_swap_window(self);
     }
 
+    App_stop_pty_thread(self);
     Monitor_kill(&self->monitor);
+    Monitor_destroy(&self->monitor);
     self->vt.callbacks.destroy_proxy(self->vt.callbacks.user_data, &self->ui.cursor_proxy);
     Vt_destroy(&self->vt);
     Gfx_destroy(self->gfx);
@@ -571,17 +939,24 @@ static void App_run(App* self)
 
 static void App_maybe_swap_window(App* self)
 {
+    bool swapped = true;
+
     if (unlikely(Vt_synchronized_update_is_active(&self->vt))) {
-        bool do_swap = self->win->paint && !self->did_paint_in_sync_update_mode;
-        Window_maybe_swap(self->win, do_swap);
+        swapped = self->win->paint && !self->did_paint_in_sync_update_mode;
+        Window_maybe_swap(self->win, swapped);
         self->did_paint_in_sync_update_mode = true;
-        if (do_swap) {
-            TimerManaget_update_last_swap(&self->timer_manager, TimePoint_now());
-        }
     } else {
         self->did_paint_in_sync_update_mode = false;
         Window_maybe_swap(self->win, true);
-        TimerManaget_update_last_swap(&self->timer_manager, TimePoint_now());
+    }
+
+    TimePoint swap_time = TimePoint_now();
+
+    /* released in App_redraw() */
+    App_lock_vt(self);
+
+    if (swapped) {
+        TimerManaget_update_last_swap(&self->timer_manager, swap_time);
     }
 }
 
@@ -606,7 +981,14 @@ static void App_selection_end_handler(void* self)
 static window_partial_swap_request_t* App_redraw(void* self, uint8_t buffer_age)
 {
     App* app = self;
-    return Gfx_draw(app->gfx, &app->vt, &app->ui, buffer_age);
+    Vt_search_update_highlights(&app->vt);
+    Vt_uri_detect_visible(&app->vt);
+    window_partial_swap_request_t* swap_request =
+      Gfx_draw(app->gfx, &app->vt, &app->ui, buffer_age);
+
+    /* waiting for the buffer swap should not hold up the pty thread */
+    App_unlock_vt(app);
+    return swap_request;
 }
 
 static void App_update_padding(App* self)
@@ -680,6 +1062,11 @@ static void App_clipboard_handler(void* self, const char* text)
 static void App_reload_font(void* self)
 {
     App* app = self;
+
+    if (App_defer_to_main_thread(app, APP_PTY_REQUEST_FONT_RELOAD)) {
+        return;
+    }
+
     Freetype_reload_fonts(&app->freetype);
     Gfx_reload_font(app->gfx);
     Gfx_draw(app->gfx, &app->vt, &app->ui, 0);
@@ -687,6 +1074,7 @@ static void App_reload_font(void* self)
     Window_notify_content_change(app->win);
     App_framebuffer_damage(self);
     Window_maybe_swap(app->win, true);
+    App_lock_vt(app);
 }
 
 static Pair_uint32_t App_get_cell_dims(App* self)
@@ -704,12 +1092,24 @@ static uint32_t App_get_key_code(void* self, char* name)
 
 static void App_notify_content_change(void* self)
 {
+    if (App_defer_to_main_thread(self, APP_PTY_REQUEST_REPAINT)) {
+        return;
+    }
+
     Window_notify_content_change(((App*)self)->win);
 }
 
 static void App_clipboard_send(void* self, const char* text)
 {
-    Window_clipboard_send(((App*)self)->win, text);
+    App* app = self;
+
+    if (App_defer_to_main_thread(app, APP_PTY_REQUEST_CLIPBOARD_SEND)) {
+        free(app->pty_thread.clipboard_text);
+        app->pty_thread.clipboard_text = text ? strdup(text) : NULL;
+        return;
+    }
+
+    Window_clipboard_send(app->win, text);
 }
 
 static void App_primary_send(void* self, const char* text)
@@ -719,6 +1119,10 @@ static void App_primary_send(void* self, const char* text)
 
 static void App_clipboard_get(void* self)
 {
+    if (App_defer_to_main_thread(self, APP_PTY_REQUEST_CLIPBOARD_GET)) {
+        return;
+    }
+
     Window_clipboard_get(((App*)self)->win);
 }
 
@@ -756,7 +1160,7 @@ static void App_set_title(void* self)
 {
     App* app = self;
 
-    if (!settings.dynamic_title) {
+    if (!settings.dynamic_title || App_defer_to_main_thread(app, APP_PTY_REQUEST_SET_TITLE)) {
         return;
     }
 
@@ -827,6 +1231,11 @@ static void App_command_changed(void* self)
 static void App_buffer_changed(void* self)
 {
     App* app = self;
+
+    if (App_defer_to_main_thread(app, APP_PTY_REQUEST_BUFFER_CHANGED)) {
+        return;
+    }
+
     App_set_title(app);
     Vt_clear_all_proxies(&app->vt);
     Gfx_external_framebuffer_damage(app->gfx);
@@ -840,6 +1249,11 @@ static void App_mouse_report_changed(void* self)
 static void App_flash(void* self)
 {
     App* app = self;
+
+    if (App_defer_to_main_thread(app, APP_PTY_REQUEST_FLASH)) {
+        return;
+    }
+
     TimerManager_schedule_tween_to_ms(&app->timer_manager,
                                       app->visual_bell_timer,
                                       VISUAL_BELL_FLASH_DURATION_MS);
@@ -905,6 +1319,10 @@ static void App_action(void* self)
 {
     App* app = self;
 
+    if (App_defer_to_main_thread(app, APP_PTY_REQUEST_ACTION)) {
+        return;
+    }
+
     if (settings.enable_cursor_blink) {
         App_restart_cursor_blink(app);
     }
@@ -946,6 +1364,91 @@ static int App_get_ksm_number(App* self)
     return res;
 }
 
+/**
+ * Move the keyboard select mode cursor to the current search match or notify the user nothing was
+ * found */
+static void App_handle_search_result(App* self, vt_search_result_e result)
+{
+    Vt* vt = &self->vt;
+
+    switch (result) {
+        case VT_SEARCH_RESULT_PENDING:
+            return;
+
+        case VT_SEARCH_RESULT_NOT_FOUND:
+            App_flash(self);
+            break;
+
+        case VT_SEARCH_RESULT_FOUND: {
+            size_t tgt           = Vt_line_id_to_row(vt, vt->search.match_line_id);
+            self->ksm_cursor.row = tgt;
+            self->ksm_cursor.col = vt->search.match_col;
+
+            if (tgt < Vt_visual_top_line(vt)) {
+                Vt_visual_scroll_to(vt, tgt, !self->keyboard_select_mode);
+            } else if (tgt > Vt_visual_bottom_line(vt)) {
+                Vt_visual_scroll_to(vt, tgt - Vt_row(vt) + 1, self->keyboard_select_mode);
+            }
+
+            if (vt->selection.mode) {
+                Vt_select_set_end_cell(vt,
+                                       self->ksm_cursor.col,
+                                       self->ksm_cursor.row - Vt_visual_top_line(vt));
+            }
+
+            App_show_scrollbar(self);
+            App_update_scrollbar_dims(self);
+            self->ui.cursor_damage.type = VT_LINE_DAMAGE_FULL;
+        } break;
+    }
+
+    App_notify_content_change(self);
+    App_action(self);
+}
+
+/**
+ * Handle a key typed into the search prompt of keyboard select mode */
+static void App_handle_search_input_key(App* self, uint32_t key, uint32_t rawkey, uint32_t mods)
+{
+    Vt* vt = &self->vt;
+
+    switch (rawkey) {
+        case KEY(Escape):
+            Vt_search_end(vt);
+            break;
+
+        case KEY(Return):
+            Vt_search_end_input(vt);
+            break;
+
+        case KEY(BackSpace):
+            if (!vt->search.pattern.size) {
+                Vt_search_end(vt);
+            } else {
+                App_handle_search_result(self, Vt_search_pop_char(vt));
+            }
+            break;
+
+        case KEY(r):
+            if (mods == MODIFIER_CONTROL) /* toggle regex search */ {
+                vt_search_result_e result = Vt_search_set_regex(vt, !vt->search.regex);
+                if (vt->search.pattern.size) {
+                    App_handle_search_result(self, result);
+                }
+                break;
+            }
+            /* fallthrough */
+        default:
+            if (key >= ' ' && key != 127 && !(mods & ~MODIFIER_SHIFT)) {
+                App_handle_search_result(self, Vt_search_push_char(vt, key));
+            }
+            return;
+    }
+
+    App_notify_content_change(self);
+    App_action(self);
+}
+
 /**
  * key commands used in keyboard select mode
  * @return exit ksm mode */
@@ -973,6 +1476,19 @@ static bool App_handle_keyboard_select_mode_key(App*     self,
     }
     self->ksm_last_input = TimePoint_now();
 
+    if (vt->search.input_active) {
+        App_handle_search_input_key(self, key, rawkey, mods);
+        return false;
+    }
+
+    if ((key == '/' || key == '?') && !(mods & ~MODIFIER_SHIFT)) {
+        Vt_search_begin_input(vt, self->ksm_cursor.row, self->ksm_cursor.col, key == '?');
+        Vector_clear_char(&self->ksm_input_buf);
+        App_notify_content_change(self);
+        App_action(self);
+        return false;
+    }
+
     switch (rawkey) {
         case KEY(z):
             if (mods != MODIFIER_SHIFT) {
@@ -981,6 +1497,7 @@ static bool App_handle_keyboard_select_mode_key(App*     self,
 
         case KEY(Escape):
             Vt_select_end(vt);
+            Vt_search_end(vt);
             App_notify_content_change(self);
             App_show_scrollbar(self);
             self->keyboard_select_mode = false;
@@ -1168,13 +1685,14 @@ static bool App_handle_keyboard_select_mode_key(App*     self,
                         if (!self->ksm_cursor.col) {
                             break;
                         }
-                        VtRune* rune = Vt_at(vt, self->ksm_cursor.col, self->ksm_cursor.row);
-                        VtRune* prev_rune =
+                        VtCell* rune = Vt_at(vt, self->ksm_cursor.col, self->ksm_cursor.row);
+                        VtCell* prev_rune =
                           Vt_at(vt, self->ksm_cursor.col - 1, self->ksm_cursor.row);
                         if (!rune || !prev_rune) {
                             break;
                         }
-                        char32_t code = rune->rune.code, prev_code = prev_rune->rune.code;
+                        char32_t code      = Vt_cell_code(vt, rune),
+                                 prev_code = Vt_cell_code(vt, prev_rune);
 
                         if (isblank(prev_code) && !isblank(code) && !initial) {
                             break;
@@ -1202,13 +1720,14 @@ static bool App_handle_keyboard_select_mode_key(App*     self,
                             self->ksm_cursor.col + 1 >= (uint16_t)row_line->data.size) {
                             break;
                         }
-                        VtRune* rune = Vt_at(vt, self->ksm_cursor.col, self->ksm_cursor.row);
-                        VtRune* next_rune =
+                        VtCell* rune = Vt_at(vt, self->ksm_cursor.col, self->ksm_cursor.row);
+                        VtCell* next_rune =
                           Vt_at(vt, self->ksm_cursor.col + 1, self->ksm_cursor.row);
                         if (!rune || !next_rune) {
                             break;
                         }
-                        char32_t code = rune->rune.code, next_code = next_rune->rune.code;
+                        char32_t code      = Vt_cell_code(vt, rune),
+                                 next_code = Vt_cell_code(vt, next_rune);
                         ++self->ksm_cursor.col;
                         App_notify_content_change(self);
                         App_show_scrollbar(self);
@@ -1265,10 +1784,11 @@ static bool App_handle_keyboard_select_mode_key(App*     self,
                             self->ksm_cursor.col + 1 >= (uint16_t)row_line->data.size) {
                             break;
                         }
-                        VtRune* rune = Vt_at(vt, self->ksm_cursor.col, self->ksm_cursor.row);
-                        VtRune* next_rune =
+                        VtCell* rune = Vt_at(vt, self->ksm_cursor.col, self->ksm_cursor.row);
+                        VtCell* next_rune =
                           Vt_at(vt, self->ksm_cursor.col + 1, self->ksm_cursor.row);
-                        char32_t code = rune->rune.code, next_code = next_rune->rune.code;
+                        char32_t code      = Vt_cell_code(vt, rune),
+                                 next_code = Vt_cell_code(vt, next_rune);
                         if ((isblank(next_code) && !isblank(code)) && !initial) {
                             break;
                         }
@@ -1333,6 +1853,13 @@ static bool App_handle_keyboard_select_mode_key(App*     self,
             App_action(self);
             break;
 
+        case KEY(n): /* jump to next (previous with shift) search match */
+            if (!mods || mods == MODIFIER_SHIFT) {
+                Vector_clear_char(&self->ksm_input_buf);
+                App_handle_search_result(self, Vt_search_next(vt, mods == MODIFIER_SHIFT));
+            }
+            break;
+
         case KEY(u): {
             if (mods == MODIFIER_CONTROL) /* half page up (keep cursor position) */ {
                 int      n                   = App_get_ksm_number(self);
@@ -1376,11 +1903,11 @@ static bool App_handle_keyboard_select_mode_key(App*     self,
                 size_t last          = Vt_line_at(vt, self->ksm_cursor.row)->data.size - 1;
                 self->ksm_cursor.col = 0;
                 for (size_t i = last; i > 0; --i) {
-                    VtRune* rune = Vt_at(vt, i, self->ksm_cursor.row);
+                    VtCell* rune = Vt_at(vt, i, self->ksm_cursor.row);
                     if (!rune) {
                         break;
                     }
-                    char32_t code = rune->rune.code;
+                    char32_t code = Vt_cell_code(vt, rune);
                     if (code != VT_RUNE_CODE_WIDE_TAIL && !isblank(code)) {
                         self->ksm_cursor.col = i;
                         break;
@@ -1407,11 +1934,11 @@ static bool App_handle_keyboard_select_mode_key(App*     self,
                 App_show_scrollbar(self);
                 self->ksm_cursor.col = 0;
                 for (size_t i = 0; i < Vt_line_at(vt, self->ksm_cursor.row)->data.size; ++i) {
-                    VtRune* rune = Vt_at(vt, i, self->ksm_cursor.row);
+                    VtCell* rune = Vt_at(vt, i, self->ksm_cursor.row);
                     if (!rune) {
                         break;
                     }
-                    char32_t code = rune->rune.code;
+                    char32_t code = Vt_cell_code(vt, rune);
                     if (code != VT_RUNE_CODE_WIDE_TAIL && !isblank(code)) {
                         self->ksm_cursor.col = i;
                         break;
@@ -1507,6 +2034,7 @@ static void App_do_extern_pipe(App* self)
                                           Vt_visual_bottom_line(&self->vt));
             break;
         case EXTERN_PIPE_SOURCE_BUFFER:
+            Vt_reflow_all(&self->vt);
             content = Vt_region_to_string(&self->vt, 0, Vt_bottom_line(&self->vt));
             break;
         default:
@@ -1704,7 +2232,7 @@ static bool App_maybe_handle_application_key(App*     self,
         return true;
     } else if (KeyCommand_is_active(&cmd[KCMD_COPY_OUTPUT], key, rawkey, mods)) {
         const VtCommand* command = Vt_get_last_completed_command(vt);
-        if (command && command->output_rows.first != command->output_rows.second) {
+        if (command && command->output_line_ids.first != command->output_line_ids.second) {
             Vector_char txt = Vt_command_to_string(vt, command, 0);
             if (txt.size > 1) {
                 App_clipboard_send(self, txt.buf);
@@ -1738,6 +2266,11 @@ void App_cursor_blink_change_handler(void* self, bool blink_state)
         return;
     }
 
+    if (App_defer_to_main_thread(app, APP_PTY_REQUEST_CURSOR_BLINK)) {
+        app->pty_thread.cursor_blink = blink_state;
+        return;
+    }
+
     app->cursor_blink_animation_should_play_vt = blink_state;
 
     if (blink_state) {
@@ -1760,6 +2293,9 @@ void App_cursor_blink_change_handler(void* self, bool blink_state)
 
 void App_gui_pointer_mode_change_handler(void* self)
 {
+    if (App_defer_to_main_thread(self, APP_PTY_REQUEST_POINTER_MODE)) {
+        return;
+    }
 
 #define L_SET_POINTER_STYLE                                                                        \
     if (app->selection_dragging_left || app->selection_dragging_right ||                           \
@@ -2381,25 +2917,33 @@ static void App_motion_handler(void* self, uint32_t button, int32_t x, int32_t y
 static void App_destroy_proxy_handler(void* self, VtLineProxy* proxy)
 {
     App* app = self;
-    Gfx_destroy_proxy(app->gfx, proxy->data);
+    if (!App_maybe_release_proxy(app, APP_PROXY_LINE, proxy->data, sizeof(proxy->data))) {
+        Gfx_destroy_proxy(app->gfx, proxy->data);
+    }
 }
 
 static void App_destroy_image_proxy_handler(void* self, VtImageSurfaceProxy* proxy)
 {
     App* app = self;
-    Gfx_destroy_image_proxy(app->gfx, proxy->data);
+    if (!App_maybe_release_proxy(app, APP_PROXY_IMAGE, proxy->data, sizeof(proxy->data))) {
+        Gfx_destroy_image_proxy(app->gfx, proxy->data);
+    }
 }
 
 static void App_destroy_sixel_proxy_handler(void* self, VtSixelSurfaceProxy* proxy)
 {
     App* app = self;
-    Gfx_destroy_sixel_proxy(app->gfx, proxy->data);
+    if (!App_maybe_release_proxy(app, APP_PROXY_SIXEL, proxy->data, sizeof(proxy->data))) {
+        Gfx_destroy_sixel_proxy(app->gfx, proxy->data);
+    }
 }
 
 static void App_destroy_image_view_proxy_handler(void* self, VtImageSurfaceViewProxy* proxy)
 {
     App* app = self;
-    Gfx_destroy_image_view_proxy(app->gfx, proxy->data);
+    if (!App_maybe_release_proxy(app, APP_PROXY_IMAGE_VIEW, proxy->data, sizeof(proxy->data))) {
+        Gfx_destroy_image_view_proxy(app->gfx, proxy->data);
+    }
 }
 
 static void App_set_monitor_callbacks(App* self)
@@ -2500,12 +3044,24 @@ static bool App_fullscreen(void* self)
 static void App_set_maximized_state(void* self, bool maximize)
 {
     App* app = self;
+
+    if (App_defer_to_main_thread(app, APP_PTY_REQUEST_MAXIMIZE)) {
+        app->pty_thread.maximize = maximize;
+        return;
+    }
+
     Window_set_maximized(app->win, maximize);
 }
 
 static void App_set_fullscreen_state(void* self, bool fullscreen)
 {
     App* app = self;
+
+    if (App_defer_to_main_thread(app, APP_PTY_REQUEST_FULLSCREEN)) {
+        app->pty_thread.fullscreen = fullscreen;
+        return;
+    }
+
     Window_set_fullscreen(app->win, fullscreen);
     App_resize(app, (Pair_uint32_t){ app->win->w, app->win->h });
 }
@@ -2518,6 +3074,12 @@ static void App_set_window_size(void* self, uint32_t width, uint32_t height)
     }
 
     App* app = self;
+
+    if (App_defer_to_main_thread(app, APP_PTY_REQUEST_WINDOW_SIZE)) {
+        app->pty_thread.window_size = (Pair_uint32_t){ width, height };
+        return;
+    }
+
     Window_resize(app->win, width, height);
     App_resize(self, (Pair_uint32_t){ app->win->w, app->win->h });
     Ui_update_CSD_button_layout(&app->ui, app->resolution);
@@ -2527,6 +3089,13 @@ static void App_set_window_size(void* self, uint32_t width, uint32_t height)
 static void App_set_text_area_size(void* self, int32_t width, int32_t height)
 {
     App* app = self;
+
+    if (App_defer_to_main_thread(app, APP_PTY_REQUEST_TEXT_AREA_SIZE)) {
+        app->pty_thread.text_area_width  = width;
+        app->pty_thread.text_area_height = height;
+        return;
+    }
+
     Window_resize(app->win, width + 2 * settings.padding, height + 2 * settings.padding);
 }
 
@@ -2542,6 +3111,10 @@ static Pair_uint32_t App_text_area_size(void* self)
 static void App_visual_scroll_reset_handler(void* self)
 {
     App* app = self;
+
+    if (App_defer_to_main_thread(app, APP_PTY_REQUEST_VISUAL_SCROLL_RESET)) {
+        return;
+    }
     if (app->ui.scrollbar.visible) {
         App_update_scrollbar_dims(self);
         App_show_scrollbar(self);
@@ -2551,6 +3124,10 @@ static void App_visual_scroll_reset_handler(void* self)
 static void App_set_urgent(void* self)
 {
     App* app = self;
+
+    if (App_defer_to_main_thread(app, APP_PTY_REQUEST_URGENT)) {
+        return;
+    }
     if (!Window_is_focused(app->win)) {
         Window_set_urgent(app->win);
 
@@ -2563,6 +3140,10 @@ static void App_set_urgent(void* self)
 
 static void App_restack_to_front(void* self)
 {
+    if (App_defer_to_main_thread(self, APP_PTY_REQUEST_RESTACK)) {
+        return;
+    }
+
     Window_set_stack_order(((App*)self)->win, true);
 }
 
@@ -2644,6 +3225,10 @@ static void App_primary_output_changed(void*         self,
 static void App_visual_scroll_params_changed_handler(void* self)
 {
     App* app = self;
+
+    if (App_defer_to_main_thread(app, APP_PTY_REQUEST_SCROLL_PARAMS)) {
+        return;
+    }
     App_update_scrollbar_dims(app);
     App_maybe_clamp_ksm_cursor(self, App_get_char_size(app));
     App_notify_content_change(self);
@@ -2670,6 +3255,10 @@ static void App_progress_bar_state_changed_handler(void* self)
 {
     App* app = self;
 
+    if (App_defer_to_main_thread(app, APP_PTY_REQUEST_PROGRESS_BAR)) {
+        return;
+    }
+
     if (progress_bar_shown(app->previous_progress_bar_state) &&
         progress_bar_shown(app->vt.progress_bar.state) && !Window_is_focused(app->win)) {
         Window_set_urgent(app->win);
@@ -2680,8 +3269,95 @@ static void App_progress_bar_state_changed_handler(void* self)
     app->previous_progress_bar_state = app->vt.progress_bar.state;
 }
 
+/**
+ * Run Vt callbacks queued by App_defer_to_main_thread(). Window state goes first as everything
+ * after it may depend on the window size */
+static void App_run_pty_thread_requests(App* self, uint32_t requests)
+{
+    struct AppPtyThread* t = &self->pty_thread;
+
+    if (requests & APP_PTY_REQUEST_FULLSCREEN) {
+        App_set_fullscreen_state(self, t->fullscreen);
+    }
+
+    if (requests & APP_PTY_REQUEST_MAXIMIZE) {
+        App_set_maximized_state(self, t->maximize);
+    }
+
+    if (requests & APP_PTY_REQUEST_WINDOW_SIZE) {
+        App_set_window_size(self, t->window_size.first, t->window_size.second);
+    }
+
+    if (requests & APP_PTY_REQUEST_TEXT_AREA_SIZE) {
+        App_set_text_area_size(self, t->text_area_width, t->text_area_height);
+    }
+
+    if (requests & APP_PTY_REQUEST_FONT_RELOAD) {
+        App_reload_font(self);
+    }
+
+    if (requests & APP_PTY_REQUEST_BUFFER_CHANGED) {
+        App_buffer_changed(self);
+    } else if (requests & APP_PTY_REQUEST_SET_TITLE) {
+        App_set_title(self);
+    }
+
+    if (requests & APP_PTY_REQUEST_VISUAL_SCROLL_RESET) {
+        App_visual_scroll_reset_handler(self);
+    }
+
+    if (requests & APP_PTY_REQUEST_SCROLL_PARAMS) {
+        App_visual_scroll_params_changed_handler(self);
+    }
+
+    if (requests & APP_PTY_REQUEST_POINTER_MODE) {
+        App_gui_pointer_mode_change_handler(self);
+    }
+
+    if (requests & APP_PTY_REQUEST_CURSOR_BLINK) {
+        App_cursor_blink_change_handler(self, t->cursor_blink);
+    }
+
+    if (requests & APP_PTY_REQUEST_CLIPBOARD_SEND) {
+        App_clipboard_send(self, t->clipboard_text);
+        free(t->clipboard_text);
+        t->clipboard_text = NULL;
+    }
+
+    if (requests & APP_PTY_REQUEST_CLIPBOARD_GET) {
+        App_clipboard_get(self);
+    }
+
+    if (requests & APP_PTY_REQUEST_FLASH) {
+        App_flash(self);
+    }
+
+    if (requests & APP_PTY_REQUEST_URGENT) {
+        App_set_urgent(self);
+    }
+
+    if (requests & APP_PTY_REQUEST_PROGRESS_BAR) {
+        App_progress_bar_state_changed_handler(self);
+    }
+
+    if (requests & APP_PTY_REQUEST_RESTACK) {
+        App_restack_to_front(self);
+    }
+
+    if (requests & APP_PTY_REQUEST_ACTION) {
+        App_action(self);
+    }
+
+    if (requests & APP_PTY_REQUEST_REPAINT) {
+        App_notify_content_change(self);
+    }
+}
+
 static void App_set_callbacks(App* self)
 {
+    /* Vt may call these from the pty thread with vt_lock held. Anything touching the window,
+     * renderer or timers queues itself for the main thread with App_defer_to_main_thread(), the
+     * state queries only read what the main thread changes under the same lock. */
     self->vt.callbacks.user_data                           = self;
     self->vt.callbacks.on_repaint_required                 = App_notify_content_change;
     self->vt.callbacks.on_clipboard_sent                   = App_clipboard_send;
@@ -121,10 +121,178 @@ void Monitor_fork_new_pty(Monitor* self, uint32_t cols, uint32_t rows)
     self->child_is_dead = false;
 }
 
+bool Monitor_start_recording(Monitor* self, const char* path, uint32_t cols, uint32_t rows)
+{
+    if (!PtyRecording_create(&self->recording, path, cols, rows)) {
+        WRN("Failed to create recording \'%s\': %s\n", path, strerror(errno));
+        return false;
+    }
+
+    self->is_recording = true;
+    return true;
+}
+
+bool Monitor_start_replay(Monitor*    self,
+                          const char* path,
+                          bool        real_time,
+                          uint32_t*   out_cols,
+                          uint32_t*   out_rows)
+{
+    ASSERT(self->callbacks.on_exit && self->callbacks.user_data,
+           "exit callbacks set before replaying");
+
+    if (!PtyRecording_open(&self->recording, path)) {
+        WRN("Failed to open recording \'%s\': %s\n", path, strerror(errno));
+        return false;
+    }
+
+    self->child_fd            = -1;
+    self->child_is_dead       = false;
+    self->is_replaying        = true;
+    self->replay_in_real_time = real_time;
+    self->replay_start        = TimePoint_now();
+    self->replay_chunk_due    = self->replay_start;
+    *out_cols                 = self->recording.cols;
+    *out_rows                 = self->recording.rows;
+
+    return true;
+}
+
+static void Monitor_finish_replay(Monitor* self)
+{
+    TimePoint duration = TimePoint_now();
+    TimePoint_subtract(&duration, self->replay_start);
+    INFO("Replay finished in %.3f s", TimePoint_get_nsecs(duration) / 1e9);
+
+    PtyRecording_close(&self->recording);
+    self->is_replaying  = false;
+    self->child_is_dead = true;
+    self->callbacks.on_exit(self->callbacks.user_data);
+}
+
+/**
+ * Move to the next chunk with data from the program
+ * @return end of recording was not reached */
+static bool Monitor_replay_next_read_chunk(Monitor* self)
+{
+    while (!self->recording.chunk_remaining ||
+           self->replay_chunk_type != PTY_RECORDING_CHUNK_READ) {
+        pty_recording_chunk_t chunk;
+        if (!PtyRecording_next_chunk(&self->recording, &chunk)) {
+            return false;
+        }
+
+        TimePoint delay = { .tv_sec  = chunk.delay_usec / 1000000,
+                            .tv_nsec = (chunk.delay_usec % 1000000) * 1000 };
+        TimePoint_add(&self->replay_chunk_due, delay);
+        self->replay_chunk_type = chunk.type;
+    }
+
+    return true;
+}
+
+/**
+ * Adjust the capacity of the input ring to the amount of data usually read at once or left
+ * waiting in it. Data still in the ring is moved to the start of the new buffer */
+static void Monitor_fit_input_ring(Monitor* self)
+{
+    struct MonitorInputRing* in  = &self->input;
+    size_t                   cap = in->cap ? in->cap : MONITOR_INPUT_RING_MIN_SZ;
+
+    if (MAX(in->avg_read, in->size) * 2 > cap && cap < MONITOR_INPUT_RING_MAX_SZ) {
+        cap *= 2;
+    } else if (in->avg_read * 8 < cap && in->size * 4 < cap && cap > MONITOR_INPUT_RING_MIN_SZ) {
+        cap /= 2;
+    }
+
+    if (cap == in->cap) {
+        return;
+    }
+
+    char* buf = _malloc(cap);
+    if (in->size) {
+        size_t head = MIN(in->size, in->cap - in->begin);
+        memcpy(buf, in->buf + in->begin, head);
+        memcpy(buf + head, in->buf, in->size - head);
+    }
+
+    free(in->buf);
+    in->buf   = buf;
+    in->cap   = cap;
+    in->begin = 0;
+}
+
+/**
+ * Get the contiguous free space after data in the input ring
+ * @return its length */
+static size_t Monitor_input_ring_free_span(Monitor* self, char** out_buf)
+{
+    struct MonitorInputRing* in  = &self->input;
+    size_t                   end = (in->begin + in->size) & (in->cap - 1);
+
+    *out_buf = in->buf + end;
+
+    if (in->size == in->cap) {
+        return 0;
+    }
+
+    return end >= in->begin ? in->cap - end : in->begin - end;
+}
+
+static ssize_t Monitor_replay_read(Monitor* self)
+{
+    if (!Monitor_replay_next_read_chunk(self)) {
+        Monitor_finish_replay(self);
+        return -1;
+    }
+
+    if (self->replay_in_real_time && !TimePoint_passed(self->replay_chunk_due)) {
+        return -1;
+    }
+
+    Monitor_fit_input_ring(self);
+
+    char*  dst;
+    size_t span = Monitor_input_ring_free_span(self, &dst);
+    if (!span) {
+        return -1;
+    }
+
+    size_t rd = PtyRecording_read(&self->recording, dst, span);
+    self->input.size += rd;
+    if (!rd) {
+        Monitor_finish_replay(self);
+        return -1;
+    }
+
+    return rd;
+}
+
 bool Monitor_wait(Monitor* self, int timeout)
 {
+    if (self->is_recording) {
+        fflush(self->recording.file);
+    }
+
+    /* data left in the input ring should be consumed first, the ring is only ours to look at
+     * when no reader thread fills it */
+    if (!self->read_on_other_thread && self->input.size) {
+        timeout = 0;
+    }
+
+    /* never block while data from a replay is pending */
+    if (self->is_replaying) {
+        if (!self->replay_in_real_time || !Monitor_replay_next_read_chunk(self)) {
+            timeout = 0;
+        } else {
+            int64_t due_ms = MAX(TimePoint_ms_in_the_future(self->replay_chunk_due) + 1, 0);
+            timeout        = timeout < 0 ? due_ms : MIN(timeout, due_ms);
+        }
+    }
+
     memset(self->pollfds, 0, sizeof(self->pollfds));
-    self->pollfds[CHILD_FD_IDX].fd     = self->child_fd;
+    self->pollfds[CHILD_FD_IDX].fd = self->read_on_other_thread ? self->wakeup_pipe[0]
+                                                                : self->child_fd;
     self->pollfds[CHILD_FD_IDX].events = POLLIN;
     self->pollfds[EXTRA_FD_IDX].fd     = self->extra_fd;
     self->pollfds[EXTRA_FD_IDX].events = POLLIN;
@@ -136,44 +304,145 @@ bool Monitor_wait(Monitor* self, int timeout)
         }
     }
 
+    if (self->read_on_other_thread) {
+        if (self->pollfds[CHILD_FD_IDX].revents & POLLIN) {
+            char    buf[64];
+            ssize_t rd;
+            do {
+                rd = read(self->wakeup_pipe[0], buf, sizeof(buf));
+            } while (rd > 0);
+        }
+        return false;
+    }
+
     self->read_info_up_to_date = true;
     return false;
 }
 
+bool Monitor_read_on_other_thread(Monitor* self)
+{
+    ASSERT(!self->is_recording && !self->is_replaying, "not using a recording");
+
+    if (pipe(self->wakeup_pipe)) {
+        WRN("Failed to create pipe %s\n", strerror(errno));
+        return false;
+    }
+
+    for (int i = 0; i < 2; ++i) {
+        fcntl(self->wakeup_pipe[i], F_SETFL, fcntl(self->wakeup_pipe[i], F_GETFL) | O_NONBLOCK);
+        fcntl(self->wakeup_pipe[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    self->read_on_other_thread = true;
+    return true;
+}
+
+void Monitor_stop_reading_on_other_thread(Monitor* self)
+{
+    if (self->read_on_other_thread) {
+        close(self->wakeup_pipe[0]);
+        close(self->wakeup_pipe[1]);
+        self->read_on_other_thread = false;
+    }
+}
+
+bool Monitor_wait_for_pty(Monitor* self, int stop_fd)
+{
+    struct pollfd fds[2] = {
+        { .fd = self->child_fd, .events = POLLIN },
+        { .fd = stop_fd, .events = POLLIN },
+    };
+
+    /* data left in the input ring can be consumed right away */
+    errno = 0;
+    while (poll(fds, 2, self->input.size ? 0 : -1) < 0) {
+        if (errno != EINTR && errno != EAGAIN) {
+            ERR("poll failed %s", strerror(errno));
+        }
+    }
+
+    if (fds[1].revents) {
+        return false;
+    }
+
+    /* after the child exits we only get POLLHUP */
+    return self->input.size || (fds[0].revents & POLLIN);
+}
+
+void Monitor_wake(Monitor* self)
+{
+    if (write(self->wakeup_pipe[1], "", 1) < 0 && errno != EAGAIN) {
+        WRN("Failed to wake main thread %s\n", strerror(errno));
+    }
+}
+
 ssize_t Monitor_read(Monitor* self)
 {
     if (unlikely(self->child_is_dead)) {
         return -1;
     }
 
-    if (!self->read_info_up_to_date) {
-        memset(self->pollfds, 0, sizeof(self->pollfds[0]));
-        self->pollfds[CHILD_FD_IDX].fd     = self->child_fd;
-        self->pollfds[CHILD_FD_IDX].events = POLLIN;
-        if (poll(self->pollfds, 1, 0) < 0) {
-            if (errno != EINTR && errno != EAGAIN) {
-                ERR("poll failed %s\n", strerror(errno));
+    if (unlikely(self->is_replaying)) {
+        return Monitor_replay_read(self);
+    }
+
+    /* the other thread has already waited for data */
+    if (!self->read_on_other_thread) {
+        if (!self->read_info_up_to_date) {
+            memset(self->pollfds, 0, sizeof(self->pollfds[0]));
+            self->pollfds[CHILD_FD_IDX].fd     = self->child_fd;
+            self->pollfds[CHILD_FD_IDX].events = POLLIN;
+            if (poll(self->pollfds, 1, 0) < 0) {
+                if (errno != EINTR && errno != EAGAIN) {
+                    ERR("poll failed %s\n", strerror(errno));
+                }
             }
         }
-        self->read_info_up_to_date = true;
-    }
 
-    if (self->pollfds[CHILD_FD_IDX].revents & POLLIN) {
-        size_t  to_read = unlikely(settings.debug_vt) ? 1 : sizeof(self->input_buffer);
-        ssize_t rd      = read(self->child_fd, self->input_buffer, to_read);
-        if (rd < 0) {
+        self->read_info_up_to_date = false;
+        if (!(self->pollfds[CHILD_FD_IDX].revents & POLLIN)) {
             return -1;
         }
-        self->read_info_up_to_date = false;
-        return rd;
-    } else {
-        self->read_info_up_to_date = false;
+    }
+
+    Monitor_fit_input_ring(self);
+
+    /* Keep reading until we run out of data. The pty hands it over in small chunks so a single
+     * read() would leave most of it waiting for the next poll() */
+    size_t total = 0;
+    char*  dst;
+    for (size_t span; (span = Monitor_input_ring_free_span(self, &dst));) {
+        ssize_t rd = read(self->child_fd, dst, unlikely(settings.debug_vt) ? 1 : span);
+        if (rd <= 0) {
+            break;
+        }
+
+        if (unlikely(self->is_recording)) {
+            PtyRecording_write_chunk(&self->recording, PTY_RECORDING_CHUNK_READ, dst, rd);
+        }
+
+        self->input.size += rd;
+        total += rd;
+
+        if (unlikely(settings.debug_vt)) {
+            break;
+        }
+    }
+
+    if (!total) {
         return -1;
     }
+
+    self->input.avg_read = (self->input.avg_read * 3 + total) / 4;
+    return total;
 }
 
 ssize_t Monitor_write(Monitor* self, char* buffer, size_t bytes)
 {
+    if (unlikely(self->is_replaying || self->child_fd < 0)) {
+        return bytes;
+    }
+
     for (uint_fast8_t i = 0; i < 2; ++i) {
         ssize_t ret = write(self->child_fd, buffer, bytes);
 
@@ -188,6 +457,9 @@ ssize_t Monitor_write(Monitor* self, char* buffer, size_t bytes)
                 ERR("wirte to pty failed %s\n", strerror(errno));
             }
         } else {
+            if (unlikely(self->is_recording) && ret > 0) {
+                PtyRecording_write_chunk(&self->recording, PTY_RECORDING_CHUNK_WRITE, buffer, ret);
+            }
             return ret;
         }
     }
@@ -202,6 +474,19 @@ void Monitor_kill(Monitor* self)
         kill(self->child_pid, SIGHUP);
     }
     self->child_pid = 0;
+
+    if (self->is_recording || self->is_replaying) {
+        PtyRecording_close(&self->recording);
+        self->is_recording = self->is_replaying = false;
+    }
+
+    Monitor_stop_reading_on_other_thread(self);
+}
+
+void Monitor_destroy(Monitor* self)
+{
+    free(self->input.buf);
+    self->input = (struct MonitorInputRing){ 0 };
 }
 
 void Monitor_watch_window_system_fd(Monitor* self, int fd)
@@ -14,12 +14,22 @@
 
 #include <poll.h>
 
+#include "pty_recording.h"
 #include "util.h"
 
 #ifndef MONITOR_INPUT_BUFFER_SZ
 #define MONITOR_INPUT_BUFFER_SZ 128
 #endif
 
+/* Limits for the capacity of the ring data from the child process is read into, both powers of 2 */
+#ifndef MONITOR_INPUT_RING_MIN_SZ
+#define MONITOR_INPUT_RING_MIN_SZ (16 * 1024)
+#endif
+
+#ifndef MONITOR_INPUT_RING_MAX_SZ
+#define MONITOR_INPUT_RING_MAX_SZ (1024 * 1024)
+#endif
+
 #define MONITOR_WRITE_WOULD_BLOCK (-1)
 
 #define CHILD_FD_IDX 0
@@ -30,9 +40,28 @@ typedef struct
     int           child_fd, parent_fd, extra_fd;
     struct pollfd pollfds[2];
     bool          read_info_up_to_date;
+
+    /* The pty is read on another thread, Monitor_wait() watches wakeup_pipe instead of child_fd */
+    bool read_on_other_thread;
+    int  wakeup_pipe[2];
     pid_t         child_pid;
     bool          child_is_dead;
-    char          input_buffer[MONITOR_INPUT_BUFFER_SZ];
+
+    /* Data read from the child process that was not consumed yet. The capacity grows when reads
+     * or data waiting to be consumed fill it up and shrinks when both get much smaller */
+    struct MonitorInputRing
+    {
+        char*  buf;
+        size_t cap, begin, size;
+        size_t avg_read;
+    } input;
+
+    /* Session saved to (is_recording) or played back from (is_replaying) a file. A replayed
+     * session has no child process, writes are discarded. */
+    PtyRecording               recording;
+    bool                       is_recording, is_replaying, replay_in_real_time;
+    pty_recording_chunk_type_t replay_chunk_type;
+    TimePoint                  replay_start, replay_chunk_due;
 
     struct MonitorCallbacks
     {
@@ -50,14 +79,71 @@ Monitor Monitor_new();
  * fork and set up a pty connection */
 void Monitor_fork_new_pty(Monitor* self, uint32_t cols, uint32_t rows);
 
+/**
+ * Save all data read from and written to the pty to @param path
+ * @return recording started */
+bool Monitor_start_recording(Monitor* self, const char* path, uint32_t cols, uint32_t rows);
+
+/**
+ * Read data from a recording made with Monitor_start_recording() instead of forking a child
+ * process. Chunks are returned with their original timing if @param real_time is set, otherwise as
+ * fast as possible. on_exit is called at the end of the recording.
+ * @param out_cols, out_rows - terminal size at the start of the recording
+ * @return replay started */
+bool Monitor_start_replay(Monitor*    self,
+                          const char* path,
+                          bool        real_time,
+                          uint32_t*   out_cols,
+                          uint32_t*   out_rows);
+
 /**
  * Wait for any activity */
 bool Monitor_wait(Monitor* self, int timeout);
 
 /**
- * Try to read data from the child process */
+ * Read the pty on another thread from now on. That thread blocks in Monitor_wait_for_pty() and
+ * calls Monitor_wake() to interrupt Monitor_wait()
+ * @return wakeups can be delivered */
+bool Monitor_read_on_other_thread(Monitor* self);
+
+/**
+ * Go back to reading the pty on the thread calling Monitor_wait(), the other thread must no longer
+ * use this monitor */
+void Monitor_stop_reading_on_other_thread(Monitor* self);
+
+/**
+ * Wait for data from the child process or for @param stop_fd to become readable
+ * @return there is something to read */
+bool Monitor_wait_for_pty(Monitor* self, int stop_fd);
+
+/**
+ * Interrupt Monitor_wait(), safe to call from any thread */
+void Monitor_wake(Monitor* self);
+
+/**
+ * Read data from the child process until there is nothing more available or the input ring is full
+ * @return number of bytes read or -1 */
 ssize_t Monitor_read(Monitor* self);
 
+/**
+ * Get up to @param max bytes of data from the child process stored contiguously in the input ring.
+ * It stays there until Monitor_consumed_input() is called */
+static inline void Monitor_peek_input(Monitor* self, size_t max, char** out_buf, size_t* out_len)
+{
+    struct MonitorInputRing* in = &self->input;
+
+    *out_len = MIN(max, MIN(in->size, in->cap - in->begin));
+    *out_buf = *out_len ? in->buf + in->begin : NULL;
+}
+
+/**
+ * Drop @param bytes from the front of the input ring */
+static inline void Monitor_consumed_input(Monitor* self, size_t bytes)
+{
+    self->input.size -= bytes;
+    self->input.begin = self->input.size ? (self->input.begin + bytes) & (self->input.cap - 1) : 0;
+}
+
 /**
  * Write data to the child process */
 ssize_t Monitor_write(Monitor* self, char* buffer, size_t bytes);
@@ -66,6 +152,10 @@ ssize_t Monitor_write(Monitor* self, char* buffer, size_t bytes);
  * Kill the child process */
 void Monitor_kill(Monitor* self);
 
+/**
+ * Free resources, call after Monitor_kill() */
+void Monitor_destroy(Monitor* self);
+
 /**
  * Set an extra file descriptor to monitor for activity when wait()-ing */
 void Monitor_watch_window_system_fd(Monitor* self, int fd);
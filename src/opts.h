@@ -306,25 +306,43 @@ static struct option long_options[] = {
 #define OPT_BIND_KEY_QUIT_IDX 93
     [OPT_BIND_KEY_QUIT_IDX] = { "bind-key-quit", required_argument, 0, 0 },
 
-#define OPT_DEBUG_PTY_IDX 94
+#define OPT_RECORD_IDX 94
+    [OPT_RECORD_IDX] = { "record", required_argument, 0, 0 },
+
+#define OPT_REPLAY_IDX 95
+    [OPT_REPLAY_IDX] = { "replay", required_argument, 0, 0 },
+
+#define OPT_REPLAY_FAST_IDX 96
+    [OPT_REPLAY_FAST_IDX] = { "replay-fast", no_argument, 0, 0 },
+
+#define OPT_SCROLLBACK_COMPRESS_IDX 97
+    [OPT_SCROLLBACK_COMPRESS_IDX] = { "scrollback-compress", required_argument, 0, 0 },
+
+#define OPT_SCROLLBACK_SPILL_IDX 98
+    [OPT_SCROLLBACK_SPILL_IDX] = { "scrollback-spill", optional_argument, 0, 0 },
+
+#define OPT_SCROLLBACK_SEARCH_INDEX_IDX 99
+    [OPT_SCROLLBACK_SEARCH_INDEX_IDX] = { "scrollback-search-index", required_argument, 0, 0 },
+
+#define OPT_DEBUG_PTY_IDX 100
     [OPT_DEBUG_PTY_IDX] = { "debug-pty", no_argument, 0, 'D' },
 
-#define OPT_DEBUG_VT_IDX 95
+#define OPT_DEBUG_VT_IDX 101
     [OPT_DEBUG_VT_IDX] = { "debug-vt", required_argument, 0, 0 },
 
-#define OPT_DEBUG_GFX_IDX 96
+#define OPT_DEBUG_GFX_IDX 102
     [OPT_DEBUG_GFX_IDX] = { "debug-gfx", no_argument, 0, 'G' },
 
-#define OPT_DEBUG_FONT_IDX 97
+#define OPT_DEBUG_FONT_IDX 103
     [OPT_DEBUG_FONT_IDX] = { "debug-font", no_argument, 0, 'F' },
 
-#define OPT_VERSION_IDX 98
+#define OPT_VERSION_IDX 104
     [OPT_VERSION_IDX] = { "version", no_argument, 0, 'v' },
 
-#define OPT_HELP_IDX 99
+#define OPT_HELP_IDX 105
     [OPT_HELP_IDX] = { "help", no_argument, 0, 'h' },
 
-#define OPT_SENTINEL_IDX 100
+#define OPT_SENTINEL_IDX 106
     [OPT_SENTINEL_IDX] = { 0 }
 };
 
@@ -439,15 +457,25 @@ static const char* long_options_descriptions[][2] = {
     [OPT_BLINK_IDX]        = { "bool:int?:int?:int?",
                                "Blinking cursor - enable:rate[ms]:suspend[ms]:end[s](<0 never)" },
 
-    [OPT_SCROLL_LINES_IDX]        = { arg_int, "Lines scrolled per wheel click (default: 3)" },
-    [OPT_SCROLLBACK_IDX]          = { arg_int, "Scrollback buffer size (default: 2000)" },
-    [OPT_URI_HANDLER_IDX]         = { arg_string, "URI handler program (default: xdg-open)" },
-    [OPT_EXTERN_PIPE_HANDLER_IDX] = { "string:name?",
-                                      "Extern pipe handler and mode - "
-                                      "executable:command/screen/buffer "
-                                      "(default: none:command)" },
-    [OPT_PADDING_IDX]             = { "bool:int?",
-                                      "Pad screen content: center:extra padding[px] (default: true:0)" },
+    [OPT_SCROLL_LINES_IDX]            = { arg_int, "Lines scrolled per wheel click (default: 3)" },
+    [OPT_SCROLLBACK_IDX]              = { arg_int, "Scrollback buffer size (default: 2000)" },
+    [OPT_SCROLLBACK_COMPRESS_IDX]     = { arg_int,
+                                          "Compress scrollback lines this far above the viewport, 0 "
+                                          "disables (default: 1000)" },
+    [OPT_SCROLLBACK_SPILL_IDX]        = { "bool?",
+                                          "Move lines removed from scrollback to a file in "
+                                          "$XDG_RUNTIME_DIR (default: false)" },
+    [OPT_SCROLLBACK_SEARCH_INDEX_IDX] = { arg_int,
+                                          "Memory for the scrollback search index[MiB], 0 "
+                                          "disables (default: 32)" },
+    [OPT_URI_HANDLER_IDX]             = { arg_string, "URI handler program (default: xdg-open)" },
+    [OPT_EXTERN_PIPE_HANDLER_IDX]     = { "string:name?",
+                                          "Extern pipe handler and mode - "
+                                          "executable:command/screen/buffer "
+                                          "(default: none:command)" },
+    [OPT_PADDING_IDX]                 = { "bool:int?",
+                                          "Pad screen content: center:extra padding[px] (default: "
+                                          "true:0)" },
 
     [OPT_ALWAYS_UNDERLINE_LINKS] = { "bool", "Draw links underlined (default: false)" },
 
@@ -495,6 +523,10 @@ static const char* long_options_descriptions[][2] = {
     [OPT_BIND_KEY_DEBUG_IDX] = { arg_key, "Debug info key command (default: C+S+slash)" },
     [OPT_BIND_KEY_QUIT_IDX]  = { arg_key, "Quit key command" },
 
+    [OPT_RECORD_IDX]      = { arg_path, "Save pty communication to file for --replay" },
+    [OPT_REPLAY_IDX]      = { arg_path, "Replay a recorded session instead of running a program" },
+    [OPT_REPLAY_FAST_IDX] = { NULL, "Replay as fast as possible instead of in real time" },
+
     [OPT_DEBUG_PTY_IDX]  = { NULL, "Output pty communication to stderr" },
     [OPT_DEBUG_VT_IDX]   = { "int?", "Slow down the interpreter to usec/byte (default: 5000)" },
     [OPT_DEBUG_GFX_IDX]  = { NULL, "Run renderer in debug mode" },
@@ -0,0 +1,152 @@
+/* See LICENSE for license information. */
+
+#define _GNU_SOURCE
+
+#include "pty_recording.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include "util.h"
+
+static void write_u16(FILE* file, uint16_t value)
+{
+    fputc(value & 0xFF, file);
+    fputc(value >> 8, file);
+}
+
+static bool read_u16(FILE* file, uint16_t* out)
+{
+    int lo = fgetc(file), hi = fgetc(file);
+    if (lo == EOF || hi == EOF) {
+        return false;
+    }
+    *out = lo | (hi << 8);
+    return true;
+}
+
+static void write_varint(FILE* file, uint64_t value)
+{
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        fputc(value ? (byte | 0x80) : byte, file);
+    } while (value);
+}
+
+static bool read_varint(FILE* file, uint64_t* out)
+{
+    uint64_t value = 0;
+    for (uint_fast8_t shift = 0; shift < 64; shift += 7) {
+        int byte = fgetc(file);
+        if (byte == EOF) {
+            return false;
+        }
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *out = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool PtyRecording_create(PtyRecording* self, const char* path, uint16_t cols, uint16_t rows)
+{
+    memset(self, 0, sizeof(*self));
+
+    if (!(self->file = fopen(path, "wb"))) {
+        return false;
+    }
+
+    self->cols            = cols;
+    self->rows            = rows;
+    self->last_chunk_time = TimePoint_now();
+
+    fwrite(PTY_RECORDING_MAGIC, 1, strlen(PTY_RECORDING_MAGIC), self->file);
+    fputc(PTY_RECORDING_VERSION, self->file);
+    write_u16(self->file, cols);
+    write_u16(self->file, rows);
+
+    return true;
+}
+
+void PtyRecording_write_chunk(PtyRecording*              self,
+                              pty_recording_chunk_type_t type,
+                              const char*                buf,
+                              size_t                     size)
+{
+    TimePoint now   = TimePoint_now();
+    TimePoint delay = now;
+    TimePoint_subtract(&delay, self->last_chunk_time);
+    self->last_chunk_time = now;
+
+    fputc(type, self->file);
+    write_varint(self->file, MAX(TimePoint_get_nsecs(delay), 0) / 1000);
+    write_varint(self->file, size);
+    fwrite(buf, 1, size, self->file);
+}
+
+bool PtyRecording_open(PtyRecording* self, const char* path)
+{
+    memset(self, 0, sizeof(*self));
+
+    if (!(self->file = fopen(path, "rb"))) {
+        return false;
+    }
+
+    char magic[sizeof(PTY_RECORDING_MAGIC) - 1];
+    if (fread(magic, 1, sizeof(magic), self->file) != sizeof(magic) ||
+        memcmp(magic, PTY_RECORDING_MAGIC, sizeof(magic)) ||
+        fgetc(self->file) != PTY_RECORDING_VERSION || !read_u16(self->file, &self->cols) ||
+        !read_u16(self->file, &self->rows)) {
+        fclose(self->file);
+        self->file = NULL;
+        errno      = EINVAL;
+        return false;
+    }
+
+    return true;
+}
+
+bool PtyRecording_next_chunk(PtyRecording* self, pty_recording_chunk_t* out_chunk)
+{
+    if (self->chunk_remaining) {
+        if (fseeko(self->file, self->chunk_remaining, SEEK_CUR)) {
+            return false;
+        }
+        self->chunk_remaining = 0;
+    }
+
+    int type = fgetc(self->file);
+    if (type != PTY_RECORDING_CHUNK_READ && type != PTY_RECORDING_CHUNK_WRITE) {
+        if (type != EOF) {
+            WRN("Unknown chunk type in pty recording\n");
+        }
+        return false;
+    }
+
+    out_chunk->type = type;
+    if (!read_varint(self->file, &out_chunk->delay_usec) ||
+        !read_varint(self->file, &out_chunk->size)) {
+        return false;
+    }
+
+    self->chunk_remaining = out_chunk->size;
+    return true;
+}
+
+size_t PtyRecording_read(PtyRecording* self, char* buf, size_t size)
+{
+    size_t rd = fread(buf, 1, MIN(size, self->chunk_remaining), self->file);
+    self->chunk_remaining -= rd;
+    return rd;
+}
+
+void PtyRecording_close(PtyRecording* self)
+{
+    if (self->file) {
+        fclose(self->file);
+        self->file = NULL;
+    }
+}
@@ -0,0 +1,84 @@
+/* See LICENSE for license information. */
+
+/**
+ * Recorded pty sessions
+ *
+ * A recording starts with a header holding the magic string, format version and the terminal size
+ * at the start of the session. It is followed by chunks:
+ *
+ *   uint8  type ('r' - data read from the program, 'w' - data written to the program)
+ *   varint microseconds since the previous chunk (or the start of recording)
+ *   varint data size
+ *   data
+ *
+ * All integers are little endian, varints are unsigned LEB128.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "timing.h"
+
+#define PTY_RECORDING_MAGIC   "WAYSTPTY"
+#define PTY_RECORDING_VERSION 1
+
+typedef enum
+{
+    PTY_RECORDING_CHUNK_READ  = 'r',
+    PTY_RECORDING_CHUNK_WRITE = 'w',
+} pty_recording_chunk_type_t;
+
+typedef struct
+{
+    pty_recording_chunk_type_t type;
+
+    /* time since the previous chunk */
+    uint64_t delay_usec;
+
+    uint64_t size;
+} pty_recording_chunk_t;
+
+typedef struct
+{
+    FILE*    file;
+    uint16_t cols, rows;
+
+    /* time the last chunk was written */
+    TimePoint last_chunk_time;
+
+    /* data of the current chunk not yet read */
+    uint64_t chunk_remaining;
+} PtyRecording;
+
+/**
+ * Create a new recording file at @param path
+ * @return false on failure (errno is set) */
+bool PtyRecording_create(PtyRecording* self, const char* path, uint16_t cols, uint16_t rows);
+
+/**
+ * Append a chunk with the current time */
+void PtyRecording_write_chunk(PtyRecording*              self,
+                              pty_recording_chunk_type_t type,
+                              const char*                buf,
+                              size_t                     size);
+
+/**
+ * Open an existing recording for reading
+ * @return false if the file could not be opened or is not a recording */
+bool PtyRecording_open(PtyRecording* self, const char* path);
+
+/**
+ * Advance to the next chunk, skipping any unread data of the current one
+ * @return false at the end of the recording */
+bool PtyRecording_next_chunk(PtyRecording* self, pty_recording_chunk_t* out_chunk);
+
+/**
+ * Read up to @param size bytes of the current chunk's data
+ * @return number of bytes read */
+size_t PtyRecording_read(PtyRecording* self, char* buf, size_t size);
+
+void PtyRecording_close(PtyRecording* self);
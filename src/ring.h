@@ -0,0 +1,203 @@
+/* See LICENSE for license information. */
+
+#pragma once
+
+#define _GNU_SOURCE
+
+#include "util.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Templated circular buffer (double ended queue) with destructor arguments
+ *
+ *  Capacity is always a power of two, elements are addressed by index relative to the first one.
+ *  Removing elements from either end never moves the remaining ones. Insertion and removal in the
+ *  middle shift elements on the shorter side of the index.
+ *
+ *  Examples:
+ *
+ *    Defining:
+ *      void ThingContext_destroy_Thing(ThingContext*, Thing*);
+ *      DEF_RING_DA(Thing, ThingContext_destroy_Thing, ThingContext)
+ *
+ *    Iterating:
+ *      for (size_t i = 0; i < ring_of_things.size; ++i)
+ *          do_something_with_a_thing(Ring_at_Thing(&ring_of_things, i));
+ *
+ *  note: pointers to elements are invalidated by any operation that adds or removes elements
+ *
+ * */
+
+#define DEF_RING_DA(t, dtor, dtorctx_t)                                                            \
+    _Pragma("GCC diagnostic push");                                                                \
+    _Pragma("GCC diagnostic ignored \"-Wpragmas\"");                                               \
+    _Pragma("GCC diagnostic push");                                                                \
+    _Pragma("GCC diagnostic ignored \"-Waddress\"");                                               \
+    _Pragma("GCC diagnostic push");                                                                \
+    _Pragma("GCC diagnostic ignored \"-Wunused-function\"");                                       \
+    _Pragma("GCC diagnostic push");                                                                \
+    _Pragma("GCC diagnostic ignored \"-Wunused-parameter\"");                                      \
+                                                                                                   \
+    typedef struct                                                                                 \
+    {                                                                                              \
+        size_t cap, size, head;                                                                    \
+        t*     buf;                                                                                \
+        void*  dtor_arg;                                                                           \
+                                                                                                   \
+        /* number of elements removed from the front and not pushed back there */                  \
+        uint64_t base;                                                                             \
+    } Ring_##t;                                                                                    \
+                                                                                                   \
+    static inline Ring_##t Ring_new_with_capacity_##t(size_t init_cap, dtorctx_t* destroy_arg)     \
+    {                                                                                              \
+        size_t cap = 4;                                                                            \
+        while (cap < init_cap)                                                                     \
+            cap <<= 1;                                                                             \
+        return (Ring_##t){ .cap      = cap,                                                        \
+                           .size     = 0,                                                          \
+                           .head     = 0,                                                          \
+                           .buf      = _malloc(sizeof(t) * cap),                                   \
+                           .dtor_arg = destroy_arg,                                                \
+                           .base     = 0 };                                                        \
+    }                                                                                              \
+                                                                                                   \
+    static inline Ring_##t Ring_new_##t(dtorctx_t* destroy_arg)                                    \
+    {                                                                                              \
+        return Ring_new_with_capacity_##t(4, destroy_arg);                                         \
+    }                                                                                              \
+                                                                                                   \
+    static inline bool Ring_is_initialized_##t(const Ring_##t* self)                               \
+    {                                                                                              \
+        return self->buf;                                                                          \
+    }                                                                                              \
+                                                                                                   \
+    static inline t* Ring_at_##t(const Ring_##t* self, size_t idx)                                 \
+    {                                                                                              \
+        return self->buf + ((self->head + idx) & (self->cap - 1));                                 \
+    }                                                                                              \
+                                                                                                   \
+    static inline t* Ring_last_##t(const Ring_##t* self)                                           \
+    {                                                                                              \
+        return self->size ? Ring_at_##t(self, self->size - 1) : NULL;                              \
+    }                                                                                              \
+                                                                                                   \
+    static inline void Ring_grow_##t(Ring_##t* self)                                               \
+    {                                                                                              \
+        self->buf = _realloc(self->buf, (self->cap << 1) * sizeof(t));                             \
+        memcpy(self->buf + self->cap, self->buf, self->head * sizeof(t));                          \
+        self->cap <<= 1;                                                                           \
+    }                                                                                              \
+                                                                                                   \
+    static inline void Ring_push_##t(Ring_##t* self, t arg)                                        \
+    {                                                                                              \
+        ASSERT(self->buf, "Ring not initialized");                                                 \
+        if (unlikely(self->cap == self->size))                                                     \
+            Ring_grow_##t(self);                                                                   \
+        *Ring_at_##t(self, self->size++) = arg;                                                    \
+    }                                                                                              \
+                                                                                                   \
+    /* the element takes the id of the one removed last, base is decremented */                   \
+    static inline void Ring_push_front_##t(Ring_##t* self, t arg)                                  \
+    {                                                                                              \
+        ASSERT(self->buf, "Ring not initialized");                                                 \
+        ASSERT(self->base, "No element was removed from the front");                               \
+        if (unlikely(self->cap == self->size))                                                     \
+            Ring_grow_##t(self);                                                                   \
+        self->head = (self->head - 1) & (self->cap - 1);                                           \
+        ++self->size;                                                                              \
+        --self->base;                                                                              \
+        *Ring_at_##t(self, 0) = arg;                                                               \
+    }                                                                                              \
+                                                                                                   \
+    static inline void Ring_pop_n_##t(Ring_##t* self, size_t n)                                    \
+    {                                                                                              \
+        n = MIN(n, self->size);                                                                    \
+        if (dtor)                                                                                  \
+            for (size_t i = 0; i < n; ++i)                                                         \
+                ((void (*)(dtorctx_t*, t*))dtor)(self->dtor_arg, Ring_at_##t(self, --self->size)); \
+        else                                                                                       \
+            self->size -= n;                                                                       \
+    }                                                                                              \
+                                                                                                   \
+    static inline void Ring_pop_front_n_##t(Ring_##t* self, size_t n)                              \
+    {                                                                                              \
+        n = MIN(n, self->size);                                                                    \
+        if (dtor)                                                                                  \
+            for (size_t i = 0; i < n; ++i)                                                         \
+                ((void (*)(dtorctx_t*, t*))dtor)(self->dtor_arg, Ring_at_##t(self, i));            \
+        self->head = (self->head + n) & (self->cap - 1);                                           \
+        self->size -= n;                                                                           \
+        self->base += n;                                                                           \
+    }                                                                                              \
+                                                                                                   \
+    /* elements are shifted towards whichever end of the buffer is closer */                       \
+    static inline void Ring_insert_at_##t(Ring_##t* self, size_t idx, t arg)                       \
+    {                                                                                              \
+        ASSERT(idx <= self->size, "Ring index out of range");                                      \
+        if (unlikely(self->cap == self->size))                                                     \
+            Ring_grow_##t(self);                                                                   \
+        if (idx < self->size / 2) {                                                                \
+            self->head = (self->head - 1) & (self->cap - 1);                                       \
+            for (size_t i = 0; i < idx; ++i)                                                       \
+                *Ring_at_##t(self, i) = *Ring_at_##t(self, i + 1);                                 \
+        } else {                                                                                   \
+            for (size_t i = self->size; i > idx; --i)                                              \
+                *Ring_at_##t(self, i) = *Ring_at_##t(self, i - 1);                                 \
+        }                                                                                          \
+        ++self->size;                                                                              \
+        *Ring_at_##t(self, idx) = arg;                                                             \
+    }                                                                                              \
+                                                                                                   \
+    /* elements are shifted towards whichever end of the buffer is closer */                       \
+    static inline void Ring_insertv_at_##t(Ring_##t* self, size_t idx, const t* argv, size_t n)    \
+    {                                                                                              \
+        ASSERT(idx <= self->size, "Ring index out of range");                                      \
+        while (self->cap < self->size + n)                                                         \
+            Ring_grow_##t(self);                                                                   \
+        if (idx < self->size / 2) {                                                                \
+            self->head = (self->head - n) & (self->cap - 1);                                       \
+            for (size_t i = 0; i < idx; ++i)                                                       \
+                *Ring_at_##t(self, i) = *Ring_at_##t(self, i + n);                                 \
+        } else {                                                                                   \
+            for (size_t i = self->size; i > idx; --i)                                              \
+                *Ring_at_##t(self, i - 1 + n) = *Ring_at_##t(self, i - 1);                         \
+        }                                                                                          \
+        self->size += n;                                                                           \
+        for (size_t i = 0; i < n; ++i)                                                             \
+            *Ring_at_##t(self, idx + i) = argv[i];                                                 \
+    }                                                                                              \
+                                                                                                   \
+    static inline void Ring_remove_at_##t(Ring_##t* self, size_t idx, size_t n)                    \
+    {                                                                                              \
+        ASSERT(idx + n <= self->size, "Ring index out of range");                                  \
+        if (dtor)                                                                                  \
+            for (size_t i = idx; i < idx + n; ++i)                                                 \
+                ((void (*)(dtorctx_t*, t*))dtor)(self->dtor_arg, Ring_at_##t(self, i));            \
+        if (idx < self->size - idx - n) {                                                          \
+            for (size_t i = idx; i > 0; --i)                                                       \
+                *Ring_at_##t(self, i - 1 + n) = *Ring_at_##t(self, i - 1);                         \
+            self->head = (self->head + n) & (self->cap - 1);                                       \
+        } else {                                                                                   \
+            for (size_t i = idx; i < self->size - n; ++i)                                          \
+                *Ring_at_##t(self, i) = *Ring_at_##t(self, i + n);                                 \
+        }                                                                                          \
+        self->size -= n;                                                                           \
+    }                                                                                              \
+                                                                                                   \
+    static inline void Ring_clear_##t(Ring_##t* self)                                              \
+    {                                                                                              \
+        Ring_pop_n_##t(self, self->size);                                                          \
+    }                                                                                              \
+                                                                                                   \
+    static inline void Ring_destroy_##t(Ring_##t* self)                                            \
+    {                                                                                              \
+        Ring_clear_##t(self);                                                                      \
+        free(self->buf);                                                                           \
+        self->buf = NULL;                                                                          \
+    }                                                                                              \
+    _Pragma("GCC diagnostic pop");                                                                 \
+    _Pragma("GCC diagnostic pop");                                                                 \
+    _Pragma("GCC diagnostic pop");                                                                 \
+    _Pragma("GCC diagnostic pop");
@@ -799,6 +799,8 @@ static void settings_make_default()
         .shell          = AString_new_uninitialized(), 
         .title_format   = AString_new_static(DFT_TITLE_FMT),
         .directory      = AString_new_uninitialized(),
+        .record_path    = AString_new_uninitialized(),
+        .replay_path    = AString_new_uninitialized(),
 
         .styled_fonts = Vector_new_with_capacity_StyledFontInfo(1),
         .symbol_fonts = Vector_new_with_capacity_UnstyledFontInfo(1),
@@ -883,7 +885,10 @@ static void settings_make_default()
 
         .allow_multiple_underlines = false,
 
-        .scrollback = 2000,
+        .scrollback              = 2000,
+        .scrollback_compress     = 1000,
+        .scrollback_spill        = false,
+        .scrollback_search_index = 32,
 
         .debug_pty = false,
         .debug_gfx = false,
@@ -1222,6 +1227,22 @@ static void handle_option(const char opt, const int array_index, const char* val
             }
             break;
 
+        case OPT_RECORD_IDX: {
+            Vector_Vector_char values = expand_list_value(value, on_list_expand_syntax_error);
+            AString_replace_with_dynamic(&settings.record_path, strdup(values.buf[0].buf));
+            Vector_destroy_Vector_char(&values);
+        } break;
+
+        case OPT_REPLAY_IDX: {
+            Vector_Vector_char values = expand_list_value(value, on_list_expand_syntax_error);
+            AString_replace_with_dynamic(&settings.replay_path, strdup(values.buf[0].buf));
+            Vector_destroy_Vector_char(&values);
+        } break;
+
+        case OPT_REPLAY_FAST_IDX:
+            settings.replay_fast = true;
+            break;
+
         case OPT_DEBUG_PTY_IDX:
             settings.debug_pty = true;
             break;
@@ -1253,6 +1274,18 @@ static void handle_option(const char opt, const int array_index, const char* val
             settings.scrollback = MAX(strtol(value, NULL, 10), 0);
             break;
 
+        case OPT_SCROLLBACK_COMPRESS_IDX:
+            settings.scrollback_compress = MAX(strtol(value, NULL, 10), 0);
+            break;
+
+        case OPT_SCROLLBACK_SPILL_IDX:
+            L_ASSIGN_BOOL(settings.scrollback_spill, true)
+            break;
+
+        case OPT_SCROLLBACK_SEARCH_INDEX_IDX:
+            settings.scrollback_search_index = MAX(strtol(value, NULL, 10), 0);
+            break;
+
         case OPT_IO_CHUNK_DELAY: {
             L_PROCESS_MULTI_ARG_PACK_BEGIN(value)
             case 0:
@@ -2116,6 +2149,8 @@ void settings_cleanup()
     AString_destroy(&settings.uri_handler);
     AString_destroy(&settings.extern_pipe_handler);
     AString_destroy(&settings.directory);
+    AString_destroy(&settings.record_path);
+    AString_destroy(&settings.replay_path);
     AString_destroy(&settings.font_style_regular);
     AString_destroy(&settings.font_style_bold);
     AString_destroy(&settings.font_style_italic);
@@ -200,6 +200,8 @@ typedef struct
     Vector_output_prefs_t output_preferences;
 
     AString term, vte_version, locale, title, directory, uri_handler, extern_pipe_handler;
+    AString record_path, replay_path;
+    bool    replay_fast;
 
     char* user_app_id;
     char* user_app_id_2;
@@ -258,6 +260,9 @@ typedef struct
     uint32_t vt_debug_delay_usec;
 
     uint32_t scrollback;
+    uint32_t scrollback_compress;
+    bool     scrollback_spill;
+    uint32_t scrollback_search_index;
 
     bool    enable_cursor_blink;
     int32_t cursor_blink_interval_ms;
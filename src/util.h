@@ -19,6 +19,12 @@
 #include <uchar.h>
 #include <unistd.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #define INCH_IN_MM 0.03937008
 #define SQRT2      1.41421356237
 
@@ -553,6 +559,364 @@ static inline bool unicode_is_ambiguous_width(char32_t codepoint)
            unicode_is_special(codepoint);
 }
 
+static inline bool ascii_is_printable(char c)
+{
+    return c >= 0x20 && c <= 0x7E;
+}
+
+/**
+ * Get the length of the run of printable ASCII characters (0x20 - 0x7E) at the start of @param buf
+ */
+__attribute__((hot)) static inline size_t ascii_printable_run_length(const char* buf, size_t len)
+{
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256i lo_256 = _mm256_set1_epi8(0x1F);
+    const __m256i hi_256 = _mm256_set1_epi8(0x7F);
+    for (; i + 32 <= len; i += 32) {
+        __m256i  v    = _mm256_loadu_si256((const __m256i*)(buf + i));
+        __m256i  lo   = _mm256_cmpgt_epi8(v, lo_256);
+        __m256i  ok   = _mm256_and_si256(lo, _mm256_cmpgt_epi8(hi_256, v));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(ok);
+        if (mask != UINT32_MAX) {
+            return i + __builtin_ctz(~mask);
+        }
+    }
+#endif
+
+#if defined(__SSE2__)
+    /* bytes >= 0x80 are negative as signed chars and fail the lower bound check */
+    const __m128i lo_128 = _mm_set1_epi8(0x1F);
+    const __m128i hi_128 = _mm_set1_epi8(0x7F);
+    for (; i + 16 <= len; i += 16) {
+        __m128i  v    = _mm_loadu_si128((const __m128i*)(buf + i));
+        __m128i  ok   = _mm_and_si128(_mm_cmpgt_epi8(v, lo_128), _mm_cmplt_epi8(v, hi_128));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(ok);
+        if (mask != 0xFFFF) {
+            return i + __builtin_ctz(~mask);
+        }
+    }
+#endif
+
+    for (; i < len; ++i) {
+        if (!ascii_is_printable(buf[i])) {
+            break;
+        }
+    }
+
+    return i;
+}
+
+/**
+ * Get the length of the run of non-ASCII bytes (0x80 - 0xFF) at the start of @param buf */
+__attribute__((hot)) static inline size_t utf8_multibyte_run_length(const char* buf, size_t len)
+{
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    for (; i + 32 <= len; i += 32) {
+        __m256i  v    = _mm256_loadu_si256((const __m256i*)(buf + i));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(v);
+        if (mask != UINT32_MAX) {
+            return i + __builtin_ctz(~mask);
+        }
+    }
+#endif
+
+#if defined(__SSE2__)
+    for (; i + 16 <= len; i += 16) {
+        __m128i  v    = _mm_loadu_si128((const __m128i*)(buf + i));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(v);
+        if (mask != 0xFFFF) {
+            return i + __builtin_ctz(~mask);
+        }
+    }
+#endif
+
+    for (; i < len; ++i) {
+        if (!(buf[i] & 0x80)) {
+            break;
+        }
+    }
+
+    return i;
+}
+
+/**
+ * Find the first occurrence of @param needle in @param buf. Candidate positions are found by
+ * comparing the first and last character of the needle with multiple positions at once
+ * @return position of the match or SIZE_MAX */
+__attribute__((hot)) static inline size_t char32_find(const char32_t* buf,
+                                                      size_t          len,
+                                                      const char32_t* needle,
+                                                      size_t          needle_len)
+{
+    if (!needle_len || needle_len > len) {
+        return SIZE_MAX;
+    }
+
+    size_t         last_offset = needle_len - 1;
+    size_t         end         = len - last_offset;
+    size_t         i           = 0;
+    const char32_t first = needle[0], last = needle[last_offset];
+
+#define L_VERIFY_CANDIDATES(_mask)                                                                 \
+    for (uint32_t m = (_mask); m; m &= m - 1) {                                                    \
+        size_t pos = i + __builtin_ctz(m);                                                         \
+        if (!memcmp(buf + pos + 1, needle + 1, (needle_len - 1) * sizeof(char32_t))) {             \
+            return pos;                                                                            \
+        }                                                                                          \
+    }
+
+#if defined(__AVX2__)
+    const __m256i first_256 = _mm256_set1_epi32(first);
+    const __m256i last_256  = _mm256_set1_epi32(last);
+    for (; i + 8 <= end; i += 8) {
+        __m256i f = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(buf + i)), first_256);
+        __m256i l =
+          _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(buf + i + last_offset)), last_256);
+        L_VERIFY_CANDIDATES(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_and_si256(f, l))));
+    }
+#endif
+
+#if defined(__SSE2__)
+    const __m128i first_128 = _mm_set1_epi32(first);
+    const __m128i last_128  = _mm_set1_epi32(last);
+    for (; i + 4 <= end; i += 4) {
+        __m128i f = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(buf + i)), first_128);
+        __m128i l =
+          _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(buf + i + last_offset)), last_128);
+        L_VERIFY_CANDIDATES(_mm_movemask_ps(_mm_castsi128_ps(_mm_and_si128(f, l))));
+    }
+#endif
+
+#undef L_VERIFY_CANDIDATES
+
+    for (; i < end; ++i) {
+        if (buf[i] == first && buf[i + last_offset] == last &&
+            !memcmp(buf + i + 1, needle + 1, (needle_len - 1) * sizeof(char32_t))) {
+            return i;
+        }
+    }
+
+    return SIZE_MAX;
+}
+
+#define UNICODE_REPLACEMENT_CHARACTER 0xFFFD
+
+/**
+ * Incremental UTF-8 decoder. Sequences can be split between calls to utf8_decode_run() */
+typedef struct
+{
+    char32_t codepoint;
+
+    /* number of continuation bytes still expected */
+    uint8_t remaining;
+
+    /* range of valid values for the next continuation byte (rejects overlong forms, surrogates
+     * and values above U+10FFFF) */
+    uint8_t lower, upper;
+} utf8_decoder_t;
+
+static inline bool utf8_decoder_in_sequence(const utf8_decoder_t* self)
+{
+    return self->remaining;
+}
+
+/**
+ * Get the number of continuation bytes following lead byte @param c0 and the range of valid values
+ * for the first of them
+ * @return 0 if @param c0 can not start a sequence */
+static inline uint8_t utf8_lead_byte(uint8_t c0, uint8_t* lower, uint8_t* upper)
+{
+    *lower = 0x80;
+    *upper = 0xBF;
+
+    switch (c0) {
+        case 0xC2 ... 0xDF:
+            return 1;
+        case 0xE0:
+            *lower = 0xA0;
+            return 2;
+        case 0xED:
+            *upper = 0x9F;
+            return 2;
+        case 0xE1 ... 0xEC:
+        case 0xEE ... 0xEF:
+            return 2;
+        case 0xF0:
+            *lower = 0x90;
+            return 3;
+        case 0xF1 ... 0xF3:
+            return 3;
+        case 0xF4:
+            *upper = 0x8F;
+            return 3;
+        default:
+            /* continuation byte without a lead byte, or a byte never used in UTF-8 */
+            return 0;
+    }
+}
+
+/**
+ * Decode a single byte, same as utf8_decode_run() with a one byte buffer but without the vector
+ * scan for callers that get their input one byte at a time.
+ *
+ * @param out - room for two codepoints
+ * @return number of codepoints written to @param out, @param consumed is set to false for an
+ * ASCII byte that is not a part of a sequence */
+static inline size_t utf8_decode_byte(utf8_decoder_t* self,
+                                      uint8_t         c,
+                                      char32_t*       out,
+                                      bool*           consumed)
+{
+    size_t n = 0;
+
+    if (self->remaining) {
+        if (c >= self->lower && c <= self->upper) {
+            self->codepoint = (self->codepoint << 6) | (c & 0x3F);
+            self->lower     = 0x80;
+            self->upper     = 0xBF;
+            if (!--self->remaining) {
+                out[n++] = self->codepoint;
+            }
+            *consumed = true;
+            return n;
+        }
+        self->remaining = 0;
+        out[n++]        = UNICODE_REPLACEMENT_CHARACTER;
+    }
+
+    if (!(c & 0x80)) {
+        *consumed = false;
+        return n;
+    }
+
+    *consumed       = true;
+    self->remaining = utf8_lead_byte(c, &self->lower, &self->upper);
+    if (!self->remaining) {
+        out[n++] = UNICODE_REPLACEMENT_CHARACTER;
+    } else {
+        self->codepoint = c & (0x3F >> self->remaining);
+    }
+
+    return n;
+}
+
+/**
+ * Decode non-ASCII text from @param buf. Stops when @param out_size codepoints were written or at
+ * the first ASCII byte that is not a part of a sequence. Malformed input is replaced with U+FFFD
+ * (one for every maximal invalid subsequence). An ASCII byte interrupting a sequence is not
+ * consumed.
+ *
+ * @param consumed - number of bytes read from @param buf
+ * @return number of codepoints written to @param out */
+__attribute__((hot)) static inline size_t utf8_decode_run(utf8_decoder_t* self,
+                                                          const char*     buf,
+                                                          size_t          len,
+                                                          char32_t*       out,
+                                                          size_t          out_size,
+                                                          size_t*         consumed)
+{
+    const uint8_t* b = (const uint8_t*)buf;
+    size_t         n = 0, i = 0;
+
+    /* complete a sequence left over from the previous call */
+    while (self->remaining && i < len && n < out_size) {
+        if (b[i] < self->lower || b[i] > self->upper) {
+            self->remaining = 0;
+            out[n++]        = UNICODE_REPLACEMENT_CHARACTER;
+            break;
+        }
+        self->codepoint = (self->codepoint << 6) | (b[i++] & 0x3F);
+        self->lower     = 0x80;
+        self->upper     = 0xBF;
+        if (!--self->remaining) {
+            out[n++] = self->codepoint;
+        }
+    }
+
+    if (self->remaining) {
+        *consumed = i;
+        return n;
+    }
+
+    /* Only bytes >= 0x80 can belong to this run. Sequences fully inside it can be decoded without
+     * checking the input length and without keeping state */
+    size_t end = i + utf8_multibyte_run_length(buf + i, len - i);
+
+    while (i < end && n < out_size) {
+        uint8_t c0 = b[i];
+
+        if (c0 >= 0xC2 && c0 <= 0xDF && i + 1 < end && (b[i + 1] & 0xC0) == 0x80) {
+            out[n++] = ((c0 & 0x1F) << 6) | (b[i + 1] & 0x3F);
+            i += 2;
+            continue;
+        }
+
+        uint8_t lower, upper, remaining = utf8_lead_byte(c0, &lower, &upper);
+        if (!remaining) {
+            out[n++] = UNICODE_REPLACEMENT_CHARACTER;
+            ++i;
+            continue;
+        }
+
+        if (i + remaining < end) {
+            /* whole sequence is available */
+            uint8_t c1 = b[i + 1];
+            if (c1 < lower || c1 > upper) {
+                out[n++] = UNICODE_REPLACEMENT_CHARACTER;
+                ++i;
+                continue;
+            }
+
+            char32_t cp = ((c0 & (0x3F >> remaining)) << 6) | (c1 & 0x3F);
+            size_t   j  = 2;
+            for (; j <= remaining; ++j) {
+                if ((b[i + j] & 0xC0) != 0x80) {
+                    break;
+                }
+                cp = (cp << 6) | (b[i + j] & 0x3F);
+            }
+
+            out[n++] = j > remaining ? cp : UNICODE_REPLACEMENT_CHARACTER;
+            i += j;
+        } else {
+            /* sequence continues past the end of this run, decode byte by byte */
+            self->codepoint = c0 & (0x3F >> remaining);
+            self->remaining = remaining;
+            self->lower     = lower;
+            self->upper     = upper;
+            ++i;
+
+            while (self->remaining && i < end) {
+                if (b[i] < self->lower || b[i] > self->upper) {
+                    self->remaining = 0;
+                    out[n++]        = UNICODE_REPLACEMENT_CHARACTER;
+                    break;
+                }
+                self->codepoint = (self->codepoint << 6) | (b[i++] & 0x3F);
+                self->lower     = 0x80;
+                self->upper     = 0xBF;
+                --self->remaining;
+            }
+
+            if (self->remaining) {
+                /* an ASCII byte interrupts the sequence */
+                if (i < len) {
+                    self->remaining = 0;
+                    out[n++]        = UNICODE_REPLACEMENT_CHARACTER;
+                }
+                break;
+            }
+        }
+    }
+
+    *consumed = i;
+    return n;
+}
+
 static inline bool is_in_tmp_dir(const char* path)
 {
     return (path == strstr(path, "/tmp/") || path == strstr(path, "/dev/shm/") ||
@@ -16,10 +16,6 @@
 
 #ifndef NOUTF8PROC
 #include <utf8proc.h>
-#define C_WIDTH(c) ((uint8_t)utf8proc_charwidth((char32_t)(c)))
-#else
-#include "wcwidth/wcwidth.h"
-#define C_WIDTH(c) ((uint8_t)wcwidth((c)))
 #endif
 
 // #include <errno.h>
@@ -31,8 +27,10 @@
 #include <uchar.h>
 #include <unistd.h>
 
+#include "char_width.h"
 #include "colors.h"
 #include "rcptr.h"
+#include "ring.h"
 #include "settings.h"
 #include "timing.h"
 #include "util.h"
@@ -158,11 +156,11 @@ typedef struct
 /* Get total grapheme cluster width (in cells) */
 static inline uint8_t Rune_width(Rune r)
 {
-    uint8_t base  = C_WIDTH(r.code);
+    uint8_t base  = char_width(r.code);
     uint8_t extra = 0;
 
     for (int i = 0; i < VT_RUNE_MAX_COMBINE; ++i) {
-        extra = MAX(extra, C_WIDTH(r.combine[i]));
+        extra = MAX(extra, char_width(r.combine[i]));
     }
 
     return base + extra;
@@ -174,14 +172,14 @@ static inline uint8_t Rune_width(Rune r)
  only advance the cursor by a single cell) */
 static inline uint8_t Rune_width_spill(Rune r)
 {
-    uint8_t base  = C_WIDTH(r.code);
+    uint8_t base  = char_width(r.code);
     uint8_t extra = 0;
 
     for (int i = 0; i < VT_RUNE_MAX_COMBINE; ++i) {
         extra = MAX(extra, r.combine[i]);
     }
 
-    return unicode_is_ambiguous_width(r.code) ? (MAX(2, base) + extra) : (base + extra);
+    return char_is_ambiguous_width(r.code) ? (MAX(2, base) + extra) : (base + extra);
 }
 
 static inline bool Rune_is_blank(Rune r)
@@ -214,7 +212,8 @@ typedef struct
         int16_t   index;
     } bg_data;
 
-    int16_t hyperlink_idx;
+    /* id in Vt.links, 0 if not linked */
+    uint16_t hyperlink_idx;
 
     bool bg_is_palette_entry : 1;
     bool fg_is_palette_entry : 1;
@@ -233,9 +232,49 @@ typedef struct
 
 DEF_VECTOR(VtRune, NULL);
 
+/* Set in VtCell.code if it is an index into Vt.cell_clusters and not a codepoint */
+#define VT_CELL_CLUSTER_FLAG (1u << 31)
+
+/* Maximum number of distinct attributes or grapheme clusters a terminal can hold at a time */
+#define VT_CELL_TABLE_MAX_ENTRIES (UINT16_MAX + 1)
+
+/**
+ * A terminal cell as stored in lines. Colors and text attributes are interned in a per-terminal
+ * table, grapheme clusters with combining characters in another one, so a cell takes up 8 bytes
+ * instead of the full VtRune */
+typedef struct
+{
+    /* codepoint, or cluster index with VT_CELL_CLUSTER_FLAG set */
+    char32_t code;
+
+    /* index into Vt.cell_attrs */
+    uint16_t attrs_idx;
+
+    /* id in Vt.links, 0 if not linked */
+    uint16_t hyperlink_idx;
+} VtCell;
+
+DEF_VECTOR(VtCell, NULL);
+
+/**
+ * Set of unique VtRunes addressable by index. Entries are never moved while referenced by a cell,
+ * the table is only compacted when it fills up */
+typedef struct
+{
+    Vector_VtRune entries;
+
+    /* open addressing hash set of entry indices + 1, 0 marks an empty slot */
+    uint32_t* slots;
+    uint32_t  n_slots;
+
+    /* result of the previous lookup, the same attributes are usually stored many times in a row */
+    uint32_t last_idx;
+} VtRuneTable;
+
 DEF_VECTOR(char, NULL);
 DEF_VECTOR(bool, NULL);
 DEF_VECTOR(size_t, NULL);
+DEF_VECTOR(char32_t, NULL);
 
 DEF_VECTOR(Vector_VtRune, Vector_destroy_VtRune);
 
@@ -259,9 +298,9 @@ typedef struct
 {
     char* command;
 
-    /* command_end_row = output_rows.first -1 */
-    size_t             command_start_row;
-    Pair_size_t        output_rows;
+    /* Line ids (see Vt_line_id()), command_end_line_id = output_line_ids.first -1 */
+    size_t             command_start_line_id;
+    Pair_size_t        output_line_ids;
     TimeSpan           execution_time;
     int                exit_status;
     uint16_t           command_start_column;
@@ -313,7 +352,7 @@ typedef struct
 {
     RcPtr_VtImageSurface source_image_surface;
 
-    size_t        anchor_global_index;
+    size_t        anchor_line_id;
     uint16_t      anchor_cell_idx;
     Pair_uint32_t anchor_offset_px;
 
@@ -377,6 +416,9 @@ DEF_VECTOR(RcPtr_VtSixelSurface, RcPtr_destroy_VtSixelSurface);
 typedef struct
 {
     char* uri_string;
+
+    /* Found in the line text, not set explicitly with OSC 8 */
+    bool detected;
 } VtUri;
 
 static void VtUri_destroy(VtUri* self)
@@ -387,6 +429,24 @@ static void VtUri_destroy(VtUri* self)
 
 DEF_VECTOR(VtUri, VtUri_destroy);
 
+/* Maximum number of distinct links a terminal can hold at a time, cells store ids starting at 1 */
+#define VT_URI_TABLE_MAX_ENTRIES UINT16_MAX
+
+/**
+ * Set of unique links. Cells store entry index + 1. Entries are never moved while referenced by a
+ * cell, the table is only compacted when it fills up */
+typedef struct
+{
+    Vector_VtUri entries;
+
+    /* open addressing hash set of entry indices + 1, 0 marks an empty slot */
+    uint32_t* slots;
+    uint32_t  n_slots;
+
+    /* result of the previous lookup */
+    uint32_t last_idx;
+} VtUriTable;
+
 typedef struct
 {
     uint32_t data[4];
@@ -439,6 +499,51 @@ static void VtGraphicLineAttachments_destroy(VtGraphicLineAttachments* self)
     }
 }
 
+/* Number of lines compressed together when moved to the cold scrollback tier */
+#define VT_COLD_BLOCK_LINES 64
+
+/* Number of lines reflowed at once when the scrollback is reflowed incrementally */
+#define VT_REFLOW_CHUNK_LINES 256
+
+/* Reflowing a range at least twice this long is split between multiple threads */
+#define VT_REFLOW_PARALLEL_MIN_LINES 8192
+
+/* Maximum number of threads used for reflowing */
+#define VT_REFLOW_MAX_THREADS 8
+
+/**
+ * Compressed characters of consecutive scrollback lines */
+typedef struct
+{
+    uint8_t* data;
+    uint32_t size, raw_size;
+
+    /* id of the first line stored in the block */
+    size_t first_line_id;
+
+    uint16_t n_lines;
+} VtColdBlock;
+
+static void VtColdBlock_destroy(VtColdBlock* self)
+{
+    free(self->data);
+    self->data = NULL;
+}
+
+DEF_RC_PTR(VtColdBlock, VtColdBlock_destroy);
+DEF_VECTOR(RcPtr_VtColdBlock, RcPtr_destroy_VtColdBlock);
+
+/**
+ * Location of VT_COLD_BLOCK_LINES lines written to the scrollback spill file */
+typedef struct
+{
+    size_t   first_line_id;
+    size_t   offset;
+    uint32_t size;
+} VtSpillBlock;
+
+DEF_VECTOR(VtSpillBlock, NULL);
+
 typedef enum
 {
     /* Proxy objects are up to date */
@@ -463,12 +568,29 @@ typedef enum
     VT_LINE_DAMAGE_PROXIES_MOVED_TO_CLONE,
 } vt_line_damage_type_e;
 
+/* Number of separate cell ranges a line can track as damaged, more are merged together */
+#define VT_LINE_DAMAGE_MAX_RANGES 3
+
+/* Damaged ranges separated by fewer unchanged cells are merged. Repainting a few cells is cheaper
+ * than an additional render pass */
+#define VT_LINE_DAMAGE_MERGE_DISTANCE 8
+
+typedef struct
+{
+    uint16_t front, end;
+} vt_line_damage_range_t;
+
 typedef struct
 {
     /* Range of cells that should be repainted if type == RANGE or
      * not repainted if type == SHIFT */
     uint16_t front, end;
 
+    /* If type == RANGE, disjoint ranges of cells within front-end that should be repainted, in
+     * order of position. Cells between them are up to date */
+    vt_line_damage_range_t ranges[VT_LINE_DAMAGE_MAX_RANGES];
+    uint8_t                n_ranges;
+
     /* Number of cells the existing contents should be moved right */
     int8_t shift;
 
@@ -478,20 +600,20 @@ typedef struct
 typedef struct
 {
     /* Characters */
-    Vector_VtRune data;
+    Vector_VtCell data;
 
     /* Arbitrary data used by the renderer */
     VtLineProxy proxy;
 
-    /* Clickable link adresses */
-    Vector_VtUri* links;
-
     /* Images attached to this line */
     VtGraphicLineAttachments* graphic_attachments;
 
     /* Ref to command info if this is an output/invocation of a shell command */
     RcPtr_VtCommand linked_command;
 
+    /* Set if characters were moved to the cold scrollback tier, data is empty until thawed */
+    RcPtr_VtColdBlock cold_block;
+
     vt_line_damage_t damage;
 
     /* Can be split by resizing window */
@@ -514,18 +636,38 @@ typedef struct
 
     /* This line ends a command output block */
     bool mark_command_output_end : 1;
+
+    /* Links in the line text were detected after it was last modified */
+    bool uris_detected : 1;
+
+    /* Cells are shared with a line in the synchronized update snapshot, which owns them. They have
+     * to be copied before they are modified */
+    bool cells_shared : 1;
 } VtLine;
 
+static inline VtLine VtLine_new()
+{
+    VtLine line;
+    memset(&line, 0, sizeof(VtLine));
+
+    line.damage.type = VT_LINE_DAMAGE_FULL;
+    line.reflowable  = true;
+    line.data        = Vector_new_VtCell();
+
+    return line;
+}
+
 static void VtLine_copy(VtLine* dest, VtLine* source)
 {
     memcpy(dest, source, sizeof(VtLine));
     dest->was_reflown = false;
     dest->reflowable  = false;
     dest->rejoinable  = false;
-    dest->damage.type = VT_LINE_DAMAGE_FULL;
+    dest->damage.type  = VT_LINE_DAMAGE_FULL;
+    dest->cells_shared = false;
     memset(&dest->proxy, 0, sizeof(VtLineProxy));
-    dest->data = Vector_new_with_capacity_VtRune(source->data.size);
-    Vector_pushv_VtRune(&dest->data, source->data.buf, source->data.size);
+    dest->data = Vector_new_with_capacity_VtCell(source->data.size);
+    Vector_pushv_VtCell(&dest->data, source->data.buf, source->data.size);
 }
 
 static VtLine VtLine_clone(VtLine* source)
@@ -533,22 +675,15 @@ static VtLine VtLine_clone(VtLine* source)
     VtLine dest;
     memcpy(&dest, source, sizeof(VtLine));
 
-    dest.data = Vector_new_with_capacity_VtRune(source->data.size);
-    Vector_pushv_VtRune(&dest.data, source->data.buf, source->data.size);
+    dest.data         = Vector_new_with_capacity_VtCell(source->data.size);
+    dest.cells_shared = false;
+    Vector_pushv_VtCell(&dest.data, source->data.buf, source->data.size);
 
     if (RcPtr_get_VtCommand(&source->linked_command)) {
         dest.linked_command = RcPtr_new_shared_VtCommand(&source->linked_command);
     }
 
-    if (source->links) {
-        dest.links  = _malloc(sizeof(Vector_VtUri));
-        *dest.links = Vector_new_with_capacity_VtUri(source->links->size);
-        Vector_pushv_VtUri(dest.links, source->links->buf, source->links->size);
-
-        for (VtUri* i = NULL; (i = Vector_iter_VtUri(dest.links, i));) {
-            i->uri_string = strdup(i->uri_string);
-        }
-    }
+    dest.cold_block = RcPtr_new_shared_VtColdBlock(&source->cold_block);
 
     if (source->graphic_attachments) {
         dest.graphic_attachments  = _malloc(sizeof(VtGraphicLineAttachments));
@@ -561,6 +696,7 @@ static VtLine VtLine_clone(VtLine* source)
 static inline void VtLine_destroy(void* vt_, VtLine* self);
 
 DEF_VECTOR_DA(VtLine, VtLine_destroy, void);
+DEF_RING_DA(VtLine, VtLine_destroy, void);
 
 /* 'reverse' some modes so default is 0  */
 typedef struct
@@ -657,6 +793,113 @@ typedef struct
     Vector_vt_synchronized_update_origin_t origins;
 } vt_synchronized_update_state_t;
 
+/* Number of lines scanned at once when a scrollback search continues in Vt_search_step() */
+#define VT_SEARCH_CHUNK_LINES 8192
+
+/* Strength of the highlight color over the background of matches other than the current one */
+#define VT_SEARCH_MATCH_BLEND_FACTOR 0.5f
+
+typedef enum
+{
+    VT_SEARCH_HIGHLIGHT_NONE = 0,
+    VT_SEARCH_HIGHLIGHT_MATCH,
+    VT_SEARCH_HIGHLIGHT_CURRENT,
+} vt_search_highlight_e;
+
+typedef enum
+{
+    /* the rest of the scrollback is scanned by Vt_search_step() */
+    VT_SEARCH_RESULT_PENDING,
+    VT_SEARCH_RESULT_FOUND,
+    VT_SEARCH_RESULT_NOT_FOUND,
+} vt_search_result_e;
+
+/**
+ * Cells of one line covered by a search match */
+typedef struct
+{
+    size_t                line_id;
+    uint16_t              begin, end;
+    vt_search_highlight_e type;
+} VtSearchHighlight;
+
+DEF_VECTOR(VtSearchHighlight, NULL);
+
+/* Lines copied for the regex search worker thread at once */
+#define VT_SEARCH_REGEX_CHUNK_LINES 4096
+
+/* Chunks waiting for or being processed by the worker. Limits memory used by line copies */
+#define VT_SEARCH_REGEX_MAX_CHUNKS_IN_FLIGHT 4
+
+/**
+ * Start of a regex search match */
+typedef struct
+{
+    size_t   line_id;
+    uint16_t col;
+} VtSearchMatch;
+
+DEF_VECTOR(VtSearchMatch, NULL);
+
+/* regex search state shared with the worker thread, see vt_search.c */
+struct VtSearchWorker;
+
+/* Size of a line trigram signature in 64 bit words */
+#define VT_SEARCH_INDEX_SIGNATURE_WORDS 4
+
+/**
+ * Every (case folded) trigram in a line sets one bit selected by its hash. A line can only contain
+ * the pattern if it has all bits of the pattern signature set */
+typedef struct
+{
+    uint64_t bits[VT_SEARCH_INDEX_SIGNATURE_WORDS];
+} VtSearchSignature;
+
+DEF_VECTOR(VtSearchSignature, NULL);
+
+/**
+ * Trigram index of logical lines that left the screen. Plain text search skips indexed lines
+ * without all trigrams of the pattern, lines outside of the indexed range are scanned */
+typedef struct
+{
+    /* signatures of lines starting at id_base, rows continuing wrapped lines are left empty.
+     * Allocated on first use */
+    Vector_VtSearchSignature signatures;
+    size_t                   id_base;
+
+    /* logical lines starting in [begin_line_id, end_line_id) are indexed */
+    size_t begin_line_id, end_line_id;
+
+    /* the index has to start over at the first line that leaves the screen, lines could have
+     * changed */
+    bool reset;
+} VtSearchIndex;
+
+#define VT_CSI_MAX_PARAMS        32
+#define VT_CSI_MAX_INTERMEDIATES 2
+#define VT_CSI_PARAM_OMITTED     (-1)
+
+/**
+ * Control sequence decoded as the bytes arrive
+ *
+ * CSI [private marker] [params] [intermediates] final */
+typedef struct
+{
+    int32_t params[VT_CSI_MAX_PARAMS];
+
+    /* bit n is set if params[n] was separated from the previous one with ':' */
+    uint32_t sub_param_mask;
+
+    uint8_t n_params;
+    uint8_t n_intermediates;
+    char    intermediates[VT_CSI_MAX_INTERMEDIATES];
+    char    private_marker;
+    char    final;
+
+    /* parameter limit was exceeded, any following parameters are dropped */
+    bool params_overflown;
+} vt_csi_sequence_t;
+
 typedef struct
 {
     struct vt_callbacks_t
@@ -746,6 +989,80 @@ typedef struct
 
     } selection;
 
+    /* Incremental search in the scrollback. Matches can span lines that were soft-wrapped */
+    struct Search
+    {
+        bool active;
+
+        /* pattern is being typed, every change searches again from the origin */
+        bool input_active;
+
+        /* look for matches above the origin */
+        bool backward;
+
+        /* pattern has no uppercase characters */
+        bool ignore_case;
+
+        Vector_char32_t pattern;
+
+        /* position the search started from, the pattern is looked for from here every time it
+         * changes */
+        size_t   origin_line_id;
+        uint16_t origin_col;
+
+        /* match the viewport was moved to */
+        bool     has_match;
+        size_t   match_line_id;
+        uint16_t match_col;
+
+        /* matches have to start after this position (before it when scanning backward), or at it
+         * if limit_inclusive is set */
+        size_t   limit_line_id;
+        uint16_t limit_col;
+        bool     limit_inclusive;
+
+        /* unfinished scan continues with the logical line containing this one */
+        bool   pending;
+        bool   scan_backward;
+        size_t resume_line_id;
+
+        /* lines were reflowed for a new width, the line ids above no longer point to the same text */
+        bool reflowed;
+
+        /* ranges to highlight in the viewport, sorted by line id */
+        Vector_VtSearchHighlight highlights;
+        size_t                   highlights_top_line_id;
+        bool                     highlights_stale;
+
+        /* pattern is a POSIX extended regular expression. Lines above the screen are copied in
+         * chunks and matched on a worker thread, lines from tail_line_id on can still change and
+         * are matched directly when needed */
+        bool                   regex;
+        bool                   regex_valid;
+        struct VtSearchWorker* worker;
+        uint64_t               generation;
+
+        /* matches found by the worker, sorted by position */
+        Vector_VtSearchMatch matches;
+
+        /* logical lines in [scanned_begin_line_id, scanned_end_line_id) were matched by the worker,
+         * scanned_to_top is set when that range reached the first line of the buffer */
+        size_t scanned_begin_line_id, scanned_end_line_id;
+        bool   scanned_to_top;
+
+        /* next lines to copy above and below the origin */
+        size_t copy_up_line_id, copy_down_line_id;
+        bool   copied_to_top;
+
+        size_t   tail_line_id;
+        uint32_t chunks_in_flight;
+
+        /* a jump to the next match has to wait for the worker */
+        bool awaiting_match;
+
+        VtSearchIndex index;
+    } search;
+
     /* Related to terminal */
     struct winsize ws;
     struct termios tios;
@@ -760,8 +1077,10 @@ typedef struct
         {
             PARSER_STATE_LITERAL = 0,
             PARSER_STATE_ESCAPED,
-            PARSER_STATE_ESCAPED_CSI,
             PARSER_STATE_CSI,
+            PARSER_STATE_CSI_PARAM,
+            PARSER_STATE_CSI_INTERMEDIATE,
+            PARSER_STATE_CSI_IGNORE,
             PARSER_STATE_DCS,
             PARSER_STATE_APC,
             PARSER_STATE_OSC,
@@ -775,15 +1094,16 @@ typedef struct
             PARSER_STATE_DEC_SPECIAL,
         } state;
 
-        bool      in_mb_seq;
-        mbstate_t input_mbstate;
+        utf8_decoder_t utf8_decoder;
 
         // TODO: SGR stack
         VtRune char_state; // records currently selected character properties
 
-        Vector_char active_sequence;
+        vt_csi_sequence_t csi;
+        Vector_char       active_sequence;
     } parser;
 
+    /* Scratch state for detecting links in line text, see Vt_uri_detect_line() */
     struct VtUriMatcher
     {
         Vector_char match;
@@ -916,9 +1236,42 @@ typedef struct
     uint8_t tabstop;
     bool*   tab_ruler;
 
-    Vector_VtLine lines, alt_lines;
+    Ring_VtLine lines, alt_lines;
 
-    char* active_hyperlink;
+    /* attributes and grapheme clusters referred to by cells in lines */
+    VtRuneTable cell_attrs, cell_clusters;
+
+    /* link targets referred to by cells in lines */
+    VtUriTable links;
+
+    struct
+    {
+        /* all lines before this one were moved to the cold tier (or thawed later) */
+        size_t frozen_end_line_id;
+
+        /* blocks decompressed on demand, their lines are frozen again when no longer near the
+         * viewport */
+        Vector_RcPtr_VtColdBlock thawed_blocks;
+    } cold_lines;
+
+    /* Lines removed from the front of the scrollback buffer if settings.scrollback_spill is set.
+     * Blocks are sorted by line id. Lines in the buffer with ids below the end of the last block
+     * were loaded back from the file and can be dropped again without writing them */
+    struct
+    {
+        int                 fd;
+        uint8_t*            map;
+        size_t              map_size, used;
+        Vector_VtSpillBlock blocks;
+        bool                failed;
+    } spill;
+
+    /* Lines with ids below this one may still be laid out for an earlier window width. They are
+     * reflowed when scrolled into view or by Vt_reflow_step() */
+    size_t reflow_pending_end_line_id;
+
+    /* id in links set by OSC 8, 0 if there is no active link */
+    uint16_t active_hyperlink;
 
     VtRune   last_inserted;
     bool     has_last_inserted_rune;
@@ -930,7 +1283,7 @@ typedef struct
     int32_t utf8proc_state;
 #endif
 
-    VtRune blank_space;
+    VtCell blank_space;
 
     VtCursor cursor;
 
@@ -981,6 +1334,70 @@ static inline const VtCommand* Vt_get_last_command(const Vt* self)
     return RcPtr_get_const_VtCommand(Vector_last_const_RcPtr_VtCommand(&self->shell_commands));
 }
 
+/**
+ * Get attributes of a cell, code and hyperlink of the returned rune are not set */
+static inline const VtRune* Vt_cell_attrs(const Vt* self, const VtCell* cell)
+{
+    return cell ? &self->cell_attrs.entries.buf[cell->attrs_idx] : NULL;
+}
+
+static inline bool VtCell_is_cluster(const VtCell* self)
+{
+    return self->code & VT_CELL_CLUSTER_FLAG;
+}
+
+static inline bool VtCell_is_blank(const VtCell* self)
+{
+    return self->code == ' ';
+}
+
+/**
+ * Get the base codepoint of a cell */
+static inline char32_t Vt_cell_code(const Vt* self, const VtCell* cell)
+{
+    if (unlikely(VtCell_is_cluster(cell))) {
+        return self->cell_clusters.entries.buf[cell->code & ~VT_CELL_CLUSTER_FLAG].rune.code;
+    }
+    return cell->code;
+}
+
+/**
+ * Get the character or grapheme cluster of a cell with its font style */
+static inline Rune Vt_cell_rune(const Vt* self, const VtCell* cell)
+{
+    Rune r;
+    if (unlikely(VtCell_is_cluster(cell))) {
+        r = self->cell_clusters.entries.buf[cell->code & ~VT_CELL_CLUSTER_FLAG].rune;
+    } else {
+        r = (Rune){ .code = cell->code };
+    }
+    r.style = Vt_cell_attrs(self, cell)->rune.style;
+    return r;
+}
+
+/* Get total grapheme cluster width of a cell (in cells) */
+static inline uint8_t Vt_cell_width(const Vt* self, const VtCell* cell)
+{
+    if (unlikely(VtCell_is_cluster(cell))) {
+        return Rune_width(Vt_cell_rune(self, cell));
+    }
+    return char_width(cell->code);
+}
+
+/**
+ * Get a cell storing @param rune, interns its attributes and grapheme cluster */
+VtCell Vt_cell_from_rune(Vt* self, const VtRune* rune);
+
+/**
+ * Get the value of VtCell.code for @param rune, interns it if it is a grapheme cluster */
+char32_t Vt_intern_cluster(Vt* self, Rune rune);
+
+/**
+ * Get the id of link to @param uri for storing in VtCell.hyperlink_idx
+ * @param detected - the link was found in the line text
+ * @return 0 if the link limit was exceeded */
+uint16_t Vt_intern_uri(Vt* self, const char* uri, bool detected);
+
 static inline bool VtRune_fg_is_default(const VtRune* rune)
 {
     return rune->fg_is_palette_entry && rune->fg_data.index == VT_RUNE_PALETTE_INDEX_TERM_DEFAULT;
@@ -1097,14 +1514,25 @@ static ColorRGB Vt_rune_cursor_ln_clr(const Vt* self, const VtRune* rune)
     }
 }
 
+/**
+ * Drop the reference a line outside of the synchronized update snapshot holds to cells it shares
+ * with it. The cells stay with the snapshot line */
+void Vt_release_shared_cells(Vt* self, VtLine* line);
+
+/**
+ * Free cells of a line, unless they still belong to the synchronized update snapshot */
+static inline void VtLine_destroy_cells(Vt* vt, VtLine* self)
+{
+    if (unlikely(self->cells_shared)) {
+        Vt_release_shared_cells(vt, self);
+    } else {
+        Vector_destroy_VtCell(&self->data);
+    }
+}
+
 static inline void VtLine_destroy(void* vt_, VtLine* self)
 {
     Vt* vt = vt_;
-    if (unlikely(self->links)) {
-        Vector_destroy_VtUri(self->links);
-        free(self->links);
-        self->links = NULL;
-    }
 
     if (unlikely(self->graphic_attachments)) {
         if (self->graphic_attachments->images) {
@@ -1123,8 +1551,9 @@ static inline void VtLine_destroy(void* vt_, VtLine* self)
     }
 
     CALL(vt->callbacks.destroy_proxy, vt->callbacks.user_data, &self->proxy);
-    Vector_destroy_VtRune(&self->data);
+    VtLine_destroy_cells(vt, self);
     RcPtr_destroy_VtCommand(&self->linked_command);
+    RcPtr_destroy_VtColdBlock(&self->cold_block);
 }
 
 static void VtImageSurface_destroy(void* vt_, VtImageSurface* self)
@@ -1155,23 +1584,12 @@ static void VtSixelSurface_destroy(void* _vt, VtSixelSurface* self)
     CALL(vt->callbacks.destroy_sixel_proxy, vt->callbacks.user_data, &self->proxy);
 }
 
-static uint16_t VtLine_add_link(VtLine* self, const char* link)
+/**
+ * Get the target of a link stored in a cell
+ * @return NULL if @param id is 0 */
+static inline const VtUri* Vt_uri_by_id(const Vt* self, uint16_t id)
 {
-    if (!self->links) {
-        self->links  = _malloc(sizeof(*self->links));
-        *self->links = Vector_new_with_capacity_VtUri(1);
-        Vector_push_VtUri(self->links, (VtUri){ .uri_string = strdup(link) });
-        return 0;
-    }
-
-    for (VtUri* i = NULL; (i = Vector_iter_VtUri(self->links, i));) {
-        if (i->uri_string && !strcmp(i->uri_string, link)) {
-            return Vector_index_VtUri(self->links, i);
-        }
-    }
-
-    Vector_push_VtUri(self->links, (VtUri){ .uri_string = strdup(link) });
-    return self->links->size - 1;
+    return id && id <= self->links.entries.size ? &self->links.entries.buf[id - 1] : NULL;
 }
 
 /**
@@ -1208,7 +1626,7 @@ static inline VtLine* Vt_line_at(Vt* self, size_t row)
     if (row > Vt_max_line(self)) {
         return NULL;
     }
-    return &self->lines.buf[row];
+    return Ring_at_VtLine(&self->lines, row);
 }
 
 /**
@@ -1218,12 +1636,47 @@ static inline const VtLine* Vt_line_at_const(const Vt* self, size_t row)
     if (row > Vt_max_line(self)) {
         return NULL;
     }
-    return &self->lines.buf[row];
+    return Ring_at_VtLine(&self->lines, row);
+}
+
+/**
+ * First row of the logical line (rows joined by soft wrapping) containing @param row */
+static inline size_t Vt_logical_line_first_row(const Vt* self, size_t row)
+{
+    while (row && Ring_at_VtLine(&self->lines, row - 1)->was_reflown) {
+        --row;
+    }
+    return row;
+}
+
+/**
+ * Last row of the logical line containing @param row */
+static inline size_t Vt_logical_line_last_row(const Vt* self, size_t row)
+{
+    while (row < Vt_max_line(self) && Ring_at_VtLine(&self->lines, row)->was_reflown) {
+        ++row;
+    }
+    return row;
+}
+
+/**
+ * Get the id of line at global index. Line ids count every line ever added to the buffer, so unlike
+ * global indices they do not change when lines are dropped from the front of scrollback */
+static inline size_t Vt_line_id(const Vt* self, size_t row)
+{
+    return self->lines.base + row;
+}
+
+/**
+ * Get global index of line with given id. The result is past Vt_max_line() if it was removed */
+static inline size_t Vt_line_id_to_row(const Vt* self, size_t line_id)
+{
+    return line_id - self->lines.base;
 }
 
 /**
  * Get cell at global position if it exists */
-static inline VtRune* Vt_at(Vt* self, uint16_t column, size_t row)
+static inline VtCell* Vt_at(Vt* self, uint16_t column, size_t row)
 {
     VtLine* line = Vt_line_at(self, row);
     if (!line || column >= line->data.size) {
@@ -1253,12 +1706,12 @@ const char* Vt_uri_range_at(Vt*            self,
 /* Get line under terminal cursor */
 static inline VtLine* Vt_cursor_line(const Vt* self)
 {
-    return &self->lines.buf[self->cursor.row];
+    return Ring_at_VtLine(&self->lines, self->cursor.row);
 }
 
 /**
  * Get cell under terminal cursor */
-static inline VtRune* Vt_cursor_cell(const Vt* self)
+static inline VtCell* Vt_cursor_cell(const Vt* self)
 {
     VtLine* cursor_line = Vt_cursor_line(self);
     if (self->cursor.col >= cursor_line->data.size) {
@@ -1269,7 +1722,7 @@ static inline VtRune* Vt_cursor_cell(const Vt* self)
 
 /**
  * Get cell at global coordinates */
-static inline VtRune* Vt_cell(Vt* self, size_t row, uint16_t col)
+static inline VtCell* Vt_cell(Vt* self, size_t row, uint16_t col)
 {
     VtLine* line = Vt_line_at(self, row);
 
@@ -1281,7 +1734,7 @@ static inline VtRune* Vt_cell(Vt* self, size_t row, uint16_t col)
         return NULL;
     }
 
-    return Vector_at_VtRune(&line->data, col);
+    return Vector_at_VtCell(&line->data, col);
 }
 
 /**
@@ -1308,8 +1761,9 @@ static inline size_t Vt_get_output_size(const Vt* self)
 void Vt_consumed_output(Vt* self, size_t len);
 
 /**
- * Get lines that should be visible */
-void Vt_get_visible_lines(const Vt* self, VtLine** out_begin, VtLine** out_end);
+ * Get range of line indices that should be visible, lines are accessed with
+ * Vt_get_visible_line() */
+void Vt_get_visible_lines(const Vt* self, size_t* out_begin, size_t* out_end);
 
 VtLine* Vt_get_visible_line(const Vt* self, size_t idx);
 
@@ -1493,10 +1947,6 @@ static inline void Vt_visual_scroll_page_down(Vt*      self,
  * Reset the visual viewport and stop scrolling if lowest position */
 void Vt_visual_scroll_reset(Vt* self);
 
-/**
- * Get a range of lines that should be visible */
-void Vt_get_visible_lines(const Vt* self, VtLine** out_begin, VtLine** out_end);
-
 /**
  * Initialize selection region to word by pixel in screen coordinates */
 void Vt_select_init_word(Vt* self, int32_t x, int32_t y);
@@ -1541,6 +1991,89 @@ void Vt_select_set_end_cell(Vt* self, int32_t x, int32_t y);
  * End selection */
 void Vt_select_end(Vt* self);
 
+/**
+ * Start typing a search pattern, matches are looked for from cell at global position @param row,
+ * @param col towards older lines if @param backward is set */
+void Vt_search_begin_input(Vt* self, size_t row, uint16_t col, bool backward);
+
+/**
+ * Add a character to the search pattern and search again from the origin */
+vt_search_result_e Vt_search_push_char(Vt* self, char32_t c);
+
+/**
+ * Remove the last character of the search pattern and search again from the origin */
+vt_search_result_e Vt_search_pop_char(Vt* self);
+
+/**
+ * Stop typing the search pattern, matches stay highlighted */
+void Vt_search_end_input(Vt* self);
+
+/**
+ * Jump to the next match in the search direction, or the opposite one if @param reverse is set */
+vt_search_result_e Vt_search_next(Vt* self, bool reverse);
+
+/**
+ * Toggle between plain text and regex search and search again from the origin */
+vt_search_result_e Vt_search_set_regex(Vt* self, bool regex);
+
+/**
+ * Does a search have work to do on the calling thread, Vt_search_step() should be called as soon
+ * as possible */
+static inline bool Vt_search_pending(const Vt* self)
+{
+    const struct Search* s = &self->search;
+
+    if (!s->active) {
+        return false;
+    } else if (!s->regex) {
+        return s->pending;
+    }
+
+    bool can_copy = !s->copied_to_top || s->copy_down_line_id < s->tail_line_id;
+    return s->regex_valid && can_copy &&
+           s->chunks_in_flight < VT_SEARCH_REGEX_MAX_CHUNKS_IN_FLIGHT;
+}
+
+/**
+ * Is the regex search worker processing lines. Results are collected by Vt_search_step() */
+static inline bool Vt_search_busy(const Vt* self)
+{
+    return self->search.active && self->search.chunks_in_flight;
+}
+
+/**
+ * Continue an unfinished search. For plain text scans up to VT_SEARCH_CHUNK_LINES more lines, for
+ * regex search collects matches from the worker thread and gives it more lines to process.
+ * Meant to be called when there is nothing else to do
+ * @return VT_SEARCH_RESULT_PENDING if the result of the last jump is not known yet or there was no
+ * jump waiting for a result */
+vt_search_result_e Vt_search_step(Vt* self);
+
+/**
+ * Find matches in the viewport and damage lines where the highlighted ranges changed. Called
+ * before the viewport is drawn */
+void Vt_search_update_highlights(Vt* self);
+
+/**
+ * End search and remove highlights */
+void Vt_search_end(Vt* self);
+
+/**
+ * Stop the regex search worker and free search data */
+void Vt_search_destroy(Vt* self);
+
+/**
+ * Add logical lines that left the screen to the search index */
+void Vt_search_index_update(Vt* self);
+
+/**
+ * Remove lines that are no longer in the buffer from the search index */
+void Vt_search_index_prune(Vt* self);
+
+/**
+ * Drop the search index, lines are indexed again as they leave the screen */
+void Vt_search_index_reset(Vt* self);
+
 /**
  * End synchronized update and display the current cell grid state instead of a previous snapshot */
 void Vt_end_synchronized_update(Vt* self);
@@ -1582,6 +2115,21 @@ static inline bool Vt_is_cell_selected(const Vt* const self, int32_t x, int32_t
     }
 }
 
+vt_search_highlight_e _vt_cell_search_highlight(const Vt* const self, int32_t x, int32_t y);
+
+/**
+ * Is a cell (in screen coordinates) part of a search match */
+static inline vt_search_highlight_e Vt_cell_search_highlight(const Vt* const self,
+                                                             int32_t         x,
+                                                             int32_t         y)
+{
+    if (likely(!self->search.highlights.size)) {
+        return VT_SEARCH_HIGHLIGHT_NONE;
+    } else {
+        return _vt_cell_search_highlight(self, x, y);
+    }
+}
+
 /**
  * Get cursor row in screen coordinates */
 static inline uint16_t Vt_cursor_row(const Vt* self)
@@ -1617,16 +2165,24 @@ static inline bool Vt_scroll_region_not_default(const Vt* self)
 }
 
 /**
- * Get UTF-8 encoded string from Vector_VtRune in a given range
+ * Get UTF-8 encoded string from Vector_VtCell in a given range
  * @param tail - append string to the end */
-Vector_char rune_vec_to_string(Vector_VtRune* line, size_t begin, size_t end, const char* opt_tail);
+Vector_char cell_vec_to_string(const Vt*     vt,
+                               Vector_VtCell* line,
+                               size_t         begin,
+                               size_t         end,
+                               const char*    opt_tail);
 
 /**
  * Get UTF-8 encoded string from VtLine in a given range
  * @param tail - append string to the end */
-static inline Vector_char VtLine_to_string(VtLine* line, size_t begin, size_t end, const char* tail)
+static inline Vector_char VtLine_to_string(const Vt*   vt,
+                                           VtLine*     line,
+                                           size_t      begin,
+                                           size_t      end,
+                                           const char* tail)
 {
-    return rune_vec_to_string(&line->data, begin, end, tail);
+    return cell_vec_to_string(vt, &line->data, begin, end, tail);
 }
 
 /**
@@ -1638,7 +2194,7 @@ static Vector_char Vt_line_to_string(const Vt*   self,
                                      size_t      end,
                                      const char* tail)
 {
-    return VtLine_to_string(&self->lines.buf[idx], begin, end, tail);
+    return VtLine_to_string(self, Ring_at_VtLine(&self->lines, idx), begin, end, tail);
 }
 
 /**
@@ -1676,16 +2232,65 @@ void Vt_shrink_scrollback(Vt* self);
 
 void Vt_clear_scrollback(Vt* self);
 
+/**
+ * Compress scrollback lines that are further than settings.scrollback_compress lines above the
+ * viewport */
+void Vt_freeze_cold_lines(Vt* self);
+
+/**
+ * Decompress characters of lines in the range (inclusive) if they were moved to the cold tier */
+void Vt_thaw_lines(Vt* self, size_t begin_line, size_t end_line);
+
+/**
+ * Decompress lines starting at @param begin_line and forget which were frozen, their contents are
+ * about to be moved around */
+void Vt_thaw_lines_from(Vt* self, size_t begin_line);
+
+/**
+ * Are there lines still laid out for an earlier window width */
+bool Vt_reflow_pending(Vt* self);
+
+/**
+ * Reflow a part of the scrollback that is still laid out for an earlier window width. Meant to be
+ * called when there is nothing else to do */
+void Vt_reflow_step(Vt* self);
+
+/**
+ * Reflow all lines still laid out for an earlier window width, e.g. before the entire buffer is
+ * exported. Large buffers are reflowed on multiple threads */
+void Vt_reflow_all(Vt* self);
+
+/**
+ * Write lines about to be removed from the front of the scrollback to the spill file
+ * @return number of lines that can be removed, whole blocks only */
+size_t Vt_spill_lines(Vt* self, size_t lines);
+
+/**
+ * Number of lines at the front of the buffer that were loaded back from the spill file */
+size_t Vt_spill_loaded_lines(Vt* self);
+
+/**
+ * Load the spilled block preceding the first line of the buffer back into it
+ * @return number of lines inserted at the front */
+size_t Vt_unspill_block(Vt* self);
+
+/**
+ * Forget all spilled lines */
+void Vt_spill_clear(Vt* self);
+
+void Vt_spill_destroy(Vt* self);
+
 /**
  * Notify that the terminal widget focus state changed */
 void Vt_focus_changed(Vt* self, bool current_state);
 
-Vector_char Vt_command_to_string(const Vt* self, const VtCommand* command, size_t opt_limit_lines);
+Vector_char Vt_command_to_string(Vt* self, const VtCommand* command, size_t opt_limit_lines);
 
 static bool Vt_ImageSurfaceView_is_visual_visible(const Vt* self, VtImageSurfaceView* view)
 {
-    return Vt_visual_top_line(self) <= view->anchor_global_index + view->cell_size.second &&
-           Vt_visual_bottom_line(self) >= view->anchor_global_index;
+    size_t row = Vt_line_id_to_row(self, view->anchor_line_id);
+    return Vt_visual_top_line(self) <= row + view->cell_size.second &&
+           Vt_visual_bottom_line(self) >= row;
 }
 
 static VtCommand* Vt_shell_integration_get_active_command(Vt* self)
@@ -1725,10 +2330,22 @@ static inline ColorRGBA Vt_rune_final_bg(const Vt*     self,
 {
     if (unlikely(Vt_is_cell_selected(self, x, y))) {
         return self->colors.highlight.bg;
-    } else if (rune) {
-        return is_cursor ? Vt_rune_cursor_bg(self, rune) : Vt_rune_bg(self, rune);
-    } else {
-        return settings.bg;
+    }
+
+    ColorRGBA bg = settings.bg;
+    if (rune) {
+        bg = is_cursor ? Vt_rune_cursor_bg(self, rune) : Vt_rune_bg(self, rune);
+    }
+
+    switch (Vt_cell_search_highlight(self, x, y)) {
+        case VT_SEARCH_HIGHLIGHT_CURRENT:
+            return self->colors.highlight.bg;
+        case VT_SEARCH_HIGHLIGHT_MATCH:
+            return ColorRGBA_new_from_blend(bg,
+                                            self->colors.highlight.bg,
+                                            VT_SEARCH_MATCH_BLEND_FACTOR);
+        default:
+            return bg;
     }
 }
 
@@ -1742,7 +2359,8 @@ static inline ColorRGB Vt_rune_final_fg(const Vt*     self,
     if (!settings.highlight_change_fg) {
         return Vt_rune_final_fg_apply_dim(self, rune, bg_color, is_cursor);
     } else {
-        if (unlikely(Vt_is_cell_selected(self, x, y))) {
+        if (unlikely(Vt_is_cell_selected(self, x, y) ||
+                     Vt_cell_search_highlight(self, x, y) == VT_SEARCH_HIGHLIGHT_CURRENT)) {
             return self->colors.highlight.fg;
         } else {
             return Vt_rune_final_fg_apply_dim(self, rune, bg_color, is_cursor);
@@ -1756,10 +2374,21 @@ static inline bool Vt_is_reporting_mouse(const Vt* self)
            self->modes.mouse_button_event || self->modes.mouse_sgr || self->modes.mouse_sgr_pixels;
 }
 
+/**
+ * Find links in the text of logical line containing @param row, unless that was done after it was
+ * last modified. Links set with OSC 8 take precedence */
+void Vt_uri_detect_line(Vt* self, size_t row);
+
+/**
+ * Find links in lines on the screen */
+void Vt_uri_detect_visible(Vt* self);
+
 /**
  * Get URI at cell in global coordinates */
 static inline const char* Vt_uri_at(Vt* self, uint16_t column, size_t row)
 {
+    Vt_uri_detect_line(self, row);
+
     VtLine* line;
     if (unlikely(Vt_synchronized_update_is_active(self) && row >= Vt_top_line(self))) {
         line =
@@ -1769,15 +2398,10 @@ static inline const char* Vt_uri_at(Vt* self, uint16_t column, size_t row)
         line = Vt_line_at(self, row);
     }
 
-    if (!line || !line->links || column >= line->data.size) {
-        return NULL;
-    }
-
-    VtRune* rune = &line->data.buf[column];
-
-    if (!rune->hyperlink_idx || rune->hyperlink_idx > (int16_t)line->links->size) {
+    if (!line || column >= line->data.size) {
         return NULL;
     }
 
-    return Vector_at_VtUri(line->links, rune->hyperlink_idx - 1)->uri_string;
+    const VtUri* uri = Vt_uri_by_id(self, line->data.buf[column].hyperlink_idx);
+    return uri ? uri->uri_string : NULL;
 }
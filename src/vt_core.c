@@ -22,6 +22,7 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <termios.h>
+#include <threads.h>
 #include <uchar.h>
 #include <unistd.h>
 
@@ -31,7 +32,9 @@ void               Vt_visual_scroll_to(Vt* self, size_t line, bool end_scroll_st
 void               Vt_visual_scroll_reset(Vt* self);
 static void        Vt_alt_buffer_on(Vt* self, bool save_mouse);
 static void        Vt_alt_buffer_off(Vt* self, bool save_mouse);
-static void        Vt_handle_multi_argument_SGR(Vt* self, Vector_char seq, VtRune* opt_target);
+static void        Vt_handle_multi_argument_SGR(Vt*                      self,
+                                                const vt_csi_sequence_t* csi,
+                                                VtRune*                  opt_target);
 static void        Vt_reset_text_attribs(Vt* self, VtRune* opt_target);
 static void        Vt_carriage_return(Vt* self);
 static void        Vt_clear_right(Vt* self);
@@ -55,14 +58,17 @@ static void        Vt_set_title(Vt* self, const char* title);
 static void        Vt_push_title(Vt* self);
 static void        Vt_pop_title(Vt* self);
 static void        Vt_insert_char_at_cursor(Vt* self, VtRune c);
-static void        Vt_insert_char_at_cursor_with_shift(Vt* self, VtRune c);
+static size_t      Vt_write_run(Vt* self, const char32_t* codes, size_t n, const VtRune* attrs);
+static void        Vt_insert_char_at_cursor_with_shift(Vt* self, VtCell c);
 static bool        Vt_alt_buffer_enabled(Vt* self);
 static inline void Vt_mark_proxy_fully_damaged(Vt* self, size_t idx);
 static void        Vt_mark_proxy_damaged_cell(Vt* self, size_t line, size_t rune);
 static void        Vt_init_tab_ruler(Vt* self);
 static void        Vt_reset_tab_ruler(Vt* self);
+static void        Vt_shift_line_index_refs(Vt* self, size_t point, int64_t delta, bool refs_only);
 
-static vt_line_damage_t VtLine_diff_to_damage(VtLine*           line_a,
+static vt_line_damage_t VtLine_diff_to_damage(const Vt*         vt,
+                                              VtLine*           line_a,
                                               VtLine*           line_b,
                                               vt_line_damage_t* damage)
 {
@@ -72,52 +78,53 @@ static vt_line_damage_t VtLine_diff_to_damage(VtLine*           line_a,
         };
     }
 
-    size_t max_size        = MAX(line_a->data.size, line_b->data.size);
-    size_t min_size        = MIN(line_a->data.size, line_b->data.size);
-    size_t dmg_range_begin = min_size;
-    size_t dmg_range_end   = 0;
-    bool   has_cell_diff   = false;
+    /* cells still shared with the synchronized update snapshot are the same */
+    bool             same_cells = line_a->data.buf == line_b->data.buf;
+    size_t           max_size   = same_cells ? 0 : MAX(line_a->data.size, line_b->data.size);
+    size_t           min_size   = same_cells ? 0 : MIN(line_a->data.size, line_b->data.size);
+    vt_line_damage_t diff       = { .type = VT_LINE_DAMAGE_NONE };
 
     for (size_t i = 0; i < min_size; ++i) {
-        VtRune* rune_a = &line_a->data.buf[i];
-        VtRune* rune_b = &line_b->data.buf[i];
+        VtCell* cell_a = &line_a->data.buf[i];
+        VtCell* cell_b = &line_b->data.buf[i];
 
-        if (memcmp(rune_a, rune_b, sizeof(VtRune))) {
-            dmg_range_begin = MIN(dmg_range_begin, i);
-            dmg_range_end   = MAX(dmg_range_end, i);
-            has_cell_diff   = true;
+        if (memcmp(cell_a, cell_b, sizeof(VtCell))) {
+            if (diff.type == VT_LINE_DAMAGE_NONE) {
+                vt_line_damage_set_range(&diff, i, i);
+            } else {
+                vt_line_damage_add_range(&diff, i, i);
+            }
         }
     }
 
     VtLine* longer_line = line_a->data.size > line_b->data.size ? line_a : line_b;
 
     for (size_t i = min_size; i < max_size; ++i) {
-        VtRune* rune = &longer_line->data.buf[i];
+        VtCell* cell = &longer_line->data.buf[i];
 
-        if (!Rune_is_blank(rune->rune) || !VtRune_bg_is_default(rune)) {
-            dmg_range_begin = MIN(dmg_range_begin, i);
-            dmg_range_end   = MAX(dmg_range_end, i);
-            has_cell_diff   = true;
+        if (!VtCell_is_blank(cell) || !VtRune_bg_is_default(Vt_cell_attrs(vt, cell))) {
+            if (diff.type == VT_LINE_DAMAGE_NONE) {
+                vt_line_damage_set_range(&diff, i, i);
+            } else {
+                vt_line_damage_add_range(&diff, i, i);
+            }
         }
     }
 
-    // merge cell diff damage with previous damage
-    switch (damage->type) {
-        case VT_LINE_DAMAGE_RANGE:
-            dmg_range_begin = MIN(dmg_range_begin, damage->front);
-            dmg_range_end   = MAX(dmg_range_end, damage->end);
-            break;
+    if (diff.type == VT_LINE_DAMAGE_RANGE) {
+        // merge cell diff damage with previous damage
+        switch (damage->type) {
+            case VT_LINE_DAMAGE_RANGE:
+                for (uint8_t i = 0; i < damage->n_ranges; ++i) {
+                    vt_line_damage_add_range(&diff, damage->ranges[i].front, damage->ranges[i].end);
+                }
+                break;
 
-            // TODO: other damage models
-        default:;
-    }
+                // TODO: other damage models
+            default:;
+        }
 
-    if (has_cell_diff) {
-        return (vt_line_damage_t){
-            .type  = VT_LINE_DAMAGE_RANGE,
-            .front = dmg_range_begin,
-            .end   = dmg_range_end,
-        };
+        return diff;
     } else if (damage->type != VT_LINE_DAMAGE_NONE) {
         return (vt_line_damage_t){
             .type = VT_LINE_DAMAGE_FULL,
@@ -136,6 +143,74 @@ static inline void Vt_maybe_emit_visual_scroll_change(Vt* self)
     }
 }
 
+/**
+ * Find the snapshot line owning cells shared with @param line
+ * @return NULL if not found */
+static VtLine* Vt_synchronized_update_cells_owner(Vt* self, const VtLine* line)
+{
+    Vector_VtLine* snapshot = &self->synchronized_update_state.lines;
+    for (VtLine* i = snapshot->buf; i < snapshot->buf + snapshot->size; ++i) {
+        if (i->cells_shared && i->data.buf == line->data.buf) {
+            return i;
+        }
+    }
+    return NULL;
+}
+
+void Vt_release_shared_cells(Vt* self, VtLine* line)
+{
+    VtLine* owner = Vt_synchronized_update_cells_owner(self, line);
+    if (owner) {
+        owner->cells_shared = false;
+    }
+    line->cells_shared = false;
+    line->data         = (Vector_VtCell){ 0 };
+}
+
+void Vt_unshare_line_cells(Vt* self, VtLine* line)
+{
+    const Vector_VtCell shared = line->data;
+    Vt_release_shared_cells(self, line);
+    line->data = Vector_new_with_capacity_VtCell(MAX(shared.size, 1));
+    Vector_pushv_VtCell(&line->data, shared.buf, shared.size);
+}
+
+static bool VtLine_shares_cells_with(const VtLine* self, const VtLine* owner)
+{
+    return self->cells_shared && self->data.buf == owner->data.buf;
+}
+
+/**
+ * Find the line that still shares cells with snapshot line @param owner. Lines usually stay where
+ * they were when the update started (@param hint) or move within the screen */
+static VtLine* Vt_synchronized_update_cells_sharer(Vt* self, const VtLine* owner, size_t hint)
+{
+    if (hint < self->lines.size &&
+        VtLine_shares_cells_with(Ring_at_VtLine(&self->lines, hint), owner)) {
+        return Ring_at_VtLine(&self->lines, hint);
+    }
+
+    for (size_t i = Vt_top_line(self); i <= MIN(Vt_bottom_line(self), Vt_max_line(self)); ++i) {
+        if (VtLine_shares_cells_with(Ring_at_VtLine(&self->lines, i), owner)) {
+            return Ring_at_VtLine(&self->lines, i);
+        }
+    }
+
+    Ring_VtLine* buffers[] = { &self->lines, &self->alt_lines };
+    for (uint_fast8_t i = 0; i < ARRAY_SIZE(buffers); ++i) {
+        if (!buffers[i]->buf) {
+            continue;
+        }
+        for (size_t j = 0; j < buffers[i]->size; ++j) {
+            if (VtLine_shares_cells_with(Ring_at_VtLine(buffers[i], j), owner)) {
+                return Ring_at_VtLine(buffers[i], j);
+            }
+        }
+    }
+
+    return NULL;
+}
+
 /* End synchronized update by merging previously cloned lines into their origins if alive and
  * calculate damage */
 void Vt_end_synchronized_update(Vt* self)
@@ -149,11 +224,23 @@ void Vt_end_synchronized_update(Vt* self)
         vt_synchronized_update_origin_t* origin = &self->synchronized_update_state.origins.buf[i];
 
         if (origin->alive) {
-            VtLine* origin_line = &self->lines.buf[origin->global_index];
-            origin_line->damage = VtLine_diff_to_damage(sync_line, origin_line, &sync_line->damage);
+            VtLine* origin_line = Ring_at_VtLine(&self->lines, origin->global_index);
+            origin_line->damage =
+              VtLine_diff_to_damage(self, sync_line, origin_line, &sync_line->damage);
             origin_line->proxy  = sync_line->proxy;
             memset(&sync_line->proxy, 0, sizeof(VtLineProxy));
         }
+
+        /* cells nothing wrote to go back to the line they came from */
+        if (sync_line->cells_shared) {
+            VtLine* sharer =
+              Vt_synchronized_update_cells_sharer(self, sync_line, origin->global_index);
+            if (sharer) {
+                sharer->cells_shared = false;
+                sync_line->data      = (Vector_VtCell){ 0 };
+            }
+            sync_line->cells_shared = false;
+        }
     }
 
     Vector_clear_VtLine(&self->synchronized_update_state.lines); // destroys proxy if not cleared
@@ -161,7 +248,36 @@ void Vt_end_synchronized_update(Vt* self)
     self->synchronized_update_state.snapshot_display_size = (Pair_uint16_t){ 0, 0 };
 }
 
-/* Begin synchronized update by cloning logical viewport lines */
+/**
+ * Copy of @param source for the synchronized update snapshot. The copy takes over the cells and
+ * @param source keeps using them until it is modified */
+static VtLine VtLine_clone_sharing_cells(VtLine* source)
+{
+    if (!source->data.buf) {
+        return VtLine_clone(source);
+    }
+
+    VtLine dest = *source;
+
+    if (RcPtr_get_VtCommand(&source->linked_command)) {
+        dest.linked_command = RcPtr_new_shared_VtCommand(&source->linked_command);
+    }
+
+    dest.cold_block = RcPtr_new_shared_VtColdBlock(&source->cold_block);
+
+    if (source->graphic_attachments) {
+        dest.graphic_attachments  = _malloc(sizeof(VtGraphicLineAttachments));
+        *dest.graphic_attachments = VtGraphicLineAttachments_clone(source->graphic_attachments);
+    }
+
+    dest.cells_shared    = true;
+    source->cells_shared = true;
+
+    return dest;
+}
+
+/* Begin synchronized update by taking over cells of logical viewport lines. They get copied back
+ * only if modified before the update ends */
 void Vt_start_synchronized_update(Vt* self)
 {
     if (unlikely(Vt_synchronized_update_is_active(self))) {
@@ -179,17 +295,15 @@ void Vt_start_synchronized_update(Vt* self)
         .second = Vt_row(self),
     };
 
-    VtLine* begin = self->lines.buf + Vt_top_line(self);
-    VtLine* end   = self->lines.buf + Vt_bottom_line(self);
-
-    for (VtLine* i = begin; i <= end; ++i) {
-        Vector_push_VtLine(&self->synchronized_update_state.lines, VtLine_clone(i));
+    for (size_t idx = Vt_top_line(self); idx <= Vt_bottom_line(self); ++idx) {
+        VtLine* i = Ring_at_VtLine(&self->lines, idx);
+        Vector_push_VtLine(&self->synchronized_update_state.lines, VtLine_clone_sharing_cells(i));
         i->damage.type  = VT_LINE_DAMAGE_PROXIES_MOVED_TO_CLONE;
         i->damage.front = self->synchronized_update_state.lines.size - 1;
         memset(&i->proxy, 0, sizeof(VtLineProxy));
         vt_synchronized_update_origin_t origin;
         origin.alive        = true;
-        origin.global_index = i - self->lines.buf;
+        origin.global_index = idx;
         Vector_push_vt_synchronized_update_origin_t(&self->synchronized_update_state.origins,
                                                     origin);
     }
@@ -213,31 +327,389 @@ static inline void Vt_synchronized_update_process_line_deletion(Vt* self, VtLine
     }
 }
 
-static inline VtLine VtLine_new()
+static inline void VtLine_strip_blanks(const Vt* vt, VtLine* self)
+{
+    for (VtCell* i = NULL; (i = Vector_last_VtCell(&self->data));) {
+        const VtRune* a = Vt_cell_attrs(vt, i);
+        if ((i->code == ' ' || i->code == '\0') && !i->hyperlink_idx && !a->invert &&
+            !a->underlined && !a->blinkng && !a->doubleunderline && !a->strikethrough &&
+            a->bg_is_palette_entry && a->bg_data.index == VT_RUNE_PALETTE_INDEX_TERM_DEFAULT &&
+            a->fg_is_palette_entry && a->fg_data.index == VT_RUNE_PALETTE_INDEX_TERM_DEFAULT) {
+            Vector_pop_VtCell(&self->data);
+        } else {
+            break;
+        }
+    }
+}
+
+static void VtRuneTable_init(VtRuneTable* self)
+{
+    self->entries  = Vector_new_VtRune();
+    self->n_slots  = 64;
+    self->slots    = _calloc(self->n_slots, sizeof(uint32_t));
+    self->last_idx = 0;
+}
+
+static void VtRuneTable_destroy(VtRuneTable* self)
+{
+    Vector_destroy_VtRune(&self->entries);
+    free(self->slots);
+    self->slots = NULL;
+}
+
+/* FNV-1a over the whole struct, keys are copied with memcpy so padding is hashed consistently */
+static inline uint32_t VtRune_hash(const VtRune* self)
+{
+    const uint8_t* bytes = (const uint8_t*)self;
+    uint32_t       hash  = 2166136261u;
+    for (size_t i = 0; i < sizeof(VtRune); ++i) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static void VtRuneTable_rehash(VtRuneTable* self, uint32_t n_slots)
+{
+    free(self->slots);
+    self->n_slots = n_slots;
+    self->slots   = _calloc(n_slots, sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < self->entries.size; ++i) {
+        uint32_t slot = VtRune_hash(&self->entries.buf[i]) & (n_slots - 1);
+        while (self->slots[slot]) {
+            slot = (slot + 1) & (n_slots - 1);
+        }
+        self->slots[slot] = i + 1;
+    }
+}
+
+/**
+ * Find or add @param key
+ * @return entry index or VT_CELL_TABLE_MAX_ENTRIES if the table is full */
+static uint32_t VtRuneTable_intern(VtRuneTable* self, const VtRune* key)
+{
+    if (likely(self->last_idx < self->entries.size) &&
+        !memcmp(&self->entries.buf[self->last_idx], key, sizeof(VtRune))) {
+        return self->last_idx;
+    }
+
+    uint32_t mask = self->n_slots - 1;
+    uint32_t slot = VtRune_hash(key) & mask;
+
+    for (; self->slots[slot]; slot = (slot + 1) & mask) {
+        uint32_t idx = self->slots[slot] - 1;
+        if (!memcmp(&self->entries.buf[idx], key, sizeof(VtRune))) {
+            return self->last_idx = idx;
+        }
+    }
+
+    if (unlikely(self->entries.size >= VT_CELL_TABLE_MAX_ENTRIES)) {
+        return VT_CELL_TABLE_MAX_ENTRIES;
+    }
+
+    Vector_push_VtRune(&self->entries, *key);
+    memcpy(Vector_last_VtRune(&self->entries), key, sizeof(VtRune));
+    self->slots[slot] = self->entries.size;
+    self->last_idx    = self->entries.size - 1;
+
+    if (self->entries.size * 2 > self->n_slots) {
+        VtRuneTable_rehash(self, self->n_slots * 2);
+    }
+
+    return self->last_idx;
+}
+
+static void VtUriTable_init(VtUriTable* self)
+{
+    self->entries  = Vector_new_VtUri();
+    self->n_slots  = 64;
+    self->slots    = _calloc(self->n_slots, sizeof(uint32_t));
+    self->last_idx = 0;
+}
+
+static void VtUriTable_destroy(VtUriTable* self)
+{
+    Vector_destroy_VtUri(&self->entries);
+    free(self->slots);
+    self->slots = NULL;
+}
+
+/* FNV-1a, detected links are kept apart from the ones set explicitly */
+static inline uint32_t VtUri_hash(const char* uri, bool detected)
+{
+    uint32_t hash = 2166136261u ^ detected;
+    for (const char* i = uri; *i; ++i) {
+        hash = (hash ^ (uint8_t)*i) * 16777619u;
+    }
+    return hash;
+}
+
+static inline bool VtUri_eq(const VtUri* self, const char* uri, bool detected)
+{
+    return self->detected == detected && !strcmp(self->uri_string, uri);
+}
+
+static void VtUriTable_rehash(VtUriTable* self, uint32_t n_slots)
+{
+    free(self->slots);
+    self->n_slots = n_slots;
+    self->slots   = _calloc(n_slots, sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < self->entries.size; ++i) {
+        const VtUri* e    = &self->entries.buf[i];
+        uint32_t     slot = VtUri_hash(e->uri_string, e->detected) & (n_slots - 1);
+        while (self->slots[slot]) {
+            slot = (slot + 1) & (n_slots - 1);
+        }
+        self->slots[slot] = i + 1;
+    }
+}
+
+/**
+ * Find or add a link
+ * @return entry index or VT_URI_TABLE_MAX_ENTRIES if the table is full */
+static uint32_t VtUriTable_intern(VtUriTable* self, const char* uri, bool detected)
+{
+    if (likely(self->last_idx < self->entries.size) &&
+        VtUri_eq(&self->entries.buf[self->last_idx], uri, detected)) {
+        return self->last_idx;
+    }
+
+    uint32_t mask = self->n_slots - 1;
+    uint32_t slot = VtUri_hash(uri, detected) & mask;
+
+    for (; self->slots[slot]; slot = (slot + 1) & mask) {
+        uint32_t idx = self->slots[slot] - 1;
+        if (VtUri_eq(&self->entries.buf[idx], uri, detected)) {
+            return self->last_idx = idx;
+        }
+    }
+
+    if (unlikely(self->entries.size >= VT_URI_TABLE_MAX_ENTRIES)) {
+        return VT_URI_TABLE_MAX_ENTRIES;
+    }
+
+    Vector_push_VtUri(&self->entries, (VtUri){ .uri_string = strdup(uri), .detected = detected });
+    self->slots[slot] = self->entries.size;
+    self->last_idx    = self->entries.size - 1;
+
+    if (self->entries.size * 2 > self->n_slots) {
+        VtUriTable_rehash(self, self->n_slots * 2);
+    }
+
+    return self->last_idx;
+}
+
+typedef enum
+{
+    VT_CELL_TABLE_ATTRS,
+    VT_CELL_TABLE_CLUSTERS,
+    VT_CELL_TABLE_URIS,
+} vt_cell_table_e;
+
+/**
+ * Mark table entries used by cells of a line with 1 or, if @param apply is set, replace stored
+ * indices with their values in @param remap */
+static void VtLine_remap_cell_table_refs(VtLine*         self,
+                                         uint32_t*       remap,
+                                         vt_cell_table_e table,
+                                         bool            apply)
+{
+    for (VtCell* c = self->data.buf; c < self->data.buf + self->data.size; ++c) {
+        if (table == VT_CELL_TABLE_ATTRS) {
+            if (apply) {
+                c->attrs_idx = remap[c->attrs_idx];
+            } else {
+                remap[c->attrs_idx] = 1;
+            }
+        } else if (table == VT_CELL_TABLE_URIS) {
+            if (apply) {
+                c->hyperlink_idx = remap[c->hyperlink_idx];
+            } else {
+                remap[c->hyperlink_idx] = 1;
+            }
+        } else if (VtCell_is_cluster(c)) {
+            if (apply) {
+                c->code = VT_CELL_CLUSTER_FLAG | remap[c->code & ~VT_CELL_CLUSTER_FLAG];
+            } else {
+                remap[c->code & ~VT_CELL_CLUSTER_FLAG] = 1;
+            }
+        }
+    }
+}
+
+static void Vt_remap_cell_table_refs(Vt* self, uint32_t* remap, vt_cell_table_e table, bool apply)
+{
+    Ring_VtLine*   buffers[] = { &self->lines, &self->alt_lines };
+    Vector_VtLine* snapshot  = &self->synchronized_update_state.lines;
+
+    for (uint_fast8_t i = 0; i < ARRAY_SIZE(buffers); ++i) {
+        for (size_t j = 0; buffers[i]->buf && j < buffers[i]->size; ++j) {
+            VtLine_remap_cell_table_refs(Ring_at_VtLine(buffers[i], j), remap, table, apply);
+        }
+    }
+
+    for (size_t j = 0; snapshot->buf && j < snapshot->size; ++j) {
+        if (!snapshot->buf[j].cells_shared) {
+            VtLine_remap_cell_table_refs(&snapshot->buf[j], remap, table, apply);
+        }
+    }
+}
+
+/**
+ * Remove entries of a cell table no cell refers to anymore and update indices stored in cells */
+__attribute__((cold)) static void Vt_compact_cell_table(Vt* self, bool clusters)
+{
+    VtRuneTable* table = clusters ? &self->cell_clusters : &self->cell_attrs;
+
+    /* used entries are marked with 1 and later replaced with their new index */
+    uint32_t* remap = _calloc(VT_CELL_TABLE_MAX_ENTRIES, sizeof(uint32_t));
+
+    vt_cell_table_e kind = clusters ? VT_CELL_TABLE_CLUSTERS : VT_CELL_TABLE_ATTRS;
+
+    remap[self->blank_space.attrs_idx] = !clusters;
+    Vt_remap_cell_table_refs(self, remap, kind, false);
+
+    uint32_t n_used = 0;
+    for (uint32_t i = 0; i < table->entries.size; ++i) {
+        if (remap[i]) {
+            table->entries.buf[n_used] = table->entries.buf[i];
+            remap[i]                   = n_used++;
+        }
+    }
+
+    Vt_remap_cell_table_refs(self, remap, kind, true);
+
+    if (!clusters) {
+        self->blank_space.attrs_idx = remap[self->blank_space.attrs_idx];
+    }
+
+    LOG("Vt::compact_cell_table{ %s: %zu -> %u }\n",
+        clusters ? "clusters" : "attributes",
+        table->entries.size,
+        n_used);
+
+    table->entries.size = n_used;
+    table->last_idx     = 0;
+    VtRuneTable_rehash(table, table->n_slots);
+    free(remap);
+}
+
+static uint16_t Vt_intern_attrs(Vt* self, const VtRune* rune)
+{
+    VtRune key;
+    memcpy(&key, rune, sizeof(key));
+    key.rune.code = 0;
+    memset(key.rune.combine, 0, sizeof(key.rune.combine));
+    key.hyperlink_idx = 0;
+
+    uint32_t idx = VtRuneTable_intern(&self->cell_attrs, &key);
+
+    if (unlikely(idx == VT_CELL_TABLE_MAX_ENTRIES)) {
+        Vt_compact_cell_table(self, false);
+        if ((idx = VtRuneTable_intern(&self->cell_attrs, &key)) == VT_CELL_TABLE_MAX_ENTRIES) {
+            WRN("Character attribute limit (%u) exceeded\n", VT_CELL_TABLE_MAX_ENTRIES);
+            idx = self->blank_space.attrs_idx;
+        }
+    }
+
+    return idx;
+}
+
+char32_t Vt_intern_cluster(Vt* self, Rune rune)
 {
-    VtLine line;
-    memset(&line, 0, sizeof(VtLine));
+    if (likely(!rune.combine[0])) {
+        return rune.code;
+    }
+
+    VtRune key;
+    memset(&key, 0, sizeof(key));
+    key.rune.code = rune.code;
+    memcpy(key.rune.combine, rune.combine, sizeof(key.rune.combine));
 
-    line.damage.type = VT_LINE_DAMAGE_FULL;
-    line.reflowable  = true;
-    line.data        = Vector_new_VtRune();
+    uint32_t idx = VtRuneTable_intern(&self->cell_clusters, &key);
+
+    if (unlikely(idx == VT_CELL_TABLE_MAX_ENTRIES)) {
+        Vt_compact_cell_table(self, true);
+        if ((idx = VtRuneTable_intern(&self->cell_clusters, &key)) == VT_CELL_TABLE_MAX_ENTRIES) {
+            WRN("Grapheme cluster limit (%u) exceeded\n", VT_CELL_TABLE_MAX_ENTRIES);
+            return rune.code;
+        }
+    }
 
-    return line;
+    return VT_CELL_CLUSTER_FLAG | idx;
 }
 
-static inline void VtLine_strip_blanks(VtLine* self)
+/**
+ * Remove links no cell refers to anymore and update ids stored in cells.
+ *
+ * Links are not reference counted. Cells are copied, overwritten and dropped in bulk all over the
+ * parser, reflow and scrollback code, counting would put a table update on every one of those
+ * paths, and a leaked count would keep a link forever. Unused entries only cost memory until the
+ * id space runs out, so they are found by walking all cells once it does, the same way the other
+ * cell tables are compacted. */
+__attribute__((cold)) static void Vt_compact_uri_table(Vt* self)
 {
-    for (VtRune* i = NULL; (i = Vector_last_VtRune(&self->data));) {
-        if ((i->rune.code == ' ' || i->rune.code == '\0') && !i->rune.combine[0] &&
-            !i->hyperlink_idx && !i->invert && !i->underlined && !i->blinkng &&
-            !i->doubleunderline && !i->strikethrough && i->bg_is_palette_entry &&
-            i->bg_data.index == VT_RUNE_PALETTE_INDEX_TERM_DEFAULT && i->fg_is_palette_entry &&
-            i->fg_data.index == VT_RUNE_PALETTE_INDEX_TERM_DEFAULT) {
-            Vector_pop_VtRune(&self->data);
+    VtUriTable* table = &self->links;
+
+    /* used ids are marked with 1 and later replaced with their new value */
+    uint32_t* remap = _calloc(VT_URI_TABLE_MAX_ENTRIES + 1, sizeof(uint32_t));
+
+    remap[self->active_hyperlink] = 1;
+    if (self->has_last_inserted_rune) {
+        remap[self->last_inserted.hyperlink_idx] = 1;
+    }
+    Vt_remap_cell_table_refs(self, remap, VT_CELL_TABLE_URIS, false);
+
+    uint32_t n_used = 0;
+    for (uint32_t i = 0; i < table->entries.size; ++i) {
+        if (remap[i + 1]) {
+            table->entries.buf[n_used] = table->entries.buf[i];
+            remap[i + 1]               = ++n_used;
         } else {
-            break;
+            VtUri_destroy(&table->entries.buf[i]);
+        }
+    }
+    remap[0] = 0;
+
+    Vt_remap_cell_table_refs(self, remap, VT_CELL_TABLE_URIS, true);
+    self->active_hyperlink = remap[self->active_hyperlink];
+    if (self->has_last_inserted_rune) {
+        self->last_inserted.hyperlink_idx = remap[self->last_inserted.hyperlink_idx];
+    }
+
+    LOG("Vt::compact_uri_table{ %zu -> %u }\n", table->entries.size, n_used);
+
+    table->entries.size = n_used;
+    table->last_idx     = 0;
+    VtUriTable_rehash(table, table->n_slots);
+    free(remap);
+}
+
+uint16_t Vt_intern_uri(Vt* self, const char* uri, bool detected)
+{
+    uint32_t idx = VtUriTable_intern(&self->links, uri, detected);
+
+    if (unlikely(idx == VT_URI_TABLE_MAX_ENTRIES)) {
+        Vt_compact_uri_table(self);
+        if ((idx = VtUriTable_intern(&self->links, uri, detected)) == VT_URI_TABLE_MAX_ENTRIES) {
+            WRN("Hyperlink limit (%u) exceeded\n", VT_URI_TABLE_MAX_ENTRIES);
+            return 0;
         }
     }
+
+    return idx + 1;
+}
+
+VtCell Vt_cell_from_rune(Vt* self, const VtRune* rune)
+{
+    /* interning the cluster can only compact the cluster table, the attribute index stays valid */
+    VtCell cell = {
+        .attrs_idx     = Vt_intern_attrs(self, rune),
+        .hyperlink_idx = rune->hyperlink_idx,
+    };
+    cell.code = Vt_intern_cluster(self, rune->rune);
+    return cell;
 }
 
 static void Vt_bell(Vt* self)
@@ -265,41 +737,28 @@ static inline void Vt_command_output_interrupted(Vt* self)
     self->shell_integration_state = VT_SHELL_INTEG_STATE_NONE;
 }
 
-static void Vt_uri_complete(Vt* self)
+/**
+ * Link cells from the start of the current match up to @param end_row, @param end_column
+ * (exclusive) */
+static void Vt_uri_complete(Vt* self, size_t end_row, uint16_t end_column)
 {
-    if (self->uri_matcher.start_row == self->cursor.row && self->cursor.col) {
-        for (uint16_t i = self->uri_matcher.start_column; i < self->cursor.col; ++i) {
-            VtRune* r = Vt_at(self, i, self->cursor.row);
-            if (r) {
-                r->hyperlink_idx =
-                  VtLine_add_link(Vt_cursor_line(self), self->uri_matcher.match.buf) + 1;
-            }
-        }
-    } else {
-        for (uint16_t i = self->uri_matcher.start_column; i < Vt_col(self); ++i) {
-            VtRune* r = Vt_at(self, i, self->uri_matcher.start_row);
-            if (r) {
-                r->hyperlink_idx = VtLine_add_link(Vt_line_at(self, self->uri_matcher.start_row),
-                                                   self->uri_matcher.match.buf) +
-                                   1;
-            }
-        }
-        for (size_t row = self->uri_matcher.start_row + 1; row < self->cursor.row; ++row) {
-            for (uint16_t i = 0; i < self->cursor.col; ++i) {
-                VtRune* r = Vt_at(self, i, row);
-                if (r) {
-                    r->hyperlink_idx =
-                      VtLine_add_link(Vt_line_at(self, row), self->uri_matcher.match.buf) + 1;
-                }
-            }
+    for (size_t row = self->uri_matcher.start_row; row <= end_row; ++row) {
+        VtLine*  line  = Ring_at_VtLine(&self->lines, row);
+        uint16_t begin = row == self->uri_matcher.start_row ? self->uri_matcher.start_column : 0;
+        uint16_t end   = row == end_row ? MIN(end_column, line->data.size) : line->data.size;
+
+        if (begin >= end) {
+            continue;
         }
-        for (uint16_t i = 0; i < self->cursor.col; ++i) {
-            VtRune* r = Vt_at(self, i, self->cursor.row);
-            if (r) {
-                r->hyperlink_idx =
-                  VtLine_add_link(Vt_cursor_line(self), self->uri_matcher.match.buf) + 1;
+
+        Vt_writable_line(self, line);
+        uint16_t idx = Vt_intern_uri(self, self->uri_matcher.match.buf, true);
+        for (uint16_t i = begin; i < end; ++i) {
+            if (!line->data.buf[i].hyperlink_idx) {
+                line->data.buf[i].hyperlink_idx = idx;
             }
         }
+        Vt_mark_line_proxy_fully_damaged(self, line);
     }
 
     LOG("Vt::uri_match: %s\n", self->uri_matcher.match.buf);
@@ -340,30 +799,34 @@ static inline bool isurl(char32_t c)
     return isalnum(c);
 }
 
-static void Vt_uri_break_match(Vt* self)
+/**
+ * End the current match before cell @param column in @param row */
+static void Vt_uri_break_match(Vt* self, size_t row, uint16_t column)
 {
     if (self->uri_matcher.state == VT_URI_MATCHER_PATH) {
         Vector_push_char(&self->uri_matcher.match, '\0');
-        Vt_uri_complete(self);
+        Vt_uri_complete(self, row, column);
     } else if (self->uri_matcher.state == VT_URI_MATCHER_SUFFIX_REFERENCE) {
         Vector_push_char(&self->uri_matcher.match, '\0');
         if (streq_glob(self->uri_matcher.match.buf, "www.*.*")) {
-            Vt_uri_complete(self);
+            Vt_uri_complete(self, row, column);
         }
     } else if (self->uri_matcher.state == VT_URI_MATCHER_AUTHORITY) {
         Vector_push_char(&self->uri_matcher.match, '\0');
         if (strstr(self->uri_matcher.match.buf, ".")) {
-            Vt_uri_complete(self);
+            Vt_uri_complete(self, row, column);
         }
     }
     self->uri_matcher.state = VT_URI_MATCHER_EMPTY;
     Vector_clear_char(&self->uri_matcher.match);
 }
 
-static void Vt_uri_next_char(Vt* self, char32_t c)
+/**
+ * Feed character @param c from cell @param column in @param row to the matcher */
+static void Vt_uri_next_char(Vt* self, char32_t c, size_t row, uint16_t column)
 {
     if (self->uri_matcher.match.size > UINT16_MAX) {
-        Vt_uri_break_match(self);
+        Vt_uri_break_match(self, row, column);
     }
 
     switch (self->uri_matcher.state) {
@@ -371,8 +834,8 @@ static void Vt_uri_next_char(Vt* self, char32_t c)
             if (c <= CHAR_MAX && isalpha(c)) {
                 Vector_push_char(&self->uri_matcher.match, c);
                 self->uri_matcher.state        = VT_URI_MATCHER_SCHEME;
-                self->uri_matcher.start_column = self->cursor.col;
-                self->uri_matcher.start_row    = self->cursor.row;
+                self->uri_matcher.start_column = column;
+                self->uri_matcher.start_row    = row;
             }
         } break;
 
@@ -401,7 +864,7 @@ static void Vt_uri_next_char(Vt* self, char32_t c)
                     Vector_push_char(&self->uri_matcher.match, c);
                     self->uri_matcher.state = VT_URI_MATCHER_SCHEME_COMPLETE;
                 } else {
-                    Vt_uri_break_match(self);
+                    Vt_uri_break_match(self, row, column);
                 }
 
             } else if (c == '.') {
@@ -411,10 +874,10 @@ static void Vt_uri_next_char(Vt* self, char32_t c)
                     Vector_push_char(&self->uri_matcher.match, c);
                     self->uri_matcher.state = VT_URI_MATCHER_SUFFIX_REFERENCE;
                 } else {
-                    Vt_uri_break_match(self);
+                    Vt_uri_break_match(self, row, column);
                 }
             } else {
-                Vt_uri_break_match(self);
+                Vt_uri_break_match(self, row, column);
             }
         } break;
 
@@ -423,7 +886,7 @@ static void Vt_uri_next_char(Vt* self, char32_t c)
                 Vector_push_char(&self->uri_matcher.match, c);
                 self->uri_matcher.state = VT_URI_MATCHER_FST_LEADING_SLASH;
             } else {
-                Vt_uri_break_match(self);
+                Vt_uri_break_match(self, row, column);
             }
         } break;
 
@@ -432,7 +895,7 @@ static void Vt_uri_next_char(Vt* self, char32_t c)
                 Vector_push_char(&self->uri_matcher.match, c);
                 self->uri_matcher.state = VT_URI_MATCHER_AUTHORITY;
             } else {
-                Vt_uri_break_match(self);
+                Vt_uri_break_match(self, row, column);
             }
         } break;
 
@@ -440,8 +903,10 @@ static void Vt_uri_next_char(Vt* self, char32_t c)
             if (c == '/') {
                 Vector_push_char(&self->uri_matcher.match, c);
                 self->uri_matcher.state = VT_URI_MATCHER_PATH;
-            } else {
+            } else if (isurl(c)) {
                 Vector_push_char(&self->uri_matcher.match, c);
+            } else {
+                Vt_uri_break_match(self, row, column);
             }
         } break;
 
@@ -450,12 +915,77 @@ static void Vt_uri_next_char(Vt* self, char32_t c)
             if (isurl(c)) {
                 Vector_push_char(&self->uri_matcher.match, c);
             } else {
-                Vt_uri_break_match(self);
+                Vt_uri_break_match(self, row, column);
             }
         } break;
     }
 }
 
+/**
+ * Remove links detected in the text of @param line
+ * @return any cells were linked */
+static bool Vt_clear_detected_links(Vt* self, VtLine* line)
+{
+    bool cleared = false;
+    for (uint16_t i = 0; i < line->data.size; ++i) {
+        const VtUri* uri = Vt_uri_by_id(self, line->data.buf[i].hyperlink_idx);
+        if (uri && uri->detected) {
+            Vt_writable_line(self, line);
+            line->data.buf[i].hyperlink_idx = 0;
+            cleared                         = true;
+        }
+    }
+    return cleared;
+}
+
+void Vt_uri_detect_line(Vt* self, size_t row)
+{
+    if (row > Vt_max_line(self) || Ring_at_VtLine(&self->lines, row)->uris_detected) {
+        return;
+    }
+
+    /* links can continue on wrapped rows */
+    size_t first = Vt_logical_line_first_row(self, row);
+    size_t last  = Vt_logical_line_last_row(self, row);
+
+    Vt_thaw_lines(self, first, last);
+
+    for (size_t i = first; i <= last; ++i) {
+        VtLine* line = Ring_at_VtLine(&self->lines, i);
+        if (Vt_clear_detected_links(self, line)) {
+            Vt_mark_line_proxy_fully_damaged(self, line);
+        }
+    }
+
+    for (size_t i = first; i <= last; ++i) {
+        VtLine* line = Ring_at_VtLine(&self->lines, i);
+        for (uint16_t col = 0; col < line->data.size; ++col) {
+            char32_t code = Vt_cell_code(self, &line->data.buf[col]);
+            if (code != VT_RUNE_CODE_WIDE_TAIL) {
+                Vt_uri_next_char(self, code ? code : ' ', i, col);
+            }
+        }
+    }
+    Vt_uri_break_match(self, last, Ring_at_VtLine(&self->lines, last)->data.size);
+
+    for (size_t i = first; i <= last; ++i) {
+        Ring_at_VtLine(&self->lines, i)->uris_detected = true;
+    }
+}
+
+void Vt_uri_detect_visible(Vt* self)
+{
+    if (Vt_synchronized_update_is_active(self)) {
+        return;
+    }
+
+    for (size_t row = Vt_visual_top_line(self);
+         row <= MIN(Vt_visual_bottom_line(self), Vt_max_line(self));
+         ++row) {
+        Vt_uri_detect_line(self, row);
+    }
+}
+
 static inline void Vt_about_to_delete_line(Vt* self, VtLine* line)
 {
     if (unlikely(line->damage.type == VT_LINE_DAMAGE_PROXIES_MOVED_TO_CLONE)) {
@@ -463,11 +993,14 @@ static inline void Vt_about_to_delete_line(Vt* self, VtLine* line)
     }
 }
 
-static inline void Vt_about_to_delete_line_by_scroll_up(Vt* self, size_t idx)
+/**
+ * Move the remaining parts of images from a line leaving the top of the screen (or scroll region)
+ * to the line that took its place */
+static inline void Vt_about_to_delete_line_by_scroll_up(Vt*     self,
+                                                        VtLine* src,
+                                                        VtLine* tgt,
+                                                        size_t  tgt_line_id)
 {
-    VtLine* src = &self->lines.buf[idx];
-    VtLine* tgt = &self->lines.buf[idx + 1];
-
     Vt_about_to_delete_line(self, src);
 
     if (unlikely(src->graphic_attachments && src->graphic_attachments->images)) {
@@ -475,8 +1008,8 @@ static inline void Vt_about_to_delete_line_by_scroll_up(Vt* self, size_t idx)
              (i = Vector_iter_RcPtr_VtImageSurfaceView(src->graphic_attachments->images, i));) {
             VtImageSurfaceView* view = RcPtr_get_VtImageSurfaceView(i);
             if (view && view->cell_size.second > 1) {
-                VtImageSurfaceView new_view  = Vt_crop_VtImageSurfaceView_top_by_line(self, view);
-                new_view.anchor_global_index = idx + 1;
+                VtImageSurfaceView new_view = Vt_crop_VtImageSurfaceView_top_by_line(self, view);
+                new_view.anchor_line_id     = tgt_line_id;
                 RcPtr_VtImageSurfaceView new_ptr        = RcPtr_new_VtImageSurfaceView(self);
                 *RcPtr_get_VtImageSurfaceView(&new_ptr) = new_view;
                 RcPtr_VtImageSurfaceView new_ptr2 = RcPtr_new_shared_VtImageSurfaceView(&new_ptr);
@@ -500,14 +1033,16 @@ static inline void Vt_about_to_delete_line_by_scroll_up(Vt* self, size_t idx)
 
 static inline void Vt_about_to_delete_line_by_scroll_down(Vt* self, size_t idx)
 {
-    VtLine* line = &self->lines.buf[idx];
+    VtLine* line = Ring_at_VtLine(&self->lines, idx);
     Vt_about_to_delete_line(self, line);
 
+    size_t line_id = Vt_line_id(self, idx);
+
     for (RcPtr_VtImageSurfaceView* i = NULL;
          (i = Vector_iter_RcPtr_VtImageSurfaceView(&self->image_views, i));) {
         VtImageSurfaceView* view = RcPtr_get_VtImageSurfaceView(i);
         if (view) {
-            while (view->cell_size.second > 1 && VtImageSurfaceView_spans_line(view, idx)) {
+            while (view->cell_size.second > 1 && VtImageSurfaceView_spans_line(view, line_id)) {
                 Vt_crop_VtImageSurfaceView_bottom_by_line(self, view);
             }
         }
@@ -619,7 +1154,7 @@ void Vt_clear_all_proxies(Vt* self)
     Vt_clear_proxies_in_region(self, 0, self->lines.size - 1);
     if (Vt_alt_buffer_enabled(self)) {
         for (size_t i = 0; i < self->alt_lines.size - 1; ++i) {
-            Vt_clear_line_proxy(self, &self->alt_lines.buf[i]);
+            Vt_clear_line_proxy(self, Ring_at_VtLine(&self->alt_lines, i));
         }
     }
 }
@@ -635,6 +1170,8 @@ void Vt_clear_all_image_proxies(Vt* self)
 
 Vector_char Vt_region_to_string(Vt* self, size_t begin_line, size_t end_line)
 {
+    Vt_thaw_lines(self, begin_line, end_line);
+
     Vector_char tmp, ret = Vt_line_to_string(self,
                                              begin_line,
                                              0,
@@ -643,7 +1180,7 @@ Vector_char Vt_region_to_string(Vt* self, size_t begin_line, size_t end_line)
     Vector_pop_char(&ret);
     for (size_t i = begin_line + 1; i < end_line; ++i) {
         tmp =
-          Vt_line_to_string(self, i, 0, Vt_col(self), self->lines.buf[i].was_reflown ? "" : "\n");
+          Vt_line_to_string(self, i, 0, Vt_col(self), Vt_line_at(self, i)->was_reflown ? "" : "\n");
         Vector_pushv_char(&ret, tmp.buf, tmp.size - 1);
         Vector_destroy_char(&tmp);
     }
@@ -911,27 +1448,13 @@ static Vector_Vector_char string_split_on(const char* str,
     return ret;
 }
 
-static inline bool is_csi_sequence_terminated(const char* seq, const size_t size)
+static inline bool is_string_sequence_terminated(const char* seq, const size_t size)
 {
-    if (unlikely(size > UINT16_MAX)) {
-        return true;
-    }
-
     if (!size) {
         return false;
     }
 
-    return isalpha(seq[size - 1]) || seq[size - 1] == '@' || seq[size - 1] == '{' ||
-           seq[size - 1] == '}' || seq[size - 1] == '~' || seq[size - 1] == '|';
-}
-
-static inline bool is_string_sequence_terminated(const char* seq, const size_t size)
-{
-    if (!size) {
-        return false;
-    }
-
-    return seq[size - 1] == '\a' || (size > 1 && seq[size - 2] == '\e' && seq[size - 1] == '\\');
+    return seq[size - 1] == '\a' || (size > 1 && seq[size - 2] == '\e' && seq[size - 1] == '\\');
 }
 
 static void Vt_reset_color_palette_entry(Vt* self, int16_t idx)
@@ -1014,8 +1537,6 @@ static void Vt_hard_reset(Vt* self)
     self->tabstop = 8;
     Vt_reset_tab_ruler(self);
 
-    Vt_uri_break_match(self);
-
     // TODO: Clear DECUDK
 }
 
@@ -1035,7 +1556,6 @@ static void Vt_soft_reset(Vt* self)
     self->scroll_region_bottom   = Vt_row(self) - 1;
     self->scroll_region_left     = 0;
     self->scroll_region_right    = Vt_col(self) - 1;
-    Vt_uri_break_match(self);
     Vector_clear_DynStr(&self->title_stack);
 }
 
@@ -1047,7 +1567,6 @@ void Vt_init(Vt* self, uint32_t cols, uint32_t rows)
     self->scroll_region_bottom = rows - 1;
     self->scroll_region_right  = cols - 1;
     self->parser.state         = PARSER_STATE_LITERAL;
-    self->parser.in_mb_seq     = false;
 
     self->colors.bg = settings.bg;
     self->colors.fg = settings.fg;
@@ -1057,15 +1576,22 @@ void Vt_init(Vt* self, uint32_t cols, uint32_t rows)
 
     Vt_reset_text_attribs(self, NULL);
 
-    memcpy(&self->blank_space, &self->parser.char_state, sizeof(VtRune));
+    VtRuneTable_init(&self->cell_attrs);
+    VtRuneTable_init(&self->cell_clusters);
+    VtUriTable_init(&self->links);
+    self->blank_space = Vt_cell_from_rune(self, &self->parser.char_state);
 
     self->parser.active_sequence = Vector_new_char();
     self->output                 = Vector_new_char();
     self->staged_output          = Vector_new_char();
-    self->lines                  = Vector_new_VtLine(self);
+    self->lines                  = Ring_new_VtLine(self);
+
+    self->cold_lines.thawed_blocks = Vector_new_RcPtr_VtColdBlock();
+    self->spill.blocks             = Vector_new_VtSpillBlock();
+    self->spill.fd                 = -1;
 
     for (size_t i = 0; i < self->ws.ws_row; ++i) {
-        Vector_push_VtLine(&self->lines, VtLine_new());
+        Ring_push_VtLine(&self->lines, VtLine_new());
     }
 
     switch (settings.initial_cursor_style) {
@@ -1119,6 +1645,9 @@ void Vt_init(Vt* self, uint32_t cols, uint32_t rows)
     self->shell_commands = Vector_new_RcPtr_VtCommand();
 
     self->unicode_input.buffer = Vector_new_char();
+    self->search.pattern       = Vector_new_char32_t();
+    self->search.highlights    = Vector_new_VtSearchHighlight();
+    self->search.matches       = Vector_new_VtSearchMatch();
 
     self->xterm_modify_keyboard      = VT_XT_MODIFY_KEYBOARD_DFT;
     self->xterm_modify_cursor_keys   = VT_XT_MODIFY_CURSOR_KEYS_DFT;
@@ -1147,9 +1676,32 @@ static inline void Vt_clear_all_tabstops(Vt* self)
     memset(self->tab_ruler, false, Vt_col(self));
 }
 
+static void Vt_reflow_visual_lines(Vt* self, uint32_t x);
+
+static inline void Vt_thaw_visual_lines(Vt* self)
+{
+    Vt_reflow_visual_lines(self, Vt_col(self));
+    Vt_thaw_lines(self, Vt_visual_top_line(self), Vt_visual_bottom_line(self));
+}
+
+/**
+ * Load lines removed from the scrollback back into the buffer when scrolling past its top
+ * @return number of lines inserted at the front */
+static size_t Vt_load_spilled_lines(Vt* self)
+{
+    size_t n = Vt_unspill_block(self);
+    if (n) {
+        Vt_shift_line_index_refs(self, 0, n, false);
+    }
+    return n;
+}
+
 bool Vt_visual_scroll_up(Vt* self, bool end_scroll_state_if_vp_in_sync)
 {
     if (self->scrolling_visual) {
+        if (!self->visual_scroll_top) {
+            Vt_load_spilled_lines(self);
+        }
         if (self->visual_scroll_top) {
             --self->visual_scroll_top;
         } else {
@@ -1162,6 +1714,7 @@ bool Vt_visual_scroll_up(Vt* self, bool end_scroll_state_if_vp_in_sync)
         }
         self->visual_scroll_top = Vt_top_line(self) - 1;
     }
+    Vt_thaw_visual_lines(self);
     return false;
 }
 
@@ -1169,6 +1722,7 @@ bool Vt_visual_scroll_down(Vt* self, bool end_scroll_state_if_vp_in_sync)
 {
     if (self->scrolling_visual && Vt_top_line(self) > self->visual_scroll_top) {
         ++self->visual_scroll_top;
+        Vt_thaw_visual_lines(self);
         if (self->visual_scroll_top == Vt_top_line(self)) {
             if (end_scroll_state_if_vp_in_sync) {
                 self->scrolling_visual = false;
@@ -1183,13 +1737,17 @@ bool Vt_visual_scroll_down(Vt* self, bool end_scroll_state_if_vp_in_sync)
 
 void Vt_visual_scroll_to(Vt* self, size_t line, bool end_scroll_state_if_vp_in_sync)
 {
-    line                    = MIN(line, Vt_top_line(self));
+    line = MIN(line, Vt_top_line(self));
+    if (!line) {
+        line += Vt_load_spilled_lines(self);
+    }
     self->visual_scroll_top = line;
 
     if (end_scroll_state_if_vp_in_sync) {
         self->scrolling_visual = line != Vt_top_line(self);
     }
 
+    Vt_thaw_visual_lines(self);
     Vt_end_synchronized_update(self);
 }
 
@@ -1204,254 +1762,400 @@ void Vt_start_visual_scroll(Vt* self)
     if (!self->scrolling_visual) {
         self->visual_scroll_top = Vt_top_line(self);
         self->scrolling_visual  = true;
+        Vt_thaw_visual_lines(self);
         Vt_end_synchronized_update(self);
     }
 }
 
-static void Vt_reflow_expand(Vt* self, uint32_t x)
+/**
+ * Reflow of a range of rows that does not modify anything outside of it, so jobs for disjoint
+ * ranges can run on separate threads */
+typedef struct
 {
-    size_t bottom_bound = self->cursor.row;
+    Vt*      vt;
+    size_t   begin, end;
+    uint32_t x;
 
-    int removals = 0;
+    /* new contents of the range */
+    Vector_VtLine out;
 
-    while (bottom_bound > 0 && self->lines.buf[bottom_bound].rejoinable) {
-        --bottom_bound;
-    }
+    /* lines joined into the line above them. Destroying them calls into the renderer, so this is
+     * left to the main thread */
+    Vector_VtLine merged;
 
-    for (size_t i = 0; i < bottom_bound; ++i) {
-        VtLine* srcline = &self->lines.buf[i + 1];
-        VtLine* tgtline = &self->lines.buf[i];
-
-        if (tgtline->data.size < x && tgtline->reflowable) {
-            int32_t chars_to_move = x - tgtline->data.size;
-            if (i + 1 < bottom_bound && srcline->rejoinable) {
-                chars_to_move = MIN(chars_to_move, (int32_t)srcline->data.size);
-
-                /* Copy uri strings to target line and convert uri idx-es to the new line */
-                if (srcline->links) {
-                    for (int32_t j = 0; j < chars_to_move; ++j) {
-                        VtRune*  r      = &srcline->data.buf[j];
-                        uint16_t srcidx = r->hyperlink_idx;
-                        if (srcidx && srcidx <= srcline->links->size) {
-                            const char* uri =
-                              Vector_at_VtUri(srcline->links, srcidx - 1)->uri_string;
-                            if (uri) {
-                                r->hyperlink_idx = VtLine_add_link(tgtline, uri) + 1;
-                            }
-                        }
-                    }
-                }
+    /* old row, old and new number of lines of every logical line that changed its size */
+    Vector_size_t resized;
 
-                /* Move the actual data */
-                Vector_pushv_VtRune(&tgtline->data, srcline->data.buf, chars_to_move);
-                Vector_remove_at_VtRune(&srcline->data, 0, chars_to_move);
+    bool damaged;
 
-                if (self->selection.mode == SELECT_MODE_NORMAL) {
-                    if (self->selection.begin_line == i + 1) {
-                        if (self->selection.begin_char_idx <= chars_to_move) {
-                            --self->selection.begin_line;
-                            self->selection.begin_char_idx =
-                              self->selection.begin_char_idx + tgtline->data.size - chars_to_move;
-                        } else {
-                            self->selection.begin_char_idx -= chars_to_move;
-                        }
-                    }
-                    if (self->selection.end_line == i + 1) {
-                        if (self->selection.end_char_idx < chars_to_move) {
-                            --self->selection.end_line;
-                            self->selection.end_char_idx =
-                              self->selection.end_char_idx + tgtline->data.size - chars_to_move;
-                        } else {
-                            self->selection.end_char_idx -= chars_to_move;
-                        }
-                    }
-                }
+    /* new positions of selection points in the range, relative to the start of out */
+    bool   selection_begin_set, selection_end_set;
+    size_t selection_begin_line, selection_end_line;
+    size_t selection_begin_char, selection_end_char;
+} VtReflowJob;
 
-                Vt_mark_proxy_fully_damaged(self, i);
-                Vt_mark_proxy_fully_damaged(self, i + 1);
+/**
+ * Lay out logical lines (a line together with all following ones marked as rejoinable) starting in
+ * rows [job->begin, job->end) for job->x columns. Both bounds must be at the start of a logical
+ * line and lines in the range can not be frozen. Logical lines are joined and split again, so the
+ * result does not depend on the width they had before. Rows in the range are left empty */
+static int VtReflowJob_run(void* job_)
+{
+    VtReflowJob* job  = job_;
+    Vt*          self = job->vt;
+    uint32_t     x    = job->x;
+    size_t       end  = job->end;
+
+    bool selection_normal = self->selection.mode == SELECT_MODE_NORMAL;
+
+    for (size_t row = job->begin; row < end;) {
+        size_t n_old = 1;
+        while (row + n_old < end && Ring_at_VtLine(&self->lines, row + n_old)->rejoinable) {
+            ++n_old;
+        }
+
+        bool reflowable = true;
+        for (size_t i = row; i < row + n_old; ++i) {
+            reflowable &= Ring_at_VtLine(&self->lines, i)->reflowable;
+        }
 
-                if (!srcline->data.size) {
-                    tgtline->was_reflown = false;
-                    size_t remove_index  = i + 1;
+        if (!reflowable) {
+            for (size_t i = row; i < row + n_old; ++i) {
+                Vector_push_VtLine(&job->out, *Ring_at_VtLine(&self->lines, i));
+                *Ring_at_VtLine(&self->lines, i) = (VtLine){ 0 };
+            }
+            row += n_old;
+            continue;
+        }
 
-                    if (srcline->mark_command_output_start)
-                        tgtline->mark_command_output_start = true;
-                    if (srcline->mark_command_output_end)
-                        tgtline->mark_command_output_end = true;
-                    if (srcline->mark_command_invoke)
-                        tgtline->mark_command_invoke = true;
-                    if (srcline->mark_explicit)
-                        tgtline->mark_explicit = true;
+        VtLine head = *Ring_at_VtLine(&self->lines, row);
 
-                    Vector_remove_at_VtLine(&self->lines, remove_index, 1);
-                    srcline = &self->lines.buf[i + 1];
-                    tgtline = &self->lines.buf[i];
+        *Ring_at_VtLine(&self->lines, row) = (VtLine){ 0 };
 
-                    Vt_shift_global_line_index_refs(self, remove_index + 1, -1, false);
+        /* selection points as offsets into the logical line */
+        int64_t sel_begin_offset = -1, sel_end_offset = -1;
+        if (selection_normal && self->selection.begin_line == row) {
+            sel_begin_offset = self->selection.begin_char_idx;
+        }
+        if (selection_normal && self->selection.end_line == row) {
+            sel_end_offset = self->selection.end_char_idx;
+        }
 
-                    if (self->lines.size - 1 < Vt_row(self)) {
-                        Vector_push_VtLine(&self->lines, VtLine_new());
-                    }
+        for (size_t i = row + 1; i < row + n_old; ++i) {
+            VtLine* part = Ring_at_VtLine(&self->lines, i);
 
-                    --bottom_bound;
-                    ++removals;
-                }
+            if (selection_normal && self->selection.begin_line == i) {
+                sel_begin_offset = head.data.size + self->selection.begin_char_idx;
+            }
+            if (selection_normal && self->selection.end_line == i) {
+                sel_end_offset = head.data.size + self->selection.end_char_idx;
             }
-        } // end should reflow
-    }
 
-    int underflow = -((int64_t)self->lines.size - Vt_row(self));
+            Vector_pushv_VtCell(&head.data, part->data.buf, part->data.size);
 
-    if (underflow > 0) {
-        for (int i = 0; i < (int)MIN(underflow, removals); ++i) {
-            Vector_push_VtLine(&self->lines, VtLine_new());
+            head.mark_explicit |= part->mark_explicit;
+            head.mark_command_invoke |= part->mark_command_invoke;
+            head.mark_command_output_start |= part->mark_command_output_start;
+            head.mark_command_output_end |= part->mark_command_output_end;
+
+            Vector_push_VtLine(&job->merged, *part);
+            *part = (VtLine){ 0 };
         }
-    }
 
-    /* do not scroll past end of screen (self->ws was not updated yet, so Vt_scroll_down does not
-     * prevent this) */
-    if (Vt_visual_top_line(self) > Vt_top_line(self)) {
-        Vt_visual_scroll_reset(self);
+        VtLine_strip_blanks(self, &head);
+
+        size_t n_new = head.data.size > x ? (head.data.size + x - 1) / x : 1;
+
+        if (n_new != 1 || n_old != 1) {
+            head.damage.type = VT_LINE_DAMAGE_FULL;
+            job->damaged     = true;
+        }
+
+        bool   output_end            = head.mark_command_output_end;
+        size_t head_idx              = job->out.size;
+        head.mark_command_output_end = false;
+        head.was_reflown             = n_new > 1;
+        Vector_push_VtLine(&job->out, (VtLine){ 0 });
+
+        for (size_t i = 1; i < n_new; ++i) {
+            VtLine part      = VtLine_new();
+            part.rejoinable  = true;
+            part.was_reflown = i + 1 < n_new;
+            Vector_pushv_VtCell(&part.data, head.data.buf + i * x, MIN(x, head.data.size - i * x));
+            Vector_push_VtLine(&job->out, part);
+        }
+
+        if (n_new > 1) {
+            Vector_pop_n_VtCell(&head.data, head.data.size - x);
+        }
+
+        *Vector_at_VtLine(&job->out, head_idx)                 = head;
+        Vector_last_VtLine(&job->out)->mark_command_output_end = output_end;
+
+        if (sel_begin_offset >= 0) {
+            size_t part               = MIN((size_t)sel_begin_offset / x, n_new - 1);
+            job->selection_begin_line = head_idx + part;
+            job->selection_begin_char = sel_begin_offset - part * x;
+            job->selection_begin_set  = true;
+        }
+        if (sel_end_offset >= 0) {
+            size_t part             = MIN((size_t)sel_end_offset / x, n_new - 1);
+            job->selection_end_line = head_idx + part;
+            job->selection_end_char = sel_end_offset - part * x;
+            job->selection_end_set  = true;
+        }
+
+        if (n_new != n_old) {
+            Vector_push_size_t(&job->resized, row);
+            Vector_push_size_t(&job->resized, n_old);
+            Vector_push_size_t(&job->resized, n_new);
+        }
+
+        row += n_old;
     }
+
+    return 0;
 }
 
-static void Vt_reflow_shrink(Vt* self, uint32_t x)
+/**
+ * Number of threads used to reflow @param n_lines lines */
+static size_t Vt_reflow_thread_count(size_t n_lines)
 {
-    size_t insertions_made = 0;
-    size_t bottom_bound    = self->cursor.row;
-
-    while (bottom_bound > 0 && self->lines.buf[bottom_bound].rejoinable) {
-        --bottom_bound;
+    if (n_lines < 2 * VT_REFLOW_PARALLEL_MIN_LINES) {
+        return 1;
     }
 
-    for (size_t i = 0; i < bottom_bound; ++i) {
-        VtLine* srcline = &self->lines.buf[i];
-        VtLine* tgtline = &self->lines.buf[i + 1];
+    long   n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t n      = MIN(n_lines / VT_REFLOW_PARALLEL_MIN_LINES, VT_REFLOW_MAX_THREADS);
+    return n_cpus > 1 ? MIN(n, (size_t)n_cpus) : 1;
+}
 
-        if (!srcline->was_reflown)
-            VtLine_strip_blanks(srcline);
+/**
+ * Lay out logical lines starting in rows [@param begin, @param end) for @param x columns. Large
+ * ranges are split at logical line boundaries and reflowed in parallel */
+static void Vt_reflow_lines(Vt* self, size_t begin, size_t end, uint32_t x)
+{
+    VtReflowJob jobs[VT_REFLOW_MAX_THREADS];
+    thrd_t      threads[VT_REFLOW_MAX_THREADS];
+    bool        started[VT_REFLOW_MAX_THREADS] = { false };
+    size_t      n_jobs                         = 0;
+    size_t      n_threads                      = Vt_reflow_thread_count(end - begin);
+
+    for (size_t i = 0, job_begin = begin; i < n_threads && job_begin < end; ++i) {
+        size_t job_end = i + 1 == n_threads ? end : begin + (end - begin) * (i + 1) / n_threads;
+        while (job_end < end && Ring_at_VtLine(&self->lines, job_end)->rejoinable) {
+            ++job_end;
+        }
+        job_end = MAX(job_end, job_begin);
+
+        if (job_end > job_begin) {
+            jobs[n_jobs++] = (VtReflowJob){
+                .vt      = self,
+                .begin   = job_begin,
+                .end     = job_end,
+                .x       = x,
+                .out     = Vector_new_with_capacity_VtLine(job_end - job_begin, self),
+                .merged  = Vector_new_VtLine(self),
+                .resized = Vector_new_size_t(),
+            };
+        }
+        job_begin = job_end;
+    }
 
-        if (srcline->data.size > x && srcline->reflowable) {
-            size_t chars_to_move = srcline->data.size - x;
+    /* the calling thread takes the first job */
+    for (size_t i = 1; i < n_jobs; ++i) {
+        started[i] = thrd_create(&threads[i], VtReflowJob_run, &jobs[i]) == thrd_success;
+    }
+    VtReflowJob_run(&jobs[0]);
+    for (size_t i = 1; i < n_jobs; ++i) {
+        if (started[i]) {
+            thrd_join(threads[i], NULL);
+        } else {
+            VtReflowJob_run(&jobs[i]);
+        }
+    }
 
-            /* move select to next line */
-            bool end_just_moved = false, begin_just_moved = false;
-            if (self->selection.mode == SELECT_MODE_NORMAL) {
-                if (self->selection.begin_char_idx > (int32_t)x &&
-                    self->selection.begin_line == i) {
-                    ++self->selection.begin_line;
-                    self->selection.begin_char_idx = self->selection.begin_char_idx - x;
-                    begin_just_moved               = true;
-                }
-                if (self->selection.end_char_idx > (int32_t)x && self->selection.end_line == i) {
-                    ++self->selection.end_line;
-                    self->selection.end_char_idx = self->selection.end_char_idx - x;
-                    end_just_moved               = true;
+    /* the range only holds empty lines now */
+    Vector_VtLine* out = &jobs[0].out;
+    for (size_t i = 1; i < n_jobs; ++i) {
+        jobs[i].selection_begin_line += out->size;
+        jobs[i].selection_end_line += out->size;
+        Vector_pushv_VtLine(out, jobs[i].out.buf, jobs[i].out.size);
+        jobs[i].out.size = 0;
+    }
+    Ring_remove_at_VtLine(&self->lines, begin, end - begin);
+    Ring_insertv_at_VtLine(&self->lines, begin, out->buf, out->size);
+    out->size = 0;
+
+    /* Going from the bottom keeps rows of logical lines above the current one valid. References
+     * to lines that were merged end up on the last line that remained */
+    for (size_t i = n_jobs; i--;) {
+        Vector_size_t* resized = &jobs[i].resized;
+        for (size_t j = resized->size; j;) {
+            size_t n_new = resized->buf[--j];
+            size_t n_old = resized->buf[--j];
+            size_t row   = resized->buf[--j];
+
+            if (n_new > n_old) {
+                Vt_shift_global_line_index_refs(self, row + n_old, n_new - n_old, false);
+            } else {
+                for (size_t k = 0; k < n_old - n_new; ++k) {
+                    Vt_shift_global_line_index_refs(self, row + n_new, -1, false);
                 }
             }
+        }
+    }
+
+    for (size_t i = 0; i < n_jobs; ++i) {
+        if (jobs[i].damaged) {
+            self->defered_events.action_performed = true;
+            self->defered_events.repaint          = true;
+        }
+        if (jobs[i].selection_begin_set) {
+            self->selection.begin_line     = begin + jobs[i].selection_begin_line;
+            self->selection.begin_char_idx = jobs[i].selection_begin_char;
+        }
+        if (jobs[i].selection_end_set) {
+            self->selection.end_line     = begin + jobs[i].selection_end_line;
+            self->selection.end_char_idx = jobs[i].selection_end_char;
+        }
+        Vector_destroy_VtLine(&jobs[i].out);
+        Vector_destroy_VtLine(&jobs[i].merged);
+        Vector_destroy_size_t(&jobs[i].resized);
+    }
+}
 
-            /* line below is a reflow already */
-            if (i + 1 < bottom_bound && tgtline->rejoinable) {
-                for (size_t ii = 0; ii < chars_to_move; ++ii) {
+/**
+ * Get the row below the last line that may still be laid out for an earlier width */
+static size_t Vt_reflow_pending_end(Vt* self)
+{
+    if (Vt_alt_buffer_enabled(self) || self->reflow_pending_end_line_id <= self->lines.base) {
+        return 0;
+    }
+    return MIN(Vt_line_id_to_row(self, self->reflow_pending_end_line_id), self->lines.size);
+}
 
-                    /* shift selection points right */
-                    if (self->selection.mode == SELECT_MODE_NORMAL) {
-                        if (self->selection.begin_line == i + 1 && !begin_just_moved)
-                            ++self->selection.begin_char_idx;
-                        if (self->selection.end_line == i + 1 && !end_just_moved)
-                            ++self->selection.end_char_idx;
-                    }
+bool Vt_reflow_pending(Vt* self)
+{
+    /* lines loaded back from the spill file keep the width they were written with */
+    return Vt_reflow_pending_end(self) > Vt_spill_loaded_lines(self);
+}
 
-                    VtRune* r = srcline->data.buf + x + chars_to_move - ii - 1;
+/**
+ * Reflow up to @param max_lines lines (rounded to whole logical lines) directly above the ones that
+ * are already laid out for @param x columns, but not lines above @param limit_row
+ * @return something was reflowed */
+static bool Vt_reflow_chunk(Vt* self, size_t limit_row, size_t max_lines, uint32_t x)
+{
+    size_t end   = Vt_reflow_pending_end(self);
+    size_t first = MAX(limit_row, Vt_spill_loaded_lines(self));
 
-                    /* update link idx-es */
-                    if (r->hyperlink_idx && srcline->links &&
-                        r->hyperlink_idx <= (uint16_t)srcline->links->size) {
-                        const char* uri = srcline->links->buf[r->hyperlink_idx - 1].uri_string;
-                        if (uri) {
-                            r->hyperlink_idx = VtLine_add_link(tgtline, uri) + 1;
-                        }
-                    }
+    if (end <= first) {
+        return false;
+    }
 
-                    Vector_insert_VtRune(&tgtline->data, tgtline->data.buf, *r);
-                }
-                Vt_mark_proxy_fully_damaged(self, i + 1);
-            } else if (i < bottom_bound) {
-                ++insertions_made;
-                size_t insert_index = i + 1;
-                Vector_insert_VtLine(&self->lines, self->lines.buf + insert_index, VtLine_new());
-                srcline = &self->lines.buf[i];
-                tgtline = &self->lines.buf[i + 1];
-
-                Vt_shift_global_line_index_refs(self, insert_index, 1, false);
-
-                ++bottom_bound;
-
-                /* update link idx-es */
-                for (size_t j = 0; j < chars_to_move; ++j) {
-                    VtRune* r = Vt_at(self, x + j, i);
-                    if (r && r->hyperlink_idx && srcline->links &&
-                        r->hyperlink_idx <= (uint16_t)srcline->links->size) {
-                        const char* uri = srcline->links->buf[r->hyperlink_idx - 1].uri_string;
-                        if (uri) {
-                            r->hyperlink_idx = VtLine_add_link(tgtline, uri) + 1;
-                        }
-                    }
-                }
+    size_t begin = MAX(first, end > max_lines ? end - max_lines : 0);
+    while (begin > Vt_spill_loaded_lines(self) && Ring_at_VtLine(&self->lines, begin)->rejoinable) {
+        --begin;
+    }
 
-                Vector_pushv_VtRune(&tgtline->data, srcline->data.buf + x, chars_to_move);
+    Vt_thaw_lines_from(self, begin);
+    Vt_reflow_lines(self, begin, end, x);
+    self->reflow_pending_end_line_id = Vt_line_id(self, begin);
 
-                if (srcline->mark_command_output_end) {
-                    srcline->mark_command_output_end = false;
-                    tgtline->mark_command_output_end = true;
-                }
+    return true;
+}
 
-                srcline->was_reflown = true;
-                tgtline->rejoinable  = true;
-            }
+/**
+ * Reflow lines in the viewport and one screen above it if they are still laid out for an earlier
+ * width */
+static void Vt_reflow_visual_lines(Vt* self, uint32_t x)
+{
+    for (;;) {
+        size_t top = MIN(Vt_visual_top_line(self), Vt_top_line(self));
+        if (!Vt_reflow_chunk(self, top > Vt_row(self) ? top - Vt_row(self) : 0, SIZE_MAX, x)) {
+            break;
         }
     }
+}
+
+void Vt_reflow_step(Vt* self)
+{
+    if (Vt_reflow_chunk(self, 0, VT_REFLOW_CHUNK_LINES, Vt_col(self)) && self->scrolling_visual) {
+        CALL(self->callbacks.on_repaint_required, self->callbacks.user_data);
+    }
+}
+
+void Vt_reflow_all(Vt* self)
+{
+    Vt_reflow_chunk(self, 0, SIZE_MAX, Vt_col(self));
+}
+
+/**
+ * Lay out lines for a new width. Only the lines around the viewport are reflowed immediately,
+ * older scrollback is reflowed when it is needed or in idle time */
+static void Vt_reflow(Vt* self, uint32_t x)
+{
+    size_t bottom_bound = self->cursor.row;
+    while (bottom_bound > 0 && Ring_at_VtLine(&self->lines, bottom_bound)->rejoinable) {
+        --bottom_bound;
+    }
 
-    if (self->lines.size - 1 != self->cursor.row) {
-        size_t overflow = self->lines.size > Vt_row(self) ? self->lines.size - Vt_row(self) : 0;
+    size_t old_size                  = self->lines.size;
+    self->reflow_pending_end_line_id = Vt_line_id(self, bottom_bound);
+    Vt_reflow_visual_lines(self, x);
+
+    if (self->lines.size > old_size) {
+        /* keep the cursor line where it was if there is empty space below it */
+        size_t insertions       = self->lines.size - old_size;
+        size_t overflow         = self->lines.size - MIN(self->lines.size, Vt_row(self));
         size_t whitespace_below = self->lines.size - 1 - self->cursor.row;
-        size_t to_pop           = MIN(overflow, MIN(whitespace_below, insertions_made));
-        Vector_pop_n_VtLine(&self->lines, to_pop);
+        Ring_pop_n_VtLine(&self->lines, MIN(overflow, MIN(whitespace_below, insertions)));
+    } else if (self->lines.size < Vt_row(self)) {
+        size_t underflow = MIN(Vt_row(self) - self->lines.size, old_size - self->lines.size);
+        for (size_t i = 0; i < underflow; ++i) {
+            Ring_push_VtLine(&self->lines, VtLine_new());
+        }
+    }
+
+    /* do not scroll past end of screen (self->ws was not updated yet, so Vt_scroll_down does not
+     * prevent this) */
+    if (Vt_visual_top_line(self) > Vt_top_line(self)) {
+        Vt_visual_scroll_reset(self);
     }
 }
 
 /**
- * Remove extra columns from all lines */
+ * Remove extra columns from all lines, except ones still waiting to be reflowed */
 static void Vt_trim_columns(Vt* self)
 {
-    for (uint16_t i = 0; i < self->lines.size; ++i) {
-        if (self->lines.buf[i].data.size > Vt_col(self)) {
+    for (size_t i = Vt_reflow_pending_end(self); i < self->lines.size; ++i) {
+        if (Ring_at_VtLine(&self->lines, i)->data.size > Vt_col(self)) {
             Vt_mark_proxy_fully_damaged(self, i);
 
             CALL(self->callbacks.destroy_proxy,
                  self->callbacks.user_data,
-                 &self->lines.buf[i].proxy);
+                 &Ring_at_VtLine(&self->lines, i)->proxy);
 
             size_t blanks = 0;
 
-            size_t s = self->lines.buf[i].data.size;
-            Vector_pop_n_VtRune(&self->lines.buf[i].data, s - Vt_col(self));
+            size_t s = Ring_at_VtLine(&self->lines, i)->data.size;
+            Vector_pop_n_VtCell(&Ring_at_VtLine(&self->lines, i)->data, s - Vt_col(self));
 
-            if (self->lines.buf[i].was_reflown) {
+            if (Ring_at_VtLine(&self->lines, i)->was_reflown) {
                 continue;
             }
 
-            s = self->lines.buf[i].data.size;
+            s = Ring_at_VtLine(&self->lines, i)->data.size;
 
             for (blanks = 0; blanks < s; ++blanks) {
-                if (!(self->lines.buf[i].data.buf[s - 1 - blanks].rune.code == ' ' &&
-                      ColorRGBA_eq(
-                        self->colors.bg,
-                        Vt_rune_bg(self, &self->lines.buf[i].data.buf[s - 1 - blanks])))) {
+                VtCell* cell = &Ring_at_VtLine(&self->lines, i)->data.buf[s - 1 - blanks];
+                if (!(cell->code == ' ' &&
+                      ColorRGBA_eq(self->colors.bg, Vt_rune_bg(self, Vt_cell_attrs(self, cell))))) {
                     break;
                 }
             }
-            Vector_pop_n_VtRune(&self->lines.buf[i].data, blanks);
+            Vector_pop_n_VtCell(&Ring_at_VtLine(&self->lines, i)->data, blanks);
         }
     }
 }
@@ -1464,6 +2168,15 @@ void Vt_resize(Vt* self, uint32_t x, uint32_t y)
 
     Vt_end_synchronized_update(self);
 
+    if (x != Vt_col(self)) {
+        /* lines loaded back from the spill file would get different ids after reflowing */
+        size_t n_loaded = Vt_spill_loaded_lines(self);
+        if (n_loaded) {
+            Ring_pop_front_n_VtLine(&self->lines, n_loaded);
+            Vt_shift_line_index_refs(self, n_loaded, -(int64_t)n_loaded, false);
+        }
+    }
+
     if (!self->alt_lines.buf) {
         Vt_trim_columns(self);
     }
@@ -1473,14 +2186,14 @@ void Vt_resize(Vt* self, uint32_t x, uint32_t y)
 
     static uint16_t ox = 0, oy = 0;
     if (x != ox || y != oy) {
+        Vt_search_index_reset(self);
         if (!self->alt_lines.buf && !Vt_scroll_region_not_default(self)) {
             if (self->selection.mode == SELECT_MODE_BOX) {
                 Vt_select_end(self);
             }
-            if (x < ox) {
-                Vt_reflow_shrink(self, x);
-            } else if (x > ox) {
-                Vt_reflow_expand(self, x);
+            if (x != ox) {
+                Vt_reflow(self, x);
+                self->search.reflowed = true;
             }
         } else {
             Vt_select_end(self);
@@ -1490,21 +2203,21 @@ void Vt_resize(Vt* self, uint32_t x, uint32_t y)
             if (self->cursor.row + to_pop > Vt_bottom_line(self)) {
                 to_pop -= self->cursor.row + to_pop - Vt_bottom_line(self);
             }
-            Vector_pop_n_VtLine(&self->lines, to_pop);
+            Ring_pop_n_VtLine(&self->lines, to_pop);
             if (self->alt_lines.buf) {
                 uint16_t to_pop_alt = Vt_row(self) - y;
                 if (self->alt_active_line + to_pop_alt > Vt_bottom_line_alt(self)) {
                     to_pop_alt -= self->alt_active_line + to_pop_alt - Vt_bottom_line_alt(self);
                 }
-                Vector_pop_n_VtLine(&self->alt_lines, to_pop_alt);
+                Ring_pop_n_VtLine(&self->alt_lines, to_pop_alt);
             }
         } else {
             for (uint16_t i = 0; i < y - Vt_row(self); ++i) {
-                Vector_push_VtLine(&self->lines, VtLine_new());
+                Ring_push_VtLine(&self->lines, VtLine_new());
             }
             if (self->alt_lines.buf) {
                 for (uint16_t i = 0; i < y - Vt_row(self); ++i) {
-                    Vector_push_VtLine(&self->alt_lines, VtLine_new());
+                    Ring_push_VtLine(&self->alt_lines, VtLine_new());
                 }
             }
         }
@@ -1529,6 +2242,12 @@ void Vt_resize(Vt* self, uint32_t x, uint32_t y)
     self->pixels_per_cell_x = (double)self->ws.ws_xpixel / Vt_col(self);
     self->pixels_per_cell_y = (double)self->ws.ws_ypixel / Vt_row(self);
 
+    /* the screen may have grown into lines that were not reflowed yet */
+    Vt_reflow_visual_lines(self, Vt_col(self));
+
+    /* cold lines must not become editable when the screen grows into the scrollback */
+    Vt_thaw_lines_from(self, Vt_top_line(self));
+
 #ifndef TEST_MODE
     if (self->master_fd > 1) {
         if (ioctl(self->master_fd, TIOCSWINSZ, &self->ws) < 0) {
@@ -1551,9 +2270,61 @@ void Vt_resize(Vt* self, uint32_t x, uint32_t y)
     Vt_init_tab_ruler(self);
 }
 
-static inline int32_t short_sequence_get_int_argument(const char* seq)
+/**
+ * Get a numeric parameter of a control sequence. Returns @param default_value if the parameter was
+ * omitted or not provided */
+static inline int32_t csi_sequence_get_int_argument(const vt_csi_sequence_t* seq,
+                                                    uint8_t                  idx,
+                                                    int32_t                  default_value)
+{
+    if (idx >= seq->n_params || seq->params[idx] == VT_CSI_PARAM_OMITTED) {
+        return default_value;
+    }
+    return seq->params[idx];
+}
+
+/**
+ * Write parameters of a control sequence to @param buf in their original form (sub-parameters are
+ * separated with ':', omitted parameters are left empty)
+ * @return number of characters written (not including the terminating null) */
+static size_t csi_sequence_format_params(const vt_csi_sequence_t* seq, char* buf, size_t size)
+{
+    size_t len = 0;
+    buf[0]     = '\0';
+
+    for (uint8_t i = 0; i < seq->n_params && len + 1 < size; ++i) {
+        if (i) {
+            buf[len++] = (seq->sub_param_mask & (1u << i)) ? ':' : ';';
+            buf[len]   = '\0';
+        }
+        if (seq->params[i] != VT_CSI_PARAM_OMITTED) {
+            int written = snprintf(buf + len, size - len, "%d", seq->params[i]);
+            len         = MIN(len + written, size - 1);
+        }
+    }
+
+    return len;
+}
+
+/**
+ * Get a printable representation of a control sequence for error messages. Returned string is
+ * valid until the next call */
+__attribute__((cold)) static const char* csi_sequence_to_string(const vt_csi_sequence_t* seq)
 {
-    return !seq ? 1 : *seq == 0 || seq[1] == 0 ? 1 : atoi(seq);
+    static char buf[VT_CSI_MAX_PARAMS * 12 + 8];
+    size_t      len = 0;
+
+    if (seq->private_marker) {
+        buf[len++] = seq->private_marker;
+    }
+    len += csi_sequence_format_params(seq, buf + len, sizeof(buf) - len - 4);
+    for (uint8_t i = 0; i < seq->n_intermediates; ++i) {
+        buf[len++] = seq->intermediates[i];
+    }
+    buf[len++] = seq->final;
+    buf[len]   = '\0';
+
+    return buf;
 }
 
 /*
@@ -1950,1589 +2721,1562 @@ static inline void Vt_handle_dec_mode(Vt* self, int code, bool on)
     }
 }
 
-__attribute__((hot)) static inline void Vt_handle_CSI(Vt* self, char c)
+/**
+ * Execute a complete control sequence */
+__attribute__((hot)) static void Vt_handle_CSI(Vt* self, const vt_csi_sequence_t* csi)
 {
-    Vector_push_char(&self->parser.active_sequence, c);
+    self->defered_events.repaint = true;
 
-    if (is_csi_sequence_terminated(self->parser.active_sequence.buf,
-                                   self->parser.active_sequence.size)) {
-        self->defered_events.repaint = true;
-        Vector_push_char(&self->parser.active_sequence, '\0');
-        char* seq        = self->parser.active_sequence.buf;
-        char  first_char = *seq;
-        char  last_char  = self->parser.active_sequence.buf[self->parser.active_sequence.size - 2];
-        char  second_last_char;
-        if (self->parser.active_sequence.size < 3) {
-            second_last_char = '\0';
-        } else {
-            second_last_char =
-              self->parser.active_sequence.buf[self->parser.active_sequence.size - 3];
-        }
-        bool is_single_arg = !strchr(seq, ';') && !strchr(seq, ':');
+    if (unlikely(csi->n_intermediates > 1)) {
+        WRN("Unknown CSI sequence: %s\n", csi_sequence_to_string(csi));
+        return;
+    }
+
+    char last_char     = csi->final;
+    char intermediate  = csi->n_intermediates ? csi->intermediates[0] : '\0';
+    bool is_single_arg = csi->n_params <= 1;
 
 #define MULTI_ARG_IS_ERROR                                                                         \
     if (!is_single_arg) {                                                                          \
-        WRN("Unexpected additional arguments for CSI sequence \'%s\'\n", seq);                     \
+        WRN("Unexpected additional arguments for CSI sequence \'%s\'\n",                          \
+            csi_sequence_to_string(csi));                                                          \
         break;                                                                                     \
     }
 
-        switch (first_char) {
+    switch (csi->private_marker) {
 
-            /* <ESC>[! ... */
-            case '!': {
-                switch (last_char) {
-                    /* <ESC>[!p - Soft terminal reset (DECSTR), VT220 and up. */
-                    case 'p': {
-                        Vt_soft_reset(self);
-                    } break;
+        /* <ESC>[? ... */
+        case '?': {
+            switch (intermediate) {
 
-                    default:
-                        WRN("Unknown CSI sequence: %s\n", seq);
-                }
-            } break;
+                /* <ESC>[? ... $ ... */
+                case '$': {
+                    switch (last_char) {
 
-            /* <ESC>[? ... */
-            case '?': {
-                switch (second_last_char) {
-
-                    /* <ESC>[? ... $ ... */
-                    case '$': {
-                        switch (last_char) {
-
-                            /* <ESC>[? Ps $p - Request DEC private mode (DECRQM). VT300 and up
-                             *
-                             * Ps - mode id as per DECSET/DECSET
-                             *
-                             * reply:
-                             *   CSI? <mode id>;<value> $y
-                             */
-                            case 'p': {
-                                /* Not recognized */
-                                int code;
-                                if (sscanf(seq, "?%d$p", &code) == 1) {
-                                    Vt_report_dec_mode(self, code);
-                                }
-                            } break;
+                        /* <ESC>[? Ps $p - Request DEC private mode (DECRQM). VT300 and up
+                         *
+                         * Ps - mode id as per DECSET/DECSET
+                         *
+                         * reply:
+                         *   CSI? <mode id>;<value> $y
+                         */
+                        case 'p': {
+                            int code = csi_sequence_get_int_argument(csi, 0, 0);
+                            if (code) {
+                                Vt_report_dec_mode(self, code);
+                            }
+                        } break;
 
-                            default:
-                                WRN("Unknown CSI sequence: %s\n", seq);
-                        }
-                    } break;
+                        default:
+                            WRN("Unknown CSI sequence: %s\n", csi_sequence_to_string(csi));
+                    }
+                } break;
 
-                    default:
-                        switch (last_char) {
-                            /* <ESC>[? Pm h - DEC Private Mode Set (DECSET) */
-                            case 'h':
-                            /* <ESC>[? Pm l - DEC Private Mode Reset (DECRST) */
-                            case 'l': {
-                                bool               is_enable = last_char == 'h';
-                                Vector_Vector_char tokens =
-                                  string_split_on(seq + 1, ";:", NULL, NULL);
-                                for (Vector_char* token = NULL;
-                                     (token = Vector_iter_Vector_char(&tokens, token));) {
-                                    errno         = 0;
-                                    uint32_t code = atoi(token->buf + 1);
-                                    if (code && !errno) {
-                                        Vt_handle_dec_mode(self, code, is_enable);
-                                    } else {
-                                        WRN("Invalid %s argument: \'%s\'\n",
-                                            is_enable ? "DECSET" : "DECRST",
-                                            token->buf + 1);
-                                    }
+                default:
+                    switch (last_char) {
+                        /* <ESC>[? Pm h - DEC Private Mode Set (DECSET) */
+                        case 'h':
+                        /* <ESC>[? Pm l - DEC Private Mode Reset (DECRST) */
+                        case 'l': {
+                            bool is_enable = last_char == 'h';
+                            for (uint8_t i = 0; i < csi->n_params; ++i) {
+                                int32_t code = csi->params[i];
+                                if (code > 0) {
+                                    Vt_handle_dec_mode(self, code, is_enable);
+                                } else {
+                                    WRN("Invalid %s argument: \'%d\'\n",
+                                        is_enable ? "DECSET" : "DECRST",
+                                        code);
                                 }
-                                Vector_destroy_Vector_char(&tokens);
-                            } break;
+                            }
+                        } break;
 
-                            /* <ESC>[? Ps i -  Media Copy (MC), DEC-specific */
-                            case 'i':
-                                break;
+                        /* <ESC>[? Ps i -  Media Copy (MC), DEC-specific */
+                        case 'i':
+                            break;
 
-                                /* <ESC>[? Ps S - Set or request graphics attribute (XTSMGRAPHICS),
-                                 * xterm/VT340+ */
-                            case 'S': {
-                                int32_t args[3];
-                                char *  s = seq + 1, *arg = NULL;
+                            /* <ESC>[? Ps S - Set or request graphics attribute (XTSMGRAPHICS),
+                             * xterm/VT340+ */
+                        case 'S': {
+                            int32_t args[3];
+                            for (uint8_t i = 0; i < ARRAY_SIZE(args); ++i) {
+                                args[i] = csi_sequence_get_int_argument(csi, i, 0);
+                            }
 
-                                for (int i = 0; i < 3; ++i) {
-                                    arg     = strsep(&s, ";");
-                                    args[i] = atoi(arg);
-                                }
+                            int32_t status = 0, value = 0, value2 = 0;
 
-                                int32_t status = 0, value = 0, value2 = 0;
+                            switch (args[0]) {
+                                case 1: /* number of color registers */
+                                    switch (args[1]) {
+                                        case 1: /* read */
+                                        case 2: /* reset */
+                                        case 4: /* get max value */
+                                            value = 256;
+                                            break;
+                                        case 3: /* set to args[2] */
+                                            value = 256;
+                                            break;
+                                        default:
+                                            status = 2;
+                                    }
+                                    break;
+                                case 2: /* sixel pixels */
+                                    switch (args[1]) {
+                                        case 1: /* read */
+                                        case 2: /* reset */
+                                        case 4: /* get max value */
+                                            value  = self->ws.ws_xpixel;
+                                            value2 = self->ws.ws_ypixel;
+                                            break;
+                                        case 3: /* set to args[2] */
+                                            break;
+                                        default:
+                                            status = 2;
+                                    }
+                                    break;
+                                case 3: /* regis pixels */
+                                    status = 3;
+                                    break;
+                                default:
+                                    status = 1;
+                            }
 
-                                switch (args[0]) {
-                                    case 1: /* number of color registers */
-                                        switch (args[1]) {
-                                            case 1: /* read */
-                                            case 2: /* reset */
-                                            case 4: /* get max value */
-                                                value = 256;
-                                                break;
-                                            case 3: /* set to args[2] */
-                                                value = 256;
-                                                break;
-                                            default:
-                                                status = 2;
-                                        }
-                                        break;
-                                    case 2: /* sixel pixels */
-                                        switch (args[1]) {
-                                            case 1: /* read */
-                                            case 2: /* reset */
-                                            case 4: /* get max value */
-                                                value  = self->ws.ws_xpixel;
-                                                value2 = self->ws.ws_ypixel;
-                                                break;
-                                            case 3: /* set to args[2] */
-                                                break;
-                                            default:
-                                                status = 2;
-                                        }
-                                        break;
-                                    case 3: /* regis pixels */
-                                        status = 3;
-                                        break;
-                                    default:
-                                        status = 1;
-                                }
+                            if (value2) {
+                                Vt_output_formated(self,
+                                                   "\e[?%d;%d;%d;%dS",
+                                                   args[0],
+                                                   status,
+                                                   value,
+                                                   value2);
+                            } else {
+                                Vt_output_formated(self, "\e[?%d;%d;%dS", args[0], status, value);
+                            }
+                        } break;
 
-                                if (value2) {
-                                    Vt_output_formated(self,
-                                                       "\e[?%d;%d;%d;%dS",
-                                                       args[0],
-                                                       status,
-                                                       value,
-                                                       value2);
-                                } else {
+                            /* <ESC>[? Ps n Device Status Report (DSR, DEC-specific) */
+                        case 'n': {
+                            int arg = csi_sequence_get_int_argument(csi, 0, 0);
+                            switch (arg) {
+                                case 6: { /* report cursor position */
                                     Vt_output_formated(self,
-                                                       "\e[?%d;%d;%dS",
-                                                       args[0],
-                                                       status,
-                                                       value);
-                                }
-                            } break;
-
-                                /* <ESC>[? Ps n Device Status Report (DSR, DEC-specific) */
-                            case 'n': {
-                                int arg = short_sequence_get_int_argument(seq);
-                                switch (arg) {
-                                    case 6: { /* report cursor position */
-                                        Vt_output_formated(self,
-                                                           "\e[?%u;%uR",
-                                                           Vt_cursor_row(self) + 1,
-                                                           self->cursor.col + 1);
-                                    } break;
-
-                                    case 15: /* Report Printer status */
-                                             /* not ready */
-                                        Vt_output(self, "\e[?11n", 6);
-                                        break;
+                                                       "\e[?%u;%uR",
+                                                       Vt_cursor_row(self) + 1,
+                                                       self->cursor.col + 1);
+                                } break;
 
-                                    case 26: /* Report keyboard status */
-                                             /* always report US */
-                                        Vt_output(self, "\e[?27;1;0;0n", 12);
-                                        break;
+                                case 15: /* Report Printer status */
+                                         /* not ready */
+                                    Vt_output(self, "\e[?11n", 6);
+                                    break;
 
-                                    case 53: /* Report locator status */
-                                             /* No locator (xterm not compiled-in) */
-                                        Vt_output(self, "\e[?50n", 6);
-                                        break;
+                                case 26: /* Report keyboard status */
+                                         /* always report US */
+                                    Vt_output(self, "\e[?27;1;0;0n", 12);
+                                    break;
 
-                                    case 56: /* Report locator type */
-                                             /* Cannot identify (xterm not compiled-in) */
-                                        Vt_output(self, "\e[?57;0n", 8);
-                                        break;
+                                case 53: /* Report locator status */
+                                         /* No locator (xterm not compiled-in) */
+                                    Vt_output(self, "\e[?50n", 6);
+                                    break;
 
-                                    case 85: /* Report multi-session configuration */
-                                        /* Device not configured for multi-session operation */
-                                        Vt_output(self, "\e[?83n", 6);
-                                        break;
+                                case 56: /* Report locator type */
+                                         /* Cannot identify (xterm not compiled-in) */
+                                    Vt_output(self, "\e[?57;0n", 8);
+                                    break;
 
-                                    default:
-                                        WRN("Unimplemented DSR sequence: %d\n", arg);
-                                }
-                            } break;
+                                case 85: /* Report multi-session configuration */
+                                    /* Device not configured for multi-session operation */
+                                    Vt_output(self, "\e[?83n", 6);
+                                    break;
 
-                            default:
-                                WRN("Unknown CSI sequence: %s\n", seq);
-                        }
-                }
-            } break;
+                                default:
+                                    WRN("Unimplemented DSR sequence: %d\n", arg);
+                            }
+                        } break;
 
-            /* <ESC>[> ... */
-            case '>': {
-                switch (last_char) {
-                    /* Report xterm name and version (XTVERSION)
-                     *   example: \eP>|XTerm(384)\e\ */
-                    case 'q': {
-                        MULTI_ARG_IS_ERROR;
-                        int arg = short_sequence_get_int_argument(seq);
-                        if (arg == 0) {
-                            Vt_output_formated(self, "\eP>|%s(%s)\e\\", APPLICATION_NAME, VERSION);
-                        }
-                    } break;
+                        default:
+                            WRN("Unknown CSI sequence: %s\n", csi_sequence_to_string(csi));
+                    }
+            }
+        } break;
 
-                        /* <ESC>[> Pp m / <ESC>[> Pp ; Pv m - Set/reset key modifier options
-                         * (XTMODKEYS)
-                         *
-                         * 0 => modifyKeyboard
-                         * 1 => modifyCursorKeys
-                         * 2 => modifyFunctionKeys
-                         * 4 => modifyOtherKeys */
-                    case 'm': {
-                        int resource, value;
-                        int nargs = sscanf(seq, "%d;%d", &resource, &value);
-                        if (nargs == EOF) {
-                            goto invalid;
-                        }
-                        if (!nargs) {
-                            self->xterm_modify_keyboard      = VT_XT_MODIFY_KEYBOARD_DFT;
-                            self->xterm_modify_cursor_keys   = VT_XT_MODIFY_CURSOR_KEYS_DFT;
-                            self->xterm_modify_function_keys = VT_XT_MODIFY_FUNCTION_KEYS_DFT;
-                            self->xterm_modify_other_keys    = VT_XT_MODIFY_OTHER_KEYS_DFT;
+        /* <ESC>[> ... */
+        case '>': {
+            switch (last_char) {
+                /* Report xterm name and version (XTVERSION)
+                 *   example: \eP>|XTerm(384)\e\ */
+                case 'q': {
+                    MULTI_ARG_IS_ERROR;
+                    int arg = csi_sequence_get_int_argument(csi, 0, 0);
+                    if (arg == 0) {
+                        Vt_output_formated(self, "\eP>|%s(%s)\e\\", APPLICATION_NAME, VERSION);
+                    }
+                } break;
+
+                    /* <ESC>[> Pp m / <ESC>[> Pp ; Pv m - Set/reset key modifier options
+                     * (XTMODKEYS)
+                     *
+                     * 0 => modifyKeyboard
+                     * 1 => modifyCursorKeys
+                     * 2 => modifyFunctionKeys
+                     * 4 => modifyOtherKeys */
+                case 'm': {
+                    int resource = csi_sequence_get_int_argument(csi, 0, 0);
+                    int value    = csi_sequence_get_int_argument(csi, 1, 0);
+                    int nargs    = csi->n_params;
+                    if (nargs >= 2 && csi->params[1] == VT_CSI_PARAM_OMITTED) {
+                        nargs = 1;
+                    }
+                    if (!nargs) {
+                        self->xterm_modify_keyboard      = VT_XT_MODIFY_KEYBOARD_DFT;
+                        self->xterm_modify_cursor_keys   = VT_XT_MODIFY_CURSOR_KEYS_DFT;
+                        self->xterm_modify_function_keys = VT_XT_MODIFY_FUNCTION_KEYS_DFT;
+                        self->xterm_modify_other_keys    = VT_XT_MODIFY_OTHER_KEYS_DFT;
+                        break;
+                    }
+
+                    switch (resource) {
+                        case 0:
+                            self->xterm_modify_keyboard =
+                              nargs == 2 ? value : VT_XT_MODIFY_KEYBOARD_DFT;
                             break;
-                        }
+                        case 1:
+                            self->xterm_modify_cursor_keys =
+                              nargs == 2 ? value : VT_XT_MODIFY_CURSOR_KEYS_DFT;
+                            break;
+                        case 2:
+                            self->xterm_modify_function_keys =
+                              nargs == 2 ? value : VT_XT_MODIFY_FUNCTION_KEYS_DFT;
+                            break;
+                        case 4:
+                            self->xterm_modify_other_keys =
+                              nargs == 2 ? value : VT_XT_MODIFY_OTHER_KEYS_DFT;
+                            break;
+                        default:
+                            goto invalid;
+                    }
 
-                        switch (resource) {
-                            case 0:
-                                self->xterm_modify_keyboard =
-                                  nargs == 2 ? value : VT_XT_MODIFY_KEYBOARD_DFT;
-                                break;
-                            case 1:
-                                self->xterm_modify_cursor_keys =
-                                  nargs == 2 ? value : VT_XT_MODIFY_CURSOR_KEYS_DFT;
-                                break;
-                            case 2:
-                                self->xterm_modify_function_keys =
-                                  nargs == 2 ? value : VT_XT_MODIFY_FUNCTION_KEYS_DFT;
-                                break;
-                            case 4:
-                                self->xterm_modify_other_keys =
-                                  nargs == 2 ? value : VT_XT_MODIFY_OTHER_KEYS_DFT;
-                                break;
-                            default:
-                                goto invalid;
-                        }
+                    break;
+                invalid:
+                    WRN("Invalid XTMODKEYS command \'%s\'\n", csi_sequence_to_string(csi));
+                } break;
 
-                        break;
-                    invalid:
-                        WRN("Invalid XTMODKEYS command \'%s\'\n", seq);
-                    } break;
+                    /* <ESC>[> Ps n - Disable key modifier options, xterm
+                     *
+                     * This control sequence corresponds to a resource value of "-1", which
+                     * cannot be set with the other sequence
+                     *
+                     * If the parameter is omitted, modifyFunctionKeys is disabled
+                     *
+                     * 0 => modifyKeyboard
+                     * 1 => modifyCursorKeys
+                     * 2 => modifyFunctionKeys
+                     * 4 => modifyOtherKeys */
+                case 'n': {
+                    MULTI_ARG_IS_ERROR
+                    int arg = csi_sequence_get_int_argument(csi, 0, 2);
+                    switch (arg) {
+                        case 0:
+                            self->xterm_modify_keyboard = -1;
+                            break;
+                        case 1:
+                            self->xterm_modify_cursor_keys = -1;
+                            break;
+                        case 2:
+                            self->xterm_modify_function_keys = -1;
+                            break;
+                        case 4:
+                            self->xterm_modify_other_keys = -1;
+                            break;
+                        default:
+                            WRN("Invalid XTMODKEYS command \'%s\'\n", csi_sequence_to_string(csi));
+                    }
+                } break;
 
-                        /* <ESC>[> Ps n - Disable key modifier options, xterm
-                         *
-                         * This control sequence corresponds to a resource value of "-1", which
-                         * cannot be set with the other sequence
-                         *
-                         * If the parameter is omitted, modifyFunctionKeys is disabled
-                         *
-                         * 0 => modifyKeyboard
-                         * 1 => modifyCursorKeys
-                         * 2 => modifyFunctionKeys
-                         * 4 => modifyOtherKeys */
-                    case 'n': {
-                        MULTI_ARG_IS_ERROR
-                        int arg = seq[1] == 'n' ? 2 : short_sequence_get_int_argument(seq);
+                /* <ESC>[ > Ps c - Send Device Attributes (Secondary DA) */
+                case 'c': {
+                    MULTI_ARG_IS_ERROR
+                    int arg = csi_sequence_get_int_argument(csi, 0, 0);
+                    if (arg == 0) {
+                        /* report VT100, firmware ver. 0, ROM number 0 */
+                        Vt_output_formated(self, "%s", "\e[>0;0;0c");
+                    }
+                } break;
+
+                /* <ESC>[ > Ps p - Set resource value pointerMode XTSMPOINTER (xterm)
+                 * 0 - never hide the pointer.
+                 * 1 - hide if the mouse tracking mode is not enabled.
+                 * 2 - always hide the pointer, except when leaving the window.
+                 * 3 - always hide the pointer, even if leaving/entering the window.
+                 */
+                case 'p': {
+                    MULTI_ARG_IS_ERROR
+                    int arg = csi_sequence_get_int_argument(csi, 0, 1);
+                    if (self->gui_pointer_mode != VT_GUI_POINTER_MODE_FORCE_HIDE &&
+                        self->gui_pointer_mode != VT_GUI_POINTER_MODE_FORCE_SHOW) {
                         switch (arg) {
                             case 0:
-                                self->xterm_modify_keyboard = -1;
+                                self->gui_pointer_mode = VT_GUI_POINTER_MODE_SHOW;
                                 break;
                             case 1:
-                                self->xterm_modify_cursor_keys = -1;
+                                self->gui_pointer_mode = VT_GUI_POINTER_MODE_SHOW_IF_REPORTING;
                                 break;
                             case 2:
-                                self->xterm_modify_function_keys = -1;
-                                break;
-                            case 4:
-                                self->xterm_modify_other_keys = -1;
+                            /* We don't control the pointer outside of the window anyway */
+                            case 3:
+                                self->gui_pointer_mode = VT_GUI_POINTER_MODE_HIDE;
                                 break;
                             default:
-                                WRN("Invalid XTMODKEYS command \'%s\'\n", seq);
+                                WRN("unknown XTSMPOINTER parameter \'%d\'\n", arg);
                         }
-                    } break;
+                    } else {
+                        WRN("XTSMPOINTER ignored because of user setting\n");
+                    }
+                } break;
 
-                    /* <ESC>[ > Ps c - Send Device Attributes (Secondary DA) */
-                    case 'c': {
-                        MULTI_ARG_IS_ERROR
-                        int arg = short_sequence_get_int_argument(seq);
-                        if (arg == 0) {
-                            /* report VT100, firmware ver. 0, ROM number 0 */
-                            Vt_output_formated(self, "%s", "\e[>0;0;0c");
-                        }
-                    } break;
+                default:
+                    WRN("Unknown CSI sequence: %s\n", csi_sequence_to_string(csi));
+            }
+        } break;
 
-                    /* <ESC>[ > Ps p - Set resource value pointerMode XTSMPOINTER (xterm)
-                     * 0 - never hide the pointer.
-                     * 1 - hide if the mouse tracking mode is not enabled.
-                     * 2 - always hide the pointer, except when leaving the window.
-                     * 3 - always hide the pointer, even if leaving/entering the window.
-                     */
-                    case 'p': {
-                        MULTI_ARG_IS_ERROR
-                        int arg = short_sequence_get_int_argument(seq);
-                        if (self->gui_pointer_mode != VT_GUI_POINTER_MODE_FORCE_HIDE &&
-                            self->gui_pointer_mode != VT_GUI_POINTER_MODE_FORCE_SHOW) {
+        /* <ESC>[= ... */
+        case '=': {
+            switch (last_char) {
+                /* <ESC>[ = Ps c - Send Device Attributes (Tertiary DA). */
+                case 'c': {
+                    MULTI_ARG_IS_ERROR
+                    int arg = csi_sequence_get_int_argument(csi, 0, 0);
+                    if (arg == 0) {
+                        Vt_output(self, "\e[?6c", 5);
+                    }
+                } break;
+
+                default:
+                    WRN("Unknown CSI sequence: %s\n", csi_sequence_to_string(csi));
+            }
+        } break;
+
+        /* <ESC>[... */
+        default: {
+            switch (intermediate) {
+                /* <ESC>[ .. ! ..  */
+                case '!':
+                    switch (last_char) {
+                        /* <ESC>[!p - Soft terminal reset (DECSTR), VT220 and up. */
+                        case 'p': {
+                            Vt_soft_reset(self);
+                        } break;
+
+                        default:
+                            WRN("Unknown CSI sequence: %s\n", csi_sequence_to_string(csi));
+                    }
+                    break;
+
+                /* <ESC>[ .. ; .. SP ?  */
+                case ' ':
+                    switch (last_char) {
+                        /* <ECS>[ Ps SP @ - Shift left Ps columns(s) (default = 1) (SL), ECMA-48
+                         */
+                        case '@': {
+                            STUB("SL");
+                        } break;
+
+                        /* <ESC>[ Ps SP A - Shift right Ps columns(s) (default = 1) (SR),
+                         * ECMA-48 */
+                        case 'A': {
+                            STUB("SR");
+                        } break;
+
+                        /* <ESC>[ Ps SP q - Set cursor style (DECSCUSR) */
+                        case 'q': {
+                            MULTI_ARG_IS_ERROR
+                            int arg = csi_sequence_get_int_argument(csi, 0, 0);
                             switch (arg) {
                                 case 0:
-                                    self->gui_pointer_mode = VT_GUI_POINTER_MODE_SHOW;
-                                    break;
                                 case 1:
-                                    self->gui_pointer_mode = VT_GUI_POINTER_MODE_SHOW_IF_REPORTING;
+                                    self->cursor.type     = CURSOR_BLOCK;
+                                    self->cursor.blinking = false;
                                     break;
                                 case 2:
-                                /* We don't control the pointer outside of the window anyway */
+                                    self->cursor.type     = CURSOR_BLOCK;
+                                    self->cursor.blinking = true;
+                                    break;
                                 case 3:
-                                    self->gui_pointer_mode = VT_GUI_POINTER_MODE_HIDE;
+                                    self->cursor.type     = CURSOR_UNDERLINE;
+                                    self->cursor.blinking = true;
+                                    break;
+                                case 4:
+                                    self->cursor.type     = CURSOR_UNDERLINE;
+                                    self->cursor.blinking = false;
+                                    break;
+                                case 5:
+                                    self->cursor.type     = CURSOR_BEAM;
+                                    self->cursor.blinking = true;
                                     break;
+                                case 6:
+                                    self->cursor.type     = CURSOR_BEAM;
+                                    self->cursor.blinking = false;
+                                    break;
+
                                 default:
-                                    WRN("unknown XTSMPOINTER parameter \'%d\'\n", arg);
+                                    WRN("Unknown DECSCUR code: %d\n", arg);
                             }
-                        } else {
-                            WRN("XTSMPOINTER ignored because of user setting\n");
-                        }
-                    } break;
-
-                    default:
-                        WRN("Unknown CSI sequence: %s\n", seq);
-                }
-            } break;
-
-            /* <ESC>[= ... */
-            case '=': {
-                switch (last_char) {
-                    /* <ESC>[ = Ps c - Send Device Attributes (Tertiary DA). */
-                    case 'c': {
-                        MULTI_ARG_IS_ERROR
-                        int arg = short_sequence_get_int_argument(seq);
-                        if (arg == 0) {
-                            Vt_output(self, "\e[?6c", 5);
-                        }
-                    } break;
-
-                    default:
-                        WRN("Unknown CSI sequence: %s\n", seq);
-                }
-            } break;
 
-            /* <ESC>[... */
-            default: {
-                switch (second_last_char) {
-                    /* <ESC>[ .. ; .. SP ?  */
-                    case ' ':
-                        switch (last_char) {
-                            /* <ECS>[ Ps SP @ - Shift left Ps columns(s) (default = 1) (SL), ECMA-48
-                             */
-                            case '@': {
-                                STUB("SL");
-                            } break;
-
-                            /* <ESC>[ Ps SP A - Shift right Ps columns(s) (default = 1) (SR),
-                             * ECMA-48 */
-                            case 'A': {
-                                STUB("SR");
-                            } break;
+                            self->defered_events.cursor_blink = true;
+                        } break;
+                    }
+                    break;
 
-                            /* <ESC>[ Ps SP q - Set cursor style (DECSCUSR) */
-                            case 'q': {
-                                MULTI_ARG_IS_ERROR
-                                int arg = short_sequence_get_int_argument(seq);
-                                switch (arg) {
-                                    case 0:
-                                    case 1:
-                                        self->cursor.type     = CURSOR_BLOCK;
-                                        self->cursor.blinking = false;
-                                        break;
-                                    case 2:
-                                        self->cursor.type     = CURSOR_BLOCK;
-                                        self->cursor.blinking = true;
-                                        break;
-                                    case 3:
-                                        self->cursor.type     = CURSOR_UNDERLINE;
-                                        self->cursor.blinking = true;
-                                        break;
-                                    case 4:
-                                        self->cursor.type     = CURSOR_UNDERLINE;
-                                        self->cursor.blinking = false;
-                                        break;
-                                    case 5:
-                                        self->cursor.type     = CURSOR_BEAM;
-                                        self->cursor.blinking = true;
-                                        break;
-                                    case 6:
-                                        self->cursor.type     = CURSOR_BEAM;
-                                        self->cursor.blinking = false;
-                                        break;
+                /* <ESC>[ .. ; .. "?  */
+                case '\"':
+                    switch (last_char) {
+                        /* <ESC>[ Ps "q - Select character protection attribute (DECSCA), VT220.
+                         *
+                         * 0 => DECSED and DECSEL can erase (default).
+                         * 1 => DECSED and DECSEL cannot erase.
+                         * 2 => DECSED and DECSEL can erase.
+                         */
+                        case 'q': {
+                            STUB("DECSCA");
+                        } break;
 
-                                    default:
-                                        WRN("Unknown DECSCUR code: %d\n", arg);
-                                }
+                        /* <ESC>[ Pl ; Pc "p - Set conformance level (DECSCL), VT220 and up.
+                         * (Pl)
+                         *   61 => level 1, e.g., VT100.
+                         *   62 => level 2, e.g., VT200.
+                         *   63 => level 3, e.g., VT300.
+                         *   64 => level 4, e.g., VT400.
+                         *   65 => level 5, e.g., VT500.
+                         * (Pc)
+                         *   0 => 8-bit controls.
+                         *   1 => 7-bit controls (DEC factory default).
+                         *   2 => 8-bit controls.
+                         */
+                        case 'p': {
+                            STUB("DECSCL");
+                        } break;
 
-                                self->defered_events.cursor_blink = true;
-                            } break;
-                        }
-                        break;
+                        default:
+                            WRN("Unknown CSI sequence: %s\n", csi_sequence_to_string(csi));
+                    }
+                    break;
 
-                    /* <ESC>[ .. ; .. "?  */
-                    case '\"':
-                        switch (last_char) {
-                            /* <ESC>[ Ps "q - Select character protection attribute (DECSCA), VT220.
-                             *
-                             * 0 => DECSED and DECSEL can erase (default).
-                             * 1 => DECSED and DECSEL cannot erase.
-                             * 2 => DECSED and DECSEL can erase.
-                             */
-                            case 'q': {
-                                STUB("DECSCA");
-                            } break;
+                /* <ESC>[ .. ; .. #?  */
+                case '#':
+                    switch (last_char) {
+                        /* <ESC>[ Pm #{ - Push video attributes onto stack (XTPUSHSGR), xterm.
+                         *
+                         * The optional parameters correspond to the SGR encoding for video
+                         * attributes, except for colors (which do not have a unique SGR code):
+                         * 1  => Bold
+                         * 2  => Faint
+                         * 3  => Italicized
+                         * 4  => Underlined
+                         * 5  => Blink
+                         * 7  => Inverse
+                         * 8  => Invisible
+                         * 9  => Crossed-out characters
+                         * 21 => Doubly-underlined
+                         * 30 => Foreground color
+                         * 31 => Background color
+                         */
+                        case '{': {
+                            MULTI_ARG_IS_ERROR
+                            STUB("XTPUSHSGR");
+                        } break;
 
-                            /* <ESC>[ Pl ; Pc "p - Set conformance level (DECSCL), VT220 and up.
-                             * (Pl)
-                             *   61 => level 1, e.g., VT100.
-                             *   62 => level 2, e.g., VT200.
-                             *   63 => level 3, e.g., VT300.
-                             *   64 => level 4, e.g., VT400.
-                             *   65 => level 5, e.g., VT500.
-                             * (Pc)
-                             *   0 => 8-bit controls.
-                             *   1 => 7-bit controls (DEC factory default).
-                             *   2 => 8-bit controls.
-                             */
-                            case 'p': {
-                                STUB("DECSCL");
-                            } break;
+                        /* <ESC>[ Pt ; Pl ; Pb ; Pr #|
+                         *
+                         * Report selected graphic rendition (XTREPORTSGR), xterm. The
+                         * response is an SGR sequence which contains the attributes which
+                         * are common to all cells in a rectangle. Pt ; Pl ; Pb ; Pr denotes
+                         * the rectangle.
+                         */
+                        case '|': {
+                            MULTI_ARG_IS_ERROR
+                            STUB("XTREPORTSGR");
+                        } break;
 
-                            default:
-                                WRN("Unknown CSI sequence: %s\n", seq);
-                        }
-                        break;
+                        /* <ESC>[#} - Pop video attributes from stack (XTPOPSGR), xterm.
+                         *
+                         * Popping restores the video-attributes which were saved using
+                         * XTPUSHSGR to their previous state.
+                         */
+                        case '}':
 
-                    /* <ESC>[ .. ; .. #?  */
-                    case '#':
-                        switch (last_char) {
-                            /* <ESC>[ Pm #{ - Push video attributes onto stack (XTPUSHSGR), xterm.
-                             *
-                             * The optional parameters correspond to the SGR encoding for video
-                             * attributes, except for colors (which do not have a unique SGR code):
-                             * 1  => Bold
-                             * 2  => Faint
-                             * 3  => Italicized
-                             * 4  => Underlined
-                             * 5  => Blink
-                             * 7  => Inverse
-                             * 8  => Invisible
-                             * 9  => Crossed-out characters
-                             * 21 => Doubly-underlined
-                             * 30 => Foreground color
-                             * 31 => Background color
-                             */
-                            case '{': {
-                                MULTI_ARG_IS_ERROR
-                                STUB("XTPUSHSGR");
-                            } break;
+                        /* <ESC>[#q - Alias for <ESC>[#} */
+                        case 'q': {
+                            MULTI_ARG_IS_ERROR
+                            STUB("XTPOPSGR");
+                        } break;
 
-                            /* <ESC>[ Pt ; Pl ; Pb ; Pr #|
-                             *
-                             * Report selected graphic rendition (XTREPORTSGR), xterm. The
-                             * response is an SGR sequence which contains the attributes which
-                             * are common to all cells in a rectangle. Pt ; Pl ; Pb ; Pr denotes
-                             * the rectangle.
-                             */
-                            case '|': {
-                                MULTI_ARG_IS_ERROR
-                                STUB("XTREPORTSGR");
-                            } break;
+                        /* <ESC>[ Pm #P - Push current dynamic and ANSI-palette colors onto
+                         * stack (XTPUSHCOLORS), xterm.
+                         *
+                         * Parameters (integers in the range 1 through 10, since the default 0
+                         * will push) may be used to store the palette into the stack without
+                         * pushing.
+                         */
+                        case 'P': {
+                            MULTI_ARG_IS_ERROR
+                            STUB("XTPUSHCOLORS");
+                        } break;
 
-                            /* <ESC>[#} - Pop video attributes from stack (XTPOPSGR), xterm.
-                             *
-                             * Popping restores the video-attributes which were saved using
-                             * XTPUSHSGR to their previous state.
-                             */
-                            case '}':
-
-                            /* <ESC>[#q - Alias for <ESC>[#} */
-                            case 'q': {
-                                MULTI_ARG_IS_ERROR
-                                STUB("XTPOPSGR");
-                            } break;
+                        /* <ESC>[ Pm #Q -  Pop stack to set dynamic- and ANSI-palette
+                         * colors (XTPOPCOLORS), xterm.
+                         *
+                         * Parameters (integers in the range 1 through 10, since the default
+                         * 0 will pop) may be used to restore the palette from the stack
+                         * without popping.
+                         */
+                        case 'Q': {
+                            MULTI_ARG_IS_ERROR
+                            STUB("XTPOPCOLORS");
+                        } break;
 
-                            /* <ESC>[ Pm #P - Push current dynamic and ANSI-palette colors onto
-                             * stack (XTPUSHCOLORS), xterm.
-                             *
-                             * Parameters (integers in the range 1 through 10, since the default 0
-                             * will push) may be used to store the palette into the stack without
-                             * pushing.
-                             */
-                            case 'P': {
-                                MULTI_ARG_IS_ERROR
-                                STUB("XTPUSHCOLORS");
-                            } break;
+                        /* <ESC> #R
+                         * Report the current entry on the palette stack, and the number of
+                         * palettes stored on the stack, using the same form as XTPOPCOLOR
+                         * (default = 0) (XTREPORTCOLORS), xterm.
+                         */
+                        case 'R': {
+                            MULTI_ARG_IS_ERROR
+                            STUB("XTREPORTCOLORS");
+                        } break;
 
-                            /* <ESC>[ Pm #Q -  Pop stack to set dynamic- and ANSI-palette
-                             * colors (XTPOPCOLORS), xterm.
-                             *
-                             * Parameters (integers in the range 1 through 10, since the default
-                             * 0 will pop) may be used to restore the palette from the stack
-                             * without popping.
-                             */
-                            case 'Q': {
-                                MULTI_ARG_IS_ERROR
-                                STUB("XTPOPCOLORS");
-                            } break;
+                        default:
+                            WRN("Unknown CSI sequence: %s\n", csi_sequence_to_string(csi));
+                    }
+                    break;
 
-                            /* <ESC> #R
-                             * Report the current entry on the palette stack, and the number of
-                             * palettes stored on the stack, using the same form as XTPOPCOLOR
-                             * (default = 0) (XTREPORTCOLORS), xterm.
-                             */
-                            case 'R': {
-                                MULTI_ARG_IS_ERROR
-                                STUB("XTREPORTCOLORS");
-                            } break;
+                /* <ESC>[ .. ; .. '?  */
+                case '\'':
+                    switch (last_char) {
 
-                            default:
-                                WRN("Unknown CSI sequence: %s\n", seq);
-                        }
-                        break;
+                        /* <ESC>[ Pt ; Pl ; Pb ; Pr 'w - Enable Filter Rectangle (DECEFR),
+                         * VT420 and up
+                         *
+                         * Parameters are [top;left;bottom;right]. Defines the coordinates
+                         * of a filter rectangle and activates it. Anytime the locator is
+                         * detected outside of the filter rectangle, an outside rectangle
+                         * event is generated and the rectangle is disabled. Filter
+                         * rectangles are always treated as "one-shot" events. Any
+                         * parameters that are omitted default to the current locator
+                         * position. If all parameters are omitted, any locator motion
+                         * will be reported. DECELR always cancels any previous rectangle
+                         * definition.
+                         */
+                        case 'w': {
+                            STUB("DECEFR");
+                        } break;
 
-                    /* <ESC>[ .. ; .. '?  */
-                    case '\'':
-                        switch (last_char) {
-
-                            /* <ESC>[ Pt ; Pl ; Pb ; Pr 'w - Enable Filter Rectangle (DECEFR),
-                             * VT420 and up
-                             *
-                             * Parameters are [top;left;bottom;right]. Defines the coordinates
-                             * of a filter rectangle and activates it. Anytime the locator is
-                             * detected outside of the filter rectangle, an outside rectangle
-                             * event is generated and the rectangle is disabled. Filter
-                             * rectangles are always treated as "one-shot" events. Any
-                             * parameters that are omitted default to the current locator
-                             * position. If all parameters are omitted, any locator motion
-                             * will be reported. DECELR always cancels any previous rectangle
-                             * definition.
-                             */
-                            case 'w': {
-                                STUB("DECEFR");
-                            } break;
+                        /* <ESC>[ Ps ; Pu 'z - Enable Locator Reporting (DECELR)
+                         * (Ps)
+                         *   0 => Locator disabled (default)
+                         *   1 => Locator enabled
+                         *   2 => Locator enabled for one report
+                         * (Pu) <coordinate unit>
+                         *   0, 2 => Cells (default)
+                         *   1    => Pixels
+                         */
+                        case 'z': {
+                            STUB("DECELR");
+                        } break;
 
-                            /* <ESC>[ Ps ; Pu 'z - Enable Locator Reporting (DECELR)
-                             * (Ps)
-                             *   0 => Locator disabled (default)
-                             *   1 => Locator enabled
-                             *   2 => Locator enabled for one report
-                             * (Pu) <coordinate unit>
-                             *   0, 2 => Cells (default)
-                             *   1    => Pixels
-                             */
-                            case 'z': {
-                                STUB("DECELR");
-                            } break;
+                        /* <ESC>[ Pm '{ - Select Locator Events (DECSLE)
+                         *
+                         * 0 => Explicit host request only (DECRQLP) (default)
+                         * 1 => on button down ON
+                         * 2 => on button down OFF
+                         * 3 => on button up ON
+                         * 4 => on button up OFF
+                         */
+                        case '{': {
+                            STUB("DECSLE");
+                        } break;
 
-                            /* <ESC>[ Pm '{ - Select Locator Events (DECSLE)
-                             *
-                             * 0 => Explicit host request only (DECRQLP) (default)
-                             * 1 => on button down ON
-                             * 2 => on button down OFF
-                             * 3 => on button up ON
-                             * 4 => on button up OFF
-                             */
-                            case '{': {
-                                STUB("DECSLE");
-                            } break;
+                        /* <ESC>[ Ps '| - Request Locator Position (DECRQLP)
+                         *
+                         * Valid values for the parameter are 0, 1 or omitted => transmit a
+                         * single DECLRP locator report.
+                         *
+                         * If Locator Reporting has been enabled by a DECELR, xterm will respond
+                         * with a DECLRP Locator Report.  This report is also generated on
+                         * button up and down events if they have been enabled with a DECSLE, or
+                         * when the locator is detected outside of a filter rectangle, if filter
+                         * rectangles have been enabled with a DECEFR.
+                         *
+                         * CSI Pe ; Pb ; Pr ; Pc ; Pp &w
+                         * Parameters are [event;button;row;column;page].
+                         * Valid values for the event:
+                         * (Pe)
+                         *   0  =>  locator unavailable - no other parameters sent.
+                         *   1  =>  request - xterm received a DECRQLP.
+                         *   2  =>  left button down.
+                         *   3  =>  left button up.
+                         *   4  =>  middle button down.
+                         *   5  =>  middle button up.
+                         *   6  =>  right button down.
+                         *   7  =>  right button up.
+                         *   8  =>  M4 button down.
+                         *   9  =>  M4 button up.
+                         *   10 =>  locator outside filter rectangle.
+                         *
+                         * The "button" parameter is a bitmask indicating which buttons are
+                         * pressed: Pb = 0  =>  no buttons down. Pb & 1  =>  right button down.
+                         * Pb & 2  =>  middle button down.
+                         * Pb & 4  =>  left button down.
+                         * Pb & 8  =>  M4 button down.
+                         *
+                         * The "row" and "column" parameters are the coordinates of the locator
+                         * position in the xterm window, encoded as ASCII decimal. The "page"
+                         * parameter is not used by xterm.
+                         */
+                        case '|': {
+                            /* locator unavailable */
+                            Vt_output(self, "\e[0&w", 5);
+                        } break;
 
-                            /* <ESC>[ Ps '| - Request Locator Position (DECRQLP)
-                             *
-                             * Valid values for the parameter are 0, 1 or omitted => transmit a
-                             * single DECLRP locator report.
-                             *
-                             * If Locator Reporting has been enabled by a DECELR, xterm will respond
-                             * with a DECLRP Locator Report.  This report is also generated on
-                             * button up and down events if they have been enabled with a DECSLE, or
-                             * when the locator is detected outside of a filter rectangle, if filter
-                             * rectangles have been enabled with a DECEFR.
-                             *
-                             * CSI Pe ; Pb ; Pr ; Pc ; Pp &w
-                             * Parameters are [event;button;row;column;page].
-                             * Valid values for the event:
-                             * (Pe)
-                             *   0  =>  locator unavailable - no other parameters sent.
-                             *   1  =>  request - xterm received a DECRQLP.
-                             *   2  =>  left button down.
-                             *   3  =>  left button up.
-                             *   4  =>  middle button down.
-                             *   5  =>  middle button up.
-                             *   6  =>  right button down.
-                             *   7  =>  right button up.
-                             *   8  =>  M4 button down.
-                             *   9  =>  M4 button up.
-                             *   10 =>  locator outside filter rectangle.
-                             *
-                             * The "button" parameter is a bitmask indicating which buttons are
-                             * pressed: Pb = 0  =>  no buttons down. Pb & 1  =>  right button down.
-                             * Pb & 2  =>  middle button down.
-                             * Pb & 4  =>  left button down.
-                             * Pb & 8  =>  M4 button down.
-                             *
-                             * The "row" and "column" parameters are the coordinates of the locator
-                             * position in the xterm window, encoded as ASCII decimal. The "page"
-                             * parameter is not used by xterm.
-                             */
-                            case '|': {
-                                /* locator unavailable */
-                                Vt_output(self, "\e[0&w", 5);
-                            } break;
+                        /* <ESC>['} - Insert Ps Column(s) (default = 1) (DECIC), VT420 and up */
+                        case '}': {
+                            // TODO: vmargins
+                            STUB("DECIC");
+                        } break;
 
-                            /* <ESC>['} - Insert Ps Column(s) (default = 1) (DECIC), VT420 and up */
-                            case '}': {
-                                // TODO: vmargins
-                                STUB("DECIC");
-                            } break;
+                        /* <ESC>['~ - Delete Ps Column(s) (default = 1) (DECDC), VT420 and up */
+                        case '~': {
+                            // TODO: vmargins
+                            STUB("DECDC");
+                        } break;
 
-                            /* <ESC>['~ - Delete Ps Column(s) (default = 1) (DECDC), VT420 and up */
-                            case '~': {
-                                // TODO: vmargins
-                                STUB("DECDC");
-                            } break;
+                        default:
+                            WRN("Unknown CSI sequence: %s\n", csi_sequence_to_string(csi));
+                    }
+                    break;
 
-                            default:
-                                WRN("Unknown CSI sequence: %s\n", seq);
-                        }
-                        break;
+                /* <ESC>[ .. ; .. * ..  */
+                case '*':
+                    switch (last_char) {
+                        /* <ESC>[ Ps *x - Select Attribute Change Extent (DECSACE), VT420 and up
+                         * (Ps)
+                         *   0, 1 => from start to end position, wrapped
+                         *   2    => rectangle (exact)
+                         */
+                        case 'x': {
+                            MULTI_ARG_IS_ERROR
+                            STUB("DECSACE");
+                        } break;
 
-                    /* <ESC>[ .. ; .. * ..  */
-                    case '*':
-                        switch (last_char) {
-                            /* <ESC>[ Ps *x - Select Attribute Change Extent (DECSACE), VT420 and up
-                             * (Ps)
-                             *   0, 1 => from start to end position, wrapped
-                             *   2    => rectangle (exact)
-                             */
-                            case 'x': {
-                                MULTI_ARG_IS_ERROR
-                                STUB("DECSACE");
-                            } break;
+                        /* <ESC>[ Pi ; Pg ; Pt ; Pl ; Pb ; Pr *y
+                         * Request Checksum of Rectangular Area (DECRQCRA), VT420 and up
+                         *
+                         * Response is DCS Pi ! ~ x x x x ST Pi is the request id. Pg is the
+                         * page number. Pt ; Pl ; Pb ; Pr denotes the rectangle. The x's are
+                         * hexadecimal digits 0-9 and A-F.
+                         */
+                        case 'y': {
+                            STUB("DECRQCRA");
+                        } break;
 
-                            /* <ESC>[ Pi ; Pg ; Pt ; Pl ; Pb ; Pr *y
-                             * Request Checksum of Rectangular Area (DECRQCRA), VT420 and up
-                             *
-                             * Response is DCS Pi ! ~ x x x x ST Pi is the request id. Pg is the
-                             * page number. Pt ; Pl ; Pb ; Pr denotes the rectangle. The x's are
-                             * hexadecimal digits 0-9 and A-F.
-                             */
-                            case 'y': {
-                                STUB("DECRQCRA");
-                            } break;
+                        /* <ESC>[*| - Select number of lines per screen (DECSNLS), VT420 and up
+                         */
+                        case '|': {
+                            STUB("DECSNLS");
+                        } break;
 
-                            /* <ESC>[*| - Select number of lines per screen (DECSNLS), VT420 and up
-                             */
-                            case '|': {
-                                STUB("DECSNLS");
-                            } break;
+                        default:
+                            WRN("Unknown CSI sequence: %s\n", csi_sequence_to_string(csi));
+                    }
+                    break;
 
-                            default:
-                                WRN("Unknown CSI sequence: %s\n", seq);
-                        }
-                        break;
+                /* <ESC>[ .. ; .. $ ..  */
+                case '$':
+                    switch (last_char) {
 
-                    /* <ESC>[ .. ; .. $ ..  */
-                    case '$':
-                        switch (last_char) {
-
-                            /* <ESC>[ Ps $p - Request ANSI mode (DECRQM). VT300 and up
-                             *
-                             * reply: CSI ? <DECSET/DECRT code>; <value> $ y
-                             *
-                             * value:
-                             * 0 => not recognized
-                             * 1 => enabled
-                             * 2 => disabled
-                             * 3 => permanently enabled
-                             * 4 => permanently disabled
-                             */
-                            case 'p': {
-                                int arg = short_sequence_get_int_argument(seq);
-                                Vt_report_dec_mode(self, arg);
-                            } break;
+                        /* <ESC>[ Ps $p - Request ANSI mode (DECRQM). VT300 and up
+                         *
+                         * reply: CSI ? <DECSET/DECRT code>; <value> $ y
+                         *
+                         * value:
+                         * 0 => not recognized
+                         * 1 => enabled
+                         * 2 => disabled
+                         * 3 => permanently enabled
+                         * 4 => permanently disabled
+                         */
+                        case 'p': {
+                            int arg = csi_sequence_get_int_argument(csi, 0, 0);
+                            Vt_report_dec_mode(self, arg);
+                        } break;
 
-                            /* <ESC>[ Pt ; Pl ; Pb ; Pr ; Ps $r - Change Attributes in Rectangular
-                             * Area (DECCARA), VT400 and up
-                             *
-                             * Pt ; Pl ; Pb ; Pr denotes the rectangle.
-                             * Ps denotes the SGR attributes to change: 0, 1, 4, 5, 7
-                             */
-                            case 'r': {
-                                STUB("DECCARA");
-                            } break;
+                        /* <ESC>[ Pt ; Pl ; Pb ; Pr ; Ps $r - Change Attributes in Rectangular
+                         * Area (DECCARA), VT400 and up
+                         *
+                         * Pt ; Pl ; Pb ; Pr denotes the rectangle.
+                         * Ps denotes the SGR attributes to change: 0, 1, 4, 5, 7
+                         */
+                        case 'r': {
+                            STUB("DECCARA");
+                        } break;
 
-                            /* <ESC>[ Pt ; Pl ; Pb ; Pr ; Ps $t - Reverse Attributes in Rectangular
-                             * Area (DECRARA), VT400 and up
-                             *
-                             * Pt ; Pl ; Pb ; Pr denotes the rectangle. Ps denotes the attributes to
-                             * reverse, i.e.,  1, 4, 5, 7.
-                             */
-                            case 't': {
-                                STUB("DECRARA");
-                            } break;
+                        /* <ESC>[ Pt ; Pl ; Pb ; Pr ; Ps $t - Reverse Attributes in Rectangular
+                         * Area (DECRARA), VT400 and up
+                         *
+                         * Pt ; Pl ; Pb ; Pr denotes the rectangle. Ps denotes the attributes to
+                         * reverse, i.e.,  1, 4, 5, 7.
+                         */
+                        case 't': {
+                            STUB("DECRARA");
+                        } break;
 
-                            /* <ESC>[ Ps $w - Request presentation state report (DECRQPSR), VT320
-                             * and up
-                             *
-                             * (Ps)
-                             *   0 => error
-                             *   1 => cursor information report (DECCIR)
-                             *     Response is DCS 1 $ u Pt ST Refer to the VT420 programming
-                             *     manual, which requires six pages to document the data string Pt,
-                             *   2 => tab stop report (DECTABSR). Response is DCS 2 $ u Pt ST The
-                             *     data string Pt is a list of the tab-stops, separated by "/"
-                             *     characters.
-                             */
-                            case 'w': {
-                                STUB("DECRQPSR");
-                            } break;
+                        /* <ESC>[ Ps $w - Request presentation state report (DECRQPSR), VT320
+                         * and up
+                         *
+                         * (Ps)
+                         *   0 => error
+                         *   1 => cursor information report (DECCIR)
+                         *     Response is DCS 1 $ u Pt ST Refer to the VT420 programming
+                         *     manual, which requires six pages to document the data string Pt,
+                         *   2 => tab stop report (DECTABSR). Response is DCS 2 $ u Pt ST The
+                         *     data string Pt is a list of the tab-stops, separated by "/"
+                         *     characters.
+                         */
+                        case 'w': {
+                            STUB("DECRQPSR");
+                        } break;
 
-                            /* <ESC>[ Pc ; Pt ; Pl ; Pb ; Pr $x - Fill Rectangular Area (DECFRA),
-                             * VT420 and up
-                             *
-                             * Pc is the character to use
-                             * Pt ; Pl ; Pb ; Pr denotes the rectangle
-                             */
-                            case 'x': {
-                                STUB("DECFRA");
-                            } break;
+                        /* <ESC>[ Pc ; Pt ; Pl ; Pb ; Pr $x - Fill Rectangular Area (DECFRA),
+                         * VT420 and up
+                         *
+                         * Pc is the character to use
+                         * Pt ; Pl ; Pb ; Pr denotes the rectangle
+                         */
+                        case 'x': {
+                            STUB("DECFRA");
+                        } break;
 
-                            /* <ESC>[ Pt ; Pl ; Pb ; Pr $z
-                             * Erase Rectangular Area (DECERA), VT400 and up
-                             */
-                            case 'z': {
-                                STUB("DECERA");
-                            } break;
+                        /* <ESC>[ Pt ; Pl ; Pb ; Pr $z
+                         * Erase Rectangular Area (DECERA), VT400 and up
+                         */
+                        case 'z': {
+                            STUB("DECERA");
+                        } break;
 
-                            /* <ESC>[ Pt ; Pl ; Pb ; Pr ${
-                             * Selective Erase Rectangular Area (DECSERA), VT400 and up
-                             */
-                            case '{': {
-                                STUB("DECSERA");
-                            } break;
+                        /* <ESC>[ Pt ; Pl ; Pb ; Pr ${
+                         * Selective Erase Rectangular Area (DECSERA), VT400 and up
+                         */
+                        case '{': {
+                            STUB("DECSERA");
+                        } break;
 
-                            /* <ESC>[ Ps $| - Select columns per page (DECSCPP), VT340 */
-                            case '|': {
-                                STUB("DECSCPP");
-                            } break;
+                        /* <ESC>[ Ps $| - Select columns per page (DECSCPP), VT340 */
+                        case '|': {
+                            STUB("DECSCPP");
+                        } break;
 
-                            default:
-                                WRN("Unknown CSI sequence: %s\n", seq);
-                        }
-                        break;
+                        default:
+                            WRN("Unknown CSI sequence: %s\n", csi_sequence_to_string(csi));
+                    }
+                    break;
 
-                        /* <ESC>[ .. ; .. ?  */
-                    default: {
-                        switch (last_char) {
-                            /* <ESC>[ Ps ; ... m - change one or more text attributes (SGR) */
-                            case 'm': {
-                                Vector_pop_n_char(&self->parser.active_sequence, 2); // 'm', '\0'
-                                Vector_push_char(&self->parser.active_sequence, '\0');
-                                Vt_handle_multi_argument_SGR(self,
-                                                             self->parser.active_sequence,
-                                                             NULL);
-                            } break;
+                    /* <ESC>[ .. ; .. ?  */
+                default: {
+                    switch (last_char) {
+                        /* <ESC>[ Ps ; ... m - change one or more text attributes (SGR) */
+                        case 'm':
+                            Vt_handle_multi_argument_SGR(self, csi, NULL);
+                            break;
 
-                            /* <ESC>[ Ps K - clear(erase) line right of cursor (EL)
-                             * none/0 - right 1 - left 2 - all */
-                            case 'K': {
-                                MULTI_ARG_IS_ERROR
-                                int arg = *seq == 'K' ? 0 : short_sequence_get_int_argument(seq);
+                        /* <ESC>[ Ps K - clear(erase) line right of cursor (EL)
+                         * none/0 - right 1 - left 2 - all */
+                        case 'K': {
+                            MULTI_ARG_IS_ERROR
+                            int arg = csi_sequence_get_int_argument(csi, 0, 0);
 
-                                switch (arg) {
-                                    case 0:
-                                        Vt_clear_right(self);
-                                        break;
-                                    case 1:
-                                        Vt_clear_left(self);
-                                        break;
-                                    case 2:
-                                        Vt_clear_left(self);
-                                        Vt_clear_right(self);
-                                        break;
+                            switch (arg) {
+                                case 0:
+                                    Vt_clear_right(self);
+                                    break;
+                                case 1:
+                                    Vt_clear_left(self);
+                                    break;
+                                case 2:
+                                    Vt_clear_left(self);
+                                    Vt_clear_right(self);
+                                    break;
 
-                                    default:
-                                        WRN("Unknown CSI(EL) sequence: %s\n", seq);
-                                }
-                            } break;
+                                default:
+                                    WRN("Unknown CSI(EL) sequence: %s\n",
+                                        csi_sequence_to_string(csi));
+                            }
+                        } break;
 
-                            /* <ECS>[ Ps @ - Insert Ps Chars (ICH) */
-                            case '@': {
-                                // the normal character
-                                // attribute. The cursor remains at the beginning of the blank
-                                // characters. Text between the cursor and right margin moves to the
-                                // right.
-                                MULTI_ARG_IS_ERROR
-                                int arg = short_sequence_get_int_argument(seq);
-                                for (int i = 0; i < arg; ++i) {
-                                    Vt_insert_char_at_cursor_with_shift(self, self->blank_space);
-                                }
-                            } break;
+                        /* <ECS>[ Ps @ - Insert Ps Chars (ICH) */
+                        case '@': {
+                            // the normal character
+                            // attribute. The cursor remains at the beginning of the blank
+                            // characters. Text between the cursor and right margin moves to the
+                            // right.
+                            MULTI_ARG_IS_ERROR
+                            int arg = csi_sequence_get_int_argument(csi, 0, 1);
+                            for (int i = 0; i < arg; ++i) {
+                                Vt_insert_char_at_cursor_with_shift(self, self->blank_space);
+                            }
+                        } break;
 
-                            /* <ESC>[ Ps a - move cursor right (forward) Ps lines (HPR) */
-                            case 'a':
-                            /* <ESC>[ Ps C - move cursor right (forward) Ps lines (CUF) */
-                            case 'C': {
-                                MULTI_ARG_IS_ERROR
-                                int arg = short_sequence_get_int_argument(seq);
-                                if (arg <= 0)
-                                    arg = 1;
-                                Vt_move_cursor(self, self->cursor.col + arg, Vt_cursor_row(self));
-                            } break;
+                        /* <ESC>[ Ps a - move cursor right (forward) Ps lines (HPR) */
+                        case 'a':
+                        /* <ESC>[ Ps C - move cursor right (forward) Ps lines (CUF) */
+                        case 'C': {
+                            MULTI_ARG_IS_ERROR
+                            int arg = csi_sequence_get_int_argument(csi, 0, 1);
+                            if (arg <= 0)
+                                arg = 1;
+                            Vt_move_cursor(self, self->cursor.col + arg, Vt_cursor_row(self));
+                        } break;
 
-                            /* <ESC>[ Ps L - Insert line at cursor shift rest down (IL) */
-                            case 'L': {
-                                MULTI_ARG_IS_ERROR
-                                int arg = short_sequence_get_int_argument(seq);
-                                if (arg <= 0)
-                                    arg = 1;
-                                for (int i = 0; i < arg; ++i)
-                                    Vt_insert_line(self);
-                            } break;
+                        /* <ESC>[ Ps L - Insert line at cursor shift rest down (IL) */
+                        case 'L': {
+                            MULTI_ARG_IS_ERROR
+                            int arg = csi_sequence_get_int_argument(csi, 0, 1);
+                            if (arg <= 0)
+                                arg = 1;
+                            for (int i = 0; i < arg; ++i)
+                                Vt_insert_line(self);
+                        } break;
 
-                            /* <ESC>[ Ps D - move cursor left (back) Ps lines (CUB) */
-                            case 'D': {
-                                MULTI_ARG_IS_ERROR
-                                int arg = short_sequence_get_int_argument(seq);
-                                if (arg <= 0)
-                                    arg = 1;
-                                uint16_t new_col =
-                                  arg >= self->cursor.col ? 0 : (self->cursor.col - arg);
-                                Vt_move_cursor(self, new_col, Vt_cursor_row(self));
-                            } break;
+                        /* <ESC>[ Ps D - move cursor left (back) Ps lines (CUB) */
+                        case 'D': {
+                            MULTI_ARG_IS_ERROR
+                            int arg = csi_sequence_get_int_argument(csi, 0, 1);
+                            if (arg <= 0)
+                                arg = 1;
+                            uint16_t new_col =
+                              arg >= self->cursor.col ? 0 : (self->cursor.col - arg);
+                            Vt_move_cursor(self, new_col, Vt_cursor_row(self));
+                        } break;
 
-                            /* <ESC>[ Ps A - move cursor up Ps lines (CUU) */
-                            case 'A': {
-                                MULTI_ARG_IS_ERROR
-                                int arg = short_sequence_get_int_argument(seq);
-                                if (arg <= 0)
-                                    arg = 1;
-                                size_t new_row = Vt_cursor_row(self) - arg;
-                                Vt_move_cursor(self, self->cursor.col, new_row);
-                            } break;
+                        /* <ESC>[ Ps A - move cursor up Ps lines (CUU) */
+                        case 'A': {
+                            MULTI_ARG_IS_ERROR
+                            int arg = csi_sequence_get_int_argument(csi, 0, 1);
+                            if (arg <= 0)
+                                arg = 1;
+                            size_t new_row = Vt_cursor_row(self) - arg;
+                            Vt_move_cursor(self, self->cursor.col, new_row);
+                        } break;
 
-                            /* <ESC>[ Ps e - move cursor down Ps lines (VPR) */
-                            case 'e':
-                            /* <ESC>[ Ps B - move cursor down Ps lines (CUD) */
-                            case 'B': {
-                                MULTI_ARG_IS_ERROR
-                                int arg = short_sequence_get_int_argument(seq);
-                                if (arg <= 0)
-                                    arg = 1;
-                                Vt_move_cursor(self, self->cursor.col, Vt_cursor_row(self) + arg);
-                            } break;
+                        /* <ESC>[ Ps e - move cursor down Ps lines (VPR) */
+                        case 'e':
+                        /* <ESC>[ Ps B - move cursor down Ps lines (CUD) */
+                        case 'B': {
+                            MULTI_ARG_IS_ERROR
+                            int arg = csi_sequence_get_int_argument(csi, 0, 1);
+                            if (arg <= 0)
+                                arg = 1;
+                            Vt_move_cursor(self, self->cursor.col, Vt_cursor_row(self) + arg);
+                        } break;
 
-                            case 'E': {
-                                MULTI_ARG_IS_ERROR
-                                int arg = short_sequence_get_int_argument(seq);
-                                if (arg <= 0)
-                                    arg = 1;
-                                Vt_move_cursor(self, 0, Vt_cursor_row(self) + arg);
-                            } break;
+                        case 'E': {
+                            MULTI_ARG_IS_ERROR
+                            int arg = csi_sequence_get_int_argument(csi, 0, 1);
+                            if (arg <= 0)
+                                arg = 1;
+                            Vt_move_cursor(self, 0, Vt_cursor_row(self) + arg);
+                        } break;
 
-                            case 'F': {
-                                MULTI_ARG_IS_ERROR
-                                int arg = short_sequence_get_int_argument(seq);
-                                if (arg <= 0)
-                                    arg = 1;
-                                Vt_move_cursor(self, 0, Vt_cursor_row(self) - arg);
-                            } break;
+                        case 'F': {
+                            MULTI_ARG_IS_ERROR
+                            int arg = csi_sequence_get_int_argument(csi, 0, 1);
+                            if (arg <= 0)
+                                arg = 1;
+                            Vt_move_cursor(self, 0, Vt_cursor_row(self) - arg);
+                        } break;
 
-                            /* <ESC>[ Ps ` - move cursor to column Ps (CBT)*/
-                            case '`':
-                            /* <ESC>[ Ps G - move cursor to column Ps (CHA)*/
-                            case 'G': {
-                                MULTI_ARG_IS_ERROR
-                                int arg = short_sequence_get_int_argument(seq);
-                                if (arg <= 0)
-                                    arg = 1;
-                                Vt_move_cursor(self, arg - 1, Vt_cursor_row(self));
-                            } break;
+                        /* <ESC>[ Ps ` - move cursor to column Ps (CBT)*/
+                        case '`':
+                        /* <ESC>[ Ps G - move cursor to column Ps (CHA)*/
+                        case 'G': {
+                            MULTI_ARG_IS_ERROR
+                            int arg = csi_sequence_get_int_argument(csi, 0, 1);
+                            if (arg <= 0)
+                                arg = 1;
+                            Vt_move_cursor(self, arg - 1, Vt_cursor_row(self));
+                        } break;
 
-                            /* <ESC>[ Ps J - Erase display (ED) - clear... */
-                            case 'J': {
-                                MULTI_ARG_IS_ERROR
-                                if (*seq == 'J') { /* ...from cursor to end of screen */
-                                    Vt_erase_to_end(self);
-                                } else {
-                                    int arg = short_sequence_get_int_argument(seq);
+                        /* <ESC>[ Ps J - Erase display (ED) - clear... */
+                        case 'J': {
+                            MULTI_ARG_IS_ERROR
+                            {
+                                int arg = csi_sequence_get_int_argument(csi, 0, 0);
 
-                                    switch (arg) {
-                                        case 0:
-                                            Vt_erase_to_end(self);
-                                            break;
+                                switch (arg) {
+                                    case 0: /* ...from cursor to end of screen */
+                                        Vt_erase_to_end(self);
+                                        break;
 
-                                        case 1: /* ...from start to cursor */
-                                            Vt_clear_above(self);
-                                            break;
+                                    case 1: /* ...from start to cursor */
+                                        Vt_clear_above(self);
+                                        break;
 
-                                        case 3: /* ...whole display + scrollback buffer */
-                                            /* if (settings.allow_scrollback_clear) { */
-                                            /*     Vt_clear_display_and_scrollback(self); */
-                                            /* } */
-                                            /* break; */
-
-                                        case 2: /* ...whole display. Contents should not
-                                                 * actually be removed, but saved to scroll
-                                                 * history if no scroll region is set */
-                                            if (self->alt_lines.buf) {
-                                                Vt_clear_display_and_scrollback(self);
+                                    case 3: /* ...whole display + scrollback buffer */
+                                        /* if (settings.allow_scrollback_clear) { */
+                                        /*     Vt_clear_display_and_scrollback(self); */
+                                        /* } */
+                                        /* break; */
+
+                                    case 2: /* ...whole display. Contents should not
+                                             * actually be removed, but saved to scroll
+                                             * history if no scroll region is set */
+                                        if (self->alt_lines.buf) {
+                                            Vt_clear_display_and_scrollback(self);
+                                        } else {
+                                            if (Vt_scroll_region_not_default(self)) {
+                                                Vt_clear_above(self);
+                                                Vt_erase_to_end(self);
                                             } else {
-                                                if (Vt_scroll_region_not_default(self)) {
-                                                    Vt_clear_above(self);
-                                                    Vt_erase_to_end(self);
-                                                } else {
-                                                    Vt_scroll_out_all_content(self);
-                                                }
+                                                Vt_scroll_out_all_content(self);
                                             }
-                                            break;
-                                    }
-                                }
-                            } break;
-
-                            /* <ESC>[ Ps d - move cursor to row Ps (VPA) */
-                            case 'd': {
-                                MULTI_ARG_IS_ERROR
-                                /* origin is 1:1 */
-                                int arg = short_sequence_get_int_argument(seq);
-                                if (arg <= 0)
-                                    arg = 1;
-                                --arg;
-                                Vt_move_cursor(self, self->cursor.col, arg);
-                            } break;
-
-                            /* <ESC>[ Ps ; Ps r - Set scroll region (top;bottom) (DECSTBM)
-                             * default: full window
-                             *
-                             * Also returns cursor to origin (not docummented?).
-                             * If the range is invalid does nothing. */
-                            case 'r': {
-                                int64_t top = 0, bottom = Vt_row(self) - 1;
-                                if (*seq != 'r') {
-                                    if (sscanf(seq, "%" PRId64 ";%" PRId64, &top, &bottom) == EOF) {
-                                        WRN("invalid CSI(DECSTBM) sequence %s\n", seq);
+                                        }
                                         break;
-                                    }
-                                    if (top <= 0) {
-                                        top = 1;
-                                    }
-                                    if (bottom <= 0) {
-                                        bottom = Vt_row(self) - 1;
-                                    }
-                                    --top;
-                                    --bottom;
-                                } else {
-                                    top = 0;
-
-                                    bottom = CALL(self->callbacks.on_number_of_cells_requested,
-                                                  self->callbacks.user_data)
-                                               .second -
-                                             1;
                                 }
+                            }
+                        } break;
 
-                                if (bottom > top) {
-                                    Vt_move_cursor(self, 0, 0);
-                                    self->scroll_region_top    = top;
-                                    self->scroll_region_bottom = bottom;
-                                } else {
-                                    WRN("Invalid DECSTBM sequence %s\n", seq);
-                                }
-                            } break;
+                        /* <ESC>[ Ps d - move cursor to row Ps (VPA) */
+                        case 'd': {
+                            MULTI_ARG_IS_ERROR
+                            /* origin is 1:1 */
+                            int arg = csi_sequence_get_int_argument(csi, 0, 1);
+                            if (arg <= 0)
+                                arg = 1;
+                            --arg;
+                            Vt_move_cursor(self, self->cursor.col, arg);
+                        } break;
 
-                            /* <ESC>[ Ps I - cursor forward ps tabulations (CHT) */
-                            case 'I': {
-                                MULTI_ARG_IS_ERROR
-                                int arg = short_sequence_get_int_argument(seq);
-                                if (arg <= 0)
-                                    arg = 1;
-                                uint16_t rt;
-                                for (rt = 0; self->cursor.col + rt < Vt_col(self) && arg; ++rt) {
-                                    if (self->tab_ruler[self->cursor.col + rt])
-                                        --arg;
+                        /* <ESC>[ Ps ; Ps r - Set scroll region (top;bottom) (DECSTBM)
+                         * default: full window
+                         *
+                         * Also returns cursor to origin (not docummented?).
+                         * If the range is invalid does nothing. */
+                        case 'r': {
+                            int64_t top = 0, bottom = Vt_row(self) - 1;
+                            if (csi->n_params) {
+                                top    = csi_sequence_get_int_argument(csi, 0, 1);
+                                bottom = csi_sequence_get_int_argument(csi, 1, Vt_row(self));
+                                if (top <= 0) {
+                                    top = 1;
                                 }
-                                Vt_move_cursor(self, self->cursor.col + rt, Vt_cursor_row(self));
-                            } break;
-
-                            /* <ESC>[ Ps Z - cursor backward ps tabulations (CBT) */
-                            case 'Z': {
-                                MULTI_ARG_IS_ERROR
-                                int arg = short_sequence_get_int_argument(seq);
-                                if (arg <= 0)
-                                    arg = 1;
-                                uint16_t lt;
-                                for (lt = 0; self->cursor.col - lt && arg; ++lt) {
-                                    if (self->tab_ruler[self->cursor.col - lt])
-                                        --arg;
+                                if (bottom <= 0) {
+                                    bottom = Vt_row(self);
                                 }
-                                Vt_move_cursor(self, self->cursor.col - lt, Vt_cursor_row(self));
-                            } break;
+                                --top;
+                                --bottom;
+                            } else {
+                                top = 0;
+
+                                bottom = CALL(self->callbacks.on_number_of_cells_requested,
+                                              self->callbacks.user_data)
+                                           .second -
+                                         1;
+                            }
 
-                            /* <ESC>[ Pm ... h - Set mode (SM) */
-                            case 'h':
-                            /* <ESC>[ Pm ... l - Reset Mode (RM) */
-                            case 'l': {
-                                bool               is_enable = last_char == 'h';
-                                Vector_Vector_char tokens = string_split_on(seq, ";:", NULL, NULL);
-                                for (Vector_char* token = NULL;
-                                     (token = Vector_iter_Vector_char(&tokens, token));) {
-                                    errno         = 0;
-                                    uint32_t code = atoi(token->buf + 1);
-                                    if (code && !errno) {
-                                        Vt_handle_regular_mode(self, code, is_enable);
-                                    } else {
-                                        WRN("Invalid %s argument: \'%s\'\n",
-                                            is_enable ? "SM" : "RM",
-                                            token->buf + 1);
-                                    }
-                                }
-                                Vector_destroy_Vector_char(&tokens);
-                            } break;
+                            if (bottom > top) {
+                                Vt_move_cursor(self, 0, 0);
+                                self->scroll_region_top    = top;
+                                self->scroll_region_bottom = bottom;
+                            } else {
+                                WRN("Invalid DECSTBM sequence %s\n", csi_sequence_to_string(csi));
+                            }
+                        } break;
+
+                        /* <ESC>[ Ps I - cursor forward ps tabulations (CHT) */
+                        case 'I': {
+                            MULTI_ARG_IS_ERROR
+                            int arg = csi_sequence_get_int_argument(csi, 0, 1);
+                            if (arg <= 0)
+                                arg = 1;
+                            uint16_t rt;
+                            for (rt = 0; self->cursor.col + rt < Vt_col(self) && arg; ++rt) {
+                                if (self->tab_ruler[self->cursor.col + rt])
+                                    --arg;
+                            }
+                            Vt_move_cursor(self, self->cursor.col + rt, Vt_cursor_row(self));
+                        } break;
 
-                            /* <ESC>[ Pn g - tabulation clear (TBC) */
-                            case 'g': {
-                                MULTI_ARG_IS_ERROR
-                                int arg = short_sequence_get_int_argument(seq);
+                        /* <ESC>[ Ps Z - cursor backward ps tabulations (CBT) */
+                        case 'Z': {
+                            MULTI_ARG_IS_ERROR
+                            int arg = csi_sequence_get_int_argument(csi, 0, 1);
+                            if (arg <= 0)
+                                arg = 1;
+                            uint16_t lt;
+                            for (lt = 0; self->cursor.col - lt && arg; ++lt) {
+                                if (self->tab_ruler[self->cursor.col - lt])
+                                    --arg;
+                            }
+                            Vt_move_cursor(self, self->cursor.col - lt, Vt_cursor_row(self));
+                        } break;
 
-                                switch (arg) {
-                                    case 0:
-                                        self->tab_ruler[self->cursor.col] = false;
-                                        break;
-                                    case 3:
-                                        Vt_clear_all_tabstops(self);
-                                        break;
-                                    default:;
+                        /* <ESC>[ Pm ... h - Set mode (SM) */
+                        case 'h':
+                        /* <ESC>[ Pm ... l - Reset Mode (RM) */
+                        case 'l': {
+                            bool is_enable = last_char == 'h';
+                            for (uint8_t i = 0; i < csi->n_params; ++i) {
+                                int32_t code = csi->params[i];
+                                if (code > 0) {
+                                    Vt_handle_regular_mode(self, code, is_enable);
+                                } else {
+                                    WRN("Invalid %s argument: \'%d\'\n",
+                                        is_enable ? "SM" : "RM",
+                                        code);
                                 }
+                            }
+                        } break;
 
-                            } break;
+                        /* <ESC>[ Pn g - tabulation clear (TBC) */
+                        case 'g': {
+                            MULTI_ARG_IS_ERROR
+                            int arg = csi_sequence_get_int_argument(csi, 0, 0);
 
-                            /* no args: 1:1, one arg: x:1 */
-                            /* <ESC>[ Py ; Px f - move cursor to Px-Py (HVP) (deprecated) */
-                            case 'f':
-                            /* <ESC>[ Py ; Px H - move cursor to Px-Py (CUP) */
-                            case 'H': {
-                                int32_t x = 1, y = 1;
-                                if (*seq != 'H' && sscanf(seq, "%d;%d", &y, &x) == EOF) {
-                                    WRN("invalid CUP/HVP sequence %s\n", seq);
+                            switch (arg) {
+                                case 0:
+                                    self->tab_ruler[self->cursor.col] = false;
                                     break;
-                                }
-                                if (x <= 0)
-                                    x = 1;
-                                if (y <= 0)
-                                    y = 1;
-                                --x;
-                                --y;
-                                Vt_move_cursor(self, x, y);
-                            } break;
+                                case 3:
+                                    Vt_clear_all_tabstops(self);
+                                    break;
+                                default:;
+                            }
 
-                            /* <ESC>[...c - Send device attributes (Primary DA)
-                             *
-                             * 1        132 columns
-                             * 2        Printer port
-                             * 4        Sixel
-                             * 6        Selective erase
-                             * 7        Soft character set (DRCS)
-                             * 8        User-defined keys (UDKs)
-                             * 9        National replacement character sets (NRCS) (International
-                             *terminal only) 12       Yugoslavian (SCS) 15       Technical character
-                             *set 18       Windowing capability 21       Horizontal scrolling 23
-                             *Greek 24       Turkish 42       ISO Latin-2 character set 44 PCTerm 45
-                             *Soft key map 46       ASCII emulation
-                             *
-                             **/
-                            case 'c': {
-                                /* report vt340 type device with sixel ,132column, and window system
-                                 * support */
-                                Vt_output(self, "\e[?63;1;4c", 10);
-                                /* Vt_output(self, "\e[?64;1;4;18c", 11); */
-                            } break;
+                        } break;
 
-                            /* <ESC>[...n - Device status report (DSR) */
-                            case 'n': {
-                                MULTI_ARG_IS_ERROR
-                                int arg = short_sequence_get_int_argument(seq);
-                                if (arg == 5) {
-                                    /* 5 - is terminal ok
-                                     *  ok - 0, not ok - 3 */
-                                    Vt_output(self, "\e[0n", 4);
-                                } else if (arg == 6) {
-                                    /* 6 - report cursor position */
-                                    Vt_output_formated(self,
-                                                       "\e[%u;%uR",
-                                                       Vt_cursor_row(self) + 1,
-                                                       self->cursor.col + 1);
-                                } else {
-                                    WRN("Unimplemented DSR code: %d\n", arg);
-                                }
-                            } break;
+                        /* no args: 1:1, one arg: x:1 */
+                        /* <ESC>[ Py ; Px f - move cursor to Px-Py (HVP) (deprecated) */
+                        case 'f':
+                        /* <ESC>[ Py ; Px H - move cursor to Px-Py (CUP) */
+                        case 'H': {
+                            int32_t y = csi_sequence_get_int_argument(csi, 0, 1);
+                            int32_t x = csi_sequence_get_int_argument(csi, 1, 1);
+                            if (x <= 0)
+                                x = 1;
+                            if (y <= 0)
+                                y = 1;
+                            --x;
+                            --y;
+                            Vt_move_cursor(self, x, y);
+                        } break;
 
-                            /* <ESC>[ Ps M - Delete lines (default = 1) (DL) */
-                            case 'M': {
-                                MULTI_ARG_IS_ERROR
-                                int arg = short_sequence_get_int_argument(seq);
-                                if (arg <= 0)
-                                    arg = 1;
-                                for (int i = 0; i < arg; ++i)
-                                    Vt_delete_line(self);
-                            } break;
+                        /* <ESC>[...c - Send device attributes (Primary DA)
+                         *
+                         * 1        132 columns
+                         * 2        Printer port
+                         * 4        Sixel
+                         * 6        Selective erase
+                         * 7        Soft character set (DRCS)
+                         * 8        User-defined keys (UDKs)
+                         * 9        National replacement character sets (NRCS) (International
+                         *terminal only) 12       Yugoslavian (SCS) 15       Technical character
+                         *set 18       Windowing capability 21       Horizontal scrolling 23
+                         *Greek 24       Turkish 42       ISO Latin-2 character set 44 PCTerm 45
+                         *Soft key map 46       ASCII emulation
+                         *
+                         **/
+                        case 'c': {
+                            /* report vt340 type device with sixel ,132column, and window system
+                             * support */
+                            Vt_output(self, "\e[?63;1;4c", 10);
+                            /* Vt_output(self, "\e[?64;1;4;18c", 11); */
+                        } break;
 
-                            /* <ESC>[ Ps S - Scroll up (default = 1) (SU) */
-                            case 'S': {
-                                MULTI_ARG_IS_ERROR
-                                int arg = short_sequence_get_int_argument(seq);
-                                if (arg <= 0)
-                                    arg = 1;
-                                for (int i = 0; i < arg; ++i)
-                                    Vt_scroll_up(self);
-                            } break;
+                        /* <ESC>[...n - Device status report (DSR) */
+                        case 'n': {
+                            MULTI_ARG_IS_ERROR
+                            int arg = csi_sequence_get_int_argument(csi, 0, 0);
+                            if (arg == 5) {
+                                /* 5 - is terminal ok
+                                 *  ok - 0, not ok - 3 */
+                                Vt_output(self, "\e[0n", 4);
+                            } else if (arg == 6) {
+                                /* 6 - report cursor position */
+                                Vt_output_formated(self,
+                                                   "\e[%u;%uR",
+                                                   Vt_cursor_row(self) + 1,
+                                                   self->cursor.col + 1);
+                            } else {
+                                WRN("Unimplemented DSR code: %d\n", arg);
+                            }
+                        } break;
 
-                            /* <ESC>[ Ps T - Scroll down (default = 1) (SD) */
-                            case 'T': {
-                                MULTI_ARG_IS_ERROR
-                                int arg = short_sequence_get_int_argument(seq);
-                                if (arg <= 0)
-                                    arg = 1;
-                                for (int i = 0; i < arg; ++i)
-                                    Vt_scroll_down(self);
-                            } break;
+                        /* <ESC>[ Ps M - Delete lines (default = 1) (DL) */
+                        case 'M': {
+                            MULTI_ARG_IS_ERROR
+                            int arg = csi_sequence_get_int_argument(csi, 0, 1);
+                            if (arg <= 0)
+                                arg = 1;
+                            for (int i = 0; i < arg; ++i)
+                                Vt_delete_line(self);
+                        } break;
 
-                                /* <ESC>[ Ps X - Erase Ps Character(s) (default = 1) (ECH) */
-                            case 'X': {
-                                MULTI_ARG_IS_ERROR
-                                int arg = short_sequence_get_int_argument(seq);
-                                if (arg <= 0)
-                                    arg = 1;
-                                Vt_erase_chars(self, arg);
-                            } break;
+                        /* <ESC>[ Ps S - Scroll up (default = 1) (SU) */
+                        case 'S': {
+                            MULTI_ARG_IS_ERROR
+                            int arg = csi_sequence_get_int_argument(csi, 0, 1);
+                            if (arg <= 0)
+                                arg = 1;
+                            for (int i = 0; i < arg; ++i)
+                                Vt_scroll_up(self);
+                        } break;
 
-                                /* <ESC>[ Ps P - Delete Ps Character(s) (default = 1) (DCH) */
-                            case 'P': {
-                                // As characters are deleted, the remaining
-                                // characters between the cursor
-                                // and right margin move to the left.
-                                MULTI_ARG_IS_ERROR
-                                int arg = short_sequence_get_int_argument(seq);
+                        /* <ESC>[ Ps T - Scroll down (default = 1) (SD) */
+                        case 'T': {
+                            MULTI_ARG_IS_ERROR
+                            int arg = csi_sequence_get_int_argument(csi, 0, 1);
+                            if (arg <= 0)
+                                arg = 1;
+                            for (int i = 0; i < arg; ++i)
+                                Vt_scroll_down(self);
+                        } break;
+
+                            /* <ESC>[ Ps X - Erase Ps Character(s) (default = 1) (ECH) */
+                        case 'X': {
+                            MULTI_ARG_IS_ERROR
+                            int arg = csi_sequence_get_int_argument(csi, 0, 1);
+                            if (arg <= 0)
+                                arg = 1;
+                            Vt_erase_chars(self, arg);
+                        } break;
+
+                            /* <ESC>[ Ps P - Delete Ps Character(s) (default = 1) (DCH) */
+                        case 'P': {
+                            // As characters are deleted, the remaining
+                            // characters between the cursor
+                            // and right margin move to the left.
+                            MULTI_ARG_IS_ERROR
+                            int arg = csi_sequence_get_int_argument(csi, 0, 1);
+                            if (arg <= 0)
+                                arg = 1;
+                            Vt_delete_chars(self, arg);
+                        } break;
+
+                        /* <ESC>[ Ps b -  Repeat the preceding graphic character Ps times (REP)
+                         * in xterm any cursor movement or SGR sequences after inserting the
+                         * character cause this to have no effect */
+                        case 'b': {
+                            MULTI_ARG_IS_ERROR
+                            if (likely(self->has_last_inserted_rune)) {
+                                int arg = csi_sequence_get_int_argument(csi, 0, 1);
                                 if (arg <= 0)
                                     arg = 1;
-                                Vt_delete_chars(self, arg);
-                            } break;
-
-                            /* <ESC>[ Ps b -  Repeat the preceding graphic character Ps times (REP)
-                             * in xterm any cursor movement or SGR sequences after inserting the
-                             * character cause this to have no effect */
-                            case 'b': {
-                                MULTI_ARG_IS_ERROR
-                                if (likely(self->has_last_inserted_rune)) {
-                                    int arg = short_sequence_get_int_argument(seq);
-                                    if (arg <= 0)
-                                        arg = 1;
-                                    VtRune repeated = self->last_inserted;
-                                    for (int i = 0; i < arg; ++i) {
+                                VtRune repeated = self->last_inserted;
+                                for (size_t i = 0; i < (size_t)arg;) {
+                                    size_t written = 0;
+                                    if (!self->modes.no_insert_replace_mode) {
+                                        written = Vt_write_run(self, NULL, arg - i, &repeated);
+                                    }
+                                    if (!written) {
                                         Vt_insert_char_at_cursor(self, repeated);
+                                        written = 1;
                                     }
+                                    i += written;
                                 }
-                            } break;
+                            }
+                        } break;
 
-                            /* <ESC>[ Ps i -  Media Copy (MC) Local printing related commands */
-                            case 'i':
-                                break;
+                        /* <ESC>[ Ps i -  Media Copy (MC) Local printing related commands */
+                        case 'i':
+                            break;
+
+                        /* <ESC>[u - Restore cursor (SCORC, also ANSI.SYS) */
+                        /* <ESC>[Ps SP u - Set margin-bell volume (DECSMBV), VT520 */
+                        case 'u': {
+                            if (!csi->n_params) {
+                                Vt_move_cursor(self,
+                                               self->saved_cursor_pos,
+                                               self->saved_active_line);
+                            } else {
+                                WRN("DECSMBV not implemented\n");
+                            }
+                        } break;
 
-                            /* <ESC>[u - Restore cursor (SCORC, also ANSI.SYS) */
-                            /* <ESC>[Ps SP u - Set margin-bell volume (DECSMBV), VT520 */
-                            case 'u': {
-                                if (*seq == 'u') {
-                                    Vt_move_cursor(self,
-                                                   self->saved_cursor_pos,
-                                                   self->saved_active_line);
+                        case 's': {
+                            /* CSI Pl ; Pr s Set left and right margins (DECSLRM), VT420 and up.
+                             * This is available only when DECLRMM is enabled.
+                             * `If the left and right margins are set to columns other than
+                             * 1 and 80 (or 132), the terminal cannot scroll smoothly.' */
+                            if (self->modes.vertical_split_screen_mode) {
+                                int32_t lmargin = csi_sequence_get_int_argument(csi, 0, 1);
+                                int32_t rmargin =
+                                  csi_sequence_get_int_argument(csi, 1, Vt_col(self));
+                                lmargin = MAX(lmargin, 1);
+                                rmargin = MIN(rmargin, Vt_col(self));
+                                if (rmargin > lmargin + 1) {
+                                    self->scroll_region_left  = lmargin - 1;
+                                    self->scroll_region_right = rmargin - 1;
                                 } else {
-                                    WRN("DECSMBV not implemented\n");
+                                    WRN("invalid DECSLRM values\n");
                                 }
-                            } break;
 
-                            case 's': {
-                                /* CSI Pl ; Pr s Set left and right margins (DECSLRM), VT420 and up.
-                                 * This is available only when DECLRMM is enabled.
-                                 * `If the left and right margins are set to columns other than
-                                 * 1 and 80 (or 132), the terminal cannot scroll smoothly.' */
-                                if (self->modes.vertical_split_screen_mode) {
-                                    uint16_t lmargin = 1, rmargin = Vt_col(self);
-                                    sscanf(seq, "%hu;%hus", &lmargin, &rmargin);
-                                    rmargin = MIN(rmargin, Vt_col(self));
-                                    if (rmargin > lmargin + 1) {
-                                        self->scroll_region_left  = lmargin - 1;
-                                        self->scroll_region_right = rmargin - 1;
-                                    } else {
-                                        WRN("invalid DECSLRM values\n");
-                                    }
+                                /* DECSLRM moves the cursor to column 1, line 1 of the page */
+                                self->cursor.col = 0;
+                                self->cursor.row = Vt_top_line(self);
 
-                                    /* DECSLRM moves the cursor to column 1, line 1 of the page */
-                                    self->cursor.col = 0;
-                                    self->cursor.row = Vt_top_line(self);
+                            } else {
+                                /* <ESC>[s - Save cursor (SCOSC, also ANSI.SYS) available only
+                                 * when DECLRMM is disabled */
+                                self->saved_active_line = Vt_cursor_row(self);
+                                self->saved_cursor_pos  = self->cursor.col;
+                            }
+                        } break;
 
-                                } else {
-                                    /* <ESC>[s - Save cursor (SCOSC, also ANSI.SYS) available only
-                                     * when DECLRMM is disabled */
-                                    self->saved_active_line = Vt_cursor_row(self);
-                                    self->saved_cursor_pos  = self->cursor.col;
-                                }
-                            } break;
+                        /* <ESC>[ Ps q - Manipulate keyboard LEDs (DECLL), VT100 */
+                        case 'q':
+                            break;
 
-                            /* <ESC>[ Ps q - Manipulate keyboard LEDs (DECLL), VT100 */
-                            case 'q':
+                        /* <ESC>[ Ps ; Ps ; Ps t - xterm windowOps (XTWINOPS)*/
+                        case 't': {
+                            int32_t args[4];
+                            int32_t nargs = MIN(csi->n_params, ARRAY_SIZE(args));
+
+                            /* omitted args are set to -1 */
+                            for (int32_t i = 0; i < nargs; ++i) {
+                                args[i] = csi->params[i];
+                            }
+                            if (!nargs) {
                                 break;
+                            }
 
-                            /* <ESC>[ Ps ; Ps ; Ps t - xterm windowOps (XTWINOPS)*/
-                            case 't': {
-                                int32_t nargs;
-                                int32_t args[4];
-
-                                /* Set omitted args to -1 */
-                                for (nargs = 0; seq && nargs < 4 && *seq != 't'; ++nargs) {
-                                    *(args + nargs) = *seq == ';' ? -1 : atoi(seq);
-                                    seq             = strstr(seq, ";");
-                                    if (seq)
-                                        ++seq;
-                                }
-                                if (!nargs) {
+                            switch (args[0]) {
+
+                                /* de-iconyfy */
+                                case 1:
+                                    // TODO:
+                                    break;
+
+                                /* iconyfy */
+                                case 2:
+                                    // TODO:
                                     break;
-                                }
 
-                                switch (args[0]) {
+                                /* move window to args[1]:args[2] */
+                                case 3:
+                                    // TODO:
+                                    break;
 
-                                    /* de-iconyfy */
-                                    case 1:
-                                        // TODO:
+                                /* Resize window in pixels
+                                 *
+                                 * Omitted parameters reuse the current height or width. Zero
+                                 * parameters use the display's height or width.
+                                 *
+                                 * FIXME: This should accounts for window decorations
+                                 * (_NET_FRAME_EXTENTS).
+                                 */
+                                case 4:
+                                    if (!settings.windowops_manip) {
                                         break;
+                                    }
 
-                                    /* iconyfy */
-                                    case 2:
-                                        // TODO:
-                                        break;
+                                    if (nargs >= 2) {
+                                        int32_t target_h = args[1];
+                                        int32_t target_w = nargs >= 3 ? args[2] : -1;
 
-                                    /* move window to args[1]:args[2] */
-                                    case 3:
-                                        // TODO:
-                                        break;
+                                        if (target_w == -1 || target_h == -1) {
+                                            Pair_uint32_t current_dims =
+                                              CALL(self->callbacks.on_window_size_requested,
+                                                   self->callbacks.user_data);
 
-                                    /* Resize window in pixels
-                                     *
-                                     * Omitted parameters reuse the current height or width. Zero
-                                     * parameters use the display's height or width.
-                                     *
-                                     * FIXME: This should accounts for window decorations
-                                     * (_NET_FRAME_EXTENTS).
-                                     */
-                                    case 4:
-                                        if (!settings.windowops_manip) {
+                                            if (target_w == -1) {
+                                                target_w = current_dims.first;
+                                            }
+                                            if (target_h == -1) {
+                                                target_h = current_dims.second;
+                                            }
+                                        }
+                                        if (target_w == 0 || target_h == 0) {
+                                            // TODO: get display size
+                                            STUB("XTWINOPS display size reports");
                                             break;
                                         }
 
-                                        if (nargs >= 2) {
-                                            int32_t target_h = args[1];
-                                            int32_t target_w = nargs >= 3 ? args[2] : -1;
-
-                                            if (target_w == -1 || target_h == -1) {
-                                                Pair_uint32_t current_dims =
-                                                  CALL(self->callbacks.on_window_size_requested,
-                                                       self->callbacks.user_data);
-
-                                                if (target_w == -1) {
-                                                    target_w = current_dims.first;
-                                                }
-                                                if (target_h == -1) {
-                                                    target_h = current_dims.second;
-                                                }
-                                            }
-                                            if (target_w == 0 || target_h == 0) {
-                                                // TODO: get display size
-                                                STUB("XTWINOPS display size reports");
-                                                break;
-                                            }
+                                        CALL(self->callbacks.on_window_dimensions_set,
+                                             self->callbacks.user_data,
+                                             target_w,
+                                             target_h);
+                                    } else {
+                                        WRN("Invalid XTWINOPS sequence: %s\n",
+                                            csi_sequence_to_string(csi));
+                                    }
+                                    break;
 
-                                            CALL(self->callbacks.on_window_dimensions_set,
-                                                 self->callbacks.user_data,
-                                                 target_w,
-                                                 target_h);
-                                        } else {
-                                            WRN("Invalid XTWINOPS sequence: %s\n", seq);
-                                        }
-                                        break;
+                                /* Raise window */
+                                case 5:
+                                    // TODO:
+                                    break;
+
+                                /* lower window */
+                                case 6:
+                                    // TODO:
+                                    break;
 
-                                    /* Raise window */
-                                    case 5:
-                                        // TODO:
+                                /* Refresh window */
+                                case 7:
+                                    if (!settings.windowops_manip) {
                                         break;
+                                    }
+                                    self->defered_events.action_performed = true;
+                                    self->defered_events.repaint          = true;
+                                    break;
 
-                                    /* lower window */
-                                    case 6:
-                                        // TODO:
+                                /* Resize in cells */
+                                case 8: {
+                                    if (!settings.windowops_manip) {
                                         break;
+                                    }
+                                    if (nargs >= 2) {
+                                        int32_t target_rows = args[1];
+                                        int32_t target_cols = nargs >= 3 ? args[2] : -1;
+
+                                        Pair_uint32_t target_text_area_dims = CALL(
+                                          self->callbacks.on_window_size_from_cells_requested,
+                                          self->callbacks.user_data,
+                                          target_cols > 0 ? target_cols : 1,
+                                          target_rows > 0 ? target_rows : 1);
+
+                                        Pair_uint32_t currnet_text_area_dims =
+                                          CALL(self->callbacks.on_text_area_size_requested,
+                                               self->callbacks.user_data);
 
-                                    /* Refresh window */
-                                    case 7:
-                                        if (!settings.windowops_manip) {
+                                        if (target_cols == -1) {
+                                            target_text_area_dims.first =
+                                              currnet_text_area_dims.first;
+                                        }
+                                        if (target_rows == -1) {
+                                            target_text_area_dims.second =
+                                              currnet_text_area_dims.second;
+                                        }
+                                        if (target_cols == 0 || target_rows == 0) {
+                                            STUB("XTWINOPS display size reports");
                                             break;
                                         }
-                                        self->defered_events.action_performed = true;
-                                        self->defered_events.repaint          = true;
-                                        break;
 
-                                    /* Resize in cells */
-                                    case 8: {
-                                        if (!settings.windowops_manip) {
+                                        if (target_cols > UINT16_MAX || target_rows > UINT16_MAX) {
+                                            LOG("WinOps requested window size too large\n");
                                             break;
                                         }
-                                        if (nargs >= 2) {
-                                            int32_t target_rows = args[1];
-                                            int32_t target_cols = nargs >= 3 ? args[2] : -1;
-
-                                            Pair_uint32_t target_text_area_dims = CALL(
-                                              self->callbacks.on_window_size_from_cells_requested,
-                                              self->callbacks.user_data,
-                                              target_cols > 0 ? target_cols : 1,
-                                              target_rows > 0 ? target_rows : 1);
-
-                                            Pair_uint32_t currnet_text_area_dims =
-                                              CALL(self->callbacks.on_text_area_size_requested,
-                                                   self->callbacks.user_data);
 
-                                            if (target_cols == -1) {
-                                                target_text_area_dims.first =
-                                                  currnet_text_area_dims.first;
-                                            }
-                                            if (target_rows == -1) {
-                                                target_text_area_dims.second =
-                                                  currnet_text_area_dims.second;
-                                            }
-                                            if (target_cols == 0 || target_rows == 0) {
-                                                STUB("XTWINOPS display size reports");
+                                        CALL(self->callbacks.on_text_area_dimensions_set,
+                                             self->callbacks.user_data,
+                                             target_text_area_dims.first,
+                                             target_text_area_dims.second);
+                                    } else {
+                                        WRN("Invalid XTWINOPS sequence: %s\n",
+                                            csi_sequence_to_string(csi));
+                                    }
+                                } break;
+
+                                /* Maximize */
+                                case 9: {
+                                    if (!settings.windowops_manip) {
+                                        break;
+                                    }
+                                    if (nargs >= 2) {
+                                        switch (args[1]) {
+                                            /* Unmaximize */
+                                            case 0:
+                                                CALL(
+                                                  self->callbacks.on_window_maximize_state_set,
+                                                  self->callbacks.user_data,
+                                                  false);
                                                 break;
-                                            }
 
-                                            if (target_cols > UINT16_MAX ||
-                                                target_rows > UINT16_MAX) {
-                                                LOG("WinOps requested window size too large\n");
+                                            /* invisible-island.net:
+                                             * `xterm uses Extended Window Manager Hints (EWMH)
+                                             * to maximize the window.  Some window managers
+                                             * have incomplete support for EWMH.  For instance,
+                                             * fvwm, flwm and quartz-wm advertise support for
+                                             * maximizing windows horizontally or vertically,
+                                             * but in fact equate those to the maximize
+                                             * operation.`
+                                             *
+                                             * Waylands xdg_shell/wl_shell have no concept of
+                                             * 'vertical/horizontal window maximization' so we
+                                             * should also treat that as regular maximization.
+                                             */
+                                            /* Maximize */
+                                            case 1:
+                                            /* Maximize vertically */
+                                            case 2:
+                                            /* Maximize horizontally */
+                                            case 3:
+                                                CALL(
+                                                  self->callbacks.on_window_maximize_state_set,
+                                                  self->callbacks.user_data,
+                                                  true);
                                                 break;
-                                            }
 
-                                            CALL(self->callbacks.on_text_area_dimensions_set,
-                                                 self->callbacks.user_data,
-                                                 target_text_area_dims.first,
-                                                 target_text_area_dims.second);
-                                        } else {
-                                            WRN("Invalid XTWINOPS sequence: %s\n", seq);
+                                            default:
+                                                WRN("Invalid XTWINOPS: %s\n",
+                                                    csi_sequence_to_string(csi));
                                         }
-                                    } break;
+                                    } else {
+                                        WRN("Invalid XTWINOPS: %s\n", csi_sequence_to_string(csi));
+                                    }
+                                } break;
 
-                                    /* Maximize */
-                                    case 9: {
-                                        if (!settings.windowops_manip) {
-                                            break;
-                                        }
-                                        if (nargs >= 2) {
-                                            switch (args[1]) {
-                                                /* Unmaximize */
-                                                case 0:
-                                                    CALL(
-                                                      self->callbacks.on_window_maximize_state_set,
-                                                      self->callbacks.user_data,
-                                                      false);
-                                                    break;
-
-                                                /* invisible-island.net:
-                                                 * `xterm uses Extended Window Manager Hints (EWMH)
-                                                 * to maximize the window.  Some window managers
-                                                 * have incomplete support for EWMH.  For instance,
-                                                 * fvwm, flwm and quartz-wm advertise support for
-                                                 * maximizing windows horizontally or vertically,
-                                                 * but in fact equate those to the maximize
-                                                 * operation.`
-                                                 *
-                                                 * Waylands xdg_shell/wl_shell have no concept of
-                                                 * 'vertical/horizontal window maximization' so we
-                                                 * should also treat that as regular maximization.
-                                                 */
-                                                /* Maximize */
-                                                case 1:
-                                                /* Maximize vertically */
-                                                case 2:
-                                                /* Maximize horizontally */
-                                                case 3:
-                                                    CALL(
-                                                      self->callbacks.on_window_maximize_state_set,
-                                                      self->callbacks.user_data,
-                                                      true);
-                                                    break;
-
-                                                default:
-                                                    WRN("Invalid XTWINOPS: %s\n", seq);
-                                            }
-                                        } else {
-                                            WRN("Invalid XTWINOPS: %s\n", seq);
-                                        }
-                                    } break;
+                                    /* Fullscreen */
+                                case 10: {
+                                    if (!settings.windowops_manip) {
+                                        break;
+                                    }
+                                    if (nargs >= 2) {
+                                        switch (args[1]) {
+                                            /* Disable */
+                                            case 0:
+                                                CALL(self->callbacks
+                                                       .on_window_fullscreen_state_set,
+                                                     self->callbacks.user_data,
+                                                     false);
+                                                break;
 
-                                        /* Fullscreen */
-                                    case 10: {
-                                        if (!settings.windowops_manip) {
-                                            break;
-                                        }
-                                        if (nargs >= 2) {
-                                            switch (args[1]) {
-                                                /* Disable */
-                                                case 0:
-                                                    CALL(self->callbacks
-                                                           .on_window_fullscreen_state_set,
-                                                         self->callbacks.user_data,
-                                                         false);
-                                                    break;
-
-                                                /* Enable */
-                                                case 1:
-                                                    CALL(self->callbacks
-                                                           .on_window_fullscreen_state_set,
-                                                         self->callbacks.user_data,
-                                                         true);
-                                                    break;
-
-                                                    /* Toggle */
-                                                case 2: {
-                                                    bool current_state = CALL(
-                                                      self->callbacks.on_fullscreen_state_requested,
-                                                      self->callbacks.user_data);
-                                                    CALL(self->callbacks
-                                                           .on_window_fullscreen_state_set,
-                                                         self->callbacks.user_data,
-                                                         !current_state);
-                                                } break;
-
-                                                default:
-                                                    WRN("Invalid XTWINOPS: %s\n", seq);
-                                                    break;
-                                            }
-                                        } else {
-                                            WRN("Invalid XTWINOPS: %s\n", seq);
-                                        }
-                                    } break;
+                                            /* Enable */
+                                            case 1:
+                                                CALL(self->callbacks
+                                                       .on_window_fullscreen_state_set,
+                                                     self->callbacks.user_data,
+                                                     true);
+                                                break;
 
-                                    /* Report iconification state */
-                                    case 11: {
-                                        if (!settings.windowops_info) {
-                                            break;
+                                                /* Toggle */
+                                            case 2: {
+                                                bool current_state = CALL(
+                                                  self->callbacks.on_fullscreen_state_requested,
+                                                  self->callbacks.user_data);
+                                                CALL(self->callbacks
+                                                       .on_window_fullscreen_state_set,
+                                                     self->callbacks.user_data,
+                                                     !current_state);
+                                            } break;
+
+                                            default:
+                                                WRN("Invalid XTWINOPS: %s\n",
+                                                    csi_sequence_to_string(csi));
+                                                break;
                                         }
-                                        bool is_minimized =
-                                          CALL(self->callbacks.on_minimized_state_requested,
-                                               self->callbacks.user_data);
-                                        Vt_output_formated(self, "\e[%d", is_minimized ? 1 : 2);
+                                    } else {
+                                        WRN("Invalid XTWINOPS: %s\n", csi_sequence_to_string(csi));
+                                    }
+                                } break;
 
-                                    } break;
+                                /* Report iconification state */
+                                case 11: {
+                                    if (!settings.windowops_info) {
+                                        break;
+                                    }
+                                    bool is_minimized =
+                                      CALL(self->callbacks.on_minimized_state_requested,
+                                           self->callbacks.user_data);
+                                    Vt_output_formated(self, "\e[%d", is_minimized ? 1 : 2);
 
-                                    /* Report window position */
-                                    case 13: {
-                                        if (!settings.windowops_info) {
-                                            break;
-                                        }
-                                        Pair_uint32_t pos =
-                                          CALL(self->callbacks.on_window_position_requested,
-                                               self->callbacks.user_data);
-                                        Vt_output_formated(self,
-                                                           "\e[3;%d;%d;t",
-                                                           pos.first,
-                                                           pos.second);
-                                    } break;
-
-                                    /* Report window size in pixels */
-                                    case 14: {
-                                        if (!settings.windowops_info) {
-                                            break;
-                                        }
-                                        Vt_output_formated(self,
-                                                           "\e[4;%d;%d;t",
-                                                           self->ws.ws_xpixel,
-                                                           self->ws.ws_ypixel);
-                                    } break;
-
-                                    /* Report text area size in chars */
-                                    case 18: {
-                                        if (!settings.windowops_info) {
-                                            break;
-                                        }
-                                        Vt_output_formated(self,
-                                                           "\e[8;%d;%d;t",
-                                                           Vt_col(self),
-                                                           Vt_row(self));
+                                } break;
 
-                                    } break;
+                                /* Report window position */
+                                case 13: {
+                                    if (!settings.windowops_info) {
+                                        break;
+                                    }
+                                    Pair_uint32_t pos =
+                                      CALL(self->callbacks.on_window_position_requested,
+                                           self->callbacks.user_data);
+                                    Vt_output_formated(self, "\e[3;%d;%d;t", pos.first, pos.second);
+                                } break;
 
-                                    /* Report window size in chars */
-                                    case 19: {
-                                        if (!settings.windowops_info) {
-                                            break;
-                                        }
-                                        Vt_output_formated(self,
-                                                           "\e[9;%d;%d;t",
-                                                           Vt_col(self),
-                                                           Vt_row(self));
-
-                                    } break;
-
-                                    /* Report icon name */
-                                    case 20:
-                                        /* Report window title */
-                                    case 21: {
-                                        if (!settings.windowops_info) {
-                                            break;
-                                        }
-                                        Vt_output_formated(self, "\e]L%s\e\\", self->title);
-                                    } break;
+                                /* Report window size in pixels */
+                                case 14: {
+                                    if (!settings.windowops_info) {
+                                        break;
+                                    }
+                                    Vt_output_formated(self,
+                                                       "\e[4;%d;%d;t",
+                                                       self->ws.ws_xpixel,
+                                                       self->ws.ws_ypixel);
+                                } break;
+
+                                /* Report text area size in chars */
+                                case 18: {
+                                    if (!settings.windowops_info) {
+                                        break;
+                                    }
+                                    Vt_output_formated(self,
+                                                       "\e[8;%d;%d;t",
+                                                       Vt_col(self),
+                                                       Vt_row(self));
 
-                                    /* push title to stack */
-                                    case 22:
-                                        Vt_push_title(self);
-                                        LOG("Title stack push\n");
+                                } break;
+
+                                /* Report window size in chars */
+                                case 19: {
+                                    if (!settings.windowops_info) {
                                         break;
+                                    }
+                                    Vt_output_formated(self,
+                                                       "\e[9;%d;%d;t",
+                                                       Vt_col(self),
+                                                       Vt_row(self));
 
-                                    /* pop title from stack */
-                                    case 23:
-                                        Vt_pop_title(self);
-                                        LOG("Title stack pop\n");
+                                } break;
+
+                                /* Report icon name */
+                                case 20:
+                                    /* Report window title */
+                                case 21: {
+                                    if (!settings.windowops_info) {
                                         break;
+                                    }
+                                    Vt_output_formated(self, "\e]L%s\e\\", self->title);
+                                } break;
 
-                                    /* Resize window to args[1] lines (DECSLPP) */
-                                    default: {
-                                        Pair_uint32_t target_dims =
-                                          CALL(self->callbacks.on_window_size_from_cells_requested,
-                                               self->callbacks.user_data,
-                                               Vt_col(self),
-                                               short_sequence_get_int_argument(seq));
+                                /* push title to stack */
+                                case 22:
+                                    Vt_push_title(self);
+                                    LOG("Title stack push\n");
+                                    break;
 
-                                        if (target_dims.second > UINT16_MAX) {
-                                            LOG("WinOps requested window size too large\n");
-                                        } else {
-                                            CALL(self->callbacks.on_window_dimensions_set,
-                                                 self->callbacks.user_data,
-                                                 target_dims.first,
-                                                 target_dims.second);
-                                        }
+                                /* pop title from stack */
+                                case 23:
+                                    Vt_pop_title(self);
+                                    LOG("Title stack pop\n");
+                                    break;
+
+                                /* Resize window to args[1] lines (DECSLPP) */
+                                default: {
+                                    Pair_uint32_t target_dims =
+                                      CALL(self->callbacks.on_window_size_from_cells_requested,
+                                           self->callbacks.user_data,
+                                           Vt_col(self),
+                                           args[0]);
+
+                                    if (target_dims.second > UINT16_MAX) {
+                                        LOG("WinOps requested window size too large\n");
+                                    } else {
+                                        CALL(self->callbacks.on_window_dimensions_set,
+                                             self->callbacks.user_data,
+                                             target_dims.first,
+                                             target_dims.second);
                                     }
                                 }
+                            }
 
-                            } break;
-
-                            default:
-                                WRN("Unknown CSI sequence: %s\n", seq);
+                        } break;
 
-                        } // end switch (last_char)
-                    }
-                } // end switch (second_last_char)
-            }
-        } // end switch (first_char)
+                        default:
+                            WRN("Unknown CSI sequence: %s\n", csi_sequence_to_string(csi));
 
-        Vector_clear_char(&self->parser.active_sequence);
-        self->parser.state = PARSER_STATE_LITERAL;
-    }
+                    } // end switch (last_char)
+                }
+            } // end switch (intermediate)
+        }
+    } // end switch (private_marker)
 }
 
 static inline void Vt_alt_buffer_on(Vt* self, bool save_mouse)
@@ -3546,10 +4290,10 @@ static inline void Vt_alt_buffer_on(Vt* self, bool save_mouse)
     self->has_last_inserted_rune = false;
     self->alt_lines              = self->lines;
     self->alt_image_views        = self->image_views;
-    self->lines                  = Vector_new_VtLine(self);
+    self->lines                  = Ring_new_VtLine(self);
     self->image_views            = Vector_new_RcPtr_VtImageSurfaceView();
     for (uint16_t i = 0; i < Vt_row(self); ++i) {
-        Vector_push_VtLine(&self->lines, VtLine_new());
+        Ring_push_VtLine(&self->lines, VtLine_new());
     }
     if (save_mouse) {
         self->alt_cursor_pos  = self->cursor.col;
@@ -3566,7 +4310,8 @@ static inline void Vt_alt_buffer_off(Vt* self, bool save_mouse)
     if (self->alt_lines.buf) {
         self->has_last_inserted_rune = false;
         Vt_select_end(self);
-        Vector_destroy_VtLine(&self->lines);
+        uint16_t screen_row = self->cursor.row - Vt_top_line(self);
+        Ring_destroy_VtLine(&self->lines);
         Vector_destroy_RcPtr_VtImageSurfaceView(&self->image_views);
         self->lines          = self->alt_lines;
         self->image_views    = self->alt_image_views;
@@ -3574,7 +4319,11 @@ static inline void Vt_alt_buffer_off(Vt* self, bool save_mouse)
         self->alt_lines.size = 0;
         if (save_mouse) {
             self->cursor.col = self->alt_cursor_pos;
-            self->cursor.row = self->alt_active_line;
+            self->cursor.row =
+              CLAMP(self->alt_active_line, Vt_top_line(self), Vt_bottom_line(self));
+        } else {
+            /* keep the cursor on the same screen row, not at a scrollback line */
+            self->cursor.row = Vt_top_line(self) + screen_row;
         }
         self->scroll_region_top    = 0;
         self->scroll_region_bottom = Vt_row(self) - 1;
@@ -3588,11 +4337,9 @@ static inline void Vt_alt_buffer_off(Vt* self, bool save_mouse)
 /**
  * Interpret a single argument SGR command */
 __attribute__((hot)) static void Vt_handle_single_argument_SGR(Vt*     self,
-                                                               char*   command,
+                                                               int32_t cmd,
                                                                VtRune* opt_target)
 {
-    int cmd = *command ? atoi(command) : 0;
-
     VtRune* r = OR(opt_target, &self->parser.char_state);
 
 #define MAYBE_DISABLE_ALL_UNDERLINES                                                               \
@@ -3791,82 +4538,152 @@ __attribute__((hot)) static void Vt_handle_single_argument_SGR(Vt*     self,
     }
 }
 
+/**
+ * Set foreground, background or underline color from SGR 38, 48 or 58 arguments
+ *
+ * @param args - color space followed by the color (5;idx or 2;r;g;b) */
+static void Vt_handle_SGR_color(Vt*            self,
+                                int32_t        cmd,
+                                const int32_t* args,
+                                uint8_t        n_args,
+                                VtRune*        opt_target)
+{
+    if (!n_args) {
+        return;
+    }
+
+#define SGR_COLOR_ARG(_i) ((uint8_t)CLAMP(args[_i], 0, 255))
+
+    switch (args[0]) {
+        /* from 256 palette (one argument) */
+        case 5: {
+            if (n_args < 2) {
+                return;
+            }
+            uint8_t idx = SGR_COLOR_ARG(1);
+            if (cmd == 38) {
+                Vt_set_fg_color_palette(self, idx, opt_target);
+            } else if (cmd == 48) {
+                Vt_set_bg_color_palette(self, idx, opt_target);
+            } else {
+                Vt_set_line_color_palette(self, idx, opt_target);
+            }
+        } break;
+
+        /* sent as 24-bit rgb (three arguments) */
+        case 2: {
+            if (n_args < 4) {
+                return;
+            }
+            uint8_t r = SGR_COLOR_ARG(1), g = SGR_COLOR_ARG(2), b = SGR_COLOR_ARG(3);
+            if (cmd == 38) {
+                Vt_set_fg_color_custom(self, (ColorRGB){ .r = r, .g = g, .b = b }, opt_target);
+            } else if (cmd == 48) {
+                Vt_set_bg_color_custom(self,
+                                       (ColorRGBA){ .r = r, .g = g, .b = b, .a = 255 },
+                                       opt_target);
+            } else {
+                Vt_set_line_color_custom(self, (ColorRGB){ .r = r, .g = g, .b = b }, opt_target);
+            }
+        } break;
+
+        default:
+            WRN("Unknown SGR color space: %d\n", args[0]);
+    }
+
+#undef SGR_COLOR_ARG
+}
+
 /**
  * Interpret an SGR sequence
  *
- * SGR codes are separated by one ';' or ':', some values require a set number of following
- * 'arguments'. 'Commands' may be combined into a single sequence. A ';' without any text should be
- * interpreted as a 0 (CSI ; 3 m == CSI 0 ; 3 m), but ':' should not
- * (CSI 58:2::130:110:255 m == CSI 58:2:130:110:255 m)" */
-static void Vt_handle_multi_argument_SGR(Vt* self, Vector_char seq, VtRune* opt_target)
-{
-    Vector_Vector_char tokens = string_split_on(seq.buf, ";", ":", NULL);
-    for (Vector_char* token = NULL; (token = Vector_iter_Vector_char(&tokens, token));) {
-        Vector_char* args[] = { token, NULL, NULL, NULL, NULL };
-
-        /* color change 'commands' */
-        if (!strcmp(token->buf + 1, "38") /* foreground */ ||
-            !strcmp(token->buf + 1, "48") /* background */ ||
-            !strcmp(token->buf + 1, "58") /* underline  */) {
-            /* next argument determines how the color will be set and final number of args */
-
-            if ((args[1] = (token = Vector_iter_Vector_char(&tokens, token))) &&
-                (args[2] = (token = Vector_iter_Vector_char(&tokens, token)))) {
-                if (!strcmp(args[1]->buf + 1, "5")) {
-                    /* from 256 palette (one argument) */
-                    uint32_t idx = MIN(atoi(args[2]->buf + 1), 255);
-                    if (args[0]->buf[1] == '3') {
-                        Vt_set_fg_color_palette(self, idx, opt_target);
-                    } else if (args[0]->buf[1] == '4') {
-                        Vt_set_bg_color_palette(self, idx, opt_target);
-                    } else if (args[0]->buf[1] == '5') {
-                        Vt_set_line_color_palette(self, idx, opt_target);
+ * SGR codes are separated by ';', some values require a set number of following 'arguments'.
+ * 'Commands' may be combined into a single sequence. An omitted parameter is interpreted as a 0
+ * (CSI ; 3 m == CSI 0 ; 3 m).
+ *
+ * Color arguments may also be sent as ':' separated sub-parameters with an optional color space
+ * identifier (CSI 58:2::130:110:255 m == CSI 58:2:130:110:255 m == CSI 58;2;130;110;255 m) */
+static void Vt_handle_multi_argument_SGR(Vt* self, const vt_csi_sequence_t* csi, VtRune* opt_target)
+{
+    if (!csi->n_params) {
+        Vt_handle_single_argument_SGR(self, 0, opt_target);
+        return;
+    }
+
+    for (uint8_t i = 0; i < csi->n_params;) {
+        int32_t cmd = csi_sequence_get_int_argument(csi, i, 0);
+
+        /* number of ':' separated sub-parameters following this one */
+        uint8_t n_sub = 0;
+        while (i + n_sub + 1 < csi->n_params && (csi->sub_param_mask & (1u << (i + n_sub + 1)))) {
+            ++n_sub;
+        }
+
+        switch (cmd) {
+            /* color change 'commands' */
+            case 38: /* foreground */
+            case 48: /* background */
+            case 58: /* underline  */ {
+                int32_t color[4] = { 0 };
+                uint8_t n_args;
+
+                if (n_sub) {
+                    /* 2:colorspace:r:g:b - skip the color space id */
+                    uint8_t skip = csi->params[i + 1] == 2 && n_sub >= 5;
+                    n_args       = MIN(n_sub - skip, (int)ARRAY_SIZE(color));
+                    for (uint8_t j = 0; j < n_args; ++j) {
+                        uint8_t idx = i + 1 + j + (j ? skip : 0);
+                        color[j]    = csi_sequence_get_int_argument(csi, idx, 0);
+                    }
+                } else {
+                    /* next argument determines how the color will be set and final number of
+                     * args */
+                    int32_t space = csi_sequence_get_int_argument(csi, i + 1, 0);
+                    n_args        = space == 2 ? 4 : space == 5 ? 2 : 1;
+                    if (i + 1 + n_args > csi->n_params) {
+                        return;
                     }
-                } else if (!strcmp(args[1]->buf + 1, "2")) {
-                    /* sent as 24-bit rgb (three arguments) */
-                    if ((args[3] = (token = Vector_iter_Vector_char(&tokens, token))) &&
-                        (args[4] = (token = Vector_iter_Vector_char(&tokens, token)))) {
-                        uint32_t c[3] = { MIN(atoi(args[2]->buf + 1), 255),
-                                          MIN(atoi(args[3]->buf + 1), 255),
-                                          MIN(atoi(args[4]->buf + 1), 255) };
-
-                        if (args[0]->buf[1] == '3') {
-                            ColorRGB clr = { .r = c[0], .g = c[1], .b = c[2] };
-                            Vt_set_fg_color_custom(self, clr, opt_target);
-                        } else if (args[0]->buf[1] == '4') {
-                            ColorRGBA clr = { .r = c[0], .g = c[1], .b = c[2], .a = 255 };
-                            Vt_set_bg_color_custom(self, clr, opt_target);
-                        } else if (args[0]->buf[1] == '5') {
-                            ColorRGB clr = { .r = c[0], .g = c[1], .b = c[2] };
-                            Vt_set_line_color_custom(self, clr, opt_target);
-                        }
+                    for (uint8_t j = 0; j < n_args; ++j) {
+                        color[j] = csi_sequence_get_int_argument(csi, i + 1 + j, 0);
                     }
                 }
-            }
-        } else if (!strcmp(token->buf + 1, "4")) {
-            /* possible curly underline */
-            if ((args[1] = (token = Vector_iter_Vector_char(&tokens, token)))) {
-                /* enable this only on "4:3" not "4;3" */
-                if (!strcmp(args[1]->buf, ":3")) {
+
+                Vt_handle_SGR_color(self, cmd, color, n_args, opt_target);
+                i += (n_sub ? n_sub : n_args) + 1;
+            } break;
+
+            /* Underline style (4:0 - none, 4:1 - single, 4:2 - double, 4:3 - curly) */
+            case 4:
+                if (n_sub) {
                     VtRune* r = OR(opt_target, &self->parser.char_state);
-                    if (!settings.allow_multiple_underlines) {
-                        r->underlined      = false;
-                        r->doubleunderline = false;
+                    switch (csi_sequence_get_int_argument(csi, i + 1, 1)) {
+                        case 0:
+                            Vt_handle_single_argument_SGR(self, 24, opt_target);
+                            break;
+                        case 2:
+                            Vt_handle_single_argument_SGR(self, 21, opt_target);
+                            break;
+                        case 3:
+                            if (!settings.allow_multiple_underlines) {
+                                r->underlined      = false;
+                                r->doubleunderline = false;
+                            }
+                            r->curlyunderline = true;
+                            break;
+                        default:
+                            Vt_handle_single_argument_SGR(self, 4, opt_target);
                     }
-                    r->curlyunderline = true;
                 } else {
-                    Vt_handle_single_argument_SGR(self, args[0]->buf + 1, opt_target);
-                    token = Vector_iter_back_Vector_char(&tokens, token);
+                    Vt_handle_single_argument_SGR(self, 4, opt_target);
                 }
-            } else {
-                Vt_handle_single_argument_SGR(self, args[0]->buf + 1, opt_target);
-                break; // end of sequence
-            }
-        } else {
-            Vt_handle_single_argument_SGR(self, token->buf + 1, opt_target);
+                i += n_sub + 1;
+                break;
+
+            default:
+                Vt_handle_single_argument_SGR(self, cmd, opt_target);
+                i += n_sub + 1;
         }
     }
-    Vector_destroy_Vector_char(&tokens);
 }
 
 static void Vt_handle_APC(Vt* self, char c)
@@ -4062,14 +4879,15 @@ static void Vt_handle_APC(Vt* self, char c)
         if (view && expr) {                                                                        \
             Vector_push_vt_image_surface_view_delete_action_t(                                     \
               &dels,                                                                               \
-              (vt_image_surface_view_delete_action_t){ .line = view->anchor_global_index,          \
-                                                       .view = view });                            \
+              (vt_image_surface_view_delete_action_t){                                             \
+                .line = Vt_line_id_to_row(self, view->anchor_line_id),                             \
+                .view = view });                                                                   \
         }                                                                                          \
     }                                                                                              \
     for (vt_image_surface_view_delete_action_t* i = NULL;                                          \
          (i = Vector_iter_vt_image_surface_view_delete_action_t(&dels, i));) {                     \
-        VtLine* ln = &self->lines.buf[i->line];                                                    \
-        if (ln->graphic_attachments && ln->graphic_attachments->images) {                          \
+        VtLine* ln = Vt_line_at(self, i->line);                                                    \
+        if (ln && ln->graphic_attachments && ln->graphic_attachments->images) {                    \
             for (RcPtr_VtImageSurfaceView* p = NULL;                                               \
                  (p =                                                                              \
                     Vector_iter_RcPtr_VtImageSurfaceView(ln->graphic_attachments->images, p));) {  \
@@ -4112,9 +4930,10 @@ static void Vt_handle_APC(Vt* self, char c)
                             case 'c':
                             case 'C': {
                                 L_DELETE_IMG_VIEWS_FILTERED(
-                                  VtImageSurfaceView_intersects(view,
-                                                                self->cursor.row,
-                                                                self->cursor.col))
+                                  VtImageSurfaceView_intersects(
+                                    view,
+                                    Vt_line_id(self, self->cursor.row),
+                                    self->cursor.col))
                             } break;
 
                             /* Delete all images that intersect a specific cell (x=, y=) */
@@ -4122,7 +4941,8 @@ static void Vt_handle_APC(Vt* self, char c)
                             case 'P': {
                                 L_DELETE_IMG_VIEWS_FILTERED(VtImageSurfaceView_intersects(
                                   view,
-                                  display_args.sample_offset_y + Vt_top_line(self) - 1,
+                                  Vt_line_id(self,
+                                             display_args.sample_offset_y + Vt_top_line(self) - 1),
                                   display_args.sample_offset_x))
                             } break;
 
@@ -4132,10 +4952,12 @@ static void Vt_handle_APC(Vt* self, char c)
                             case 'Q': {
                                 L_DELETE_IMG_VIEWS_FILTERED(
                                   view->z_layer == display_args.z_layer &&
-                                  VtImageSurfaceView_intersects(view,
-                                                                display_args.sample_offset_y +
-                                                                  Vt_top_line(self) - 1,
-                                                                display_args.sample_offset_x))
+                                  VtImageSurfaceView_intersects(
+                                    view,
+                                    Vt_line_id(self,
+                                               display_args.sample_offset_y +
+                                                 Vt_top_line(self) - 1),
+                                    display_args.sample_offset_x))
                             } break;
 
                             /* Delete all images that intersect a specific column (x=) */
@@ -4151,7 +4973,8 @@ static void Vt_handle_APC(Vt* self, char c)
                             case 'Y': {
                                 L_DELETE_IMG_VIEWS_FILTERED(VtImageSurfaceView_spans_line(
                                   view,
-                                  display_args.anchor_offset_y + Vt_top_line(self) - 1))
+                                  Vt_line_id(self,
+                                             display_args.anchor_offset_y + Vt_top_line(self) - 1)))
                             } break;
 
                             /* Delete all on given z-layer (z=) */
@@ -4548,13 +5371,8 @@ static void Vt_handle_OSC(Vt* self, char c)
                 strsep(&seq, ";\0");
                 char* link = strsep(&seq, ";\0");
 
-                if (link && strnlen(link, 1)) {
-                    free(self->active_hyperlink);
-                    self->active_hyperlink = strdup(link);
-                } else {
-                    free(self->active_hyperlink);
-                    self->active_hyperlink = NULL;
-                }
+                self->active_hyperlink =
+                  link && strnlen(link, 1) ? Vt_intern_uri(self, link, false) : 0;
             } break;
 
             /* ConEmu specific OSC (used by WindowsTerminal)
@@ -5061,6 +5879,56 @@ static void Vt_carriage_return(Vt* self)
     Vt_move_cursor(self, 0, Vt_cursor_row(self));
 }
 
+/**
+ * Move lines in [top, bottom] up by one, discarding the line at top and leaving a new empty line at
+ * bottom. Lines are moved within the ring, so this costs O(bottom - top) and leaves the scrollback
+ * and everything below the range alone */
+static void Vt_rotate_lines_up(Vt* self, size_t top, size_t bottom)
+{
+    VtLine removed = *Ring_at_VtLine(&self->lines, top);
+
+    for (size_t i = top; i < bottom; ++i) {
+        *Ring_at_VtLine(&self->lines, i) = *Ring_at_VtLine(&self->lines, i + 1);
+    }
+
+    *Ring_at_VtLine(&self->lines, bottom) = VtLine_new();
+
+    if (top < bottom) {
+        Vt_shift_global_line_index_refs(self, top + 1, -1, true);
+        Vt_shift_global_line_index_refs(self, bottom, 1, true);
+    }
+
+    Vt_about_to_delete_line_by_scroll_up(self,
+                                         &removed,
+                                         Ring_at_VtLine(&self->lines, top),
+                                         Vt_line_id(self, top));
+    VtLine_destroy(self, &removed);
+    Vt_empty_line_fill_bg(self, bottom);
+}
+
+/**
+ * Move lines in [top, bottom] down by one, discarding the line at bottom and leaving a new empty
+ * line at top */
+static void Vt_rotate_lines_down(Vt* self, size_t top, size_t bottom)
+{
+    Vt_about_to_delete_line_by_scroll_down(self, bottom);
+    VtLine removed = *Ring_at_VtLine(&self->lines, bottom);
+
+    for (size_t i = bottom; i > top; --i) {
+        *Ring_at_VtLine(&self->lines, i) = *Ring_at_VtLine(&self->lines, i - 1);
+    }
+
+    *Ring_at_VtLine(&self->lines, top) = VtLine_new();
+
+    if (top < bottom) {
+        Vt_shift_global_line_index_refs(self, top, 1, true);
+        Vt_shift_global_line_index_refs(self, bottom + 1, -1, true);
+    }
+
+    VtLine_destroy(self, &removed);
+    Vt_empty_line_fill_bg(self, top);
+}
+
 /**
  * make a new empty line at cursor position, scroll down contents below */
 static void Vt_insert_line(Vt* self)
@@ -5070,16 +5938,11 @@ static void Vt_insert_line(Vt* self)
     }
 
     self->has_last_inserted_rune = false;
-    Vector_insert_at_VtLine(&self->lines, self->cursor.row, VtLine_new());
-    Vt_shift_global_line_index_refs(self, self->cursor.row, 1, true);
-
-    Vt_empty_line_fill_bg(self, self->cursor.row);
-
-    size_t rem_idx = MIN(Vt_get_scroll_region_bottom(self), Vt_bottom_line(self));
-    Vt_about_to_delete_line_by_scroll_down(self, rem_idx);
-    Vector_remove_at_VtLine(&self->lines, rem_idx, 1);
-    Vt_shift_global_line_index_refs(self, rem_idx + 1, -1, true);
-
+    /* Lines below the scroll region are not affected */
+    size_t bottom = MIN(Vt_get_scroll_region_bottom(self), Vt_bottom_line(self));
+    if (self->cursor.row <= bottom) {
+        Vt_rotate_lines_down(self, self->cursor.row, bottom);
+    }
     Vt_mark_proxies_damaged_in_selected_region_and_scroll_region(self);
 }
 
@@ -5093,14 +5956,7 @@ static void Vt_reverse_line_feed(Vt* self)
 
     self->has_last_inserted_rune = false;
     if (self->cursor.row == Vt_get_scroll_region_top(self)) {
-        Vt_about_to_delete_line_by_scroll_down(self, Vt_get_scroll_region_bottom(self));
-        Vector_remove_at_VtLine(&self->lines, Vt_get_scroll_region_bottom(self), 1);
-        Vt_shift_global_line_index_refs(self, Vt_get_scroll_region_bottom(self) + 1, -1, true);
-
-        Vector_insert_at_VtLine(&self->lines, self->cursor.row, VtLine_new());
-        Vt_shift_global_line_index_refs(self, self->cursor.row, 1, true);
-
-        Vt_empty_line_fill_bg(self, self->cursor.row);
+        Vt_rotate_lines_down(self, self->cursor.row, Vt_get_scroll_region_bottom(self));
     } else if (Vt_cursor_row(self)) {
         Vt_move_cursor(self, self->cursor.col, Vt_cursor_row(self) - 1);
     }
@@ -5117,16 +5973,11 @@ static void Vt_delete_line(Vt* self)
         Vt_mark_proxies_damaged_in_selected_region_and_scroll_region(self);
     }
 
-    size_t insert_idx = MIN(Vt_get_scroll_region_bottom(self), Vt_bottom_line(self)) + 1;
-    size_t remove_idx = self->cursor.row;
-
-    Vector_insert_at_VtLine(&self->lines, insert_idx, VtLine_new());
-    Vt_shift_global_line_index_refs(self, insert_idx, 1, true);
-    Vt_empty_line_fill_bg(self, insert_idx);
-
-    Vt_about_to_delete_line_by_scroll_up(self, remove_idx);
-    Vector_remove_at_VtLine(&self->lines, remove_idx, 1);
-    Vt_shift_global_line_index_refs(self, remove_idx + 1, -1, true);
+    /* Lines below the scroll region are not affected */
+    size_t bottom = MIN(Vt_get_scroll_region_bottom(self), Vt_bottom_line(self));
+    if (self->cursor.row <= bottom) {
+        Vt_rotate_lines_up(self, self->cursor.row, bottom);
+    }
 }
 
 static void Vt_scroll_up(Vt* self)
@@ -5136,16 +5987,9 @@ static void Vt_scroll_up(Vt* self)
     }
 
     self->has_last_inserted_rune = false;
-    size_t insert_idx            = MIN(Vt_bottom_line(self), Vt_get_scroll_region_bottom(self)) + 1;
-    Vector_insert_at_VtLine(&self->lines, insert_idx, VtLine_new());
-    Vt_shift_global_line_index_refs(self, insert_idx, 1, true);
-
-    size_t new_line_idx = MIN(Vt_bottom_line(self), Vt_get_scroll_region_bottom(self));
-    Vt_empty_line_fill_bg(self, new_line_idx);
-
-    Vt_about_to_delete_line_by_scroll_up(self, Vt_get_scroll_region_top(self) - 1);
-    Vector_remove_at_VtLine(&self->lines, Vt_get_scroll_region_top(self) - 1, 1);
-    Vt_shift_global_line_index_refs(self, Vt_get_scroll_region_top(self) - 1 + 1, -1, true);
+    Vt_rotate_lines_up(self,
+                       Vt_get_scroll_region_top(self),
+                       MIN(Vt_bottom_line(self), Vt_get_scroll_region_bottom(self)));
     Vt_mark_proxies_damaged_in_selected_region_and_scroll_region(self);
 }
 
@@ -5156,21 +6000,14 @@ static void Vt_scroll_down(Vt* self)
     }
 
     self->has_last_inserted_rune = false;
-    Vector_insert_at_VtLine(&self->lines, Vt_get_scroll_region_top(self), VtLine_new());
-    Vt_shift_global_line_index_refs(self, Vt_get_scroll_region_top(self), 1, true);
-
-    size_t rm_idx = MAX(Vt_top_line(self), Vt_get_scroll_region_bottom(self));
-    Vt_about_to_delete_line_by_scroll_down(self, rm_idx);
-    Vector_remove_at_VtLine(&self->lines, rm_idx, 1);
-    Vt_shift_global_line_index_refs(self, rm_idx + 1, -1, true);
-
+    Vt_rotate_lines_down(self, Vt_get_scroll_region_top(self), Vt_get_scroll_region_bottom(self));
     Vt_mark_proxies_damaged_in_selected_region_and_scroll_region(self);
 }
 
 static inline void Vt_erase_to_end(Vt* self)
 {
     for (size_t i = self->cursor.row + 1; i <= Vt_bottom_line(self); ++i) {
-        Vector_clear_VtRune(&self->lines.buf[i].data);
+        Vector_clear_VtCell(&Vt_writable_line(self, Ring_at_VtLine(&self->lines, i))->data);
         Vt_empty_line_fill_bg(self, i);
         Vt_sixel_clear_line(self, i);
     }
@@ -5192,12 +6029,15 @@ static inline void Vt_handle_backspace(Vt* self)
  * Overwrite characters with colored space */
 static inline void Vt_erase_chars(Vt* self, size_t n)
 {
+    VtCell fill = Vt_cell_from_rune(self, &self->parser.char_state);
+    Vt_writable_line(self, Vt_cursor_line(self));
+
     for (size_t i = 0; i < n; ++i) {
         size_t idx = self->cursor.col + i;
         if (idx >= Vt_cursor_line(self)->data.size) {
-            Vector_push_VtRune(&Vt_cursor_line(self)->data, self->parser.char_state);
+            Vector_push_VtCell(&Vt_cursor_line(self)->data, fill);
         } else {
-            Vt_cursor_line(self)->data.buf[idx] = self->parser.char_state;
+            Vt_cursor_line(self)->data.buf[idx] = fill;
         }
         Vt_sixel_overwrite_cell(self, self->cursor.row, idx);
     }
@@ -5208,9 +6048,11 @@ static inline void Vt_erase_chars(Vt* self, size_t n)
  * remove characters at cursor, remaining content scrolls left */
 static void Vt_delete_chars(Vt* self, size_t n)
 {
+    Vt_writable_line(self, Vt_cursor_line(self));
+
     /* Trim if line is longer than screen area */
     if (Vt_cursor_line(self)->data.size > Vt_col(self)) {
-        Vector_pop_n_VtRune(&Vt_cursor_line(self)->data,
+        Vector_pop_n_VtCell(&Vt_cursor_line(self)->data,
                             Vt_cursor_line(self)->data.size - Vt_col(self));
     }
 
@@ -5222,7 +6064,7 @@ static void Vt_delete_chars(Vt* self, size_t n)
 
     size_t left = Vt_cursor_line(self)->data.size - self->cursor.col;
 
-    Vector_remove_at_VtRune(&Vt_cursor_line(self)->data,
+    Vector_remove_at_VtCell(&Vt_cursor_line(self)->data,
                             self->cursor.col,
                             MIN(MIN(rm_size, n), left));
 
@@ -5233,41 +6075,41 @@ static void Vt_delete_chars(Vt* self, size_t n)
     Vt_reset_text_attribs(self, NULL);
 
     if (Vt_cursor_line(self)->data.size >= 2) {
-        self->parser.char_state.bg_data =
-          Vt_cursor_line(self)->data.buf[Vt_cursor_line(self)->data.size - 2].bg_data;
+        const VtRune* attrs =
+          Vt_cell_attrs(self, &Vt_cursor_line(self)->data.buf[Vt_cursor_line(self)->data.size - 2]);
 
-        self->parser.char_state.bg_is_palette_entry =
-          Vt_cursor_line(self)->data.buf[Vt_cursor_line(self)->data.size - 2].bg_is_palette_entry;
+        self->parser.char_state.bg_data             = attrs->bg_data;
+        self->parser.char_state.bg_is_palette_entry = attrs->bg_is_palette_entry;
     } else {
         Vt_set_bg_color_default(self, NULL);
     }
 
-    uint16_t st = Vt_cursor_line(self)->data.size ? Vt_cursor_line(self)->data.size - 1 : 0;
+    VtCell   fill = Vt_cell_from_rune(self, &self->parser.char_state);
+    uint16_t st   = Vt_cursor_line(self)->data.size ? Vt_cursor_line(self)->data.size - 1 : 0;
     for (size_t i = st; i < Vt_col(self); ++i) {
-        Vector_push_VtRune(&Vt_cursor_line(self)->data, self->parser.char_state);
+        Vector_push_VtCell(&Vt_cursor_line(self)->data, fill);
     }
 
     self->parser.char_state = tmp;
+    fill                    = Vt_cell_from_rune(self, &self->parser.char_state);
 
     if (Vt_cursor_line(self)->data.size > Vt_col(self)) {
-        Vector_pop_n_VtRune(&Vt_cursor_line(self)->data,
+        Vector_pop_n_VtCell(&Vt_cursor_line(self)->data,
                             Vt_cursor_line(self)->data.size - Vt_col(self));
     }
 
     /* ...add n spaces with currently set attributes to the end (right margin) */
     for (uint16_t i = 0; i < n && self->cursor.col + i < self->scroll_region_right + 1; ++i) {
         if (i == Vt_cursor_line(self)->data.size) {
-            Vector_push_VtRune(&Vt_cursor_line(self)->data, self->parser.char_state);
+            Vector_push_VtCell(&Vt_cursor_line(self)->data, fill);
         } else {
-            Vector_insert_at_VtRune(&Vt_cursor_line(self)->data,
-                                    self->scroll_region_right,
-                                    self->parser.char_state);
+            Vector_insert_at_VtCell(&Vt_cursor_line(self)->data, self->scroll_region_right, fill);
         }
     }
 
     /* Trim to screen size again */
-    if (self->lines.buf[self->cursor.row].data.size > Vt_col(self)) {
-        Vector_pop_n_VtRune(&Vt_cursor_line(self)->data,
+    if (Ring_at_VtLine(&self->lines, self->cursor.row)->data.size > Vt_col(self)) {
+        Vector_pop_n_VtCell(&Vt_cursor_line(self)->data,
                             Vt_cursor_line(self)->data.size - Vt_col(self));
     }
     Vt_mark_proxy_fully_damaged(self, self->cursor.row);
@@ -5283,8 +6125,8 @@ static inline void Vt_scroll_out_all_content(Vt* self)
     }
 
     size_t to_add = Vt_top_line(self);
-    for (size_t i = Vt_bottom_line(self); i >= Vt_top_line(self); --i) {
-        if (self->lines.buf[i].data.size) {
+    for (size_t i = Vt_bottom_line(self) + 1; i-- > Vt_top_line(self);) {
+        if (Ring_at_VtLine(&self->lines, i)->data.size) {
             to_add = i + 1;
             break;
         }
@@ -5292,7 +6134,7 @@ static inline void Vt_scroll_out_all_content(Vt* self)
     to_add -= Vt_top_line(self);
 
     for (size_t i = 0; i < to_add; ++i) {
-        Vector_push_VtLine(&self->lines, VtLine_new());
+        Ring_push_VtLine(&self->lines, VtLine_new());
         Vt_empty_line_fill_bg(self, self->lines.size - 1);
     }
     if (to_add > 0) {
@@ -5311,7 +6153,7 @@ static inline void Vt_scroll_out_above(Vt* self)
     size_t to_add = Vt_cursor_row(self);
     for (size_t i = 0; i <= to_add; ++i) {
         size_t insert_point = self->cursor.row;
-        Vector_insert_at_VtLine(&self->lines, insert_point, VtLine_new());
+        Ring_insert_at_VtLine(&self->lines, insert_point, VtLine_new());
         Vt_empty_line_fill_bg(self, insert_point);
         ++self->cursor.row;
     }
@@ -5322,7 +6164,7 @@ static inline void Vt_scroll_out_above(Vt* self)
 static inline void Vt_clear_above(Vt* self)
 {
     for (size_t i = Vt_top_line(self); i < self->cursor.row; ++i) {
-        self->lines.buf[i].data.size = 0;
+        Vt_writable_line(self, Ring_at_VtLine(&self->lines, i))->data.size = 0;
         Vt_sixel_clear_line(self, i);
     }
     Vt_clear_left(self);
@@ -5332,11 +6174,18 @@ static inline void Vt_clear_display_and_scrollback(Vt* self)
 {
     Vt_end_synchronized_update(self);
     Vt_visual_scroll_reset(self);
-    Vector_destroy_VtLine(&self->lines);
-    self->lines = Vector_new_VtLine(self);
+    Ring_destroy_VtLine(&self->lines);
+    self->lines = Ring_new_VtLine(self);
+
+    if (!Vt_alt_buffer_enabled(self)) {
+        Vector_clear_RcPtr_VtColdBlock(&self->cold_lines.thawed_blocks);
+        self->cold_lines.frozen_end_line_id = 0;
+        self->reflow_pending_end_line_id    = 0;
+        Vt_spill_clear(self);
+    }
 
     for (uint16_t i = 0; i < Vt_row(self); ++i) {
-        Vector_push_VtLine(&self->lines, VtLine_new());
+        Ring_push_VtLine(&self->lines, VtLine_new());
         Vt_empty_line_fill_bg(self, self->lines.size - 1);
     }
     self->cursor.row = 0;
@@ -5354,13 +6203,16 @@ static inline void Vt_clear_display_and_scrollback(Vt* self)
  * attributes are set */
 static inline void Vt_clear_left(Vt* self)
 {
+    Vt_writable_line(self, Vt_cursor_line(self));
+
     if (self->cursor.col >= Vt_cursor_line(self)->data.size) {
-        Vector_reserve_VtRune(&Vt_cursor_line(self)->data, self->cursor.col + 1);
+        Vector_reserve_VtCell(&Vt_cursor_line(self)->data, self->cursor.col + 1);
         Vt_cursor_line(self)->data.size = MAX(Vt_cursor_line(self)->data.size, self->cursor.col);
     }
 
+    VtCell fill = Vt_cell_from_rune(self, &self->parser.char_state);
     for (size_t i = 0; i <= self->cursor.col; ++i) {
-        Vt_cursor_line(self)->data.buf[i] = self->parser.char_state;
+        Vt_cursor_line(self)->data.buf[i] = fill;
     }
 
     Vt_mark_proxy_fully_damaged(self, self->cursor.row);
@@ -5376,27 +6228,25 @@ static inline void Vt_clear_left(Vt* self)
  * attributes are set */
 static inline void Vt_clear_right(Vt* self)
 {
-    Vector_reserve_VtRune(&Vt_cursor_line(self)->data, Vt_col(self));
+    Vt_writable_line(self, Vt_cursor_line(self));
+
+    /* cells between the end of a short line and the cursor were never written */
+    for (size_t i = Vt_cursor_line(self)->data.size; i < self->cursor.col; ++i) {
+        Vector_push_VtCell(&Vt_cursor_line(self)->data, self->blank_space);
+    }
+
+    Vector_reserve_VtCell(&Vt_cursor_line(self)->data, Vt_col(self));
     Vt_cursor_line(self)->data.size = Vt_col(self);
 
+    VtCell fill = Vt_cell_from_rune(self, &self->parser.char_state);
     for (uint16_t i = self->cursor.col; i < Vt_col(self); ++i) {
-        Vt_cursor_line(self)->data.buf[i] = self->parser.char_state;
+        Vt_cursor_line(self)->data.buf[i] = fill;
     }
 
     Vt_mark_proxy_fully_damaged(self, self->cursor.row);
     Vt_sixel_clear_line(self, self->cursor.row); // TODO: improve?
 }
 
-static void Vt_overwrite_char_at(Vt* self, size_t col, size_t row, VtRune c)
-{
-    VtLine* line = Vt_line_at(self, row);
-    while (line->data.size <= col) {
-        Vector_push_VtRune(&line->data, self->blank_space);
-    }
-    line->data.buf[col] = c;
-    Vt_sixel_overwrite_cell(self, row, col);
-}
-
 /**
  * Insert character literal at cursor position, deal with reaching column limit */
 __attribute__((hot)) static void Vt_insert_char_at_cursor(Vt* self, VtRune c)
@@ -5412,53 +6262,56 @@ __attribute__((hot)) static void Vt_insert_char_at_cursor(Vt* self, VtRune c)
 
     // add lines if missing
     while (self->lines.size <= self->cursor.row) {
-        Vector_push_VtLine(&self->lines, VtLine_new());
+        Ring_push_VtLine(&self->lines, VtLine_new());
         Vt_maybe_emit_visual_scroll_change(self);
     }
 
+    Vt_writable_line(self, Vt_cursor_line(self));
+
     // add cells if missing
     while (Vt_cursor_line(self)->data.size <= self->cursor.col) {
-        Vector_push_VtRune(&Vt_cursor_line(self)->data, self->blank_space);
+        Vector_push_VtCell(&Vt_cursor_line(self)->data, self->blank_space);
     }
 
-    VtRune* insert_point = &self->lines.buf[self->cursor.row].data.buf[self->cursor.col];
+    VtCell  cell         = Vt_cell_from_rune(self, &c);
+    VtCell* insert_point = &Vt_cursor_line(self)->data.buf[self->cursor.col];
 
     if (unlikely(self->modes.no_insert_replace_mode)) {
         // insert and shift existing characters
         // TODO: Vt_mark_proxy_damaged_shift()
         Vt_mark_proxy_fully_damaged(self, self->cursor.row);
-        Vector_insert_at_VtRune(&Vt_cursor_line(self)->data, self->cursor.col, c);
+        Vector_insert_at_VtCell(&Vt_cursor_line(self)->data, self->cursor.col, cell);
 
         if (Vt_cursor_line(self)->data.size >= Vt_col(self)) {
-            Vector_pop_VtRune(&Vt_cursor_line(self)->data);
+            Vector_pop_VtCell(&Vt_cursor_line(self)->data);
         }
-    } else if (likely(memcmp(insert_point, &c, sizeof(VtRune)))) {
+    } else if (likely(memcmp(insert_point, &cell, sizeof(VtCell)))) {
         // standard behaviour - overwrite (if differs)
         Vt_mark_proxy_damaged_cell(self, self->cursor.row, self->cursor.col);
-        *Vt_cursor_cell(self) = c;
+        *Vt_cursor_cell(self) = cell;
     }
 
     Vt_sixel_overwrite_cell(self, self->cursor.row, self->cursor.col);
 
-    self->last_inserted          = *Vt_cursor_cell(self);
+    self->last_inserted          = c;
     self->last_inserted_line_nr  = self->cursor.row;
     self->last_inserted_col_nr   = self->cursor.col;
     self->has_last_inserted_rune = true;
 
     ++self->cursor.col;
 
-    int width = C_WIDTH(c.rune.code);
+    int width = char_width(c.rune.code);
 
     if (unlikely(width > 1)) {
-        VtRune tmp    = c;
-        tmp.rune.code = VT_RUNE_CODE_WIDE_TAIL;
+        VtCell tmp = cell;
+        tmp.code   = VT_RUNE_CODE_WIDE_TAIL;
 
         for (int i = 0; i < (width - 1); ++i) {
             if (Vt_cursor_line(self)->data.size <= self->cursor.col) {
-                Vector_push_VtRune(&Vt_cursor_line(self)->data, tmp);
+                Vector_push_VtCell(&Vt_cursor_line(self)->data, tmp);
             } else {
                 if (self->modes.no_insert_replace_mode) {
-                    Vector_insert_at_VtRune(&Vt_cursor_line(self)->data, self->cursor.col, tmp);
+                    Vector_insert_at_VtCell(&Vt_cursor_line(self)->data, self->cursor.col, tmp);
                 } else {
                     *Vt_cursor_cell(self) = tmp;
                 }
@@ -5474,8 +6327,8 @@ __attribute__((hot)) static void Vt_insert_char_at_cursor(Vt* self, VtRune c)
                 Vt_mark_proxy_damaged_cell(self, self->cursor.row, self->cursor.col);
             }
         }
-    } else if (unlikely(unicode_is_ambiguous_width(c.rune.code))) {
-        Vector_push_VtRune(&Vt_cursor_line(self)->data, self->blank_space);
+    } else if (unlikely(char_is_ambiguous_width(c.rune.code))) {
+        Vector_push_VtCell(&Vt_cursor_line(self)->data, self->blank_space);
         Vt_mark_proxy_damaged_cell(self, self->cursor.row, self->cursor.col + 1);
     }
 
@@ -5483,7 +6336,138 @@ __attribute__((hot)) static void Vt_insert_char_at_cursor(Vt* self, VtRune c)
     self->cursor.col = MIN(self->cursor.col, (Vt_col(self) - 1));
 }
 
-static void Vt_insert_char_at_cursor_with_shift(Vt* self, VtRune c)
+/**
+ * Write up to @param n characters at the cursor, replacing what was there. Codes are taken from
+ * @param codes, @param ascii (printable characters only) or, if both are NULL, the character of
+ * @param attrs is repeated. The run stops at the end of the line and before characters that need
+ * more than a cell lookup (zero and ambiguous width, wide characters not fitting the line). The
+ * line is resized once and damage and sixel overwrites are reported for the whole run. Insert mode
+ * is not respected, callers that need it have to shift the line themselves
+ * @return number of characters written, 0 if the first one has to go through
+ * Vt_insert_char_at_cursor() */
+__attribute__((always_inline, hot)) static inline size_t Vt_write_run_impl(Vt*             self,
+                                                                           const char32_t* codes,
+                                                                           const char*     ascii,
+                                                                           size_t          n,
+                                                                           const VtRune*   attrs)
+{
+    if (unlikely(!n)) {
+        return 0;
+    }
+
+    if (self->wrap_next && !self->modes.no_wraparound) {
+        self->cursor.col                  = 0;
+        self->wrap_next                   = false;
+        Vt_cursor_line(self)->was_reflown = true;
+        Vt_line_feed(self);
+        Vt_cursor_line(self)->rejoinable = true;
+    }
+
+    while (self->lines.size <= self->cursor.row) {
+        Ring_push_VtLine(&self->lines, VtLine_new());
+        Vt_maybe_emit_visual_scroll_change(self);
+    }
+
+    VtRune rune = *attrs;
+    if (codes || ascii) {
+        memset(rune.rune.combine, 0, sizeof(rune.rune.combine));
+        rune.rune.code = ascii ? (char32_t)ascii[0] : codes[0];
+    }
+
+    /* count characters and cells that fit */
+    uint16_t col   = self->cursor.col;
+    uint16_t space = Vt_col(self) - col;
+    uint16_t cells = 0;
+    size_t   count = 0;
+    if (ascii) {
+        count = cells = MIN(n, space);
+    } else {
+        for (; count < n; ++count) {
+            char32_t code  = codes ? codes[count] : rune.rune.code;
+            uint8_t  width = code < 0x7f ? 1 : char_width(code);
+
+            if ((width != 1 && width != 2) || cells + width > space ||
+                (code >= 0x7f && char_is_ambiguous_width(code))) {
+                break;
+            }
+            cells += width;
+        }
+    }
+
+    if (!count) {
+        return 0;
+    }
+
+    VtLine* line = Vt_writable_line(self, Vt_cursor_line(self));
+    if (line->data.size < col + cells) {
+        if (line->data.cap < col + cells) {
+            Vector_reserve_VtCell(&line->data, MAX(col + cells, line->data.cap * 2));
+        }
+        while (line->data.size < col + cells) {
+            Vector_push_VtCell(&line->data, self->blank_space);
+        }
+    }
+
+    /* attributes are the same for the whole run, intern them once */
+    VtCell   cell      = Vt_cell_from_rune(self, &rune);
+    VtCell*  out       = line->data.buf + col;
+    size_t   damage_lo = SIZE_MAX;
+    size_t   damage_hi = 0;
+    uint16_t last_col  = 0;
+    for (size_t i = 0, c = 0; i < count; ++i) {
+        char32_t code = ascii ? (char32_t)ascii[i] : codes ? codes[i] : rune.rune.code;
+        if (codes || ascii) {
+            cell.code = code;
+        }
+
+        last_col = c;
+        if (likely(memcmp(&out[c], &cell, sizeof(VtCell)))) {
+            out[c]    = cell;
+            damage_lo = MIN(damage_lo, c);
+            damage_hi = c;
+        }
+        ++c;
+
+        if (unlikely(!ascii && code >= 0x7f && char_width(code) == 2)) {
+            VtCell tail = cell;
+            tail.code   = VT_RUNE_CODE_WIDE_TAIL;
+            if (memcmp(&out[c], &tail, sizeof(VtCell))) {
+                out[c]    = tail;
+                damage_lo = MIN(damage_lo, c);
+                damage_hi = c;
+            }
+            ++c;
+        }
+    }
+
+    if (damage_lo != SIZE_MAX) {
+        Vt_mark_proxy_damaged_cells(self, self->cursor.row, col + damage_lo, col + damage_hi);
+    }
+
+    Vt_sixel_overwrite_cell_range(self, self->cursor.row, col, col + cells);
+
+    if (codes || ascii) {
+        rune.rune.code = ascii ? (char32_t)ascii[count - 1] : codes[count - 1];
+    }
+    self->defered_events.repaint = true;
+    self->last_inserted          = rune;
+    self->last_inserted_line_nr  = self->cursor.row;
+    self->last_inserted_col_nr   = col + last_col;
+    self->has_last_inserted_rune = true;
+
+    self->cursor.col = col + cells;
+    self->wrap_next  = self->cursor.col >= (size_t)Vt_col(self);
+    self->cursor.col = MIN(self->cursor.col, (Vt_col(self) - 1));
+
+    return count;
+}
+
+static size_t Vt_write_run(Vt* self, const char32_t* codes, size_t n, const VtRune* attrs)
+{
+    return Vt_write_run_impl(self, codes, NULL, n, attrs);
+}
+
+static void Vt_insert_char_at_cursor_with_shift(Vt* self, VtCell c)
 {
     if (unlikely(self->cursor.col >= (size_t)Vt_col(self))) {
         if (unlikely(self->modes.no_wraparound)) {
@@ -5495,12 +6479,14 @@ static void Vt_insert_char_at_cursor_with_shift(Vt* self, VtRune c)
         }
     }
 
+    Vt_writable_line(self, Vt_cursor_line(self));
+
     if (self->scroll_region_right != Vt_col(self) - 1 &&
         self->scroll_region_right > self->cursor.col) {
-        Vector_remove_at_VtRune(&Vt_cursor_line(self)->data, self->scroll_region_right, 1);
+        Vector_remove_at_VtCell(&Vt_cursor_line(self)->data, self->scroll_region_right, 1);
     }
 
-    Vector_insert_at_VtRune(&Vt_cursor_line(self)->data, self->cursor.col, c);
+    Vector_insert_at_VtCell(&Vt_cursor_line(self)->data, self->cursor.col, c);
 
     Vt_mark_proxy_fully_damaged(self, self->cursor.row);
     Vt_sixel_clear_line(self, self->cursor.row); // TODO: improve?
@@ -5508,13 +6494,15 @@ static void Vt_insert_char_at_cursor_with_shift(Vt* self, VtRune c)
 
 static inline void Vt_empty_line_fill_bg(Vt* self, size_t idx)
 {
-    ASSERT(self->lines.buf[idx].data.size == 0, "line is empty");
+    ASSERT(Ring_at_VtLine(&self->lines, idx)->data.size == 0, "line is empty");
 
     Vt_mark_proxy_fully_damaged(self, idx);
     Vt_sixel_clear_line(self, idx);
     if (!ColorRGBA_eq(Vt_active_bg_color(self), self->colors.bg)) {
+        VtCell  fill = Vt_cell_from_rune(self, &self->parser.char_state);
+        VtLine* line = Vt_writable_line(self, Ring_at_VtLine(&self->lines, idx));
         for (uint16_t i = 0; i < Vt_col(self); ++i) {
-            Vector_push_VtRune(&self->lines.buf[idx].data, self->parser.char_state);
+            Vector_push_VtCell(&line->data, fill);
         }
     }
 }
@@ -5530,19 +6518,15 @@ static inline void Vt_line_feed(Vt* self)
 
     if (self->cursor.row == Vt_get_scroll_region_bottom(self) &&
         Vt_scroll_region_not_default(self)) {
-        Vt_about_to_delete_line_by_scroll_up(self, Vt_get_scroll_region_top(self));
-        Vector_remove_at_VtLine(&self->lines, Vt_get_scroll_region_top(self), 1);
-        Vt_shift_global_line_index_refs(self, Vt_get_scroll_region_top(self) + 1, -1, true);
-
-        Vector_insert_at_VtLine(&self->lines, self->cursor.row, VtLine_new());
-        Vt_shift_global_line_index_refs(self, self->cursor.row, 1, true);
-
-        Vt_empty_line_fill_bg(self, self->cursor.row);
+        Vt_rotate_lines_up(self, Vt_get_scroll_region_top(self), self->cursor.row);
         cmove = 0;
     } else if (Vt_bottom_line(self) == self->cursor.row) {
-        Vector_push_VtLine(&self->lines, VtLine_new());
+        Ring_push_VtLine(&self->lines, VtLine_new());
         Vt_empty_line_fill_bg(self, self->lines.size - 1);
         Vt_maybe_emit_visual_scroll_change(self);
+        if (settings.scrollback_search_index) {
+            Vt_search_index_update(self);
+        }
     }
 
     Vt_move_cursor(self, self->cursor.col, Vt_cursor_row(self) + cmove);
@@ -5573,10 +6557,12 @@ static inline void Vt_move_cursor(Vt* self, uint16_t column, uint16_t rows)
         (cmd_ptr = Vector_last_RcPtr_VtCommand(&self->shell_commands)) &&
         (cmd = RcPtr_get_VtCommand(cmd_ptr))) {
 
+        size_t cursor_line_id = Vt_line_id(self, self->cursor.row);
+
         if (self->shell_integration_state == VT_SHELL_INTEG_STATE_OUTPUT &&
-            self->cursor.row < cmd->output_rows.first) {
+            cursor_line_id < cmd->output_line_ids.first) {
             Vt_command_output_interrupted(self);
-        } else if (self->cursor.row < cmd->command_start_row) {
+        } else if (cursor_line_id < cmd->command_start_line_id) {
             Vt_command_output_interrupted(self);
         }
     }
@@ -5641,16 +6627,19 @@ static inline bool Rune_is_subcluster(Rune* base, Rune* extended)
 
 static inline void Vt_update_last_inserted_char_in_cellgrid(Vt* self)
 {
-    VtRune* maybe_last = Vt_at(self, self->last_inserted_col_nr, self->last_inserted_line_nr);
+    VtCell* maybe_last = Vt_at(self, self->last_inserted_col_nr, self->last_inserted_line_nr);
     if (likely(maybe_last)) {
-        if (likely(Rune_is_subcluster(&maybe_last->rune, &self->last_inserted.rune))) {
-            maybe_last->rune            = self->last_inserted.rune;
-            maybe_last->strikethrough   = self->last_inserted.strikethrough;
-            maybe_last->underlined      = self->last_inserted.underlined;
-            maybe_last->strikethrough   = self->last_inserted.strikethrough;
-            maybe_last->curlyunderline  = self->last_inserted.curlyunderline;
-            maybe_last->doubleunderline = self->last_inserted.doubleunderline;
-            maybe_last->overline        = self->last_inserted.overline;
+        Rune last_rune = Vt_cell_rune(self, maybe_last);
+        if (likely(Rune_is_subcluster(&last_rune, &self->last_inserted.rune))) {
+            VtRune updated          = *Vt_cell_attrs(self, maybe_last);
+            updated.rune            = self->last_inserted.rune;
+            updated.hyperlink_idx   = maybe_last->hyperlink_idx;
+            updated.strikethrough   = self->last_inserted.strikethrough;
+            updated.underlined      = self->last_inserted.underlined;
+            updated.curlyunderline  = self->last_inserted.curlyunderline;
+            updated.doubleunderline = self->last_inserted.doubleunderline;
+            updated.overline        = self->last_inserted.overline;
+            *maybe_last             = Vt_cell_from_rune(self, &updated);
         } else {
             self->has_last_inserted_rune = false;
         }
@@ -5707,403 +6696,703 @@ static void Vt_handle_combinable(Vt* self, char32_t c)
     }
 }
 
+/**
+ * Handle a decoded non-ASCII codepoint */
+__attribute__((hot)) static void Vt_handle_codepoint(Vt* self, char32_t c)
+{
+    bool is_combining = false;
+#ifndef NOUTF8PROC
+    if (self->last_codepoint) {
+        is_combining =
+          !utf8proc_grapheme_break_stateful(self->last_codepoint, c, &self->utf8proc_state) &&
+          char_width(c) == 0;
+    } else {
+        is_combining = unicode_is_combining(c);
+    }
+#else
+    is_combining = unicode_is_combining(c);
+#endif
+
+    if (unlikely(is_combining)) {
+        Vt_handle_combinable(self, c);
+        self->last_codepoint = c;
+    } else {
+        VtRune new_rune        = self->parser.char_state;
+        self->last_codepoint   = c;
+        new_rune.rune.code     = c;
+        new_rune.hyperlink_idx = self->active_hyperlink;
+        Vt_insert_char_at_cursor(self, new_rune);
+    }
+}
+
+/**
+ * Decode and handle UTF-8 text starting with a non-ASCII byte or continuing a sequence started in
+ * a previous call. Stops at the first ASCII character outside of a sequence.
+ *
+ * @return number of bytes consumed, can be 0 if an incomplete sequence was interrupted by the
+ * first character */
+__attribute__((hot)) static size_t Vt_handle_utf8_run(Vt* self, const char* buf, size_t len)
+{
+    char32_t codepoints[64];
+    size_t   consumed;
+    size_t   n = utf8_decode_run(&self->parser.utf8_decoder,
+                               buf,
+                               len,
+                               codepoints,
+                               ARRAY_SIZE(codepoints),
+                               &consumed);
+
+    for (size_t i = 0; i < n; ++i) {
+        Vt_handle_codepoint(self, codepoints[i]);
+    }
+
+    return consumed;
+}
+
+/**
+ * Decode and handle a single byte of UTF-8 text
+ *
+ * @return false if @param c is an ASCII character that was not consumed */
+static bool Vt_handle_utf8_byte(Vt* self, char c)
+{
+    char32_t codepoints[2];
+    bool     consumed;
+    size_t   n = utf8_decode_byte(&self->parser.utf8_decoder, c, codepoints, &consumed);
+
+    for (size_t i = 0; i < n; ++i) {
+        Vt_handle_codepoint(self, codepoints[i]);
+    }
+
+    return consumed;
+}
+
 __attribute__((hot, flatten)) inline void Vt_handle_literal(Vt* self, char c)
 {
-    if (self->parser.in_mb_seq) {
-        char32_t res;
-        size_t   rd = mbrtoc32(&res, &c, 1, &self->parser.input_mbstate);
+    // TODO: ISO 8859-1 charset (not UTF-8 mode)
+    if (unlikely(utf8_decoder_in_sequence(&self->parser.utf8_decoder) || (c & (1 << 7)))) {
+        if (Vt_handle_utf8_byte(self, c)) {
+            return;
+        }
+        /* incomplete sequence was interrupted by this character */
+    }
 
-        if (unlikely(rd == (size_t)-1)) {
-            /* encoding error */
-            WRN("%s\n", strerror(errno));
-            errno = 0;
+    switch (c) {
+        case '\a':
+            Vt_grapheme_break(self);
+            Vt_bell(self);
+            break;
 
-            /* zero-initialized mbstate_t always represents the initial conversion state */
-            memset(&self->parser.input_mbstate, 0, sizeof(mbstate_t));
-        } else if (rd != (size_t)-2) {
-            /* sequence is complete */
-            self->parser.in_mb_seq = false;
+        case '\b':
+            Vt_grapheme_break(self);
+            Vt_handle_backspace(self);
+            break;
 
-            bool is_combining = false;
-#ifndef NOUTF8PROC
-            if (self->last_codepoint) {
-                is_combining = !utf8proc_grapheme_break_stateful(self->last_codepoint,
-                                                                 res,
-                                                                 &self->utf8proc_state) &&
-                               utf8proc_charwidth(res) == 0;
-            } else {
-                is_combining = unicode_is_combining(res);
+        case '\r':
+            Vt_grapheme_break(self);
+            Vt_carriage_return(self);
+            break;
+
+        case '\f':
+        case '\v':
+        case '\n':
+            Vt_grapheme_break(self);
+            if (self->modes.new_line_mode) {
+                Vt_carriage_return(self);
             }
-#else
-            is_combining = unicode_is_combining(res);
-#endif
+            Vt_line_feed(self);
+            break;
 
-            Vt_uri_next_char(self, res);
+        case '\e':
+            Vt_grapheme_break(self);
+            self->parser.state = PARSER_STATE_ESCAPED;
+            break;
 
-            if (unlikely(is_combining)) {
-                Vt_handle_combinable(self, res);
-                self->last_codepoint = res;
-            } else {
-                VtRune new_rune      = self->parser.char_state;
-                self->last_codepoint = res;
-                new_rune.rune.code   = res;
-                if (self->active_hyperlink) {
-                    new_rune.hyperlink_idx =
-                      VtLine_add_link(Vt_cursor_line(self), self->active_hyperlink) + 1;
-                }
-                Vt_insert_char_at_cursor(self, new_rune);
+        /* Invoke the G1 character set as GL */
+        case 14 /* SO */:
+            Vt_grapheme_break(self);
+            self->charset_gl = &self->charset_g1;
+            break;
+
+        /* Invoke the G0 character set (the default) as GL */
+        case 15 /* SI */:
+            Vt_grapheme_break(self);
+            self->charset_gl = &self->charset_g0;
+            break;
+
+        case '\t': {
+            Vt_grapheme_break(self);
+            uint16_t rt;
+            for (rt = 0; self->cursor.col + rt + 1 < Vt_col(self);) {
+                if (self->tab_ruler[self->cursor.col + ++rt])
+                    break;
             }
+            Vt_move_cursor(self, self->cursor.col + rt, Vt_cursor_row(self));
+        } break;
+
+        default: {
+            VtRune new_rune    = self->parser.char_state;
+            new_rune.rune.code = c;
+
+            new_rune.hyperlink_idx = self->active_hyperlink;
+
+            if (unlikely(self->charset_single_shift && *self->charset_single_shift)) {
+                new_rune.rune.code         = (*(self->charset_single_shift))(c);
+                self->charset_single_shift = NULL;
+            } else if (unlikely(self->charset_gl && (*self->charset_gl))) {
+                new_rune.rune.code = (*(self->charset_gl))(c);
+            }
+
+            self->last_codepoint = new_rune.rune.code;
+            Vt_insert_char_at_cursor(self, new_rune);
         }
-    } else {
-        switch (c) {
-            case '\a':
-                Vt_grapheme_break(self);
-                Vt_bell(self);
-                break;
+    }
+}
 
-            case '\b':
-                Vt_grapheme_break(self);
-                Vt_uri_break_match(self);
-                Vt_handle_backspace(self);
-                break;
+/**
+ * Write a run of printable ASCII characters in one go. The run is clipped to the end of the line,
+ * the remaining characters are handled by the next call after wrapping.
+ * @return number of characters consumed */
+__attribute__((hot)) static size_t Vt_handle_printable_ascii_run(Vt*         self,
+                                                                 const char* run,
+                                                                 size_t      len)
+{
+    if (unlikely(self->modes.no_insert_replace_mode ||
+                 (self->charset_single_shift && *self->charset_single_shift) ||
+                 (self->charset_gl && *self->charset_gl))) {
+        Vt_handle_literal(self, *run);
+        return 1;
+    }
 
-            case '\r':
-                Vt_grapheme_break(self);
-                Vt_uri_break_match(self);
-                Vt_carriage_return(self);
-                break;
+    VtRune new_rune        = self->parser.char_state;
+    new_rune.hyperlink_idx = self->active_hyperlink;
 
-            case '\f':
-            case '\v':
-            case '\n':
-                Vt_grapheme_break(self);
-                Vt_uri_break_match(self);
-                if (self->modes.new_line_mode) {
-                    Vt_carriage_return(self);
-                }
-                Vt_line_feed(self);
-                break;
+    size_t count = Vt_write_run_impl(self, NULL, run, len, &new_rune);
+    if (unlikely(!count)) {
+        Vt_handle_literal(self, *run);
+        return 1;
+    }
 
-            case '\e':
-                Vt_uri_break_match(self);
-                Vt_grapheme_break(self);
-                self->parser.state = PARSER_STATE_ESCAPED;
-                break;
+    self->last_codepoint = run[count - 1];
+    return count;
+}
 
-            /* Invoke the G1 character set as GL */
-            case 14 /* SO */:
-                Vt_grapheme_break(self);
-                self->charset_gl = &self->charset_g1;
-                break;
+/**
+ * Character classes for the escape sequence parser */
+typedef enum
+{
+    VT_CHAR_CLASS_C0 = 0,
+    VT_CHAR_CLASS_CANCEL,
+    VT_CHAR_CLASS_ESC,
+    VT_CHAR_CLASS_INTERMEDIATE,
+    VT_CHAR_CLASS_DIGIT,
+    VT_CHAR_CLASS_COLON,
+    VT_CHAR_CLASS_SEMICOLON,
+    VT_CHAR_CLASS_PRIVATE_MARKER,
+    VT_CHAR_CLASS_FINAL,
+    VT_CHAR_CLASS_DEL,
+    VT_CHAR_CLASS_HIGH,
+
+    VT_CHAR_CLASS_COUNT,
+} vt_char_class_t;
+
+static const uint8_t vt_char_class_table[256] = {
+    [0x00 ... 0x17] = VT_CHAR_CLASS_C0,
+    [0x18]          = VT_CHAR_CLASS_CANCEL,
+    [0x19]          = VT_CHAR_CLASS_C0,
+    [0x1A]          = VT_CHAR_CLASS_CANCEL,
+    [0x1B]          = VT_CHAR_CLASS_ESC,
+    [0x1C ... 0x1F] = VT_CHAR_CLASS_C0,
+    [0x20 ... 0x2F] = VT_CHAR_CLASS_INTERMEDIATE,
+    [0x30 ... 0x39] = VT_CHAR_CLASS_DIGIT,
+    [0x3A]          = VT_CHAR_CLASS_COLON,
+    [0x3B]          = VT_CHAR_CLASS_SEMICOLON,
+    [0x3C ... 0x3F] = VT_CHAR_CLASS_PRIVATE_MARKER,
+    [0x40 ... 0x7E] = VT_CHAR_CLASS_FINAL,
+    [0x7F]          = VT_CHAR_CLASS_DEL,
+    [0x80 ... 0xFF] = VT_CHAR_CLASS_HIGH,
+};
+
+typedef enum
+{
+    VT_PARSER_ACTION_NONE = 0,
+    VT_PARSER_ACTION_EXECUTE,
+    VT_PARSER_ACTION_COLLECT,
+    VT_PARSER_ACTION_PRIVATE_MARKER,
+    VT_PARSER_ACTION_PARAM,
+    VT_PARSER_ACTION_PARAM_SEPARATOR,
+    VT_PARSER_ACTION_SUB_PARAM_SEPARATOR,
+    VT_PARSER_ACTION_CSI_DISPATCH,
+    VT_PARSER_ACTION_ESC_INTERMEDIATE,
+    VT_PARSER_ACTION_ESC_DISPATCH,
+} vt_parser_action_t;
+
+typedef struct
+{
+    uint8_t action;
+    uint8_t next_state;
+} vt_parser_transition_t;
+
+#define VT_TRANSITION(_action, _state)                                                             \
+    {                                                                                              \
+        .action = VT_PARSER_ACTION_##_action, .next_state = PARSER_STATE_##_state                  \
+    }
+
+/**
+ * State transitions for escape and control sequences (based on the DEC VT500 parser). Indexed
+ * with [state - PARSER_STATE_ESCAPED][char class]. Action may override the next state */
+static const vt_parser_transition_t
+  vt_parser_transition_table[PARSER_STATE_CSI_IGNORE - PARSER_STATE_ESCAPED + 1]
+                            [VT_CHAR_CLASS_COUNT] = {
+      [PARSER_STATE_ESCAPED - PARSER_STATE_ESCAPED] = {
+        [VT_CHAR_CLASS_C0]             = VT_TRANSITION(EXECUTE, ESCAPED),
+        [VT_CHAR_CLASS_CANCEL]         = VT_TRANSITION(NONE, LITERAL),
+        [VT_CHAR_CLASS_ESC]            = VT_TRANSITION(NONE, ESCAPED),
+        [VT_CHAR_CLASS_INTERMEDIATE]   = VT_TRANSITION(ESC_INTERMEDIATE, LITERAL),
+        [VT_CHAR_CLASS_DIGIT]          = VT_TRANSITION(ESC_DISPATCH, LITERAL),
+        [VT_CHAR_CLASS_COLON]          = VT_TRANSITION(ESC_DISPATCH, LITERAL),
+        [VT_CHAR_CLASS_SEMICOLON]      = VT_TRANSITION(ESC_DISPATCH, LITERAL),
+        [VT_CHAR_CLASS_PRIVATE_MARKER] = VT_TRANSITION(ESC_DISPATCH, LITERAL),
+        [VT_CHAR_CLASS_FINAL]          = VT_TRANSITION(ESC_DISPATCH, LITERAL),
+        [VT_CHAR_CLASS_DEL]            = VT_TRANSITION(NONE, ESCAPED),
+        [VT_CHAR_CLASS_HIGH]           = VT_TRANSITION(ESC_DISPATCH, LITERAL),
+      },
+      [PARSER_STATE_CSI - PARSER_STATE_ESCAPED] = {
+        [VT_CHAR_CLASS_C0]             = VT_TRANSITION(EXECUTE, CSI),
+        [VT_CHAR_CLASS_CANCEL]         = VT_TRANSITION(NONE, LITERAL),
+        [VT_CHAR_CLASS_ESC]            = VT_TRANSITION(NONE, ESCAPED),
+        [VT_CHAR_CLASS_INTERMEDIATE]   = VT_TRANSITION(COLLECT, CSI_INTERMEDIATE),
+        [VT_CHAR_CLASS_DIGIT]          = VT_TRANSITION(PARAM, CSI_PARAM),
+        [VT_CHAR_CLASS_COLON]          = VT_TRANSITION(SUB_PARAM_SEPARATOR, CSI_PARAM),
+        [VT_CHAR_CLASS_SEMICOLON]      = VT_TRANSITION(PARAM_SEPARATOR, CSI_PARAM),
+        [VT_CHAR_CLASS_PRIVATE_MARKER] = VT_TRANSITION(PRIVATE_MARKER, CSI_PARAM),
+        [VT_CHAR_CLASS_FINAL]          = VT_TRANSITION(CSI_DISPATCH, LITERAL),
+        [VT_CHAR_CLASS_DEL]            = VT_TRANSITION(NONE, CSI),
+        [VT_CHAR_CLASS_HIGH]           = VT_TRANSITION(NONE, CSI),
+      },
+      [PARSER_STATE_CSI_PARAM - PARSER_STATE_ESCAPED] = {
+        [VT_CHAR_CLASS_C0]             = VT_TRANSITION(EXECUTE, CSI_PARAM),
+        [VT_CHAR_CLASS_CANCEL]         = VT_TRANSITION(NONE, LITERAL),
+        [VT_CHAR_CLASS_ESC]            = VT_TRANSITION(NONE, ESCAPED),
+        [VT_CHAR_CLASS_INTERMEDIATE]   = VT_TRANSITION(COLLECT, CSI_INTERMEDIATE),
+        [VT_CHAR_CLASS_DIGIT]          = VT_TRANSITION(PARAM, CSI_PARAM),
+        [VT_CHAR_CLASS_COLON]          = VT_TRANSITION(SUB_PARAM_SEPARATOR, CSI_PARAM),
+        [VT_CHAR_CLASS_SEMICOLON]      = VT_TRANSITION(PARAM_SEPARATOR, CSI_PARAM),
+        [VT_CHAR_CLASS_PRIVATE_MARKER] = VT_TRANSITION(NONE, CSI_IGNORE),
+        [VT_CHAR_CLASS_FINAL]          = VT_TRANSITION(CSI_DISPATCH, LITERAL),
+        [VT_CHAR_CLASS_DEL]            = VT_TRANSITION(NONE, CSI_PARAM),
+        [VT_CHAR_CLASS_HIGH]           = VT_TRANSITION(NONE, CSI_PARAM),
+      },
+      [PARSER_STATE_CSI_INTERMEDIATE - PARSER_STATE_ESCAPED] = {
+        [VT_CHAR_CLASS_C0]             = VT_TRANSITION(EXECUTE, CSI_INTERMEDIATE),
+        [VT_CHAR_CLASS_CANCEL]         = VT_TRANSITION(NONE, LITERAL),
+        [VT_CHAR_CLASS_ESC]            = VT_TRANSITION(NONE, ESCAPED),
+        [VT_CHAR_CLASS_INTERMEDIATE]   = VT_TRANSITION(COLLECT, CSI_INTERMEDIATE),
+        [VT_CHAR_CLASS_DIGIT]          = VT_TRANSITION(NONE, CSI_IGNORE),
+        [VT_CHAR_CLASS_COLON]          = VT_TRANSITION(NONE, CSI_IGNORE),
+        [VT_CHAR_CLASS_SEMICOLON]      = VT_TRANSITION(NONE, CSI_IGNORE),
+        [VT_CHAR_CLASS_PRIVATE_MARKER] = VT_TRANSITION(NONE, CSI_IGNORE),
+        [VT_CHAR_CLASS_FINAL]          = VT_TRANSITION(CSI_DISPATCH, LITERAL),
+        [VT_CHAR_CLASS_DEL]            = VT_TRANSITION(NONE, CSI_INTERMEDIATE),
+        [VT_CHAR_CLASS_HIGH]           = VT_TRANSITION(NONE, CSI_INTERMEDIATE),
+      },
+      [PARSER_STATE_CSI_IGNORE - PARSER_STATE_ESCAPED] = {
+        [VT_CHAR_CLASS_C0]             = VT_TRANSITION(EXECUTE, CSI_IGNORE),
+        [VT_CHAR_CLASS_CANCEL]         = VT_TRANSITION(NONE, LITERAL),
+        [VT_CHAR_CLASS_ESC]            = VT_TRANSITION(NONE, ESCAPED),
+        [VT_CHAR_CLASS_INTERMEDIATE]   = VT_TRANSITION(NONE, CSI_IGNORE),
+        [VT_CHAR_CLASS_DIGIT]          = VT_TRANSITION(NONE, CSI_IGNORE),
+        [VT_CHAR_CLASS_COLON]          = VT_TRANSITION(NONE, CSI_IGNORE),
+        [VT_CHAR_CLASS_SEMICOLON]      = VT_TRANSITION(NONE, CSI_IGNORE),
+        [VT_CHAR_CLASS_PRIVATE_MARKER] = VT_TRANSITION(NONE, CSI_IGNORE),
+        [VT_CHAR_CLASS_FINAL]          = VT_TRANSITION(NONE, LITERAL),
+        [VT_CHAR_CLASS_DEL]            = VT_TRANSITION(NONE, CSI_IGNORE),
+        [VT_CHAR_CLASS_HIGH]           = VT_TRANSITION(NONE, CSI_IGNORE),
+      },
+  };
+
+#undef VT_TRANSITION
+
+/**
+ * Handle a single character escape sequence (or the character introducing a longer one) */
+static void Vt_handle_ESC(Vt* self, char c)
+{
+    switch (expect(c, '[')) {
+
+        /* Control sequence introducer (CSI) */
+        case '[':
+            memset(&self->parser.csi, 0, sizeof(self->parser.csi));
+            self->parser.state = PARSER_STATE_CSI;
+            return;
+
+        /* Operating system command (OSC) */
+        case ']':
+            self->parser.state = PARSER_STATE_OSC;
+            return;
+
+        /* Device control */
+        case 'P':
+            self->parser.state = PARSER_STATE_DCS;
+            return;
+
+        /* Application Programming Command (APC) */
+        case '_':
+            self->parser.state = PARSER_STATE_APC;
+            return;
+
+        /* Privacy message (PM) */
+        case '^':
+            self->parser.state = PARSER_STATE_PM;
+            return;
+
+        /* Reverse line feed (RI) */
+        case 'M':
+            Vt_reverse_line_feed(self);
+            self->parser.state = PARSER_STATE_LITERAL;
+            return;
+
+        /* New line (NEL) */
+        case 'E':
+            Vt_carriage_return(self);
+            /* fallthrough */
+
+        /* Line feed (IND) */
+        case 'D':
+            Vt_line_feed(self);
+            self->parser.state = PARSER_STATE_LITERAL;
+            return;
+
+        /* Set tab stop at current column (HTS) */
+        case 'H':
+            self->tab_ruler[self->cursor.col] = true;
+            self->parser.state                = PARSER_STATE_LITERAL;
+            return;
+
+        case 'g':
+            Vt_bell(self);
+            self->parser.state = PARSER_STATE_LITERAL;
+            break;
+
+        /* Application Keypad (DECKPAM) */
+        case '=':
+            self->modes.application_keypad = true;
+            self->parser.state             = PARSER_STATE_LITERAL;
+            return;
+
+        /* Normal Keypad (DECKPNM) */
+        case '>':
+            self->modes.application_keypad = false;
+            self->parser.state             = PARSER_STATE_LITERAL;
+            return;
+
+        /* Disable Manual Input (DMI) */
+        case '`':
+        /* Enable Manual Input (EMI) */
+        case 'b':
+            STUB("EMI/DMI");
+            self->parser.state = PARSER_STATE_LITERAL;
+            break;
+
+        /* Reset initial state (RIS) */
+        case 'c':
+            Vt_hard_reset(self);
+            return;
 
-            /* Invoke the G0 character set (the default) as GL */
-            case 15 /* SI */:
-                Vt_grapheme_break(self);
-                self->charset_gl = &self->charset_g0;
-                break;
+        /* Save cursor (DECSC) */
+        case '7':
+            self->saved_active_line = Vt_cursor_row(self);
+            self->saved_cursor_pos  = self->cursor.col;
+            self->parser.state      = PARSER_STATE_LITERAL;
+            return;
 
-            case '\t': {
-                Vt_grapheme_break(self);
-                Vt_uri_break_match(self);
-                uint16_t rt;
-                for (rt = 0; self->cursor.col + rt + 1 < Vt_col(self);) {
-                    if (self->tab_ruler[self->cursor.col + ++rt])
-                        break;
-                }
-                Vt_move_cursor(self, self->cursor.col + rt, Vt_cursor_row(self));
-            } break;
+        /* Restore cursor (DECRC) */
+        case '8':
+            Vt_move_cursor(self, self->saved_cursor_pos, self->saved_active_line);
+            self->parser.state = PARSER_STATE_LITERAL;
+            return;
 
-            default: {
-                // TODO: ISO 8859-1 charset (not UTF-8 mode)
-                if (c & (1 << 7)) {
-                    mbrtoc32(NULL, &c, 1, &self->parser.input_mbstate);
-                    self->parser.in_mb_seq = true;
-                    break;
-                }
+        /* Back Index (DECBI) (VT400)
+         *
+         * This control function moves the cursor backward one column. If the cursor is
+         * at the left margin, all screen data within the margins moves onecolumn to the
+         * right. The column shifted past the right margin is lost
+         */
+        case '6':
 
-                VtRune new_rune    = self->parser.char_state;
-                new_rune.rune.code = c;
+        /* Forward Index (DECFI) (VT400)
+         *
+         * This control function moves the cursor forward one column. If the cursor is
+         *at the right margin, all screen data within the margins moves onecolumn to the
+         *left. The column shifted past the left margin is lost.
+         **/
+        case '9':
+            STUB("DECBI/DECFI");
+            self->parser.state = PARSER_STATE_LITERAL;
+            break;
 
-                if (self->active_hyperlink) {
-                    new_rune.hyperlink_idx =
-                      VtLine_add_link(Vt_cursor_line(self), self->active_hyperlink) + 1;
-                }
+        /* Coding Method Delimiter (CMD) */
+        case 'd':
+            STUB("CMD");
+            self->parser.state = PARSER_STATE_LITERAL;
+            break;
 
-                if (unlikely(self->charset_single_shift && *self->charset_single_shift)) {
-                    new_rune.rune.code         = (*(self->charset_single_shift))(c);
-                    self->charset_single_shift = NULL;
-                } else if (unlikely(self->charset_gl && (*self->charset_gl))) {
-                    new_rune.rune.code = (*(self->charset_gl))(c);
-                }
+        /* Invoke the G2 Character Set into GL (VT200 mode only) (LS2) */
+        case 'n':
+            self->charset_gl   = &self->charset_g2;
+            self->parser.state = PARSER_STATE_LITERAL;
+            break;
 
-                self->last_codepoint = new_rune.rune.code;
-                Vt_uri_next_char(self, new_rune.rune.code);
-                Vt_insert_char_at_cursor(self, new_rune);
-            }
-        }
-    }
-}
+        /* Invoke the G3 Character Set into GL (VT200 mode only) (LS3) */
+        case 'o':
+            self->charset_gl   = &self->charset_g3;
+            self->parser.state = PARSER_STATE_LITERAL;
+            break;
 
-__attribute__((always_inline, hot)) static inline void Vt_handle_char(Vt* self, char c)
-{
-    switch (expect(self->parser.state, PARSER_STATE_LITERAL)) {
+        /*  Invoke the G3 Character Set into GR (VT200 mode only) (LS3R) */
+        case '|':
+            self->charset_gr   = &self->charset_g3;
+            self->parser.state = PARSER_STATE_LITERAL;
+            break;
 
-        case PARSER_STATE_LITERAL:
-            Vt_handle_literal(self, c);
+        /* Invoke the G2 Character Set into GR (VT200 mode only) (LS2R) */
+        case '}':
+            self->charset_gr   = &self->charset_g2;
+            self->parser.state = PARSER_STATE_LITERAL;
             break;
 
-        case PARSER_STATE_CSI:
-            switch (c) {
-                case '\a':
-                    Vt_bell(self);
-                    break;
-                case '\b':
-                    Vt_handle_backspace(self);
-                    break;
-                case '\r':
-                    Vt_carriage_return(self);
-                    break;
-                case '\f':
-                case '\v':
-                case '\n':
-                    if (self->modes.new_line_mode) {
-                        Vt_carriage_return(self);
-                    }
-                    Vt_line_feed(self);
-                    break;
-                default:
-                    Vt_handle_CSI(self, c);
-            }
+        /* Invoke the G1 Character Set into GR (VT200 mode only) (LS1R) */
+        case '~':
+            self->charset_gr   = &self->charset_g1;
+            self->parser.state = PARSER_STATE_LITERAL;
             break;
 
-        case PARSER_STATE_ESCAPED:
-            switch (expect(c, '[')) {
+        /* Single Shift Select of G2 Character Set (SS2), VT220 */
+        case 'N':
+            self->charset_single_shift = &self->charset_g2;
+            self->parser.state         = PARSER_STATE_LITERAL;
+            break;
 
-                /* Control sequence introduce (CSI) */
-                case '[':
-                    self->parser.state = PARSER_STATE_CSI;
-                    return;
+        /* Single Shift Select of G3 Character Set (SS3), VT220 */
+        case 'O':
+            self->charset_single_shift = &self->charset_g3;
+            self->parser.state         = PARSER_STATE_LITERAL;
+            break;
 
-                /* Operating system command (OSC) */
-                case ']':
-                    self->parser.state = PARSER_STATE_OSC;
-                    return;
+        /* Old (tab)title set sequence */
+        case 'k':
+            self->parser.state = PARSER_STATE_TITLE;
+            break;
 
-                /* Device control */
-                case 'P':
-                    self->parser.state = PARSER_STATE_DCS;
-                    return;
+        /* Start of string */
+        case 'X':
+            STUB("SOS");
+            self->parser.state = PARSER_STATE_LITERAL;
+            break;
 
-                /* Application Programming Command (APC) */
-                case '_':
-                    self->parser.state = PARSER_STATE_APC;
-                    return;
+        /* Start of guarded area */
+        case 'V':
+        /* End of guarded area */
+        case 'W':
+            STUB("SGA/EGA");
+            self->parser.state = PARSER_STATE_LITERAL;
+            break;
 
-                /* Reverse line feed (RI) */
-                case 'M':
-                    Vt_reverse_line_feed(self);
-                    self->parser.state = PARSER_STATE_LITERAL;
-                    return;
+        /* ST */
+        case '\\':
+            self->parser.state = PARSER_STATE_LITERAL;
+            return;
 
-                /* New line (NEL) */
-                case 'E':
-                    Vt_carriage_return(self);
-                    /* fallthrough */
+        default: {
+            const char* cs    = control_char_get_pretty_string(c);
+            char        cb[2] = { c, 0 };
+            WRN("Unknown escape sequence: \'%s" TERMCOLOR_RESET ""
+                "\' (%d)\n",
+                cs ? cs : cb,
+                c);
 
-                /* Line feed (IND) */
-                case 'D':
-                    Vt_line_feed(self);
-                    self->parser.state = PARSER_STATE_LITERAL;
-                    return;
+            self->parser.state = PARSER_STATE_LITERAL;
+            return;
+        }
+    }
+}
 
-                case '#':
-                    self->parser.state = PARSER_STATE_DEC_SPECIAL;
-                    return;
+/**
+ * Handle an intermediate character following ESC */
+static void Vt_handle_ESC_intermediate(Vt* self, char c)
+{
+    switch (c) {
+        case '#':
+            self->parser.state = PARSER_STATE_DEC_SPECIAL;
+            break;
 
-                /* Set tab stop at current column (HTS) */
-                case 'H':
-                    self->tab_ruler[self->cursor.col] = true;
-                    self->parser.state                = PARSER_STATE_LITERAL;
-                    return;
+        /* set primary charset G0 */
+        case '(':
+            self->parser.state = PARSER_STATE_CHARSET_G0;
+            break;
 
-                /* set primary charset G0 */
-                case '(':
-                    self->parser.state = PARSER_STATE_CHARSET_G0;
-                    return;
+        /* set secondary charset G1 */
+        case ')':
+            self->parser.state = PARSER_STATE_CHARSET_G1;
+            break;
 
-                /* set secondary charset G1 */
-                case ')':
-                    self->parser.state = PARSER_STATE_CHARSET_G1;
-                    return;
+        /* set tertiary charset G2 */
+        case '*':
+            self->parser.state = PARSER_STATE_CHARSET_G2;
+            break;
 
-                /* set tertiary charset G2 */
-                case '*':
-                    self->parser.state = PARSER_STATE_CHARSET_G2;
-                    return;
+        /* set quaternary charset G3 */
+        case '+':
+            self->parser.state = PARSER_STATE_CHARSET_G3;
+            break;
 
-                /* set quaternary charset G3 */
-                case '+':
-                    self->parser.state = PARSER_STATE_CHARSET_G3;
-                    return;
+        /* Select default character set(<ESC>%@) or Select UTF-8 character set(<ESC>%G) */
+        case '%':
+        /* Switch 7/8 bit controls or select ANSI conformance level */
+        case ' ':
+            self->parser.state = PARSER_STATE_OTHER_ESC_CTL_SEQ;
+            break;
 
-                /* Select default character set(<ESC>%@) or Select UTF-8 character set(<ESC>%G) */
-                case '%':
-                    self->parser.state = PARSER_STATE_OTHER_ESC_CTL_SEQ;
-                    return;
+        default:
+            WRN("Unknown escape sequence: \'%c\' (%d)\n", c, c);
+    }
+}
 
-                /* Switch 7/8 bit controls or select ANSI conformance level */
-                case ' ':
-                    self->parser.state = PARSER_STATE_OTHER_ESC_CTL_SEQ;
-                    return;
+/**
+ * Execute a C0 control character received in the middle of an escape sequence */
+static inline void Vt_execute_C0(Vt* self, char c)
+{
+    switch (c) {
+        case '\a':
+        case '\b':
+        case '\r':
+        case '\n':
+        case '\v':
+        case '\f':
+        case '\t':
+        case 14 /* SO */:
+        case 15 /* SI */:
+            Vt_handle_literal(self, c);
+            break;
 
-                case 'g':
-                    Vt_bell(self);
-                    self->parser.state = PARSER_STATE_LITERAL;
-                    break;
+        default:;
+    }
+}
 
-                /* Application Keypad (DECKPAM) */
-                case '=':
-                    self->modes.application_keypad = true;
-                    self->parser.state             = PARSER_STATE_LITERAL;
-                    return;
+/**
+ * Accumulate a digit of the last control sequence parameter */
+static inline void vt_csi_sequence_param_digit(vt_csi_sequence_t* csi, char c)
+{
+    if (unlikely(csi->params_overflown)) {
+        return;
+    }
 
-                /* Normal Keypad (DECKPNM) */
-                case '>':
-                    self->modes.application_keypad = false;
-                    self->parser.state             = PARSER_STATE_LITERAL;
-                    return;
+    if (!csi->n_params) {
+        csi->n_params  = 1;
+        csi->params[0] = VT_CSI_PARAM_OMITTED;
+    }
 
-                /* Disable Manual Input (DMI) */
-                case '`':
-                /* Enable Manual Input (EMI) */
-                case 'b':
-                    STUB("EMI/DMI");
-                    self->parser.state = PARSER_STATE_LITERAL;
-                    break;
+    int32_t* p = &csi->params[csi->n_params - 1];
+    int32_t  d = c - '0';
 
-                /* Reset initial state (RIS) */
-                case 'c':
-                    Vt_hard_reset(self);
-                    return;
+    if (*p == VT_CSI_PARAM_OMITTED) {
+        *p = d;
+    } else {
+        *p = *p < (INT32_MAX - 9) / 10 ? *p * 10 + d : INT32_MAX;
+    }
+}
 
-                /* Save cursor (DECSC) */
-                case '7':
-                    self->saved_active_line = Vt_cursor_row(self);
-                    self->saved_cursor_pos  = self->cursor.col;
-                    self->parser.state      = PARSER_STATE_LITERAL;
-                    return;
+/**
+ * Start the next control sequence parameter */
+static inline void vt_csi_sequence_param_separator(vt_csi_sequence_t* csi, bool is_sub_param)
+{
+    if (!csi->n_params) {
+        csi->n_params  = 1;
+        csi->params[0] = VT_CSI_PARAM_OMITTED;
+    }
 
-                /* Restore cursor (DECRC) */
-                case '8':
-                    Vt_move_cursor(self, self->saved_cursor_pos, self->saved_active_line);
-                    self->parser.state = PARSER_STATE_LITERAL;
-                    return;
+    if (unlikely(csi->n_params >= VT_CSI_MAX_PARAMS)) {
+        csi->params_overflown = true;
+        return;
+    }
 
-                /* Back Index (DECBI) (VT400)
-                 *
-                 * This control function moves the cursor backward one column. If the cursor is
-                 * at the left margin, all screen data within the margins moves onecolumn to the
-                 * right. The column shifted past the right margin is lost
-                 */
-                case '6':
+    if (is_sub_param) {
+        csi->sub_param_mask |= (1u << csi->n_params);
+    }
+    csi->params[csi->n_params++] = VT_CSI_PARAM_OMITTED;
+}
 
-                /* Forward Index (DECFI) (VT400)
-                 *
-                 * This control function moves the cursor forward one column. If the cursor is
-                 *at the right margin, all screen data within the margins moves onecolumn to the
-                 *left. The column shifted past the left margin is lost.
-                 **/
-                case '9':
-                    STUB("DECBI/DECFI");
-                    self->parser.state = PARSER_STATE_LITERAL;
-                    break;
+/**
+ * Feed a character to the escape/control sequence state machine */
+__attribute__((hot)) static void Vt_handle_escape_sequence_char(Vt* self, char c)
+{
+    vt_parser_transition_t t =
+      vt_parser_transition_table[self->parser.state - PARSER_STATE_ESCAPED]
+                                [vt_char_class_table[(uint8_t)c]];
+    self->parser.state = t.next_state;
 
-                /* Coding Method Delimiter (CMD) */
-                case 'd':
-                    STUB("CMD");
-                    self->parser.state = PARSER_STATE_LITERAL;
-                    break;
+    switch (t.action) {
+        case VT_PARSER_ACTION_NONE:
+            break;
 
-                /* Invoke the G2 Character Set into GL (VT200 mode only) (LS2) */
-                case 'n':
-                    self->charset_gl   = &self->charset_g2;
-                    self->parser.state = PARSER_STATE_LITERAL;
-                    break;
+        case VT_PARSER_ACTION_EXECUTE:
+            Vt_execute_C0(self, c);
+            break;
 
-                /* Invoke the G3 Character Set into GL (VT200 mode only) (LS3) */
-                case 'o':
-                    self->charset_gl   = &self->charset_g3;
-                    self->parser.state = PARSER_STATE_LITERAL;
-                    break;
+        case VT_PARSER_ACTION_PARAM:
+            vt_csi_sequence_param_digit(&self->parser.csi, c);
+            break;
 
-                /*  Invoke the G3 Character Set into GR (VT200 mode only) (LS3R) */
-                case '|':
-                    self->charset_gr   = &self->charset_g3;
-                    self->parser.state = PARSER_STATE_LITERAL;
-                    break;
+        case VT_PARSER_ACTION_PARAM_SEPARATOR:
+            vt_csi_sequence_param_separator(&self->parser.csi, false);
+            break;
 
-                /* Invoke the G2 Character Set into GR (VT200 mode only) (LS2R) */
-                case '}':
-                    self->charset_gr   = &self->charset_g2;
-                    self->parser.state = PARSER_STATE_LITERAL;
-                    break;
+        case VT_PARSER_ACTION_SUB_PARAM_SEPARATOR:
+            vt_csi_sequence_param_separator(&self->parser.csi, true);
+            break;
 
-                /* Invoke the G1 Character Set into GR (VT200 mode only) (LS1R) */
-                case '~':
-                    self->charset_gr   = &self->charset_g1;
-                    self->parser.state = PARSER_STATE_LITERAL;
-                    break;
+        case VT_PARSER_ACTION_PRIVATE_MARKER:
+            self->parser.csi.private_marker = c;
+            break;
 
-                /* Single Shift Select of G2 Character Set (SS2), VT220 */
-                case 'N':
-                    self->charset_single_shift = &self->charset_g2;
-                    self->parser.state         = PARSER_STATE_LITERAL;
-                    break;
+        case VT_PARSER_ACTION_COLLECT:
+            if (self->parser.csi.n_intermediates < VT_CSI_MAX_INTERMEDIATES) {
+                self->parser.csi.intermediates[self->parser.csi.n_intermediates++] = c;
+            } else {
+                self->parser.state = PARSER_STATE_CSI_IGNORE;
+            }
+            break;
 
-                /* Single Shift Select of G3 Character Set (SS3), VT220 */
-                case 'O':
-                    self->charset_single_shift = &self->charset_g3;
-                    self->parser.state         = PARSER_STATE_LITERAL;
-                    break;
+        case VT_PARSER_ACTION_CSI_DISPATCH:
+            self->parser.csi.final = c;
+            Vt_handle_CSI(self, &self->parser.csi);
+            break;
 
-                /* Old (tab)title set sequence */
-                case 'k':
-                    self->parser.state = PARSER_STATE_TITLE;
-                    break;
+        case VT_PARSER_ACTION_ESC_INTERMEDIATE:
+            Vt_handle_ESC_intermediate(self, c);
+            break;
 
-                /* Start of string */
-                case 'X':
-                    STUB("SOS");
-                    self->parser.state = PARSER_STATE_LITERAL;
-                    break;
+        case VT_PARSER_ACTION_ESC_DISPATCH:
+            Vt_handle_ESC(self, c);
+            break;
 
-                /* Start of guarded area */
-                case 'V':
-                /* End of guarded area */
-                case 'W':
-                    STUB("SGA/EGA");
-                    self->parser.state = PARSER_STATE_LITERAL;
-                    break;
+        default:
+            ASSERT_UNREACHABLE;
+    }
+}
 
-                /* ST */
-                case '\\':
-                    return;
+__attribute__((always_inline, hot)) static inline void Vt_handle_char(Vt* self, char c)
+{
+    switch (expect(self->parser.state, PARSER_STATE_LITERAL)) {
 
-                case '\e':
-                    return;
+        case PARSER_STATE_LITERAL:
+            Vt_handle_literal(self, c);
+            break;
 
-                default: {
-                    const char* cs    = control_char_get_pretty_string(c);
-                    char        cb[2] = { c, 0 };
-                    WRN("Unknown escape sequence: \'%s" TERMCOLOR_RESET ""
-                        "\' (%d)\n",
-                        cs ? cs : cb,
-                        c);
-
-                    self->parser.state = PARSER_STATE_LITERAL;
-                    return;
-                }
-            }
+        case PARSER_STATE_ESCAPED:
+        case PARSER_STATE_CSI:
+        case PARSER_STATE_CSI_PARAM:
+        case PARSER_STATE_CSI_INTERMEDIATE:
+        case PARSER_STATE_CSI_IGNORE:
+            Vt_handle_escape_sequence_char(self, c);
             break;
 
         case PARSER_STATE_CHARSET_G0:
@@ -6236,14 +7525,26 @@ __attribute__((always_inline, hot)) static inline void Vt_handle_char(Vt* self,
                     self->scroll_region_right  = Vt_col(self) - 1;
                     self->scroll_region_top    = 0;
                     self->scroll_region_bottom = Vt_row(self) - 1;
-                    Vt_move_cursor(self, 0, 0);
-                    VtRune blank_E    = self->blank_space;
+                    /* the test pattern is not something REP should repeat */
+                    VtRune   last_inserted     = self->last_inserted;
+                    bool     has_last_inserted = self->has_last_inserted_rune;
+                    size_t   last_line_nr      = self->last_inserted_line_nr;
+                    uint16_t last_col_nr       = self->last_inserted_col_nr;
+
+                    VtRune blank_E    = *Vt_cell_attrs(self, &self->blank_space);
                     blank_E.rune.code = 'E';
-                    for (size_t cl = 0; cl < Vt_col(self); ++cl) {
-                        for (size_t r = Vt_top_line(self); r <= Vt_bottom_line(self); ++r) {
-                            Vt_overwrite_char_at(self, cl, r, blank_E);
-                        }
+                    for (size_t r = Vt_top_line(self); r <= Vt_bottom_line(self); ++r) {
+                        self->cursor.row = r;
+                        self->cursor.col = 0;
+                        self->wrap_next  = false;
+                        Vt_write_run(self, NULL, Vt_col(self), &blank_E);
                     }
+                    Vt_move_cursor(self, 0, 0);
+
+                    self->last_inserted          = last_inserted;
+                    self->has_last_inserted_rune = has_last_inserted;
+                    self->last_inserted_line_nr  = last_line_nr;
+                    self->last_inserted_col_nr   = last_col_nr;
                 } break;
 
                 default:
@@ -6271,7 +7572,10 @@ __attribute__((always_inline, hot)) static inline void Vt_handle_char(Vt* self,
     }
 }
 
-static void Vt_shift_global_line_index_refs(Vt* self, size_t point, int64_t delta, bool refs_only)
+/**
+ * Update references stored as global line indices after lines were inserted (delta > 0) or removed
+ * (delta < 0) before point */
+static void Vt_shift_line_index_refs(Vt* self, size_t point, int64_t delta, bool refs_only)
 {
     LOG("Vt::shift_idx{ pt: %zu, delta: %ld }\n", point, delta);
 
@@ -6287,32 +7591,6 @@ static void Vt_shift_global_line_index_refs(Vt* self, size_t point, int64_t delt
         }
     }
 
-    for (RcPtr_VtImageSurfaceView* rp = NULL;
-         (rp = Vector_iter_RcPtr_VtImageSurfaceView(&self->image_views, rp));) {
-        VtImageSurfaceView* sv = RcPtr_get_VtImageSurfaceView(rp);
-
-        if (sv && sv->anchor_global_index >= point) {
-            sv->anchor_global_index += delta;
-        }
-    }
-
-    for (RcPtr_VtCommand* rp = NULL;
-         (rp = Vector_iter_RcPtr_VtCommand(&self->shell_commands, rp));) {
-        VtCommand* cmd = RcPtr_get_VtCommand(rp);
-
-        if (cmd->command_start_row >= point) {
-            cmd->command_start_row += delta;
-        }
-
-        if (cmd->output_rows.first >= point) {
-            cmd->output_rows.first += delta;
-        }
-
-        if (cmd->output_rows.second >= point) {
-            cmd->output_rows.second += delta;
-        }
-    }
-
     if (self->selection.mode == SELECT_MODE_NORMAL) {
         if (self->selection.begin_line >= point) {
             self->selection.begin_line += delta;
@@ -6323,6 +7601,11 @@ static void Vt_shift_global_line_index_refs(Vt* self, size_t point, int64_t delt
         }
     }
 
+    if (self->last_inserted_line_nr >= point) {
+        self->last_inserted_line_nr += delta;
+    }
+
+
     if (unlikely(Vt_synchronized_update_is_active(self))) {
         for (vt_synchronized_update_origin_t* i = NULL;
              (i = Vector_iter_vt_synchronized_update_origin_t(
@@ -6335,6 +7618,85 @@ static void Vt_shift_global_line_index_refs(Vt* self, size_t point, int64_t delt
     }
 }
 
+/**
+ * Update references stored as line ids after lines were inserted or removed in the middle of the
+ * buffer. Ids are not affected by removing lines from the front of scrollback, so this never has to
+ * run when the history is trimmed */
+static void Vt_shift_line_id_refs(Vt* self, size_t point, int64_t delta)
+{
+    size_t point_id = Vt_line_id(self, point);
+
+    /* Commands are stored in the order they were started, once we find one that is entirely above
+     * point all earlier ones are too */
+    for (size_t i = self->shell_commands.size; i--;) {
+        VtCommand* cmd = RcPtr_get_VtCommand(Vector_at_RcPtr_VtCommand(&self->shell_commands, i));
+
+        if (!cmd) {
+            continue;
+        }
+
+        if (MAX(cmd->command_start_line_id,
+                MAX(cmd->output_line_ids.first, cmd->output_line_ids.second)) < point_id) {
+            break;
+        }
+
+        if (cmd->command_start_line_id >= point_id) {
+            cmd->command_start_line_id += delta;
+        }
+
+        if (cmd->output_line_ids.first >= point_id) {
+            cmd->output_line_ids.first += delta;
+        }
+
+        if (cmd->output_line_ids.second >= point_id) {
+            cmd->output_line_ids.second += delta;
+        }
+    }
+
+    if (likely(!self->image_views.size)) {
+        return;
+    }
+
+    /* Scroll region operations only move lines on screen. If there are fewer of those than views,
+     * re-anchor the views attached to them instead of visiting every view in the history */
+    size_t first_moved = delta < 0 ? point + delta : point;
+
+    if (self->lines.size - first_moved < self->image_views.size) {
+        for (size_t row = first_moved; row < self->lines.size; ++row) {
+            VtLine* ln = Ring_at_VtLine(&self->lines, row);
+
+            if (likely(!ln->graphic_attachments || !ln->graphic_attachments->images)) {
+                continue;
+            }
+
+            Vector_RcPtr_VtImageSurfaceView* views = ln->graphic_attachments->images;
+            for (RcPtr_VtImageSurfaceView* rp = NULL;
+                 (rp = Vector_iter_RcPtr_VtImageSurfaceView(views, rp));) {
+                VtImageSurfaceView* sv = RcPtr_get_VtImageSurfaceView(rp);
+
+                if (sv) {
+                    sv->anchor_line_id = Vt_line_id(self, row);
+                }
+            }
+        }
+    } else {
+        for (RcPtr_VtImageSurfaceView* rp = NULL;
+             (rp = Vector_iter_RcPtr_VtImageSurfaceView(&self->image_views, rp));) {
+            VtImageSurfaceView* sv = RcPtr_get_VtImageSurfaceView(rp);
+
+            if (sv && sv->anchor_line_id >= point_id) {
+                sv->anchor_line_id += delta;
+            }
+        }
+    }
+}
+
+static void Vt_shift_global_line_index_refs(Vt* self, size_t point, int64_t delta, bool refs_only)
+{
+    Vt_shift_line_index_refs(self, point, delta, refs_only);
+    Vt_shift_line_id_refs(self, point, delta);
+}
+
 static void Vt_remove_scrollback(Vt* self, size_t lines)
 {
     if (Vt_alt_buffer_enabled(self))
@@ -6344,37 +7706,44 @@ static void Vt_remove_scrollback(Vt* self, size_t lines)
         return;
 
     lines = MIN(lines, (self->lines.size - Vt_row(self)));
-    Vector_remove_at_VtLine(&self->lines, 0, lines);
 
-    for (size_t i = 0; i < self->shell_commands.size; ++i) {
-        VtCommand* cmd = RcPtr_get_VtCommand(Vector_at_RcPtr_VtCommand(&self->shell_commands, i));
-        if (!cmd || cmd->command_start_row < lines) {
-            Vector_remove_at_RcPtr_VtCommand(&self->shell_commands, i, 1);
+    bool dropped_images = false;
+    for (size_t i = 0; i < lines; ++i) {
+        if (unlikely(Ring_at_VtLine(&self->lines, i)->graphic_attachments)) {
+            dropped_images = true;
+            break;
         }
     }
 
-    Vt_shift_global_line_index_refs(self, lines, -(int64_t)lines, false);
+    Ring_pop_front_n_VtLine(&self->lines, lines);
+    Vt_search_index_prune(self);
 
-    while (self->image_views.size) {
-        bool removed = false;
-        for (RcPtr_VtImageSurfaceView* i = NULL;
-             (i = Vector_iter_RcPtr_VtImageSurfaceView(&self->image_views, i));) {
-            if (RcPtr_is_unique_VtImageSurfaceView(i)) {
-                Vector_remove_at_RcPtr_VtImageSurfaceView(
-                  &self->image_views,
-                  Vector_index_RcPtr_VtImageSurfaceView(&self->image_views, i),
-                  1);
-                RcPtr_destroy_VtImageSurfaceView(i);
-                removed = true;
-                break;
-            }
+    /* Line ids stay valid, only drop commands that started in removed lines */
+    size_t n_commands = 0;
+    for (VtCommand* cmd; n_commands < self->shell_commands.size; ++n_commands) {
+        cmd = RcPtr_get_VtCommand(Vector_at_RcPtr_VtCommand(&self->shell_commands, n_commands));
+        if (cmd && cmd->command_start_line_id >= self->lines.base) {
+            break;
+        }
+    }
+    if (n_commands) {
+        Vector_remove_at_RcPtr_VtCommand(&self->shell_commands, 0, n_commands);
+    }
 
-            if (removed) {
-                continue;
+    Vt_shift_line_index_refs(self, lines, -(int64_t)lines, false);
+
+    /* Views no longer attached to any line went away with it */
+    if (unlikely(dropped_images)) {
+        size_t kept = 0;
+        for (size_t i = 0; i < self->image_views.size; ++i) {
+            RcPtr_VtImageSurfaceView* rp = &self->image_views.buf[i];
+            if (RcPtr_is_unique_VtImageSurfaceView(rp)) {
+                RcPtr_destroy_VtImageSurfaceView(rp);
             } else {
-                break;
+                self->image_views.buf[kept++] = *rp;
             }
         }
+        self->image_views.size = kept;
     }
 }
 
@@ -6385,6 +7754,7 @@ void Vt_clear_scrollback(Vt* self)
     }
 
     Vt_remove_scrollback(self, self->lines.size);
+    Vt_spill_clear(self);
 }
 
 void Vt_shrink_scrollback(Vt* self)
@@ -6393,10 +7763,12 @@ void Vt_shrink_scrollback(Vt* self)
         return;
     }
 
-    int64_t ln_cnt = self->lines.size;
-    if (unlikely(ln_cnt > MAX(settings.scrollback * 1.1, Vt_row(self)))) {
-        int64_t to_remove = ln_cnt - settings.scrollback - Vt_row(self);
-        Vt_remove_scrollback(self, to_remove);
+    /* dropping lines from the front of the ring does not move the rest of them, so there is no
+     * need to let the buffer overgrow and trim it in large batches. Spilling lines to a file only
+     * removes whole blocks */
+    size_t limit = settings.scrollback + Vt_row(self);
+    if (self->lines.size > limit) {
+        Vt_remove_scrollback(self, Vt_spill_lines(self, self->lines.size - limit));
     }
 }
 
@@ -6430,11 +7802,27 @@ inline void Vt_interpret(Vt* self, char* buf, size_t bytes)
 
     memset(&self->defered_events, 0, sizeof(self->defered_events));
 
-    for (size_t i = 0; i < bytes; ++i) {
-        Vt_handle_char(self, buf[i]);
+    for (size_t i = 0; i < bytes;) {
+        if (likely(self->parser.state == PARSER_STATE_LITERAL)) {
+            if (unlikely((buf[i] & 0x80) || utf8_decoder_in_sequence(&self->parser.utf8_decoder))) {
+                size_t rd = Vt_handle_utf8_run(self, buf + i, bytes - i);
+                if (rd) {
+                    i += rd;
+                    continue;
+                }
+            } else {
+                size_t run = ascii_printable_run_length(buf + i, bytes - i);
+                if (run) {
+                    i += Vt_handle_printable_ascii_run(self, buf + i, run);
+                    continue;
+                }
+            }
+        }
+        Vt_handle_char(self, buf[i++]);
     }
 
     Vt_shrink_scrollback(self);
+    Vt_freeze_cold_lines(self);
 
     if (self->defered_events.action_performed) {
         CALL(self->callbacks.on_action_performed, self->callbacks.user_data);
@@ -6468,28 +7856,27 @@ VtLine* Vt_get_visible_line(const Vt* self, size_t idx)
     if (unlikely(Vt_synchronized_update_is_active(self) && idx >= Vt_top_line(self))) {
         return &self->synchronized_update_state.lines.buf[idx - Vt_top_line(self)];
     } else {
-        return &self->lines.buf[idx];
+        return Ring_at_VtLine(&self->lines, idx);
     }
 }
 
-void Vt_get_visible_lines(const Vt* self, VtLine** out_begin, VtLine** out_end)
+void Vt_get_visible_lines(const Vt* self, size_t* out_begin, size_t* out_end)
 {
     if (unlikely(Vt_synchronized_update_is_active(self))) {
         if (out_begin) {
-            *out_begin = self->synchronized_update_state.lines.buf;
+            *out_begin = Vt_top_line(self);
         }
 
         if (out_end) {
-            *out_end = self->synchronized_update_state.lines.buf +
-                       (self->synchronized_update_state.lines.size);
+            *out_end = Vt_top_line(self) + self->synchronized_update_state.lines.size;
         }
     } else {
         if (out_begin) {
-            *out_begin = self->lines.buf + Vt_visual_top_line(self);
+            *out_begin = Vt_visual_top_line(self);
         }
 
         if (out_end) {
-            *out_end = self->lines.buf + Vt_visual_bottom_line(self) + 1;
+            *out_end = Vt_visual_bottom_line(self) + 1;
         }
     }
 }
@@ -6769,18 +8156,23 @@ void Vt_consumed_output(Vt* self, size_t len)
 
 void Vt_destroy(Vt* self)
 {
-    Vector_destroy_VtLine(&self->lines);
+    Ring_destroy_VtLine(&self->lines);
 
     if (Vt_alt_buffer_enabled(self)) {
-        Vector_destroy_VtLine(&self->alt_lines);
+        Ring_destroy_VtLine(&self->alt_lines);
         Vector_destroy_RcPtr_VtImageSurfaceView(&self->alt_image_views);
     }
 
     Vector_destroy_VtLine(&self->synchronized_update_state.lines);
     Vector_destroy_vt_synchronized_update_origin_t(&self->synchronized_update_state.origins);
+    Vector_destroy_RcPtr_VtColdBlock(&self->cold_lines.thawed_blocks);
+    Vt_spill_destroy(self);
+    VtRuneTable_destroy(&self->cell_attrs);
+    VtRuneTable_destroy(&self->cell_clusters);
     Vector_destroy_char(&self->parser.active_sequence);
     Vector_destroy_DynStr(&self->title_stack);
     Vector_destroy_char(&self->unicode_input.buffer);
+    Vt_search_destroy(self);
     Vector_destroy_char(&self->output);
     Vector_destroy_char(&self->staged_output);
     Vector_destroy_char(&self->uri_matcher.match);
@@ -6789,7 +8181,7 @@ void Vt_destroy(Vt* self)
     Vector_destroy_RcPtr_VtCommand(&self->shell_commands);
     RcPtr_destroy_VtImageSurface(&self->manipulated_image);
     free(self->title);
-    free(self->active_hyperlink);
+    VtUriTable_destroy(&self->links);
     free(self->work_dir);
     free(self->tab_ruler);
     free(self->client_host);
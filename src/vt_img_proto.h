@@ -465,20 +465,21 @@ static bool VtImageSurfaceView_spans_column(VtImageSurfaceView* self, uint16_t c
     return (self->anchor_cell_idx <= col) && (self->anchor_cell_idx + self->cell_size.first >= col);
 }
 
-static bool VtImageSurfaceView_spans_line(VtImageSurfaceView* self, size_t idx)
+static bool VtImageSurfaceView_spans_line(VtImageSurfaceView* self, size_t line_id)
 {
-    return self->anchor_global_index <= idx &&
-           (self->anchor_global_index + self->cell_size.second) >= idx;
+    return self->anchor_line_id <= line_id &&
+           (self->anchor_line_id + self->cell_size.second) >= line_id;
 }
 
 static bool Vt_ImageSurfaceView_is_visible(const Vt* self, VtImageSurfaceView* view)
 {
-    return Vt_top_line(self) <= view->anchor_global_index + view->cell_size.second;
+    return Vt_line_id(self, Vt_top_line(self)) <= view->anchor_line_id + view->cell_size.second;
 }
 
-static bool VtImageSurfaceView_intersects(VtImageSurfaceView* self, size_t idx, uint16_t col)
+static bool VtImageSurfaceView_intersects(VtImageSurfaceView* self, size_t line_id, uint16_t col)
 {
-    return VtImageSurfaceView_spans_line(self, idx) && VtImageSurfaceView_spans_column(self, col);
+    return VtImageSurfaceView_spans_line(self, line_id) &&
+           VtImageSurfaceView_spans_column(self, col);
 }
 
 static void Vt_crop_VtImageSurfaceView_bottom_by_line(Vt* self, VtImageSurfaceView* view)
@@ -555,7 +556,7 @@ static const char* Vt_img_proto_display(Vt* self, uint64_t id, vt_image_proto_di
     }
 
     VtImageSurfaceView image_view;
-    image_view.anchor_global_index     = self->cursor.row;
+    image_view.anchor_line_id          = Vt_line_id(self, self->cursor.row);
     image_view.anchor_cell_idx         = anchor_cell;
     image_view.anchor_offset_px.first  = args.anchor_offset_x;
     image_view.anchor_offset_px.second = args.anchor_offset_y;
@@ -15,6 +15,18 @@ void                               Vt_start_synchronized_update(Vt* self);
 
 static void Vt_clear_line_sixel_proxies(Vt* self, VtLine* ln);
 void        Vt_select_clamp_to_buffer(Vt* self);
+void        Vt_unshare_line_cells(Vt* self, VtLine* line);
+
+/**
+ * Get @param line ready for modifying its cells. Cells still shared with the synchronized update
+ * snapshot are copied first */
+static inline VtLine* Vt_writable_line(Vt* self, VtLine* line)
+{
+    if (unlikely(line->cells_shared)) {
+        Vt_unshare_line_cells(self, line);
+    }
+    return line;
+}
 
 static inline void Vt_output(Vt* self, const char* buf, size_t len)
 {
@@ -35,31 +47,121 @@ static inline void Vt_mark_line_proxy_fully_damaged(Vt* self, VtLine* line)
     self->defered_events.action_performed = true;
     self->defered_events.repaint          = true;
     line->damage.type                     = VT_LINE_DAMAGE_FULL;
+    line->uris_detected                   = false;
 }
 
 static inline void Vt_mark_proxy_fully_damaged(Vt* self, size_t idx)
 {
-    Vt_mark_line_proxy_fully_damaged(self, &self->lines.buf[idx]);
+    Vt_mark_line_proxy_fully_damaged(self, Ring_at_VtLine(&self->lines, idx));
+}
+
+/**
+ * Make cells from @param front to @param end (inclusive) the only damaged range */
+static inline void vt_line_damage_set_range(vt_line_damage_t* self, uint16_t front, uint16_t end)
+{
+    self->type      = VT_LINE_DAMAGE_RANGE;
+    self->front     = front;
+    self->end       = end;
+    self->ranges[0] = (vt_line_damage_range_t){ .front = front, .end = end };
+    self->n_ranges  = 1;
+}
+
+/**
+ * Add cells from @param front to @param end (inclusive) to a damage of type RANGE. Ranges closer
+ * than VT_LINE_DAMAGE_MERGE_DISTANCE are merged, if there are too many the two closest ones are */
+static inline void vt_line_damage_add_range(vt_line_damage_t* self, uint16_t front, uint16_t end)
+{
+    self->front = MIN(self->front, front);
+    self->end   = MAX(self->end, end);
+
+    /* text is mostly written left to right, extend the last range */
+    vt_line_damage_range_t* last = &self->ranges[self->n_ranges - 1];
+    if (likely(front >= last->front && front <= last->end + VT_LINE_DAMAGE_MERGE_DISTANCE + 1)) {
+        last->end = MAX(last->end, end);
+        return;
+    }
+
+    vt_line_damage_range_t r[VT_LINE_DAMAGE_MAX_RANGES + 1];
+    uint8_t                n        = 0;
+    bool                   inserted = false;
+    for (uint8_t i = 0; i < self->n_ranges; ++i) {
+        if (!inserted && front < self->ranges[i].front) {
+            r[n++]   = (vt_line_damage_range_t){ .front = front, .end = end };
+            inserted = true;
+        }
+        r[n++] = self->ranges[i];
+    }
+    if (!inserted) {
+        r[n++] = (vt_line_damage_range_t){ .front = front, .end = end };
+    }
+
+    uint8_t merged = 0;
+    for (uint8_t i = 1; i < n; ++i) {
+        if (r[i].front <= r[merged].end + VT_LINE_DAMAGE_MERGE_DISTANCE + 1) {
+            r[merged].end = MAX(r[merged].end, r[i].end);
+        } else {
+            r[++merged] = r[i];
+        }
+    }
+    n = merged + 1;
+
+    if (n > VT_LINE_DAMAGE_MAX_RANGES) {
+        uint8_t closest = 0;
+        for (uint8_t i = 1; i + 1 < n; ++i) {
+            if (r[i + 1].front - r[i].end < r[closest + 1].front - r[closest].end) {
+                closest = i;
+            }
+        }
+        r[closest].end = r[closest + 1].end;
+        memmove(&r[closest + 1], &r[closest + 2], (n - closest - 2) * sizeof(*r));
+        --n;
+    }
+
+    memcpy(self->ranges, r, n * sizeof(*r));
+    self->n_ranges = n;
 }
 
 static inline void Vt_mark_proxy_damaged_cell(Vt* self, size_t line, size_t rune)
 {
+    VtLine*           ln                  = Ring_at_VtLine(&self->lines, line);
+    vt_line_damage_t* damage              = &ln->damage;
     self->defered_events.action_performed = true;
-    switch (self->lines.buf[line].damage.type) {
+    ln->uris_detected                     = false;
+    switch (damage->type) {
         case VT_LINE_DAMAGE_NONE:
-            self->lines.buf[line].damage.type  = VT_LINE_DAMAGE_RANGE;
-            self->lines.buf[line].damage.front = rune;
-            self->lines.buf[line].damage.end   = rune;
+            vt_line_damage_set_range(damage, rune, rune);
             break;
 
-        case VT_LINE_DAMAGE_RANGE: {
-            size_t lo = MIN(self->lines.buf[line].damage.front, rune);
-            size_t hi = MAX(self->lines.buf[line].damage.end, rune);
+        case VT_LINE_DAMAGE_RANGE:
+            vt_line_damage_add_range(damage, rune, rune);
+            break;
 
-            self->lines.buf[line].damage.front = lo;
-            self->lines.buf[line].damage.end   = hi;
+        case VT_LINE_DAMAGE_SHIFT: {
+            ASSERT_UNREACHABLE;
         } break;
 
+        default:
+            return;
+    }
+}
+
+/**
+ * Mark cells from @param begin to @param end (inclusive) as damaged */
+static inline void Vt_mark_proxy_damaged_cells(Vt* self, size_t line, size_t begin, size_t end)
+{
+    VtLine*           ln                  = Ring_at_VtLine(&self->lines, line);
+    vt_line_damage_t* damage              = &ln->damage;
+    self->defered_events.action_performed = true;
+    ln->uris_detected                     = false;
+    switch (damage->type) {
+        case VT_LINE_DAMAGE_NONE:
+            vt_line_damage_set_range(damage, begin, end);
+            break;
+
+        case VT_LINE_DAMAGE_RANGE:
+            vt_line_damage_add_range(damage, begin, end);
+            break;
+
         case VT_LINE_DAMAGE_SHIFT: {
             ASSERT_UNREACHABLE;
         } break;
@@ -86,8 +188,9 @@ static inline void Vt_clear_line_proxy(Vt* self, VtLine* line)
 
 static inline void Vt_clear_proxy(Vt* self, size_t idx)
 {
-    Vt_clear_line_proxy(self, &self->lines.buf[idx]);
-    Vt_clear_line_sixel_proxies(self, &self->lines.buf[idx]);
+    VtLine* line = Ring_at_VtLine(&self->lines, idx);
+    Vt_clear_line_proxy(self, line);
+    Vt_clear_line_sixel_proxies(self, line);
 }
 
 static inline void Vt_clear_proxies_in_region(Vt* self, size_t begin, size_t end)
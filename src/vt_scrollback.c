@@ -0,0 +1,795 @@
+/* See LICENSE for license information. */
+
+/* Cold tier of the scrollback buffer. Cells of lines far above the viewport are packed into
+ * compressed blocks and only decompressed when something needs to read them again. Blocks removed
+ * from the front of the buffer can be written to a spill file and loaded back from it */
+
+#define _GNU_SOURCE
+
+#include "lz.h"
+#include "settings.h"
+#include "vt.h"
+#include "vt_private.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* Bytes of a cell are stored in separate planes: code (4), attrs_idx (2) and hyperlink_idx (2).
+ * Keeping the same byte of every cell together turns runs of text with the same attributes into
+ * long repeats the codec can remove */
+#define VT_COLD_PLANES 8
+
+/* Uncompressed block layout:
+ *   vt_cold_block_header_t header
+ *   uint32_t               line_sizes[n_lines]
+ *   VtRune                 attrs[n_attrs]       - copies of Vt.cell_attrs entries
+ *   Rune                   clusters[n_clusters] - copies of Vt.cell_clusters entries
+ *   uint8_t                links[]              - copies of Vt.links entries: detected (uint8_t),
+ *                                                 length (uint32_t) and string, n_links times
+ *   uint8_t                planes[VT_COLD_PLANES][n_cells]
+ *
+ * Cells refer to the block local tables, so blocks stay valid when the global ones are compacted */
+typedef struct
+{
+    uint32_t n_attrs, n_clusters, n_links;
+} vt_cold_block_header_t;
+
+typedef struct
+{
+    /* global table index -> local index + 1 */
+    uint32_t* attrs_remap;
+    uint32_t* clusters_remap;
+    uint32_t* links_remap;
+
+    /* local index -> global table index */
+    uint16_t* attrs;
+    uint16_t* clusters;
+    uint16_t* links;
+} vt_cold_freeze_ctx_t;
+
+static void Vt_freeze_line(Vt* self, VtLine* line, RcPtr_VtColdBlock* block)
+{
+    CALL(self->callbacks.destroy_proxy, self->callbacks.user_data, &line->proxy);
+    line->damage.type = VT_LINE_DAMAGE_FULL;
+    VtLine_destroy_cells(self, line);
+    line->data       = (Vector_VtCell){ 0 };
+    line->cold_block = RcPtr_new_shared_VtColdBlock(block);
+}
+
+static vt_cold_freeze_ctx_t vt_cold_freeze_ctx_new()
+{
+    return (vt_cold_freeze_ctx_t){
+        .attrs_remap    = _calloc(VT_CELL_TABLE_MAX_ENTRIES, sizeof(uint32_t)),
+        .clusters_remap = _calloc(VT_CELL_TABLE_MAX_ENTRIES, sizeof(uint32_t)),
+        .links_remap    = _calloc(VT_URI_TABLE_MAX_ENTRIES + 1, sizeof(uint32_t)),
+        .attrs          = _malloc(VT_CELL_TABLE_MAX_ENTRIES * sizeof(uint16_t)),
+        .clusters       = _malloc(VT_CELL_TABLE_MAX_ENTRIES * sizeof(uint16_t)),
+        .links          = _malloc(VT_URI_TABLE_MAX_ENTRIES * sizeof(uint16_t)),
+    };
+}
+
+static void vt_cold_freeze_ctx_destroy(vt_cold_freeze_ctx_t* self)
+{
+    free(self->attrs_remap);
+    free(self->clusters_remap);
+    free(self->links_remap);
+    free(self->attrs);
+    free(self->clusters);
+    free(self->links);
+}
+
+/**
+ * Compress characters of VT_COLD_BLOCK_LINES lines starting at @param row
+ * @return compressed data */
+static uint8_t* Vt_pack_lines(Vt*                   self,
+                              vt_cold_freeze_ctx_t* ctx,
+                              size_t                row,
+                              uint32_t*             out_size,
+                              uint32_t*             out_raw_size)
+{
+    uint32_t n_attrs = 0, n_clusters = 0, n_links = 0;
+    size_t   n_cells = 0, links_size = 0;
+
+    for (size_t i = row; i < row + VT_COLD_BLOCK_LINES; ++i) {
+        VtLine* line = Ring_at_VtLine(&self->lines, i);
+        for (VtCell* c = line->data.buf; c < line->data.buf + line->data.size; ++c) {
+            if (!ctx->attrs_remap[c->attrs_idx]) {
+                ctx->attrs[n_attrs]            = c->attrs_idx;
+                ctx->attrs_remap[c->attrs_idx] = ++n_attrs;
+            }
+            if (VtCell_is_cluster(c) && !ctx->clusters_remap[c->code & ~VT_CELL_CLUSTER_FLAG]) {
+                ctx->clusters[n_clusters] = c->code & ~VT_CELL_CLUSTER_FLAG;
+                ctx->clusters_remap[c->code & ~VT_CELL_CLUSTER_FLAG] = ++n_clusters;
+            }
+            if (c->hyperlink_idx && !ctx->links_remap[c->hyperlink_idx]) {
+                ctx->links[n_links]                = c->hyperlink_idx;
+                ctx->links_remap[c->hyperlink_idx] = ++n_links;
+                links_size += sizeof(uint8_t) + sizeof(uint32_t) +
+                              strlen(Vt_uri_by_id(self, c->hyperlink_idx)->uri_string);
+            }
+        }
+        n_cells += line->data.size;
+    }
+
+    vt_cold_block_header_t header = {
+        .n_attrs    = n_attrs,
+        .n_clusters = n_clusters,
+        .n_links    = n_links,
+    };
+
+    size_t raw_size = sizeof(header) + VT_COLD_BLOCK_LINES * sizeof(uint32_t) +
+                      n_attrs * sizeof(VtRune) + n_clusters * sizeof(Rune) + links_size +
+                      n_cells * VT_COLD_PLANES;
+    uint8_t* raw = _malloc(raw_size);
+    uint8_t* p   = raw;
+
+    memcpy(p, &header, sizeof(header));
+    p += sizeof(header);
+
+    for (size_t i = row; i < row + VT_COLD_BLOCK_LINES; ++i) {
+        uint32_t line_size = Ring_at_VtLine(&self->lines, i)->data.size;
+        memcpy(p, &line_size, sizeof(line_size));
+        p += sizeof(line_size);
+    }
+
+    for (uint32_t i = 0; i < n_attrs; ++i) {
+        memcpy(p, &self->cell_attrs.entries.buf[ctx->attrs[i]], sizeof(VtRune));
+        p += sizeof(VtRune);
+    }
+
+    for (uint32_t i = 0; i < n_clusters; ++i) {
+        memcpy(p, &self->cell_clusters.entries.buf[ctx->clusters[i]].rune, sizeof(Rune));
+        p += sizeof(Rune);
+    }
+
+    for (uint32_t i = 0; i < n_links; ++i) {
+        const VtUri* uri = Vt_uri_by_id(self, ctx->links[i]);
+        uint32_t     len = strlen(uri->uri_string);
+        *p++             = uri->detected;
+        memcpy(p, &len, sizeof(len));
+        memcpy(p + sizeof(len), uri->uri_string, len);
+        p += sizeof(len) + len;
+    }
+
+    for (size_t i = row, cell = 0; i < row + VT_COLD_BLOCK_LINES; ++i) {
+        VtLine* line = Ring_at_VtLine(&self->lines, i);
+        for (VtCell* c = line->data.buf; c < line->data.buf + line->data.size; ++c, ++cell) {
+            uint32_t code = c->code;
+            if (VtCell_is_cluster(c)) {
+                code = VT_CELL_CLUSTER_FLAG |
+                       (ctx->clusters_remap[c->code & ~VT_CELL_CLUSTER_FLAG] - 1);
+            }
+            uint16_t attrs_idx     = ctx->attrs_remap[c->attrs_idx] - 1;
+            uint16_t hyperlink_idx = ctx->links_remap[c->hyperlink_idx];
+
+            p[cell]               = code;
+            p[n_cells + cell]     = code >> 8;
+            p[n_cells * 2 + cell] = code >> 16;
+            p[n_cells * 3 + cell] = code >> 24;
+            p[n_cells * 4 + cell] = attrs_idx;
+            p[n_cells * 5 + cell] = attrs_idx >> 8;
+            p[n_cells * 6 + cell] = hyperlink_idx;
+            p[n_cells * 7 + cell] = hyperlink_idx >> 8;
+        }
+    }
+
+    for (uint32_t i = 0; i < n_attrs; ++i) {
+        ctx->attrs_remap[ctx->attrs[i]] = 0;
+    }
+
+    for (uint32_t i = 0; i < n_clusters; ++i) {
+        ctx->clusters_remap[ctx->clusters[i]] = 0;
+    }
+
+    for (uint32_t i = 0; i < n_links; ++i) {
+        ctx->links_remap[ctx->links[i]] = 0;
+    }
+
+    uint8_t* data = _malloc(lz_compress_bound(raw_size));
+    size_t   size = lz_compress(raw, raw_size, data);
+    free(raw);
+
+    *out_size     = size;
+    *out_raw_size = raw_size;
+    return _realloc(data, size);
+}
+
+/**
+ * Decompress characters of a block into @param lines, NULL entries are skipped. The lines have to
+ * be in the buffer already, adding cells may compact the global tables
+ * @return false if the data is corrupted, all lines are left empty */
+static bool Vt_unpack_lines(Vt*            self,
+                            const uint8_t* data,
+                            uint32_t       size,
+                            uint32_t       raw_size,
+                            uint16_t       n_lines,
+                            VtLine**       lines)
+{
+    uint8_t* raw   = _malloc(raw_size);
+    bool     valid = raw_size >= sizeof(vt_cold_block_header_t);
+    valid          = valid && lz_decompress(data, size, raw, raw_size) == (ptrdiff_t)raw_size;
+
+    vt_cold_block_header_t header = { 0 };
+    if (valid) {
+        memcpy(&header, raw, sizeof(header));
+    }
+
+    /* records can come from the spill file, do not trust the counts */
+    if (!valid || raw_size < sizeof(header) + n_lines * sizeof(uint32_t) +
+                               (size_t)header.n_attrs * sizeof(VtRune) +
+                               (size_t)header.n_clusters * sizeof(Rune)) {
+        valid  = false;
+        header = (vt_cold_block_header_t){ 0 };
+    }
+
+    const uint8_t* sizes    = raw + sizeof(header);
+    const uint8_t* attrs    = sizes + n_lines * sizeof(uint32_t);
+    const uint8_t* clusters = attrs + header.n_attrs * sizeof(VtRune);
+    const uint8_t* p        = clusters + header.n_clusters * sizeof(Rune);
+
+    Vector_VtUri links = Vector_new_with_capacity_VtUri(MAX(header.n_links, 1));
+    for (uint32_t i = 0; valid && i < header.n_links; ++i) {
+        uint32_t len;
+        if (raw + raw_size - p < (ptrdiff_t)(sizeof(uint8_t) + sizeof(len))) {
+            valid = false;
+            break;
+        }
+        bool detected = *p;
+        memcpy(&len, p + 1, sizeof(len));
+        if ((size_t)(raw + raw_size - p) < sizeof(uint8_t) + sizeof(len) + len) {
+            valid = false;
+            break;
+        }
+        Vector_push_VtUri(&links,
+                          (VtUri){ .uri_string = strndup((const char*)p + 1 + sizeof(len), len),
+                                   .detected   = detected });
+        p += sizeof(uint8_t) + sizeof(len) + len;
+    }
+
+    size_t n_cells = valid ? (raw + raw_size - p) / VT_COLD_PLANES : 0;
+
+    /* check every cell refers to stored table entries before adding any of them */
+    size_t n_used = 0;
+    for (size_t i = 0; valid && i < n_lines; ++i) {
+        uint32_t line_size;
+        memcpy(&line_size, sizes + i * sizeof(uint32_t), sizeof(line_size));
+        n_used += line_size;
+    }
+    valid = valid && n_used <= n_cells;
+    for (size_t cell = 0; valid && cell < n_used; ++cell) {
+        char32_t code = p[cell] | p[n_cells + cell] << 8 | p[n_cells * 2 + cell] << 16 |
+                        (char32_t)p[n_cells * 3 + cell] << 24;
+        uint16_t attrs_idx = p[n_cells * 4 + cell] | p[n_cells * 5 + cell] << 8;
+
+        if (attrs_idx >= header.n_attrs ||
+            ((code & VT_CELL_CLUSTER_FLAG) &&
+             (code & ~VT_CELL_CLUSTER_FLAG) >= header.n_clusters)) {
+            valid = false;
+        }
+    }
+    if (!valid) {
+        n_cells = 0;
+    }
+
+    for (size_t i = 0, cell = 0; i < n_lines; ++i) {
+        uint32_t line_size = 0;
+        if (valid) {
+            memcpy(&line_size, sizes + i * sizeof(uint32_t), sizeof(line_size));
+        }
+
+        VtLine* line = lines[i];
+        if (!line) {
+            cell += line_size;
+            continue;
+        }
+
+        Vector_destroy_VtCell(&line->data);
+        line->data        = Vector_new_with_capacity_VtCell(MAX(line_size, 1));
+        line->damage.type = VT_LINE_DAMAGE_FULL;
+
+        for (uint32_t j = 0; j < line_size; ++j, ++cell) {
+            char32_t code = p[cell] | p[n_cells + cell] << 8 | p[n_cells * 2 + cell] << 16 |
+                            (char32_t)p[n_cells * 3 + cell] << 24;
+            uint16_t attrs_idx = p[n_cells * 4 + cell] | p[n_cells * 5 + cell] << 8;
+
+            VtRune rune;
+            memcpy(&rune, attrs + attrs_idx * sizeof(VtRune), sizeof(VtRune));
+
+            if (code & VT_CELL_CLUSTER_FLAG) {
+                Rune cluster;
+                memcpy(&cluster,
+                       clusters + (code & ~VT_CELL_CLUSTER_FLAG) * sizeof(Rune),
+                       sizeof(Rune));
+                rune.rune.code = cluster.code;
+                memcpy(rune.rune.combine, cluster.combine, sizeof(cluster.combine));
+            } else {
+                rune.rune.code = code;
+            }
+
+            uint16_t link_idx  = p[n_cells * 6 + cell] | p[n_cells * 7 + cell] << 8;
+            rune.hyperlink_idx = link_idx && link_idx <= links.size
+                                   ? Vt_intern_uri(self,
+                                                   links.buf[link_idx - 1].uri_string,
+                                                   links.buf[link_idx - 1].detected)
+                                   : 0;
+
+            /* may compact the global tables, cells are added one at a time so the ones already
+             * stored are updated */
+            Vector_push_VtCell(&line->data, Vt_cell_from_rune(self, &rune));
+        }
+    }
+
+    Vector_destroy_VtUri(&links);
+    free(raw);
+    return valid;
+}
+
+/**
+ * Compress VT_COLD_BLOCK_LINES lines starting at @param row */
+static void Vt_freeze_block(Vt* self, vt_cold_freeze_ctx_t* ctx, size_t row)
+{
+    RcPtr_VtColdBlock block = RcPtr_new_VtColdBlock();
+    VtColdBlock*      b     = RcPtr_get_VtColdBlock(&block);
+
+    *b = (VtColdBlock){ .first_line_id = Vt_line_id(self, row), .n_lines = VT_COLD_BLOCK_LINES };
+
+    b->data = Vt_pack_lines(self, ctx, row, &b->size, &b->raw_size);
+
+    for (size_t i = row; i < row + VT_COLD_BLOCK_LINES; ++i) {
+        Vt_freeze_line(self, Ring_at_VtLine(&self->lines, i), &block);
+    }
+
+    RcPtr_destroy_VtColdBlock(&block);
+}
+
+/**
+ * Move lines of a thawed block back to it, its compressed data is still valid as lines in the
+ * scrollback do not change */
+static void Vt_refreeze_block(Vt* self, RcPtr_VtColdBlock* block_ref)
+{
+    const VtColdBlock* block = RcPtr_get_VtColdBlock(block_ref);
+
+    size_t begin = MAX(block->first_line_id, self->lines.base);
+    size_t end   = block->first_line_id + block->n_lines;
+
+    for (size_t id = begin; id < end && Vt_line_id_to_row(self, id) < self->lines.size; ++id) {
+        VtLine* line = Ring_at_VtLine(&self->lines, Vt_line_id_to_row(self, id));
+        if (!RcPtr_get_VtColdBlock(&line->cold_block)) {
+            Vt_freeze_line(self, line, block_ref);
+        }
+    }
+}
+
+/**
+ * Decompress all remaining lines of a block */
+static void Vt_thaw_block(Vt* self, RcPtr_VtColdBlock* block_ref)
+{
+    /* the lines release their references below */
+    RcPtr_VtColdBlock  block_ptr = RcPtr_new_shared_VtColdBlock(block_ref);
+    const VtColdBlock* block     = RcPtr_get_VtColdBlock(&block_ptr);
+
+    VtLine* lines[VT_COLD_BLOCK_LINES] = { 0 };
+
+    for (size_t i = 0; i < block->n_lines; ++i) {
+        /* lines may have been removed from the front of the buffer */
+        size_t  id   = block->first_line_id + i;
+        VtLine* line = NULL;
+        if (id >= self->lines.base) {
+            line = Vt_line_at(self, Vt_line_id_to_row(self, id));
+        }
+
+        if (line && line->cold_block.block == block_ptr.block) {
+            RcPtr_destroy_VtColdBlock(&line->cold_block);
+            lines[i] = line;
+        }
+    }
+
+    /* a block that can not be decoded leaves its lines empty */
+    if (!Vt_unpack_lines(self, block->data, block->size, block->raw_size, block->n_lines, lines)) {
+        WRN("Failed to decompress scrollback lines %zu..%zu\n",
+            block->first_line_id,
+            block->first_line_id + block->n_lines);
+    }
+
+    Vector_push_RcPtr_VtColdBlock(&self->cold_lines.thawed_blocks, block_ptr);
+}
+
+void Vt_thaw_lines(Vt* self, size_t begin_line, size_t end_line)
+{
+    if (Vt_alt_buffer_enabled(self) ||
+        Vt_line_id(self, begin_line) >= self->cold_lines.frozen_end_line_id) {
+        return;
+    }
+
+    end_line = MIN(end_line, Vt_line_id_to_row(self, self->cold_lines.frozen_end_line_id) - 1);
+    end_line = MIN(end_line, self->lines.size - 1);
+
+    for (size_t row = begin_line; row <= end_line; ++row) {
+        VtLine* line = Ring_at_VtLine(&self->lines, row);
+        if (RcPtr_get_VtColdBlock(&line->cold_block)) {
+            Vt_thaw_block(self, &line->cold_block);
+        }
+    }
+}
+
+void Vt_thaw_lines_from(Vt* self, size_t begin_line)
+{
+    if (Vt_alt_buffer_enabled(self) || begin_line >= self->lines.size) {
+        return;
+    }
+
+    size_t begin_id = Vt_line_id(self, begin_line);
+    if (begin_id < self->cold_lines.frozen_end_line_id) {
+        Vt_thaw_lines(self, begin_line, self->lines.size - 1);
+    }
+
+    /* Whole blocks are thawed, lines of the first one above begin_line are no longer frozen either
+     * and freezing has to start over from there */
+    size_t                    frozen_end = MIN(self->cold_lines.frozen_end_line_id, begin_id);
+    Vector_RcPtr_VtColdBlock* thawed     = &self->cold_lines.thawed_blocks;
+    for (size_t i = 0; i < thawed->size;) {
+        const VtColdBlock* block = RcPtr_get_VtColdBlock(&thawed->buf[i]);
+        if (block->first_line_id + block->n_lines > begin_id) {
+            frozen_end = MIN(frozen_end, block->first_line_id);
+            Vector_remove_at_RcPtr_VtColdBlock(thawed, i, 1);
+        } else {
+            ++i;
+        }
+    }
+
+    self->cold_lines.frozen_end_line_id = frozen_end;
+}
+
+void Vt_freeze_cold_lines(Vt* self)
+{
+    if (!settings.scrollback_compress || Vt_alt_buffer_enabled(self)) {
+        return;
+    }
+
+    size_t viewport_top = MIN(Vt_visual_top_line(self), Vt_top_line(self));
+    if (viewport_top < settings.scrollback_compress) {
+        return;
+    }
+
+    size_t limit_id = Vt_line_id(self, viewport_top - settings.scrollback_compress);
+
+    /* lines below ones waiting to be reflowed will still get different ids */
+    if (Vt_reflow_pending(self)) {
+        limit_id = MIN(limit_id, self->reflow_pending_end_line_id);
+    }
+
+    Vector_RcPtr_VtColdBlock* thawed = &self->cold_lines.thawed_blocks;
+    for (size_t i = 0; i < thawed->size;) {
+        const VtColdBlock* block = RcPtr_get_VtColdBlock(&thawed->buf[i]);
+        if (block->first_line_id + block->n_lines <= limit_id) {
+            Vt_refreeze_block(self, &thawed->buf[i]);
+            Vector_remove_at_RcPtr_VtColdBlock(thawed, i, 1);
+        } else {
+            ++i;
+        }
+    }
+
+    size_t begin_id = MAX(self->cold_lines.frozen_end_line_id, self->lines.base);
+    if (begin_id + VT_COLD_BLOCK_LINES > limit_id) {
+        return;
+    }
+
+    vt_cold_freeze_ctx_t ctx = vt_cold_freeze_ctx_new();
+
+    for (; begin_id + VT_COLD_BLOCK_LINES <= limit_id; begin_id += VT_COLD_BLOCK_LINES) {
+        Vt_freeze_block(self, &ctx, Vt_line_id_to_row(self, begin_id));
+    }
+
+    self->cold_lines.frozen_end_line_id = begin_id;
+    vt_cold_freeze_ctx_destroy(&ctx);
+}
+
+/* Spill file record layout:
+ *   vt_spill_record_header_t header
+ *   uint8_t                  meta[meta_size] - per line flags (uint8_t)
+ *   uint8_t                  data[size]      - compressed characters, same as VtColdBlock.data */
+typedef struct
+{
+    uint32_t size, raw_size, meta_size;
+} vt_spill_record_header_t;
+
+enum vt_spill_line_flags_e
+{
+    VT_SPILL_LINE_REFLOWABLE                = (1 << 0),
+    VT_SPILL_LINE_REJOINABLE                = (1 << 1),
+    VT_SPILL_LINE_WAS_REFLOWN               = (1 << 2),
+    VT_SPILL_LINE_MARK_EXPLICIT             = (1 << 3),
+    VT_SPILL_LINE_MARK_COMMAND_INVOKE       = (1 << 4),
+    VT_SPILL_LINE_MARK_COMMAND_OUTPUT_START = (1 << 5),
+    VT_SPILL_LINE_MARK_COMMAND_OUTPUT_END   = (1 << 6),
+};
+
+#define VT_SPILL_MIN_FILE_SIZE (1 << 20)
+
+static bool Vt_spill_open(Vt* self)
+{
+    const char* dir = getenv("XDG_RUNTIME_DIR");
+    if (!dir) {
+        WRN("XDG_RUNTIME_DIR is not set, lines removed from scrollback will be discarded\n");
+        return false;
+    }
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/wayst-scrollback-XXXXXX", dir);
+
+    int fd = mkostemp(path, O_CLOEXEC);
+    if (fd < 0) {
+        WRN("Failed to create scrollback spill file in \'%s\': %s\n", dir, strerror(errno));
+        return false;
+    }
+
+    /* nothing else needs to open it, the file goes away with the descriptor */
+    unlink(path);
+
+    self->spill.fd = fd;
+    return true;
+}
+
+/**
+ * Make sure the file is mapped with space for @param bytes more */
+static bool Vt_spill_reserve(Vt* self, size_t bytes)
+{
+    if (self->spill.used + bytes <= self->spill.map_size) {
+        return true;
+    }
+
+    if (self->spill.fd < 0 && !Vt_spill_open(self)) {
+        return false;
+    }
+
+    size_t new_size = MAX(self->spill.map_size * 2, VT_SPILL_MIN_FILE_SIZE);
+    while (new_size < self->spill.used + bytes) {
+        new_size *= 2;
+    }
+
+    if (ftruncate(self->spill.fd, new_size)) {
+        WRN("Failed to resize scrollback spill file: %s\n", strerror(errno));
+        return false;
+    }
+
+    if (self->spill.map) {
+        munmap(self->spill.map, self->spill.map_size);
+        self->spill.map      = NULL;
+        self->spill.map_size = 0;
+    }
+
+    void* map = mmap(NULL, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, self->spill.fd, 0);
+    if (map == MAP_FAILED) {
+        WRN("Failed to map scrollback spill file: %s\n", strerror(errno));
+        return false;
+    }
+
+    self->spill.map      = map;
+    self->spill.map_size = new_size;
+    return true;
+}
+
+static void Vt_spill_pack_meta(Vt* self, size_t row, Vector_uint8_t* out)
+{
+    for (size_t i = row; i < row + VT_COLD_BLOCK_LINES; ++i) {
+        VtLine* line  = Ring_at_VtLine(&self->lines, i);
+        uint8_t flags = 0;
+
+        flags |= line->reflowable ? VT_SPILL_LINE_REFLOWABLE : 0;
+        flags |= line->rejoinable ? VT_SPILL_LINE_REJOINABLE : 0;
+        flags |= line->was_reflown ? VT_SPILL_LINE_WAS_REFLOWN : 0;
+        flags |= line->mark_explicit ? VT_SPILL_LINE_MARK_EXPLICIT : 0;
+        flags |= line->mark_command_invoke ? VT_SPILL_LINE_MARK_COMMAND_INVOKE : 0;
+        flags |= line->mark_command_output_start ? VT_SPILL_LINE_MARK_COMMAND_OUTPUT_START : 0;
+        flags |= line->mark_command_output_end ? VT_SPILL_LINE_MARK_COMMAND_OUTPUT_END : 0;
+
+        Vector_push_uint8_t(out, flags);
+    }
+}
+
+static bool spill_read(const uint8_t** p, const uint8_t* end, void* out, size_t bytes)
+{
+    if ((size_t)(end - *p) < bytes) {
+        return false;
+    }
+    memcpy(out, *p, bytes);
+    *p += bytes;
+    return true;
+}
+
+static bool Vt_spill_unpack_meta(const uint8_t* p, const uint8_t* end, VtLine** lines)
+{
+    for (size_t i = 0; i < VT_COLD_BLOCK_LINES; ++i) {
+        VtLine* line  = lines[i];
+        uint8_t flags = 0;
+
+        if (!spill_read(&p, end, &flags, sizeof(flags))) {
+            return false;
+        }
+
+        line->reflowable                = flags & VT_SPILL_LINE_REFLOWABLE;
+        line->rejoinable                = flags & VT_SPILL_LINE_REJOINABLE;
+        line->was_reflown               = flags & VT_SPILL_LINE_WAS_REFLOWN;
+        line->mark_explicit             = flags & VT_SPILL_LINE_MARK_EXPLICIT;
+        line->mark_command_invoke       = flags & VT_SPILL_LINE_MARK_COMMAND_INVOKE;
+        line->mark_command_output_start = flags & VT_SPILL_LINE_MARK_COMMAND_OUTPUT_START;
+        line->mark_command_output_end   = flags & VT_SPILL_LINE_MARK_COMMAND_OUTPUT_END;
+    }
+
+    return true;
+}
+
+/**
+ * Append VT_COLD_BLOCK_LINES lines starting at @param row to the spill file */
+static bool Vt_spill_write_block(Vt* self, vt_cold_freeze_ctx_t* ctx, size_t row)
+{
+    /* lines that are still frozen as a whole block can be written without recompressing them */
+    VtLine*            first = Ring_at_VtLine(&self->lines, row);
+    const VtColdBlock* cold  = RcPtr_get_VtColdBlock(&first->cold_block);
+
+    bool reuse = cold && cold->n_lines == VT_COLD_BLOCK_LINES &&
+                 cold->first_line_id == Vt_line_id(self, row);
+
+    for (size_t i = row + 1; reuse && i < row + VT_COLD_BLOCK_LINES; ++i) {
+        reuse = Ring_at_VtLine(&self->lines, i)->cold_block.block == first->cold_block.block;
+    }
+
+    vt_spill_record_header_t header = { 0 };
+    uint8_t*                 data   = NULL;
+
+    if (reuse) {
+        header.size     = cold->size;
+        header.raw_size = cold->raw_size;
+    } else {
+        Vt_thaw_lines(self, row, row + VT_COLD_BLOCK_LINES - 1);
+        if (!ctx->attrs_remap) {
+            *ctx = vt_cold_freeze_ctx_new();
+        }
+        data = Vt_pack_lines(self, ctx, row, &header.size, &header.raw_size);
+    }
+
+    Vector_uint8_t meta = Vector_new_uint8_t();
+    Vt_spill_pack_meta(self, row, &meta);
+    header.meta_size = meta.size;
+
+    size_t record_size = sizeof(header) + header.meta_size + header.size;
+    bool   ok          = Vt_spill_reserve(self, record_size);
+
+    if (ok) {
+        uint8_t* p = self->spill.map + self->spill.used;
+        memcpy(p, &header, sizeof(header));
+        memcpy(p + sizeof(header), meta.buf, meta.size);
+        memcpy(p + sizeof(header) + meta.size, reuse ? cold->data : data, header.size);
+
+        Vector_push_VtSpillBlock(&self->spill.blocks,
+                                 (VtSpillBlock){ .first_line_id = Vt_line_id(self, row),
+                                                 .offset        = self->spill.used,
+                                                 .size          = record_size });
+        self->spill.used += record_size;
+    }
+
+    Vector_destroy_uint8_t(&meta);
+    free(data);
+    return ok;
+}
+
+size_t Vt_spill_loaded_lines(Vt* self)
+{
+    if (Vt_alt_buffer_enabled(self) || !self->spill.blocks.size) {
+        return 0;
+    }
+
+    size_t end_id = Vector_last_VtSpillBlock(&self->spill.blocks)->first_line_id +
+                    VT_COLD_BLOCK_LINES;
+
+    return end_id > self->lines.base ? MIN(end_id - self->lines.base, self->lines.size) : 0;
+}
+
+size_t Vt_spill_lines(Vt* self, size_t lines)
+{
+    if (!settings.scrollback_spill || self->spill.failed || Vt_alt_buffer_enabled(self)) {
+        return lines;
+    }
+
+    /* blocks loaded back from the file are still stored there, new ones can only be appended once
+     * all of them are gone */
+    size_t loaded = Vt_spill_loaded_lines(self);
+    if (lines <= loaded) {
+        return lines - lines % VT_COLD_BLOCK_LINES;
+    }
+
+    size_t               n_blocks = (lines - loaded) / VT_COLD_BLOCK_LINES;
+    vt_cold_freeze_ctx_t ctx      = { 0 };
+
+    for (size_t i = 0; i < n_blocks; ++i) {
+        if (!Vt_spill_write_block(self, &ctx, loaded + i * VT_COLD_BLOCK_LINES)) {
+            /* drop lines as if spilling was disabled */
+            self->spill.failed = true;
+            break;
+        }
+    }
+
+    vt_cold_freeze_ctx_destroy(&ctx);
+
+    return self->spill.failed ? lines : loaded + n_blocks * VT_COLD_BLOCK_LINES;
+}
+
+size_t Vt_unspill_block(Vt* self)
+{
+    if (Vt_alt_buffer_enabled(self) || self->lines.base < VT_COLD_BLOCK_LINES) {
+        return 0;
+    }
+
+    size_t               first_id = self->lines.base - VT_COLD_BLOCK_LINES;
+    Vector_VtSpillBlock* blocks   = &self->spill.blocks;
+
+    size_t lo = 0, hi = blocks->size;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (blocks->buf[mid].first_line_id < first_id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo == blocks->size || blocks->buf[lo].first_line_id != first_id) {
+        return 0;
+    }
+
+    const uint8_t*           p   = self->spill.map + blocks->buf[lo].offset;
+    const uint8_t*           end = p + blocks->buf[lo].size;
+    vt_spill_record_header_t header;
+
+    if (!spill_read(&p, end, &header, sizeof(header)) ||
+        (size_t)(end - p) < (size_t)header.meta_size + header.size) {
+        WRN("Corrupted scrollback spill file record at line %zu\n", first_id);
+        return 0;
+    }
+
+    VtLine* lines[VT_COLD_BLOCK_LINES];
+    for (size_t i = 0; i < VT_COLD_BLOCK_LINES; ++i) {
+        Ring_push_front_VtLine(&self->lines, VtLine_new());
+    }
+    for (size_t i = 0; i < VT_COLD_BLOCK_LINES; ++i) {
+        lines[i] = Ring_at_VtLine(&self->lines, i);
+    }
+
+    if (!Vt_spill_unpack_meta(p, p + header.meta_size, lines) ||
+        !Vt_unpack_lines(self,
+                         p + header.meta_size,
+                         header.size,
+                         header.raw_size,
+                         VT_COLD_BLOCK_LINES,
+                         lines)) {
+        WRN("Failed to load scrollback lines %zu..%zu\n", first_id, self->lines.base);
+    }
+
+    /* Lines keep the width the terminal had when they were written. Reflowing them would change
+     * the number of rows the block takes up, so they are kept whole like lines that can not be
+     * reflowed and the part past the right edge is still there for selections and searches */
+    return VT_COLD_BLOCK_LINES;
+}
+
+void Vt_spill_clear(Vt* self)
+{
+    Vector_clear_VtSpillBlock(&self->spill.blocks);
+    self->spill.used = 0;
+}
+
+void Vt_spill_destroy(Vt* self)
+{
+    Vector_destroy_VtSpillBlock(&self->spill.blocks);
+
+    if (self->spill.map) {
+        munmap(self->spill.map, self->spill.map_size);
+    }
+
+    if (self->spill.fd >= 0) {
+        close(self->spill.fd);
+    }
+}
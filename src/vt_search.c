@@ -0,0 +1,1522 @@
+/* See LICENSE for license information. */
+
+/* Incremental search in the scrollback buffer. A line is joined with the lines it was soft-wrapped
+ * into and flattened to a string of codepoints, so matches can span multiple rows.
+ *
+ * Plain text search starts next to the origin and moves away from it one logical line at a time,
+ * what is not done within VT_SEARCH_CHUNK_LINES lines is continued by Vt_search_step().
+ *
+ * Regex search copies the lines above the screen in chunks (starting next to the origin) and hands
+ * them to a worker thread. Copies are immutable so the worker never touches the buffer while new
+ * output is interpreted. Matches are sent back with the chunk and collected by Vt_search_step().
+ * Changing the pattern bumps the search generation, queued chunks are dropped and the worker stops
+ * processing the current one. Lines that scroll off the screen during a search are copied as they
+ * come, lines still on the screen are matched directly when needed */
+
+#define _GNU_SOURCE
+
+#include "vt.h"
+#include "vt_private.h"
+
+#include <limits.h>
+#include <regex.h>
+#include <stdatomic.h>
+#include <threads.h>
+#include <wctype.h>
+
+/**
+ * Cell a character of a flattened line was taken from */
+typedef struct
+{
+    size_t   row;
+    uint16_t col, col_end;
+} vt_search_cell_t;
+
+DEF_VECTOR(vt_search_cell_t, NULL);
+DEF_VECTOR(uint32_t, NULL);
+
+/**
+ * Text of a logical line with the cell of every character. For regex search the text is also
+ * encoded as UTF-8 with the byte offset of every character and the end of text */
+typedef struct
+{
+    Vector_char32_t         text;
+    Vector_vt_search_cell_t cells;
+    Vector_char             utf8;
+    Vector_uint32_t         offsets;
+} vt_search_line_t;
+
+/**
+ * Logical line in a chunk copied for the worker */
+typedef struct
+{
+    size_t   line_id;
+    uint32_t text_begin, offsets_begin, cells_begin, n_chars;
+} vt_search_chunk_line_t;
+
+DEF_VECTOR(vt_search_chunk_line_t, NULL);
+
+typedef struct VtSearchChunk
+{
+    uint64_t generation;
+
+    /* lines were copied going towards the top of the buffer, reached_top is set if the first line
+     * of the buffer was included */
+    bool   up, reached_top;
+    size_t begin_line_id, end_line_id;
+
+    /* NUL-terminated text of every line, character offsets relative to the beginning of its line
+     * and cells as (row offset from the first line << 16 | column) */
+    Vector_char                   text;
+    Vector_uint32_t               offsets;
+    Vector_uint32_t               cells;
+    Vector_vt_search_chunk_line_t lines;
+
+    /* filled by the worker */
+    Vector_VtSearchMatch matches;
+
+    struct VtSearchChunk* next;
+} VtSearchChunk;
+
+struct VtSearchWorker
+{
+    thrd_t thread;
+    bool   started;
+    mtx_t  lock;
+    cnd_t  cond;
+    bool   quit;
+
+    /* chunks of older generations are returned without being processed. Written with lock held,
+     * read without it to cancel the chunk being processed */
+    _Atomic uint64_t generation;
+
+    /* pattern of the current generation */
+    Vector_char pattern;
+    int         cflags;
+
+    VtSearchChunk *todo, *todo_tail;
+    VtSearchChunk *done, *done_tail;
+
+    /* compiled pattern used on the calling thread */
+    regex_t regex;
+    bool    regex_compiled;
+};
+
+static vt_search_line_t vt_search_line_new()
+{
+    return (vt_search_line_t){
+        .text    = Vector_new_char32_t(),
+        .cells   = Vector_new_vt_search_cell_t(),
+        .utf8    = Vector_new_char(),
+        .offsets = Vector_new_uint32_t(),
+    };
+}
+
+static void vt_search_line_destroy(vt_search_line_t* self)
+{
+    Vector_destroy_char32_t(&self->text);
+    Vector_destroy_vt_search_cell_t(&self->cells);
+    Vector_destroy_char(&self->utf8);
+    Vector_destroy_uint32_t(&self->offsets);
+}
+
+static VtSearchChunk* VtSearchChunk_new(uint64_t generation, bool up)
+{
+    VtSearchChunk* self = _malloc(sizeof(VtSearchChunk));
+    *self               = (VtSearchChunk){
+        .generation = generation,
+        .up         = up,
+        .text       = Vector_new_char(),
+        .offsets    = Vector_new_uint32_t(),
+        .cells      = Vector_new_uint32_t(),
+        .lines      = Vector_new_vt_search_chunk_line_t(),
+        .matches    = Vector_new_VtSearchMatch(),
+    };
+    return self;
+}
+
+static void VtSearchChunk_destroy(VtSearchChunk* self)
+{
+    Vector_destroy_char(&self->text);
+    Vector_destroy_uint32_t(&self->offsets);
+    Vector_destroy_uint32_t(&self->cells);
+    Vector_destroy_vt_search_chunk_line_t(&self->lines);
+    Vector_destroy_VtSearchMatch(&self->matches);
+    free(self);
+}
+
+static void VtSearchChunk_destroy_list(VtSearchChunk* self)
+{
+    while (self) {
+        VtSearchChunk* next = self->next;
+        VtSearchChunk_destroy(self);
+        self = next;
+    }
+}
+
+static inline char32_t vt_search_fold_case(char32_t c)
+{
+    if (likely(c < 0x80)) {
+        return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+    }
+    return towlower(c);
+}
+
+/**
+ * Position in the buffer as a single comparable value */
+static inline uint64_t vt_search_pos_key(size_t row, uint16_t col)
+{
+    return (uint64_t)row << 16 | col;
+}
+
+/**
+ * Index of the character at byte @param offset
+ * @param offsets - byte offsets of @param n_chars characters and the end of text */
+static inline size_t vt_search_char_at_offset(const uint32_t* offsets,
+                                              size_t          n_chars,
+                                              size_t          offset)
+{
+    size_t lo = 0, hi = n_chars;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (offsets[mid] < offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/**
+ * Find the first non-empty match of @param regex starting at character @param from
+ * @param text    - NUL-terminated UTF-8
+ * @param offsets - byte offsets of @param n_chars characters and the end of text
+ * @return character index or SIZE_MAX */
+static size_t vt_search_regex_find(const regex_t*  regex,
+                                   const char*     text,
+                                   const uint32_t* offsets,
+                                   size_t          n_chars,
+                                   size_t          from,
+                                   size_t*         out_len)
+{
+    while (from < n_chars) {
+        regmatch_t match;
+        if (regexec(regex, text + offsets[from], 1, &match, from ? REG_NOTBOL : 0)) {
+            return SIZE_MAX;
+        }
+
+        size_t begin = offsets[from] + match.rm_so;
+        size_t end   = offsets[from] + match.rm_eo;
+        size_t idx   = vt_search_char_at_offset(offsets, n_chars, begin);
+
+        if (end > begin) {
+            *out_len = vt_search_char_at_offset(offsets, n_chars, end) - idx;
+            return idx;
+        }
+        from = idx + 1;
+    }
+
+    return SIZE_MAX;
+}
+
+static void VtSearchChunk_match(VtSearchChunk* self, const regex_t* regex, _Atomic uint64_t* gen)
+{
+    for (size_t i = 0; i < self->lines.size; ++i) {
+        if (atomic_load_explicit(gen, memory_order_relaxed) != self->generation) {
+            return;
+        }
+
+        const vt_search_chunk_line_t* line    = &self->lines.buf[i];
+        const char*                   text    = self->text.buf + line->text_begin;
+        const uint32_t*               offsets = self->offsets.buf + line->offsets_begin;
+        size_t                        len;
+
+        for (size_t idx = 0;
+             (idx = vt_search_regex_find(regex, text, offsets, line->n_chars, idx, &len)) !=
+             SIZE_MAX;
+             idx += len) {
+            uint32_t cell = self->cells.buf[line->cells_begin + idx];
+            Vector_push_VtSearchMatch(&self->matches,
+                                      (VtSearchMatch){
+                                        .line_id = line->line_id + (cell >> 16),
+                                        .col     = cell & UINT16_MAX,
+                                      });
+        }
+    }
+}
+
+static int VtSearchWorker_run(void* arg)
+{
+    struct VtSearchWorker* self                = arg;
+    regex_t                regex               = { 0 };
+    bool                   compiled            = false;
+    uint64_t               compiled_generation = 0;
+
+    mtx_lock(&self->lock);
+    for (;;) {
+        while (!self->quit && !self->todo) {
+            cnd_wait(&self->cond, &self->lock);
+        }
+
+        if (self->quit) {
+            break;
+        }
+
+        VtSearchChunk* chunk = self->todo;
+        if (!(self->todo = chunk->next)) {
+            self->todo_tail = NULL;
+        }
+        chunk->next = NULL;
+
+        bool current = chunk->generation == atomic_load(&self->generation);
+        if (current && (!compiled || compiled_generation != chunk->generation)) {
+            if (compiled) {
+                regfree(&regex);
+            }
+            compiled            = !regcomp(&regex, self->pattern.buf, self->cflags);
+            compiled_generation = chunk->generation;
+        }
+        mtx_unlock(&self->lock);
+
+        if (current && compiled) {
+            VtSearchChunk_match(chunk, &regex, &self->generation);
+        }
+
+        mtx_lock(&self->lock);
+        if (self->done_tail) {
+            self->done_tail->next = chunk;
+        } else {
+            self->done = chunk;
+        }
+        self->done_tail = chunk;
+    }
+    mtx_unlock(&self->lock);
+
+    if (compiled) {
+        regfree(&regex);
+    }
+
+    return 0;
+}
+
+static struct VtSearchWorker* Vt_search_worker(Vt* self)
+{
+    if (self->search.worker) {
+        return self->search.worker;
+    }
+
+    struct VtSearchWorker* worker = _calloc(1, sizeof(struct VtSearchWorker));
+    worker->pattern               = Vector_new_char();
+    mtx_init(&worker->lock, mtx_plain);
+    cnd_init(&worker->cond);
+
+    /* without a thread chunks are processed when they are submitted */
+    if (!(worker->started = thrd_create(&worker->thread, VtSearchWorker_run, worker) ==
+                            thrd_success)) {
+        WRN("Failed to start search worker thread\n");
+    }
+
+    return self->search.worker = worker;
+}
+
+/**
+ * Start a new search generation, drop chunks that were not processed yet */
+static void Vt_search_worker_cancel(Vt* self, const Vector_char* pattern, int cflags)
+{
+    struct Search*         s      = &self->search;
+    struct VtSearchWorker* worker = Vt_search_worker(self);
+
+    mtx_lock(&worker->lock);
+    for (VtSearchChunk* i = worker->todo; i; i = i->next) {
+        --s->chunks_in_flight;
+    }
+    VtSearchChunk_destroy_list(worker->todo);
+    worker->todo = worker->todo_tail = NULL;
+
+    atomic_store(&worker->generation, ++s->generation);
+    Vector_clear_char(&worker->pattern);
+    if (pattern) {
+        Vector_pushv_char(&worker->pattern, pattern->buf, pattern->size);
+    }
+    worker->cflags = cflags;
+    mtx_unlock(&worker->lock);
+}
+
+static void Vt_search_worker_submit(Vt* self, VtSearchChunk* chunk)
+{
+    struct VtSearchWorker* worker = Vt_search_worker(self);
+
+    ++self->search.chunks_in_flight;
+
+    mtx_lock(&worker->lock);
+    if (worker->started) {
+        if (worker->todo_tail) {
+            worker->todo_tail->next = chunk;
+        } else {
+            worker->todo = chunk;
+        }
+        worker->todo_tail = chunk;
+        cnd_signal(&worker->cond);
+    } else {
+        if (worker->regex_compiled) {
+            VtSearchChunk_match(chunk, &worker->regex, &worker->generation);
+        }
+        if (worker->done_tail) {
+            worker->done_tail->next = chunk;
+        } else {
+            worker->done = chunk;
+        }
+        worker->done_tail = chunk;
+    }
+    mtx_unlock(&worker->lock);
+}
+
+/**
+ * Add matches from chunks processed by the worker */
+static void Vt_search_worker_collect(Vt* self)
+{
+    struct Search*         s      = &self->search;
+    struct VtSearchWorker* worker = s->worker;
+
+    if (!worker) {
+        return;
+    }
+
+    mtx_lock(&worker->lock);
+    VtSearchChunk* done = worker->done;
+    worker->done = worker->done_tail = NULL;
+    mtx_unlock(&worker->lock);
+
+    for (VtSearchChunk* chunk = done; chunk; chunk = chunk->next) {
+        --s->chunks_in_flight;
+
+        if (chunk->generation != s->generation) {
+            continue;
+        }
+
+        /* chunks going in the same direction come back in order, so scanned ranges stay
+         * contiguous and chunk matches go to either end of the sorted match list */
+        if (chunk->up) {
+            Vector_insertv_front_VtSearchMatch(&s->matches,
+                                               chunk->matches.buf,
+                                               chunk->matches.size);
+            s->scanned_begin_line_id = chunk->begin_line_id;
+            s->scanned_to_top |= chunk->reached_top;
+        } else {
+            Vector_pushv_VtSearchMatch(&s->matches, chunk->matches.buf, chunk->matches.size);
+            s->scanned_end_line_id = chunk->end_line_id;
+        }
+    }
+
+    VtSearchChunk_destroy_list(done);
+
+    size_t n_removed = 0;
+    while (n_removed < s->matches.size && s->matches.buf[n_removed].line_id < self->lines.base) {
+        ++n_removed;
+    }
+    if (n_removed) {
+        Vector_remove_at_VtSearchMatch(&s->matches, 0, n_removed);
+    }
+}
+
+/**
+ * Id of the first line that is not handed to the worker. Lines on the screen may still change */
+static size_t Vt_search_tail_line_id(const Vt* self)
+{
+    return Vt_line_id(self, Vt_logical_line_first_row(self, Vt_top_line(self)));
+}
+
+static inline void vt_search_signature_add(VtSearchSignature* sig,
+                                           char32_t           a,
+                                           char32_t           b,
+                                           char32_t           c)
+{
+    uint64_t h = (uint64_t)a * 0x9E3779B97F4A7C15ULL ^ (uint64_t)b * 0xC2B2AE3D27D4EB4FULL ^
+                 (uint64_t)c * 0x165667B19E3779F9ULL;
+    uint32_t bit = (h >> 32) & (VT_SEARCH_INDEX_SIGNATURE_WORDS * 64 - 1);
+    sig->bits[bit / 64] |= 1ULL << (bit % 64);
+}
+
+static inline bool vt_search_signature_contains(const VtSearchSignature* sig,
+                                                const VtSearchSignature* other)
+{
+    uint64_t missing = 0;
+    for (uint_fast8_t i = 0; i < VT_SEARCH_INDEX_SIGNATURE_WORDS; ++i) {
+        missing |= other->bits[i] & ~sig->bits[i];
+    }
+    return !missing;
+}
+
+static void VtSearchIndex_clear(VtSearchIndex* self)
+{
+    if (Vector_is_initialized_VtSearchSignature(&self->signatures)) {
+        Vector_destroy_VtSearchSignature(&self->signatures);
+    }
+}
+
+/**
+ * Remove lines before @param line_id from the index */
+static void VtSearchIndex_drop_before(VtSearchIndex* self, size_t line_id)
+{
+    line_id = CLAMP(line_id, self->begin_line_id, self->end_line_id);
+    Vector_remove_at_VtSearchSignature(&self->signatures, 0, line_id - self->id_base);
+    self->id_base       = line_id;
+    self->begin_line_id = line_id;
+}
+
+/**
+ * Append the signature of logical line in rows [@param first, @param last]. Text is built the same
+ * way as by Vt_search_flatten() */
+static void Vt_search_index_add_line(Vt* self, size_t first, size_t last)
+{
+    VtSearchSignature sig = { 0 };
+    char32_t          a = 0, b = 0;
+    size_t            n = 0;
+
+    Vt_thaw_lines(self, first, last);
+
+    for (size_t row = first; row <= last; ++row) {
+        const VtLine* line = Ring_at_VtLine(&self->lines, row);
+        uint16_t      end  = line->data.size;
+
+        while (row == last && end && !line->data.buf[end - 1].code) {
+            --end;
+        }
+
+        for (uint16_t col = 0; col < end; ++col) {
+            char32_t code = Vt_cell_code(self, &line->data.buf[col]);
+
+            if (code == VT_RUNE_CODE_WIDE_TAIL) {
+                continue;
+            }
+
+            char32_t c = vt_search_fold_case(code ? code : ' ');
+
+            if (++n >= 3) {
+                vt_search_signature_add(&sig, a, b, c);
+            }
+
+            a = b;
+            b = c;
+        }
+    }
+
+    Vector_push_VtSearchSignature(&self->search.index.signatures, sig);
+    for (size_t row = first; row < last; ++row) {
+        Vector_push_VtSearchSignature(&self->search.index.signatures, (VtSearchSignature){ 0 });
+    }
+}
+
+void Vt_search_index_update(Vt* self)
+{
+    VtSearchIndex* index  = &self->search.index;
+    size_t         budget = (size_t)settings.scrollback_search_index * 1024 * 1024;
+
+    /* ids of lines waiting to be reflowed are about to change */
+    if (Vt_alt_buffer_enabled(self) || Vt_reflow_pending(self)) {
+        return;
+    }
+
+    if (!budget) {
+        VtSearchIndex_clear(index);
+        return;
+    }
+
+    size_t tail = Vt_search_tail_line_id(self);
+
+    if (!Vector_is_initialized_VtSearchSignature(&index->signatures) || index->reset) {
+        VtSearchIndex_clear(index);
+        index->signatures = Vector_new_VtSearchSignature();
+        index->id_base = index->begin_line_id = index->end_line_id = tail;
+        index->reset                                               = false;
+        return;
+    }
+
+    if (index->end_line_id < self->lines.base) {
+        VtSearchIndex_drop_before(index, index->end_line_id);
+        index->id_base = index->begin_line_id = index->end_line_id = self->lines.base;
+    }
+
+    for (size_t row = Vt_line_id_to_row(self, index->end_line_id),
+                tail_row = Vt_line_id_to_row(self, tail);
+         row < tail_row;) {
+        size_t last = Vt_logical_line_last_row(self, row);
+        Vt_search_index_add_line(self, row, last);
+        row = last + 1;
+    }
+    index->end_line_id = index->id_base + index->signatures.size;
+
+    /* keep the newest lines */
+    if (index->signatures.size * sizeof(VtSearchSignature) > budget) {
+        VtSearchIndex_drop_before(index,
+                                  index->begin_line_id +
+                                    (index->end_line_id - index->begin_line_id) / 2);
+    }
+}
+
+void Vt_search_index_prune(Vt* self)
+{
+    VtSearchIndex* index = &self->search.index;
+    size_t         base  = self->lines.base;
+
+    if (!Vector_is_initialized_VtSearchSignature(&index->signatures) ||
+        base <= index->begin_line_id) {
+        return;
+    }
+
+    /* signatures of removed lines are skipped by lookups until there are more of them than of
+     * lines still in the buffer */
+    index->begin_line_id = MIN(base, index->end_line_id);
+    if (base - index->id_base > index->end_line_id - index->begin_line_id) {
+        VtSearchIndex_drop_before(index, index->begin_line_id);
+    }
+}
+
+void Vt_search_index_reset(Vt* self)
+{
+    self->search.index.reset = true;
+}
+
+/**
+ * Get signature of the current pattern
+ * @return the index can be used for the current pattern */
+static bool Vt_search_index_pattern_signature(Vt* self, VtSearchSignature* out)
+{
+    const struct Search* s     = &self->search;
+    const VtSearchIndex* index = &s->index;
+
+    if (!Vector_is_initialized_VtSearchSignature(&index->signatures) || index->reset ||
+        s->regex || s->pattern.size < 3 || Vt_alt_buffer_enabled(self) ||
+        index->begin_line_id >= index->end_line_id) {
+        return false;
+    }
+
+    *out = (VtSearchSignature){ 0 };
+    for (size_t i = 2; i < s->pattern.size; ++i) {
+        vt_search_signature_add(out,
+                                vt_search_fold_case(s->pattern.buf[i - 2]),
+                                vt_search_fold_case(s->pattern.buf[i - 1]),
+                                vt_search_fold_case(s->pattern.buf[i]));
+    }
+
+    return true;
+}
+
+/**
+ * Next indexed logical line (previous one if @param backward is set) starting from
+ * @param line_id, that can contain the pattern with signature @param sig
+ * @return line id or SIZE_MAX if there are no more candidates in the indexed range */
+static size_t Vt_search_index_next_candidate(const Vt*                self,
+                                             const VtSearchSignature* sig,
+                                             size_t                   line_id,
+                                             bool                     backward)
+{
+    const VtSearchIndex*     index = &self->search.index;
+    const VtSearchSignature* sigs  = index->signatures.buf;
+
+    if (backward) {
+        for (size_t i = line_id - index->id_base + 1; i > index->begin_line_id - index->id_base;
+             --i) {
+            if (vt_search_signature_contains(&sigs[i - 1], sig)) {
+                return index->id_base + i - 1;
+            }
+        }
+    } else {
+        for (size_t i = line_id - index->id_base; i < index->signatures.size; ++i) {
+            if (vt_search_signature_contains(&sigs[i], sig)) {
+                return index->id_base + i;
+            }
+        }
+    }
+
+    return SIZE_MAX;
+}
+
+/**
+ * Flatten rows [@param first, @param last] into @param out */
+static void Vt_search_flatten(Vt* self, size_t first, size_t last, vt_search_line_t* out)
+{
+    Vector_clear_char32_t(&out->text);
+    Vector_clear_vt_search_cell_t(&out->cells);
+    Vector_clear_char(&out->utf8);
+    Vector_clear_uint32_t(&out->offsets);
+
+    Vt_thaw_lines(self, first, last);
+
+    bool      regex       = self->search.regex;
+    bool      ignore_case = self->search.ignore_case && !regex;
+    mbstate_t mbs         = { 0 };
+
+    for (size_t row = first; row <= last; ++row) {
+        const VtLine* line = Ring_at_VtLine(&self->lines, row);
+        uint16_t      end  = line->data.size;
+
+        /* trailing blank cells are not part of the text, so regex '$' can match */
+        while (row == last && end && !line->data.buf[end - 1].code) {
+            --end;
+        }
+
+        for (uint16_t col = 0; col < end; ++col) {
+            char32_t code = Vt_cell_code(self, &line->data.buf[col]);
+
+            if (code == VT_RUNE_CODE_WIDE_TAIL) {
+                continue;
+            }
+
+            uint16_t col_end = col + 1;
+            if (col_end < line->data.size &&
+                line->data.buf[col_end].code == VT_RUNE_CODE_WIDE_TAIL) {
+                ++col_end;
+            }
+
+            code = code ? code : ' ';
+            Vector_push_char32_t(&out->text, ignore_case ? vt_search_fold_case(code) : code);
+            Vector_push_vt_search_cell_t(&out->cells,
+                                         (vt_search_cell_t){
+                                           .row     = row,
+                                           .col     = col,
+                                           .col_end = col_end,
+                                         });
+
+            if (regex) {
+                char   utfbuf[MB_LEN_MAX];
+                size_t bytes = c32rtomb(utfbuf, code, &mbs);
+                if (bytes == (size_t)-1) {
+                    utfbuf[0] = '?';
+                    bytes     = 1;
+                    mbs       = (mbstate_t){ 0 };
+                }
+                Vector_push_uint32_t(&out->offsets, out->utf8.size);
+                Vector_pushv_char(&out->utf8, utfbuf, bytes);
+            }
+        }
+    }
+
+    if (regex) {
+        Vector_push_uint32_t(&out->offsets, out->utf8.size);
+        Vector_push_char(&out->utf8, '\0');
+    }
+}
+
+/**
+ * Find the position of the next match in @param line starting at character @param from
+ * @param out_len - number of matched characters
+ * @return character index or SIZE_MAX */
+static inline size_t Vt_search_find_in_line(Vt*                     self,
+                                            const vt_search_line_t* line,
+                                            size_t                  from,
+                                            size_t*                 out_len)
+{
+    const struct Search* s = &self->search;
+
+    if (from >= line->text.size) {
+        return SIZE_MAX;
+    }
+
+    if (s->regex) {
+        return s->regex_valid ? vt_search_regex_find(&s->worker->regex,
+                                                     line->utf8.buf,
+                                                     line->offsets.buf,
+                                                     line->text.size,
+                                                     from,
+                                                     out_len)
+                              : SIZE_MAX;
+    }
+
+    size_t idx =
+      char32_find(line->text.buf + from, line->text.size - from, s->pattern.buf, s->pattern.size);
+
+    *out_len = s->pattern.size;
+    return idx == SIZE_MAX ? idx : from + idx;
+}
+
+/**
+ * Record a match the viewport should be moved to */
+static vt_search_result_e Vt_search_set_match(Vt* self, size_t line_id, uint16_t col)
+{
+    struct Search* s    = &self->search;
+    s->has_match        = true;
+    s->match_line_id    = line_id;
+    s->match_col        = col;
+    s->highlights_stale = true;
+    return VT_SEARCH_RESULT_FOUND;
+}
+
+/**
+ * Find the match closest to the search limit in the scan direction
+ * @return a match was found and stored */
+static bool Vt_search_match_in_line(Vt* self, const vt_search_line_t* line)
+{
+    struct Search* s     = &self->search;
+    size_t         found = SIZE_MAX;
+    uint64_t       limit = 0;
+    size_t         len;
+
+    if (s->limit_line_id >= self->lines.base) {
+        limit = vt_search_pos_key(Vt_line_id_to_row(self, s->limit_line_id), s->limit_col);
+    }
+
+    for (size_t idx = 0; (idx = Vt_search_find_in_line(self, line, idx, &len)) != SIZE_MAX; ++idx) {
+        const vt_search_cell_t* cell = &line->cells.buf[idx];
+        uint64_t                key  = vt_search_pos_key(cell->row, cell->col);
+
+        if (s->scan_backward) {
+            if (key < limit || (s->limit_inclusive && key == limit)) {
+                found = idx;
+            } else {
+                break;
+            }
+        } else if (key > limit || (s->limit_inclusive && key == limit)) {
+            found = idx;
+            break;
+        }
+    }
+
+    if (found == SIZE_MAX) {
+        return false;
+    }
+
+    Vt_search_set_match(self,
+                        Vt_line_id(self, line->cells.buf[found].row),
+                        line->cells.buf[found].col);
+    return true;
+}
+
+/**
+ * Scan up to @param max_lines lines starting with the logical line containing the resume point.
+ * Scanning backward stops after the logical line starting at @param floor_row */
+static vt_search_result_e Vt_search_scan(Vt* self, size_t max_lines, size_t floor_row)
+{
+    struct Search*     s      = &self->search;
+    vt_search_result_e result = VT_SEARCH_RESULT_PENDING;
+
+    s->highlights_stale = true;
+
+    if (!s->pattern.size) {
+        s->pending = false;
+        return VT_SEARCH_RESULT_NOT_FOUND;
+    }
+
+    /* lines may have been removed from the front of the buffer since the last step */
+    size_t row = 0;
+    if (s->resume_line_id >= self->lines.base) {
+        row = MIN(Vt_line_id_to_row(self, s->resume_line_id), Vt_max_line(self));
+    } else if (s->scan_backward) {
+        s->pending = false;
+        return VT_SEARCH_RESULT_NOT_FOUND;
+    }
+
+    const VtSearchIndex* index = &s->index;
+    VtSearchSignature    sig;
+    bool                 indexed  = Vt_search_index_pattern_signature(self, &sig);
+    size_t floor_id = Vt_line_id(self, Vt_logical_line_first_row(self, MIN(floor_row, row)));
+
+    vt_search_line_t line = vt_search_line_new();
+
+    for (size_t scanned = 0; scanned < max_lines;) {
+        size_t first = Vt_logical_line_first_row(self, row);
+        size_t id    = Vt_line_id(self, first);
+
+        /* skip indexed lines that can not contain the pattern. The first line in the buffer may
+         * continue a line that was partially removed */
+        if (indexed && id >= index->begin_line_id && id < index->end_line_id &&
+            !Ring_at_VtLine(&self->lines, first)->rejoinable) {
+            size_t candidate = Vt_search_index_next_candidate(self, &sig, id, s->scan_backward);
+
+            if (candidate != id) {
+                if (!s->scan_backward) {
+                    row = Vt_line_id_to_row(self,
+                                            candidate == SIZE_MAX ? index->end_line_id : candidate);
+                } else if (candidate != SIZE_MAX && candidate >= floor_id) {
+                    row = Vt_line_id_to_row(self, candidate);
+                } else if (candidate == SIZE_MAX && index->begin_line_id > floor_id) {
+                    row = Vt_line_id_to_row(self, index->begin_line_id) - 1;
+                } else {
+                    result = VT_SEARCH_RESULT_NOT_FOUND;
+                    break;
+                }
+                continue;
+            }
+        }
+
+        size_t last = Vt_logical_line_last_row(self, row);
+
+        Vt_search_flatten(self, first, last, &line);
+
+        if (Vt_search_match_in_line(self, &line)) {
+            result = VT_SEARCH_RESULT_FOUND;
+            break;
+        }
+
+        scanned += last - first + 1;
+
+        if (s->scan_backward ? first <= floor_row : last >= Vt_max_line(self)) {
+            result = VT_SEARCH_RESULT_NOT_FOUND;
+            break;
+        }
+
+        row = s->scan_backward ? first - 1 : last + 1;
+    }
+
+    vt_search_line_destroy(&line);
+
+    s->pending        = result == VT_SEARCH_RESULT_PENDING;
+    s->resume_line_id = Vt_line_id(self, row);
+
+    /* compress the blocks decompressed for scanning again */
+    Vt_freeze_cold_lines(self);
+
+    return result;
+}
+
+/**
+ * Index of the first worker match at or after @param line_id, @param col */
+static size_t vt_search_matches_lower_bound(const Vector_VtSearchMatch* matches,
+                                            size_t                      line_id,
+                                            uint16_t                    col)
+{
+    size_t lo = 0, hi = matches->size;
+    while (lo < hi) {
+        size_t               mid = lo + (hi - lo) / 2;
+        const VtSearchMatch* m   = &matches->buf[mid];
+        if (m->line_id < line_id || (m->line_id == line_id && m->col < col)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/**
+ * Find the regex match closest to the search limit in the scan direction. Worker matches are only
+ * used if all lines between them and the limit were already scanned
+ * @return VT_SEARCH_RESULT_PENDING if the worker has to scan more lines first */
+static vt_search_result_e Vt_search_regex_jump(Vt* self)
+{
+    struct Search* s      = &self->search;
+    size_t         base   = self->lines.base;
+    bool           to_top = s->scanned_to_top || s->scanned_begin_line_id <= base;
+    bool           to_end = s->scanned_end_line_id >= s->tail_line_id;
+
+    size_t   limit_id        = s->limit_line_id;
+    uint16_t limit_col       = s->limit_col;
+    bool     limit_inclusive = s->limit_inclusive;
+    if (limit_id < base) {
+        limit_id        = base;
+        limit_col       = 0;
+        limit_inclusive = true;
+    }
+
+    s->awaiting_match = false;
+
+    if (!s->regex_valid) {
+        return VT_SEARCH_RESULT_NOT_FOUND;
+    }
+
+    size_t idx = vt_search_matches_lower_bound(&s->matches, limit_id, limit_col);
+    bool   at_limit =
+      idx < s->matches.size && s->matches.buf[idx].line_id == limit_id &&
+      s->matches.buf[idx].col == limit_col;
+
+    if (!s->scan_backward) {
+        if (to_top || limit_id >= s->scanned_begin_line_id) {
+            if (at_limit && !limit_inclusive) {
+                ++idx;
+            }
+            if (idx < s->matches.size) {
+                return Vt_search_set_match(self,
+                                           s->matches.buf[idx].line_id,
+                                           s->matches.buf[idx].col);
+            }
+            if (to_end || limit_id >= s->tail_line_id) {
+                s->resume_line_id = MAX(limit_id, s->tail_line_id);
+                return Vt_search_scan(self, SIZE_MAX, 0);
+            }
+        }
+    } else {
+        if (limit_id >= s->tail_line_id) {
+            s->resume_line_id = limit_id;
+            if (Vt_search_scan(self, SIZE_MAX, Vt_line_id_to_row(self, s->tail_line_id)) ==
+                VT_SEARCH_RESULT_FOUND) {
+                return VT_SEARCH_RESULT_FOUND;
+            }
+        }
+        if (to_end || limit_id < s->scanned_end_line_id) {
+            if (at_limit && limit_inclusive) {
+                ++idx;
+            }
+            if (idx) {
+                return Vt_search_set_match(self,
+                                           s->matches.buf[idx - 1].line_id,
+                                           s->matches.buf[idx - 1].col);
+            }
+            if (to_top) {
+                return VT_SEARCH_RESULT_NOT_FOUND;
+            }
+        }
+    }
+
+    s->awaiting_match = true;
+    return VT_SEARCH_RESULT_PENDING;
+}
+
+/**
+ * Append logical line @param line starting at @param first_row to @param chunk */
+static void VtSearchChunk_append(VtSearchChunk*          self,
+                                 Vt*                     vt,
+                                 const vt_search_line_t* line,
+                                 size_t                  first_row)
+{
+    Vector_push_vt_search_chunk_line_t(&self->lines,
+                                       (vt_search_chunk_line_t){
+                                         .line_id       = Vt_line_id(vt, first_row),
+                                         .text_begin    = self->text.size,
+                                         .offsets_begin = self->offsets.size,
+                                         .cells_begin   = self->cells.size,
+                                         .n_chars       = line->text.size,
+                                       });
+
+    Vector_pushv_char(&self->text, line->utf8.buf, line->utf8.size);
+    Vector_pushv_uint32_t(&self->offsets, line->offsets.buf, line->offsets.size);
+
+    for (size_t i = 0; i < line->cells.size; ++i) {
+        uint32_t row_offset = line->cells.buf[i].row - first_row;
+        Vector_push_uint32_t(&self->cells, row_offset << 16 | line->cells.buf[i].col);
+    }
+}
+
+/**
+ * Copy up to VT_SEARCH_REGEX_CHUNK_LINES lines next to the already copied range and submit them
+ * to the worker. Lines in the search direction go first */
+static void Vt_search_copy_chunk(Vt* self)
+{
+    struct Search* s = &self->search;
+
+    if (s->copy_up_line_id <= self->lines.base) {
+        s->copied_to_top = true;
+    }
+    s->copy_down_line_id = MAX(s->copy_down_line_id, self->lines.base);
+
+    bool can_copy_down = s->copy_down_line_id < s->tail_line_id;
+    bool up = s->copied_to_top ? false : (s->backward || !can_copy_down);
+
+    if (!up && !can_copy_down) {
+        return;
+    }
+
+    VtSearchChunk*   chunk  = VtSearchChunk_new(s->generation, up);
+    vt_search_line_t line   = vt_search_line_new();
+    size_t           copied = 0;
+
+    /* row offsets of cells are stored in 16 bits, longer logical lines are split */
+    if (up) {
+        size_t end_row = Vt_line_id_to_row(self, s->copy_up_line_id);
+        size_t row     = end_row;
+
+        while (row && copied < VT_SEARCH_REGEX_CHUNK_LINES) {
+            size_t last  = row - 1;
+            size_t first = Vt_logical_line_first_row(self, last);
+            first        = MAX(first, last - MIN(last, UINT16_MAX));
+
+            Vt_search_flatten(self, first, last, &line);
+            VtSearchChunk_append(chunk, self, &line, first);
+
+            copied += last - first + 1;
+            row = first;
+        }
+
+        /* the worker goes through lines in order, so its matches come out sorted */
+        for (size_t i = 0, j = chunk->lines.size; i + 1 < j; ++i, --j) {
+            vt_search_chunk_line_t tmp = chunk->lines.buf[i];
+            chunk->lines.buf[i]        = chunk->lines.buf[j - 1];
+            chunk->lines.buf[j - 1]    = tmp;
+        }
+
+        chunk->begin_line_id = Vt_line_id(self, row);
+        chunk->end_line_id   = s->copy_up_line_id;
+        chunk->reached_top   = !row;
+        s->copy_up_line_id   = chunk->begin_line_id;
+        s->copied_to_top     = !row;
+    } else {
+        size_t row      = Vt_line_id_to_row(self, s->copy_down_line_id);
+        size_t tail_row = Vt_line_id_to_row(self, s->tail_line_id);
+
+        while (row < tail_row && copied < VT_SEARCH_REGEX_CHUNK_LINES) {
+            size_t last = Vt_logical_line_last_row(self, row);
+            last        = MIN(last, row + UINT16_MAX);
+
+            Vt_search_flatten(self, row, last, &line);
+            VtSearchChunk_append(chunk, self, &line, row);
+
+            copied += last - row + 1;
+            row = last + 1;
+        }
+
+        chunk->begin_line_id = s->copy_down_line_id;
+        chunk->end_line_id   = Vt_line_id(self, row);
+        s->copy_down_line_id = chunk->end_line_id;
+    }
+
+    vt_search_line_destroy(&line);
+    Vt_freeze_cold_lines(self);
+
+    Vt_search_worker_submit(self, chunk);
+}
+
+/**
+ * Encode the pattern for regcomp() */
+static Vector_char Vt_search_pattern_utf8(const Vt* self)
+{
+    Vector_char out = Vector_new_char();
+    mbstate_t   mbs = { 0 };
+
+    for (size_t i = 0; i < self->search.pattern.size; ++i) {
+        char   utfbuf[MB_LEN_MAX];
+        size_t bytes = c32rtomb(utfbuf, self->search.pattern.buf[i], &mbs);
+        if (bytes != (size_t)-1) {
+            Vector_pushv_char(&out, utfbuf, bytes);
+        }
+    }
+
+    Vector_push_char(&out, '\0');
+    return out;
+}
+
+/**
+ * Compile the pattern, cancel the worker and start copying lines next to the origin */
+static vt_search_result_e Vt_search_regex_restart(Vt* self)
+{
+    struct Search*         s      = &self->search;
+    struct VtSearchWorker* worker = Vt_search_worker(self);
+    Vector_char            source = Vt_search_pattern_utf8(self);
+    int                    cflags = REG_EXTENDED | (s->ignore_case ? REG_ICASE : 0);
+
+    if (worker->regex_compiled) {
+        regfree(&worker->regex);
+    }
+    worker->regex_compiled = !regcomp(&worker->regex, source.buf, cflags);
+    s->regex_valid         = worker->regex_compiled && s->pattern.size;
+
+    Vt_search_worker_cancel(self, &source, cflags);
+    Vector_destroy_char(&source);
+
+    Vector_clear_VtSearchMatch(&s->matches);
+
+    size_t origin_row = Vt_line_id_to_row(self, MAX(s->origin_line_id, self->lines.base));
+    origin_row        = MIN(origin_row, Vt_max_line(self));
+
+    s->tail_line_id = Vt_search_tail_line_id(self);
+    s->scanned_begin_line_id = s->scanned_end_line_id = s->copy_up_line_id =
+      s->copy_down_line_id =
+        MIN(Vt_line_id(self, Vt_logical_line_first_row(self, origin_row)), s->tail_line_id);
+    s->scanned_to_top = s->copied_to_top = s->copy_up_line_id <= self->lines.base;
+
+    return Vt_search_regex_jump(self);
+}
+
+/**
+ * Finish reflowing the buffer if it was resized since the search started, so line ids stay valid
+ * from now on
+ * @return line ids held by the search are stale and it has to start over */
+static bool Vt_search_reflow(Vt* self)
+{
+    if (!self->search.reflowed && !Vt_reflow_pending(self)) {
+        return false;
+    }
+
+    Vt_reflow_all(self);
+    self->search.reflowed = false;
+
+    return true;
+}
+
+/**
+ * Look for the current pattern starting from the origin */
+static vt_search_result_e Vt_search_restart(Vt* self)
+{
+    struct Search* s = &self->search;
+
+    s->ignore_case = true;
+    for (size_t i = 0; i < s->pattern.size; ++i) {
+        if (iswupper(s->pattern.buf[i])) {
+            s->ignore_case = false;
+            break;
+        }
+    }
+
+    s->has_match        = false;
+    s->pending          = false;
+    s->scan_backward    = s->backward;
+    s->limit_line_id    = s->origin_line_id;
+    s->limit_col        = s->origin_col;
+    s->limit_inclusive  = true;
+    s->resume_line_id   = s->origin_line_id;
+    s->highlights_stale = true;
+
+    if (s->regex) {
+        return Vt_search_regex_restart(self);
+    }
+
+    return Vt_search_scan(self, VT_SEARCH_CHUNK_LINES, 0);
+}
+
+void Vt_search_begin_input(Vt* self, size_t row, uint16_t col, bool backward)
+{
+    struct Search* s = &self->search;
+
+    /* match positions would change if lines were reflowed later */
+    Vt_reflow_all(self);
+
+    s->active           = true;
+    s->input_active     = true;
+    s->backward         = backward;
+    s->has_match        = false;
+    s->pending          = false;
+    s->awaiting_match   = false;
+    s->regex_valid      = false;
+    s->reflowed         = false;
+    s->origin_line_id   = Vt_line_id(self, MIN(row, Vt_max_line(self)));
+    s->origin_col       = col;
+    s->highlights_stale = true;
+    Vector_clear_char32_t(&s->pattern);
+    Vector_clear_VtSearchMatch(&s->matches);
+}
+
+vt_search_result_e Vt_search_push_char(Vt* self, char32_t c)
+{
+    Vector_push_char32_t(&self->search.pattern, c);
+    return Vt_search_restart(self);
+}
+
+vt_search_result_e Vt_search_pop_char(Vt* self)
+{
+    if (self->search.pattern.size) {
+        Vector_pop_char32_t(&self->search.pattern);
+    }
+    return Vt_search_restart(self);
+}
+
+vt_search_result_e Vt_search_set_regex(Vt* self, bool regex)
+{
+    self->search.regex = regex;
+
+    if (!self->search.active) {
+        return VT_SEARCH_RESULT_NOT_FOUND;
+    }
+
+    if (!regex && self->search.worker) {
+        Vt_search_worker_cancel(self, NULL, 0);
+        Vector_clear_VtSearchMatch(&self->search.matches);
+        self->search.awaiting_match = false;
+    }
+
+    return Vt_search_restart(self);
+}
+
+void Vt_search_end_input(Vt* self)
+{
+    self->search.input_active = false;
+
+    if (!self->search.pattern.size) {
+        Vt_search_end(self);
+    }
+}
+
+vt_search_result_e Vt_search_next(Vt* self, bool reverse)
+{
+    struct Search* s = &self->search;
+
+    if (!s->active || !s->pattern.size) {
+        return VT_SEARCH_RESULT_NOT_FOUND;
+    }
+
+    if (Vt_search_reflow(self)) {
+        return Vt_search_restart(self);
+    }
+
+    s->scan_backward = s->backward != reverse;
+
+    if (s->has_match) {
+        s->limit_line_id   = s->match_line_id;
+        s->limit_col       = s->match_col;
+        s->limit_inclusive = false;
+    } else {
+        s->limit_line_id   = s->origin_line_id;
+        s->limit_col       = s->origin_col;
+        s->limit_inclusive = true;
+    }
+
+    s->resume_line_id = s->limit_line_id;
+
+    if (s->regex) {
+        return Vt_search_regex_jump(self);
+    }
+
+    return Vt_search_scan(self, VT_SEARCH_CHUNK_LINES, 0);
+}
+
+vt_search_result_e Vt_search_step(Vt* self)
+{
+    struct Search* s = &self->search;
+
+    if (!s->active) {
+        return VT_SEARCH_RESULT_NOT_FOUND;
+    }
+
+    /* copied lines and scan positions no longer match the buffer after a resize */
+    if (Vt_search_reflow(self)) {
+        return s->regex ? Vt_search_regex_restart(self) : Vt_search_restart(self);
+    }
+
+    if (!s->regex) {
+        if (!Vt_search_pending(self)) {
+            return s->has_match ? VT_SEARCH_RESULT_FOUND : VT_SEARCH_RESULT_NOT_FOUND;
+        }
+        return Vt_search_scan(self, VT_SEARCH_CHUNK_LINES, 0);
+    }
+
+    Vt_search_worker_collect(self);
+
+    /* hand lines that scrolled off the screen to the worker without scanning everything again */
+    s->tail_line_id = MAX(s->tail_line_id, Vt_search_tail_line_id(self));
+
+    while (Vt_search_pending(self)) {
+        Vt_search_copy_chunk(self);
+    }
+
+    if (s->awaiting_match) {
+        return Vt_search_regex_jump(self);
+    }
+
+    return VT_SEARCH_RESULT_PENDING;
+}
+
+/**
+ * Get the first highlight of line with @param line_id
+ * @return index into highlights or highlights->size if the line has none */
+static size_t vt_search_highlights_find(const Vector_VtSearchHighlight* highlights, size_t line_id)
+{
+    size_t lo = 0, hi = highlights->size;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (highlights->buf[mid].line_id < line_id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return (lo < highlights->size && highlights->buf[lo].line_id == line_id) ? lo
+                                                                             : highlights->size;
+}
+
+static bool vt_search_highlights_equal_for_line(const Vector_VtSearchHighlight* a,
+                                                const Vector_VtSearchHighlight* b,
+                                                size_t                          line_id)
+{
+    size_t i = vt_search_highlights_find(a, line_id);
+    size_t j = vt_search_highlights_find(b, line_id);
+
+    for (;; ++i, ++j) {
+        bool a_end = i >= a->size || a->buf[i].line_id != line_id;
+        bool b_end = j >= b->size || b->buf[j].line_id != line_id;
+
+        if (a_end || b_end) {
+            return a_end && b_end;
+        }
+
+        if (a->buf[i].begin != b->buf[j].begin || a->buf[i].end != b->buf[j].end ||
+            a->buf[i].type != b->buf[j].type) {
+            return false;
+        }
+    }
+}
+
+/**
+ * Damage lines in the buffer that have highlights in @param a different from @param b */
+static void Vt_search_damage_changed_highlights(Vt*                             self,
+                                                const Vector_VtSearchHighlight* a,
+                                                const Vector_VtSearchHighlight* b)
+{
+    for (size_t i = 0; i < a->size; ++i) {
+        size_t line_id = a->buf[i].line_id;
+
+        if (i && a->buf[i - 1].line_id == line_id) {
+            continue;
+        }
+
+        if (line_id >= self->lines.base && Vt_line_id_to_row(self, line_id) <= Vt_max_line(self) &&
+            !vt_search_highlights_equal_for_line(a, b, line_id)) {
+            Vt_mark_proxy_fully_damaged(self, Vt_line_id_to_row(self, line_id));
+        }
+    }
+}
+
+/**
+ * Add highlights for a match of @param len characters starting at character @param idx of
+ * @param line, rows outside of [@param top, @param bottom] are skipped */
+static void Vt_search_highlight_match(Vt*                       self,
+                                      const vt_search_line_t*   line,
+                                      size_t                    idx,
+                                      size_t                    len,
+                                      size_t                    top,
+                                      size_t                    bottom,
+                                      Vector_VtSearchHighlight* out)
+{
+    const struct Search*    s     = &self->search;
+    const vt_search_cell_t* begin = &line->cells.buf[idx];
+
+    vt_search_highlight_e type =
+      (s->has_match && s->match_line_id == Vt_line_id(self, begin->row) &&
+       s->match_col == begin->col)
+        ? VT_SEARCH_HIGHLIGHT_CURRENT
+        : VT_SEARCH_HIGHLIGHT_MATCH;
+
+    for (size_t i = idx; i < idx + len; ++i) {
+        const vt_search_cell_t* cell = &line->cells.buf[i];
+
+        if (cell->row < top || cell->row > bottom) {
+            continue;
+        }
+
+        VtSearchHighlight* last    = Vector_last_VtSearchHighlight(out);
+        size_t             line_id = Vt_line_id(self, cell->row);
+
+        if (i != idx && last && last->line_id == line_id) {
+            last->end = cell->col_end;
+        } else {
+            Vector_push_VtSearchHighlight(out,
+                                          (VtSearchHighlight){
+                                            .line_id = line_id,
+                                            .begin   = cell->col,
+                                            .end     = cell->col_end,
+                                            .type    = type,
+                                          });
+        }
+    }
+}
+
+void Vt_search_update_highlights(Vt* self)
+{
+    struct Search* s = &self->search;
+
+    if (!s->active) {
+        return;
+    }
+
+    size_t top    = MIN(Vt_visual_top_line(self), Vt_max_line(self));
+    size_t bottom = MIN(Vt_visual_bottom_line(self), Vt_max_line(self));
+
+    bool stale = s->highlights_stale || s->highlights_top_line_id != Vt_line_id(self, top);
+    for (size_t row = top; row <= bottom && !stale; ++row) {
+        stale = Ring_at_VtLine(&self->lines, row)->damage.type != VT_LINE_DAMAGE_NONE;
+    }
+
+    if (!stale) {
+        return;
+    }
+
+    Vector_VtSearchHighlight highlights = Vector_new_VtSearchHighlight();
+
+    if (s->pattern.size) {
+        vt_search_line_t line = vt_search_line_new();
+        size_t           len;
+
+        for (size_t row = Vt_logical_line_first_row(self, top); row <= bottom;) {
+            size_t last = Vt_logical_line_last_row(self, row);
+            Vt_search_flatten(self, row, last, &line);
+
+            for (size_t idx = 0;
+                 (idx = Vt_search_find_in_line(self, &line, idx, &len)) != SIZE_MAX;
+                 idx += len) {
+                Vt_search_highlight_match(self, &line, idx, len, top, bottom, &highlights);
+            }
+
+            row = last + 1;
+        }
+
+        vt_search_line_destroy(&line);
+    }
+
+    Vt_search_damage_changed_highlights(self, &s->highlights, &highlights);
+    Vt_search_damage_changed_highlights(self, &highlights, &s->highlights);
+
+    Vector_destroy_VtSearchHighlight(&s->highlights);
+    s->highlights             = highlights;
+    s->highlights_top_line_id = Vt_line_id(self, top);
+    s->highlights_stale       = false;
+}
+
+void Vt_search_end(Vt* self)
+{
+    struct Search* s = &self->search;
+
+    Vector_VtSearchHighlight none = Vector_new_VtSearchHighlight();
+    Vt_search_damage_changed_highlights(self, &s->highlights, &none);
+    Vector_destroy_VtSearchHighlight(&none);
+
+    if (s->worker) {
+        Vt_search_worker_cancel(self, NULL, 0);
+    }
+
+    Vector_clear_VtSearchHighlight(&s->highlights);
+    Vector_clear_VtSearchMatch(&s->matches);
+    Vector_clear_char32_t(&s->pattern);
+
+    s->active         = false;
+    s->input_active   = false;
+    s->has_match      = false;
+    s->pending        = false;
+    s->awaiting_match = false;
+    s->regex_valid    = false;
+}
+
+void Vt_search_destroy(Vt* self)
+{
+    struct Search*         s      = &self->search;
+    struct VtSearchWorker* worker = s->worker;
+
+    if (worker) {
+        if (worker->started) {
+            mtx_lock(&worker->lock);
+            worker->quit = true;
+            cnd_signal(&worker->cond);
+            mtx_unlock(&worker->lock);
+            thrd_join(worker->thread, NULL);
+        }
+
+        VtSearchChunk_destroy_list(worker->todo);
+        VtSearchChunk_destroy_list(worker->done);
+        if (worker->regex_compiled) {
+            regfree(&worker->regex);
+        }
+        Vector_destroy_char(&worker->pattern);
+        cnd_destroy(&worker->cond);
+        mtx_destroy(&worker->lock);
+        free(worker);
+        s->worker = NULL;
+    }
+
+    Vector_destroy_char32_t(&s->pattern);
+    Vector_destroy_VtSearchHighlight(&s->highlights);
+    Vector_destroy_VtSearchMatch(&s->matches);
+    VtSearchIndex_clear(&s->index);
+}
+
+vt_search_highlight_e _vt_cell_search_highlight(const Vt* const self, int32_t x, int32_t y)
+{
+    const Vector_VtSearchHighlight* highlights = &self->search.highlights;
+
+    size_t line_id = Vt_line_id(self, Vt_visual_top_line(self) + y);
+
+    for (size_t i = vt_search_highlights_find(highlights, line_id);
+         i < highlights->size && highlights->buf[i].line_id == line_id;
+         ++i) {
+        if (x >= highlights->buf[i].begin && x < highlights->buf[i].end) {
+            return highlights->buf[i].type;
+        }
+    }
+
+    return VT_SEARCH_HIGHLIGHT_NONE;
+}
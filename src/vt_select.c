@@ -43,15 +43,15 @@ void Vt_select_init_word(Vt* self, int32_t x, int32_t y)
     size_t click_x = (double)x / self->pixels_per_cell_x;
     size_t click_y = (double)y / self->pixels_per_cell_y;
 
-    Vector_VtRune* ln = &self->lines.buf[Vt_visual_top_line(self) + click_y].data;
+    Vector_VtCell* ln = &Ring_at_VtLine(&self->lines, Vt_visual_top_line(self) + click_y)->data;
 
     size_t cmax  = ln->size;
     size_t begin = click_x;
     size_t end   = click_x;
-    while (begin - 1 < cmax && begin > 0 && !isspace(ln->buf[begin - 1].rune.code)) {
+    while (begin - 1 < cmax && begin > 0 && !isspace(Vt_cell_code(self, &ln->buf[begin - 1]))) {
         --begin;
     }
-    while (end + 1 < cmax && end > 0 && !isspace(ln->buf[end + 1].rune.code)) {
+    while (end + 1 < cmax && end > 0 && !isspace(Vt_cell_code(self, &ln->buf[end + 1]))) {
         ++end;
     }
     self->selection.begin_char_idx = begin;
@@ -173,6 +173,8 @@ Vector_char Vt_select_region_to_string(Vt* self)
     size_t      begin_line = MIN(self->selection.begin_line, self->selection.end_line);
     size_t      end_line   = MAX(self->selection.begin_line, self->selection.end_line);
 
+    Vt_thaw_lines(self, begin_line, end_line);
+
     if (begin_line == end_line && self->selection.mode != SELECT_MODE_NONE) {
         begin_char_idx = MIN(self->selection.begin_char_idx, self->selection.end_char_idx);
         end_char_idx   = MAX(self->selection.begin_char_idx, self->selection.end_char_idx);
@@ -186,11 +188,11 @@ Vector_char Vt_select_region_to_string(Vt* self)
     }
 
     if (self->selection.mode == SELECT_MODE_NORMAL) {
-        char* term = self->lines.buf[begin_line + 1].rejoinable ? "" : "\n";
+        char* term = Ring_at_VtLine(&self->lines, begin_line + 1)->rejoinable ? "" : "\n";
         ret        = Vt_line_to_string(self, begin_line, begin_char_idx, Vt_col(self), term);
         Vector_pop_char(&ret);
         for (size_t i = begin_line + 1; i < end_line; ++i) {
-            char* term_mid = self->lines.buf[i + 1].rejoinable ? "" : "\n";
+            char* term_mid = Ring_at_VtLine(&self->lines, i + 1)->rejoinable ? "" : "\n";
             tmp            = Vt_line_to_string(self, i, 0, Vt_col(self), term_mid);
             Vector_pushv_char(&ret, tmp.buf, tmp.size - 1);
             Vector_destroy_char(&tmp);
@@ -12,10 +12,10 @@ static void Vt_shell_integration_begin_command(Vt* self)
 {
     RcPtr_VtCommand new_command        = RcPtr_new_VtCommand();
     *RcPtr_get_VtCommand(&new_command) = (VtCommand){
-        .command              = NULL,
-        .command_start_row    = self->cursor.row,
-        .command_start_column = self->cursor.col,
-        .state                = VT_COMMAND_STATE_TYPING,
+        .command               = NULL,
+        .command_start_line_id = Vt_line_id(self, self->cursor.row),
+        .command_start_column  = self->cursor.col,
+        .state                 = VT_COMMAND_STATE_TYPING,
     };
 
     for (VtCommand* c;
@@ -41,9 +41,10 @@ static void Vt_shell_integration_begin_execution(Vt*  self,
         return;
     }
 
-    if (cmd->command_start_row > self->cursor.row ||
-        (cmd->command_start_row == self->cursor.row &&
-         cmd->command_start_column >= self->cursor.col)) {
+    size_t start_row = Vt_line_id_to_row(self, cmd->command_start_line_id);
+
+    if (start_row > self->cursor.row ||
+        (start_row == self->cursor.row && cmd->command_start_column >= self->cursor.col)) {
         self->shell_integration_state = VT_SHELL_INTEG_STATE_NONE;
         return;
     }
@@ -51,24 +52,24 @@ static void Vt_shell_integration_begin_execution(Vt*  self,
     cmd->state           = VT_COMMAND_STATE_RUNNING;
     cmd->is_vte_protocol = is_vte_protocol;
 
-    for (size_t i = cmd->command_start_row; i < self->cursor.row; ++i) {
+    for (size_t i = start_row; i < self->cursor.row; ++i) {
         Vt_line_at(self, i)->mark_command_invoke = true;
     }
 
     Vt_cursor_line(self)->mark_command_output_start = true;
     RcPtr_new_shared_in_place_of_VtCommand(&Vt_cursor_line(self)->linked_command, cmd_ptr);
 
-    cmd->output_rows.first    = self->cursor.row;
-    cmd->execution_time.start = TimePoint_now();
+    cmd->output_line_ids.first = Vt_line_id(self, self->cursor.row);
+    cmd->execution_time.start  = TimePoint_now();
 
     Vector_char command_string_builder;
 
     if (!no_name_search) {
-        if (cmd->command_start_row == self->cursor.row - 1) {
-            VtLine* ln              = Vt_line_at(self, cmd->command_start_row);
+        if (start_row == self->cursor.row - 1) {
+            VtLine* ln              = Vt_line_at(self, start_row);
             ln->mark_command_invoke = true;
             command_string_builder =
-              VtLine_to_string(ln, cmd->command_start_column, self->cursor.col, NULL);
+              VtLine_to_string(self, ln, cmd->command_start_column, self->cursor.col, NULL);
 
             for (char* r; command_string_builder.size &&
                           (r = Vector_last_char(&command_string_builder)) && *r == ' ';) {
@@ -76,10 +77,10 @@ static void Vt_shell_integration_begin_execution(Vt*  self,
             }
 
         } else {
-            VtLine* ln              = Vt_line_at(self, cmd->command_start_row);
+            VtLine* ln              = Vt_line_at(self, start_row);
             ln->mark_command_invoke = true;
             command_string_builder =
-              VtLine_to_string(ln, cmd->command_start_column, Vt_col(self) - 1, NULL);
+              VtLine_to_string(self, ln, cmd->command_start_column, Vt_col(self) - 1, NULL);
 
             for (char* r; command_string_builder.size &&
                           (r = Vector_last_char(&command_string_builder)) && *r == ' ';) {
@@ -88,10 +89,10 @@ static void Vt_shell_integration_begin_execution(Vt*  self,
 
             Vector_push_char(&command_string_builder, '\n');
 
-            for (size_t row = cmd->command_start_row + 1; row < self->cursor.row; ++row) {
+            for (size_t row = start_row + 1; row < self->cursor.row; ++row) {
                 ln                      = Vt_line_at(self, row);
                 ln->mark_command_invoke = true;
-                Vector_char tmp         = VtLine_to_string(ln, 0, Vt_col(self), NULL);
+                Vector_char tmp         = VtLine_to_string(self, ln, 0, Vt_col(self), NULL);
 
                 for (char* r; command_string_builder.size &&
                               (r = Vector_last_char(&command_string_builder)) && *r == ' ';) {
@@ -143,10 +144,10 @@ static void Vt_shell_integration_end_execution(Vt* self, const char* opt_exit_st
         return;
     }
 
-    cmd->state              = VT_COMMAND_STATE_COMPLETED;
-    cmd->exit_status        = opt_exit_status_string ? atoi(opt_exit_status_string) : 0;
-    cmd->execution_time.end = TimePoint_now();
-    cmd->output_rows.second = self->cursor.row;
+    cmd->state                  = VT_COMMAND_STATE_COMPLETED;
+    cmd->exit_status            = opt_exit_status_string ? atoi(opt_exit_status_string) : 0;
+    cmd->execution_time.end     = TimePoint_now();
+    cmd->output_line_ids.second = Vt_line_id(self, self->cursor.row);
 
     VtLine* ln = Vt_line_at(self, self->cursor.row - 1);
 
@@ -160,10 +161,10 @@ static void Vt_shell_integration_end_execution(Vt* self, const char* opt_exit_st
             "%zu..%zu }\n",
             cmd->command,
             cmd->command_start_column,
-            cmd->command_start_row,
+            cmd->command_start_line_id,
             cmd->exit_status,
-            cmd->output_rows.first,
-            cmd->output_rows.second);
+            cmd->output_line_ids.first,
+            cmd->output_line_ids.second);
 
         CALL(self->callbacks.on_urgency_set, self->callbacks.user_data);
         if (minimized && cmd->command) {
@@ -14,19 +14,22 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-Vector_char Vt_command_to_string(const Vt* self, const VtCommand* command, size_t opt_limit_lines)
+Vector_char Vt_command_to_string(Vt* self, const VtCommand* command, size_t opt_limit_lines)
 {
     ASSERT(command->state == VT_COMMAND_STATE_COMPLETED, "is completed");
 
-    size_t end;
+    size_t begin = Vt_line_id_to_row(self, command->output_line_ids.first);
+    size_t end   = Vt_line_id_to_row(self, command->output_line_ids.second);
     if (opt_limit_lines) {
-        end = MIN(command->output_rows.second, command->output_rows.first + opt_limit_lines);
-    } else {
-        end = command->output_rows.second;
+        end = MIN(end, begin + opt_limit_lines);
+    }
+
+    if (begin < end) {
+        Vt_thaw_lines(self, begin, end - 1);
     }
 
     Vector_char str = Vector_new_with_capacity_char(128);
-    for (size_t row = command->output_rows.first; row < end; ++row) {
+    for (size_t row = begin; row < end; ++row) {
         Vector_char ln = Vt_line_to_string(self, row, 0, Vt_col(self), "\n");
         Vector_pushv_char(&str, ln.buf, ln.size - 1);
         Vector_destroy_char(&ln);
@@ -42,7 +45,7 @@ const char* Vt_uri_range_at(Vt*            self,
                             Pair_uint16_t* out_columns)
 {
     VtLine* base_line = Vt_line_at(self, row);
-    if (!base_line || !base_line->links || column >= base_line->data.size) {
+    if (!base_line || column >= base_line->data.size) {
         return NULL;
     }
 
@@ -58,32 +61,19 @@ const char* Vt_uri_range_at(Vt*            self,
 
     /* Front */
     VtLine*  ln;
-    uint16_t ln_base_idx;
     uint16_t line_start_column = start_column;
 
     for (size_t r = row; r + 1; --r) {
         ln = Vt_line_at(self, r);
 
-        if (!ln || !ln->links || line_start_column >= ln->data.size) {
-            min_row = r + 1;
-            break;
-        }
-
-        ln_base_idx = 0;
-        for (VtUri* i = NULL; (i = Vector_iter_VtUri(ln->links, i));) {
-            if (!strcmp(i->uri_string, base_link_str)) {
-                ln_base_idx = Vector_index_VtUri(ln->links, i) + 1;
-                break;
-            }
-        }
-
-        if (!ln_base_idx) {
+        if (!ln || line_start_column >= ln->data.size ||
+            ln->data.buf[line_start_column].hyperlink_idx != base_link_idx) {
             min_row = r + 1;
             break;
         }
 
         while (line_start_column) {
-            if (ln->data.buf[line_start_column - 1].hyperlink_idx != ln_base_idx)
+            if (ln->data.buf[line_start_column - 1].hyperlink_idx != base_link_idx)
                 break;
             --line_start_column;
         }
@@ -102,26 +92,14 @@ const char* Vt_uri_range_at(Vt*            self,
     for (size_t r = row; r < Vt_visual_bottom_line(self); ++r) {
         ln = Vt_line_at(self, r);
 
-        if (!ln || !ln->links || line_end_column >= ln->data.size) {
-            min_row = r - 1;
-            break;
-        }
-
-        ln_base_idx = 0;
-        for (VtUri* i = NULL; (i = Vector_iter_VtUri(ln->links, i));) {
-            if (!strcmp(i->uri_string, base_link_str)) {
-                ln_base_idx = Vector_index_VtUri(ln->links, i) + 1;
-                break;
-            }
-        }
-
-        if (!ln_base_idx) {
+        if (!ln || line_end_column >= ln->data.size ||
+            ln->data.buf[line_end_column].hyperlink_idx != base_link_idx) {
             min_row = r - 1;
             break;
         }
 
         while (line_end_column < Vt_col(self) && ln->data.size > (size_t)(line_end_column + 1)) {
-            if (ln->data.buf[line_end_column + 1].hyperlink_idx != ln_base_idx)
+            if (ln->data.buf[line_end_column + 1].hyperlink_idx != base_link_idx)
                 break;
             ++line_end_column;
         }
@@ -147,7 +125,11 @@ const char* Vt_uri_range_at(Vt*            self,
     return base_link_str;
 }
 
-Vector_char rune_vec_to_string(Vector_VtRune* line, size_t begin, size_t end, const char* tail)
+Vector_char cell_vec_to_string(const Vt*     vt,
+                               Vector_VtCell* line,
+                               size_t         begin,
+                               size_t         end,
+                               const char*    tail)
 {
     Vector_char res;
     end   = MIN((end ? end : line->size), line->size);
@@ -165,26 +147,26 @@ Vector_char rune_vec_to_string(Vector_VtRune* line, size_t begin, size_t end, co
     static mbstate_t mbstate;
 
     for (uint32_t i = begin; i < end; ++i) {
-        Rune* rune = &line->buf[i].rune;
+        Rune rune = Vt_cell_rune(vt, &line->buf[i]);
 
-        if (rune->code == VT_RUNE_CODE_WIDE_TAIL) {
+        if (rune.code == VT_RUNE_CODE_WIDE_TAIL) {
             continue;
         }
 
-        if (rune->code > CHAR_MAX) {
-            size_t bytes = c32rtomb(utfbuf, rune->code, &mbstate);
+        if (rune.code > CHAR_MAX) {
+            size_t bytes = c32rtomb(utfbuf, rune.code, &mbstate);
             if (bytes > 0 && bytes <= ARRAY_SIZE(utfbuf)) {
                 Vector_pushv_char(&res, utfbuf, bytes);
             }
-        } else if (!rune->code) {
+        } else if (!rune.code) {
             Vector_push_char(&res, ' ');
         } else {
-            Vector_push_char(&res, rune->code);
+            Vector_push_char(&res, rune.code);
         }
 
-        for (int j = 0; j < VT_RUNE_MAX_COMBINE && rune->combine[j]; ++j) {
-            size_t bytes = c32rtomb(utfbuf, rune->combine[j], &mbstate);
-            if (bytes > 0) {
+        for (int j = 0; j < VT_RUNE_MAX_COMBINE && rune.combine[j]; ++j) {
+            size_t bytes = c32rtomb(utfbuf, rune.combine[j], &mbstate);
+            if (bytes > 0 && bytes <= ARRAY_SIZE(utfbuf)) {
                 Vector_pushv_char(&res, utfbuf, bytes);
             }
         }
@@ -546,7 +528,7 @@ __attribute__((cold)) void Vt_dump_info(Vt* self)
     static int dump_index = 0;
     printf("\n====================[ STATE DUMP %2d ]====================\n", dump_index++);
     printf("parser state: ");
-    if (self->parser.in_mb_seq) {
+    if (utf8_decoder_in_sequence(&self->parser.utf8_decoder)) {
         puts("in multi-byte sequence");
     } else {
         switch (self->parser.state) {
@@ -556,6 +538,15 @@ __attribute__((cold)) void Vt_dump_info(Vt* self)
             case PARSER_STATE_CSI:
                 puts("in control sequence");
                 break;
+            case PARSER_STATE_CSI_PARAM:
+                puts("in control sequence parameters");
+                break;
+            case PARSER_STATE_CSI_INTERMEDIATE:
+                puts("in control sequence intermediates");
+                break;
+            case PARSER_STATE_CSI_IGNORE:
+                puts("in malformed control sequence");
+                break;
             case PARSER_STATE_DCS:
                 puts("in device control string");
                 break;
@@ -568,9 +559,6 @@ __attribute__((cold)) void Vt_dump_info(Vt* self)
             case PARSER_STATE_ESCAPED:
                 puts("escape code");
                 break;
-            case PARSER_STATE_ESCAPED_CSI:
-                puts("in control sequence escape code");
-                break;
             case PARSER_STATE_DEC_SPECIAL:
                 puts("DEC special command");
                 break;
@@ -679,8 +667,8 @@ __attribute__((cold)) void Vt_dump_info(Vt* self)
             printf("    \'%s\', exit status:%d, output lines: %zu..%zu\n",
                    c->command,
                    c->exit_status,
-                   c->output_rows.first,
-                   c->output_rows.second);
+                   c->output_line_ids.first,
+                   c->output_line_ids.second);
         }
     }
 
@@ -711,7 +699,8 @@ __attribute__((cold)) void Vt_dump_info(Vt* self)
     printf("V V V  \n");
 
     for (size_t i = 0; i < self->lines.size; ++i) {
-        Vector_char str = rune_vec_to_string(&self->lines.buf[i].data, 0, 0, "");
+        VtLine*     ln  = Ring_at_VtLine(&self->lines, i);
+        Vector_char str = cell_vec_to_string(self, &ln->data, 0, 0, "");
         printf("%s%c %c %c %4zu%c s:%3zu dmg:%d proxy{%3d,%3d,%3d,%3d} reflow{%d,%d,%d} "
                "marks{%d,%d,%d,%d} data{%.90s%s}" TERMCOLOR_RESET "\n",
                i == self->cursor.row ? TERMCOLOR_BOLD : "",
@@ -723,34 +712,31 @@ __attribute__((cold)) void Vt_dump_info(Vt* self)
                i == Vt_visual_top_line(self) || i == Vt_visual_bottom_line(self) ? '*' : ' ',
                i,
                i == self->cursor.row ? '<' : ' ',
-               self->lines.buf[i].data.size,
-               self->lines.buf[i].damage.type != VT_LINE_DAMAGE_NONE,
-               self->lines.buf[i].proxy.data[0],
-               self->lines.buf[i].proxy.data[1],
-               self->lines.buf[i].proxy.data[2],
-               self->lines.buf[i].proxy.data[3],
-               self->lines.buf[i].reflowable,
-               self->lines.buf[i].rejoinable,
-               self->lines.buf[i].was_reflown,
-               self->lines.buf[i].mark_command_invoke,
-               self->lines.buf[i].mark_command_output_start,
-               self->lines.buf[i].mark_command_output_end,
-               self->lines.buf[i].mark_explicit,
+               ln->data.size,
+               ln->damage.type != VT_LINE_DAMAGE_NONE,
+               ln->proxy.data[0],
+               ln->proxy.data[1],
+               ln->proxy.data[2],
+               ln->proxy.data[3],
+               ln->reflowable,
+               ln->rejoinable,
+               ln->was_reflown,
+               ln->mark_command_invoke,
+               ln->mark_command_output_start,
+               ln->mark_command_output_end,
+               ln->mark_explicit,
                str.buf,
                (str.size > 90 ? "…" : ""));
 
-        if (self->lines.buf[i].links) {
-            for (uint16_t j = 0; j < self->lines.buf[i].links->size; ++j) {
-                printf("              URI[%u]: %s\n",
-                       j,
-                       self->lines.buf[i].links->buf[j].uri_string);
+        for (uint16_t j = 0; j < ln->data.size; ++j) {
+            const VtUri* uri = Vt_uri_by_id(self, ln->data.buf[j].hyperlink_idx);
+            if (uri && (!j || ln->data.buf[j - 1].hyperlink_idx != ln->data.buf[j].hyperlink_idx)) {
+                printf("              URI[%u]: %s\n", j, uri->uri_string);
             }
         }
 
-        if (self->lines.buf[i].graphic_attachments &&
-            self->lines.buf[i].graphic_attachments->images) {
-            for (uint16_t j = 0; j < self->lines.buf[i].graphic_attachments->images->size; ++j) {
-                VtLine*             ln = &self->lines.buf[i];
+        if (ln->graphic_attachments && ln->graphic_attachments->images) {
+            for (uint16_t j = 0; j < ln->graphic_attachments->images->size; ++j) {
                 VtImageSurfaceView* vu =
                   RcPtr_get_VtImageSurfaceView(&ln->graphic_attachments->images->buf[j]);
                 VtImageSurface* src = RcPtr_get_VtImageSurface(&vu->source_image_surface);
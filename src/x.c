@@ -470,6 +470,8 @@ static WindowBase* WindowX11_new(uint32_t  w,
         init_globals = true;
         global       = _calloc(1, sizeof(WindowStatic) + sizeof(GlobalX11) - sizeof(uint8_t));
 
+        /* callbacks from the pty thread can make requests while we are swapping buffers */
+        XInitThreads();
         XSetErrorHandler(x11_error_handler);
         XSetIOErrorHandler(x11_io_error_handler);
     }
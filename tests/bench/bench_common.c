@@ -0,0 +1,134 @@
+/* See LICENSE for license information. */
+
+#include "bench_common.h"
+
+#include "settings.h"
+#include "util.h"
+
+#include <fcntl.h>
+#include <locale.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+size_t bench_n_allocs = 0;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+    ++bench_n_allocs;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size)
+{
+    ++bench_n_allocs;
+    return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+    ++bench_n_allocs;
+    return __real_realloc(ptr, size);
+}
+
+static Pair_uint32_t bench_cells;
+
+static void nop(void* user_data) {}
+static void nop_bool(void* user_data, bool value) {}
+static void nop_str(void* user_data, const char* value) {}
+static void nop_line_proxy(void* user_data, VtLineProxy* proxy) {}
+static void nop_image_proxy(void* user_data, VtImageSurfaceProxy* proxy) {}
+static void nop_image_view_proxy(void* user_data, VtImageSurfaceViewProxy* proxy) {}
+static void nop_sixel_proxy(void* user_data, VtSixelSurfaceProxy* proxy) {}
+
+static Pair_uint32_t get_number_of_cells(void* user_data)
+{
+    return bench_cells;
+}
+
+/* pretend every cell is 9x18 pixels */
+static Pair_uint32_t get_pixels_from_cells(void* user_data, uint32_t rows, uint32_t cols)
+{
+    return (Pair_uint32_t){ .first = cols * 9, .second = rows * 18 };
+}
+
+static Pair_uint32_t get_pixel_size(void* user_data)
+{
+    return get_pixels_from_cells(user_data, bench_cells.second, bench_cells.first);
+}
+
+static const char* get_application_hostname(void* user_data)
+{
+    return "localhost";
+}
+
+void bench_init(const char* argv0)
+{
+    setlocale(LC_ALL, "C.UTF-8");
+    char* args[] = { (char*)argv0, "-c", NULL };
+    settings_init(2, args);
+}
+
+void bench_cleanup()
+{
+    settings_cleanup();
+}
+
+void bench_vt_init(Vt* vt, uint32_t cols, uint32_t rows)
+{
+    bench_cells = (Pair_uint32_t){ .first = cols, .second = rows };
+
+    Vt_init(vt, cols, rows);
+    vt->callbacks.on_action_performed                 = nop;
+    vt->callbacks.on_repaint_required                 = nop;
+    vt->callbacks.on_visual_bell                      = nop;
+    vt->callbacks.on_buffer_changed                   = nop;
+    vt->callbacks.on_visual_scroll_reset              = nop;
+    vt->callbacks.on_command_state_changed            = nop;
+    vt->callbacks.on_select_end                       = nop;
+    vt->callbacks.on_cursor_blink_state_changed       = nop_bool;
+    vt->callbacks.on_title_changed                    = nop_str;
+    vt->callbacks.on_application_hostname_requested   = get_application_hostname;
+    vt->callbacks.on_window_size_requested            = get_pixel_size;
+    vt->callbacks.on_text_area_size_requested         = get_pixel_size;
+    vt->callbacks.on_number_of_cells_requested        = get_number_of_cells;
+    vt->callbacks.on_window_size_from_cells_requested = get_pixels_from_cells;
+    vt->callbacks.destroy_proxy                       = nop_line_proxy;
+    vt->callbacks.destroy_image_proxy                 = nop_image_proxy;
+    vt->callbacks.destroy_image_view_proxy            = nop_image_view_proxy;
+    vt->callbacks.destroy_sixel_proxy                 = nop_sixel_proxy;
+}
+
+void bench_vt_interpret(Vt* vt, char* buf, size_t len)
+{
+    Vt_interpret(vt, buf, len);
+    Vt_consumed_output(vt, Vt_get_output_size(vt));
+}
+
+long bench_peak_rss_kib()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage)) {
+        return -1;
+    }
+
+    /* kilobytes on Linux and the BSDs */
+    return usage.ru_maxrss;
+}
+
+void bench_reset_peak_rss()
+{
+    int fd = open("/proc/self/clear_refs", O_WRONLY);
+    if (fd < 0) {
+        return;
+    }
+
+    if (write(fd, "5", 1) != 1) {
+        WRN("Failed to reset peak RSS: %s\n", strerror(errno));
+    }
+
+    close(fd);
+}
@@ -0,0 +1,41 @@
+/* See LICENSE for license information. */
+
+/**
+ * Shared setup for benchmarks running the terminal emulator without a window.
+ *
+ * Benchmark binaries are linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc so every
+ * heap allocation made by the emulator is counted in bench_n_allocs.
+ */
+
+#pragma once
+
+#include "vt.h"
+
+#include <stddef.h>
+
+extern size_t bench_n_allocs;
+
+/**
+ * Set the locale and load default settings (the user config file is skipped so results do not
+ * depend on it) */
+void bench_init(const char* argv0);
+
+void bench_cleanup();
+
+/**
+ * Initialize @param vt with callbacks that do nothing, as if it was attached to a window of
+ * @param cols by @param rows cells that never gets redrawn */
+void bench_vt_init(Vt* vt, uint32_t cols, uint32_t rows);
+
+/**
+ * Feed @param len bytes through the parser and drop any responses it generated */
+void bench_vt_interpret(Vt* vt, char* buf, size_t len);
+
+/**
+ * Get the peak resident set size of this process in KiB */
+long bench_peak_rss_kib();
+
+/**
+ * Lower the peak resident set size to the current one, so memory used before (e.g. by a parent
+ * process before fork()) does not hide what is used after. Only possible on Linux */
+void bench_reset_peak_rss();
@@ -0,0 +1,92 @@
+/* See LICENSE for license information. */
+
+/**
+ * SGR microbenchmark
+ *
+ * Feeds a buffer made mostly of SGR sequences (like the output of 'ls --color' or a compiler with
+ * colored diagnostics) through Vt_interpret and reports time and heap allocations per sequence.
+ */
+
+#include "bench_common.h"
+#include "timing.h"
+#include "util.h"
+#include "vt.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char* const sequences[] = {
+    "\e[0m",
+    "\e[m",
+    "\e[1m",
+    "\e[01;34m",
+    "\e[01;32m",
+    "\e[31m",
+    "\e[1;31m",
+    "\e[0;1m",
+    "\e[22m",
+    "\e[4m",
+    "\e[4:3m",
+    "\e[24m",
+    "\e[7m",
+    "\e[27m",
+    "\e[39m",
+    "\e[49m",
+    "\e[38;5;208m",
+    "\e[48;5;236m",
+    "\e[38:5:81m",
+    "\e[38;2;255;135;0m",
+    "\e[48;2;40;40;40m",
+    "\e[38:2::171:178:191m",
+    "\e[58:2::255:0:0m",
+    "\e[0;38;5;245;48;5;233m",
+};
+
+#define BENCH_ROUNDS 200
+#define BENCH_SPANS  4096
+
+int main(int argc, char** argv)
+{
+    bench_init(argv[0]);
+
+    Vt vt;
+    bench_vt_init(&vt, 80, 24);
+
+    /* every sequence is followed by a short word, the cursor is moved back often enough for the
+     * text to never wrap or scroll */
+    Vector_char buf = Vector_new_char();
+    for (size_t i = 0; i < BENCH_SPANS; ++i) {
+        const char* seq = sequences[i % ARRAY_SIZE(sequences)];
+        Vector_pushv_char(&buf, seq, strlen(seq));
+        Vector_pushv_char(&buf, "word ", 5);
+        if (i % 8 == 7) {
+            Vector_pushv_char(&buf, "\e[H", 3);
+        }
+    }
+
+    /* warm up, so the initial line allocations are not counted */
+    Vt_interpret(&vt, buf.buf, buf.size);
+
+    size_t    allocs_before = bench_n_allocs;
+    TimePoint start         = TimePoint_now();
+    for (int i = 0; i < BENCH_ROUNDS; ++i) {
+        Vt_interpret(&vt, buf.buf, buf.size);
+    }
+    TimePoint end = TimePoint_now();
+    TimePoint_subtract(&end, start);
+
+    size_t  n_seqs  = (size_t)BENCH_SPANS * BENCH_ROUNDS;
+    int64_t elapsed = TimePoint_get_nsecs(end);
+
+    printf("sgr: %zu sequences in %.3f ms, %.1f ns/sequence, %.2f allocations/sequence\n",
+           n_seqs,
+           elapsed / 1e6,
+           (double)elapsed / n_seqs,
+           (double)(bench_n_allocs - allocs_before) / n_seqs);
+
+    Vector_destroy_char(&buf);
+    Vt_destroy(&vt);
+    bench_cleanup();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,483 @@
+/* See LICENSE for license information. */
+
+/**
+ * Headless terminal emulation throughput benchmark
+ *
+ * Replays byte streams through Vt_interpret and reports throughput, heap allocations and peak
+ * resident set size for each of them. Without arguments a synthetic corpus covering plain text,
+ * colored output, CJK, full screen TUI redraws and both image protocols is generated, otherwise
+ * every argument is a file to replay: either raw program output or a session saved with 'wayst
+ * --record' (its initial terminal size is used).
+ *
+ * Each corpus runs in a forked child, so a crash is reported instead of taking down the whole run.
+ * The reported RSS is how much the peak resident set size of the child grew while running the
+ * corpus, memory the child shares with the benchmark process is not counted.
+ */
+
+#include "base64.h"
+#include "bench_common.h"
+#include "pty_recording.h"
+#include "timing.h"
+#include "util.h"
+#include "vt.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define BENCH_COLS 120
+#define BENCH_ROWS 40
+
+/* approximate size of every generated corpus */
+#define BENCH_CORPUS_SIZE (4 * 1024 * 1024)
+
+/* every corpus is replayed until at least this much time has passed */
+#define BENCH_MIN_DURATION_NS 500000000LL
+#define BENCH_MAX_ROUNDS      1000
+
+/* start of every line printed by WRN() */
+#define BENCH_WRN_PREFIX "[\e[33mwarning\e[m] "
+
+typedef struct
+{
+    const char* name;
+    Vector_char data;
+    uint32_t    cols, rows;
+} bench_corpus_t;
+
+static uint32_t rng_state = 0x12345678;
+
+/* xorshift32, the corpus has to be the same on every run */
+static uint32_t rng_next()
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static uint32_t rng_range(uint32_t lo, uint32_t hi)
+{
+    return lo + rng_next() % (hi - lo + 1);
+}
+
+static void push_str(Vector_char* v, const char* str)
+{
+    Vector_pushv_char(v, str, strlen(str));
+}
+
+__attribute__((format(printf, 2, 3))) static void push_fmt(Vector_char* v, const char* fmt, ...)
+{
+    char    tmp[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(tmp, sizeof(tmp), fmt, ap);
+    va_end(ap);
+    Vector_pushv_char(v, tmp, MIN((size_t)len, sizeof(tmp) - 1));
+}
+
+static void push_codepoint(Vector_char* v, char32_t c)
+{
+    char      buf[4];
+    mbstate_t mbs = { 0 };
+    size_t    len = c32rtomb(buf, c, &mbs);
+    if (len != (size_t)-1) {
+        Vector_pushv_char(v, buf, len);
+    }
+}
+
+static const char* const words[] = {
+    "the",    "terminal", "emulator", "parses", "every",   "byte",    "of",     "output",
+    "from",   "a",        "program",  "running", "in",     "pseudo",  "console", "make:",
+    "error:", "warning:", "src/",     "main.c", "include", "return",  "static", "void",
+    "0x7f3a", "1234",     "--help",   "[OK]",    "(null)", "/usr/lib", "#",     "...",
+};
+
+static const char* random_word()
+{
+    return words[rng_range(0, ARRAY_SIZE(words) - 1)];
+}
+
+/* plain text with lines of varying length, some wrap */
+static void corpus_generate_ascii(Vector_char* out)
+{
+    while (out->size < BENCH_CORPUS_SIZE) {
+        for (uint32_t len = rng_range(0, 160), i = 0; i < len;) {
+            const char* word = random_word();
+            push_str(out, word);
+            Vector_push_char(out, ' ');
+            i += strlen(word) + 1;
+        }
+        push_str(out, "\r\n");
+    }
+}
+
+/* colored output similar to 'ls --color', 'grep --color' or compiler diagnostics */
+static void corpus_generate_sgr(Vector_char* out)
+{
+    static const char* const sgr[] = {
+        "\e[01;34m",    "\e[01;32m",    "\e[31m",       "\e[1;31m",
+        "\e[4m",        "\e[7m",        "\e[4:3m",      "\e[38;5;208m",
+        "\e[48;5;236m", "\e[38:5:81m",  "\e[3m",        "\e[2m",
+        "\e[1;4;35m",   "\e[38;2;255;135;0m",           "\e[48;2;40;40;40m",
+    };
+
+    while (out->size < BENCH_CORPUS_SIZE) {
+        for (uint32_t n = rng_range(1, 10), i = 0; i < n; ++i) {
+            push_str(out, sgr[rng_range(0, ARRAY_SIZE(sgr) - 1)]);
+            push_str(out, random_word());
+            push_str(out, "\e[0m ");
+            push_str(out, random_word());
+            Vector_push_char(out, ' ');
+        }
+        push_str(out, "\r\n");
+    }
+}
+
+/* double width ideographs mixed with kana, punctuation and some ASCII */
+static void corpus_generate_cjk(Vector_char* out)
+{
+    while (out->size < BENCH_CORPUS_SIZE) {
+        for (uint32_t len = rng_range(0, 80), i = 0; i < len; ++i) {
+            switch (rng_range(0, 9)) {
+                case 0:
+                    push_codepoint(out, rng_range(0x3041, 0x3096)); /* hiragana */
+                    break;
+                case 1:
+                    push_codepoint(out, 0x3001); /* ideographic comma */
+                    break;
+                case 2:
+                    push_str(out, random_word());
+                    break;
+                default:
+                    push_codepoint(out, rng_range(0x4E00, 0x9FFF));
+            }
+        }
+        push_str(out, "\r\n");
+    }
+}
+
+/* cursor addressed full screen redraws, like 'htop' or 'top' */
+static void corpus_generate_tui(Vector_char* out)
+{
+    while (out->size < BENCH_CORPUS_SIZE) {
+        push_str(out, "\e[?25l\e[H\e[30;46m");
+        push_str(out, "  PID USER      PRI  NI  VIRT   RES S CPU% MEM% COMMAND\e[K\e[m");
+
+        for (uint32_t row = 2; row < BENCH_ROWS; ++row) {
+            push_fmt(out,
+                     "\e[%u;1H%s%5u %-9s %3u %3d %5uM %4uM %c %4.1f %4.1f \e[1m%s\e[m %s\e[K",
+                     row,
+                     row == 2 ? "\e[30;42m" : "",
+                     rng_range(1, 99999),
+                     rng_range(0, 3) ? "user" : "root",
+                     rng_range(0, 39),
+                     (int)rng_range(0, 39) - 20,
+                     rng_range(1, 9999),
+                     rng_range(1, 999),
+                     rng_range(0, 7) ? 'S' : 'R',
+                     rng_range(0, 1000) / 10.0,
+                     rng_range(0, 1000) / 10.0,
+                     random_word(),
+                     random_word());
+        }
+
+        /* scroll part of the screen like a log pane does */
+        push_fmt(out, "\e[%u;%ur\e[%u;1H\n%s\e[r", 10, BENCH_ROWS - 2, BENCH_ROWS - 2, "log");
+        push_fmt(out,
+                 "\e[%u;1H\e[7mF1\e[mHelp \e[7mF2\e[mSetup \e[7mF10\e[mQuit\e[K\e[?25h",
+                 BENCH_ROWS);
+    }
+}
+
+/* 128x96 sixel images with a 16 color palette, separated by some text */
+static void corpus_generate_sixel(Vector_char* out)
+{
+    const uint32_t width = 128, height = 96, colors = 16;
+
+    while (out->size < BENCH_CORPUS_SIZE) {
+        push_fmt(out, "\eP0;1;0q\"1;1;%u;%u", width, height);
+
+        for (uint32_t c = 0; c < colors; ++c) {
+            push_fmt(out, "#%u;2;%u;%u;%u", c, rng_range(0, 100), rng_range(0, 100), 50);
+        }
+
+        for (uint32_t band = 0; band < height / 6; ++band) {
+            for (uint32_t c = 0; c < colors; ++c) {
+                push_fmt(out, "#%u", c);
+                for (uint32_t x = 0; x < width;) {
+                    uint32_t run = MIN(rng_range(1, 12), width - x);
+                    char     six = '?' + rng_range(0, 63);
+                    if (run > 3) {
+                        push_fmt(out, "!%u%c", run, six);
+                    } else {
+                        for (uint32_t i = 0; i < run; ++i) {
+                            Vector_push_char(out, six);
+                        }
+                    }
+                    x += run;
+                }
+                Vector_push_char(out, c + 1 == colors ? '-' : '$');
+            }
+        }
+
+        push_str(out, "\e\\\r\n");
+        push_str(out, random_word());
+        push_str(out, "\r\n");
+    }
+}
+
+/* 64x64 RGBA images sent with the kitty image protocol in 4096 byte chunks */
+static void corpus_generate_kitty(Vector_char* out)
+{
+    const uint32_t width = 64, height = 64, chunk = 4096;
+    char           pixels[64 * 64 * 4];
+    uint32_t       id = 0;
+
+    while (out->size < BENCH_CORPUS_SIZE) {
+        for (size_t i = 0; i < sizeof(pixels); ++i) {
+            pixels[i] = rng_next();
+        }
+
+        size_t encoded_size;
+        char*  encoded = base64_encode_alloc(pixels, sizeof(pixels), &encoded_size);
+
+        /* a handful of ids so older images get replaced instead of piling up */
+        id = id % 8 + 1;
+
+        for (size_t offset = 0; offset < encoded_size; offset += chunk) {
+            bool last = offset + chunk >= encoded_size;
+
+            if (!offset) {
+                push_fmt(out, "\e_Ga=T,f=32,s=%u,v=%u,i=%u,q=2,m=%d;", width, height, id, !last);
+            } else {
+                push_fmt(out, "\e_Gm=%d;", !last);
+            }
+
+            Vector_pushv_char(out, encoded + offset, MIN(chunk, encoded_size - offset));
+            push_str(out, "\e\\");
+        }
+
+        free(encoded);
+        push_str(out, "\r\n");
+        push_str(out, random_word());
+        push_str(out, "\r\n");
+    }
+}
+
+static const struct
+{
+    const char* name;
+    void (*generate)(Vector_char* out);
+} generated_corpora[] = {
+    { "ascii", corpus_generate_ascii }, { "sgr", corpus_generate_sgr },
+    { "cjk", corpus_generate_cjk },     { "tui", corpus_generate_tui },
+    { "sixel", corpus_generate_sixel }, { "kitty", corpus_generate_kitty },
+};
+
+/* replay only the program output from a session saved with --record */
+static bool corpus_load_recording(bench_corpus_t* corpus, const char* path)
+{
+    PtyRecording recording;
+    if (!PtyRecording_open(&recording, path)) {
+        return false;
+    }
+
+    corpus->name = path;
+    corpus->data = Vector_new_char();
+    corpus->cols = recording.cols;
+    corpus->rows = recording.rows;
+
+    pty_recording_chunk_t chunk;
+    while (PtyRecording_next_chunk(&recording, &chunk)) {
+        if (chunk.type != PTY_RECORDING_CHUNK_READ) {
+            continue;
+        }
+
+        char   buf[BUFSIZ];
+        size_t rd;
+        while ((rd = PtyRecording_read(&recording, buf, sizeof(buf)))) {
+            Vector_pushv_char(&corpus->data, buf, rd);
+        }
+    }
+
+    PtyRecording_close(&recording);
+    return true;
+}
+
+static bool corpus_load_file(bench_corpus_t* corpus, const char* path)
+{
+    if (corpus_load_recording(corpus, path)) {
+        return true;
+    }
+
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "failed to open \'%s\': %s\n", path, strerror(errno));
+        return false;
+    }
+
+    corpus->name = path;
+    corpus->data = Vector_new_char();
+    corpus->cols = BENCH_COLS;
+    corpus->rows = BENCH_ROWS;
+
+    char   buf[BUFSIZ];
+    size_t rd;
+    while ((rd = fread(buf, 1, sizeof(buf), file))) {
+        Vector_pushv_char(&corpus->data, buf, rd);
+    }
+
+    fclose(file);
+    return true;
+}
+
+static void corpus_run(bench_corpus_t* corpus)
+{
+    bench_reset_peak_rss();
+    long rss_before = bench_peak_rss_kib();
+
+    Vt vt;
+    bench_vt_init(&vt, corpus->cols, corpus->rows);
+
+    size_t    rounds        = 0;
+    int64_t   elapsed       = 0;
+    size_t    allocs_before = bench_n_allocs;
+    TimePoint start         = TimePoint_now();
+
+    do {
+        bench_vt_interpret(&vt, corpus->data.buf, corpus->data.size);
+        TimePoint now = TimePoint_now();
+        TimePoint_subtract(&now, start);
+        elapsed = TimePoint_get_nsecs(now);
+    } while (++rounds < BENCH_MAX_ROUNDS && elapsed < BENCH_MIN_DURATION_NS);
+
+    double bytes = (double)corpus->data.size * rounds;
+
+    printf("%-16s %8.2f MiB %10.1f %9.2f %12.1f %10ld KiB\n",
+           corpus->name,
+           corpus->data.size / (1024.0 * 1024.0),
+           bytes / 1e6 / (elapsed / 1e9),
+           elapsed / bytes,
+           (bench_n_allocs - allocs_before) / (bytes / (1024.0 * 1024.0)),
+           bench_peak_rss_kib() - rss_before);
+
+    Vt_destroy(&vt);
+}
+
+/**
+ * Copy lines a child writes to @param fd to stderr until it exits. The emulator warns about every
+ * unsupported or malformed sequence, printing that would only measure the speed of the terminal
+ * the benchmark runs in, so warnings are dropped. Everything else (e.g. sanitizer reports) is kept
+ */
+static void forward_child_stderr(int fd)
+{
+    FILE* in = fdopen(fd, "r");
+    if (!in) {
+        close(fd);
+        return;
+    }
+
+    char*  line = NULL;
+    size_t cap  = 0;
+    while (getline(&line, &cap, in) >= 0) {
+        if (strncmp(line, BENCH_WRN_PREFIX, sizeof(BENCH_WRN_PREFIX) - 1)) {
+            fputs(line, stderr);
+        }
+    }
+
+    free(line);
+    fclose(in);
+}
+
+/**
+ * Run @param corpus in a child process
+ * @return child exited normally */
+static bool corpus_run_isolated(bench_corpus_t* corpus)
+{
+    fflush(stdout);
+
+    int err_pipe[2];
+    if (pipe(err_pipe)) {
+        fprintf(stderr, "pipe failed: %s\n", strerror(errno));
+        return false;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "fork failed: %s\n", strerror(errno));
+        close(err_pipe[0]);
+        close(err_pipe[1]);
+        return false;
+    } else if (!pid) {
+        close(err_pipe[0]);
+        dup2(err_pipe[1], STDERR_FILENO);
+        close(err_pipe[1]);
+
+        corpus_run(corpus);
+        fflush(stdout);
+        _exit(EXIT_SUCCESS);
+    }
+
+    close(err_pipe[1]);
+    forward_child_stderr(err_pipe[0]);
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0) {
+        fprintf(stderr, "waitpid failed: %s\n", strerror(errno));
+        return false;
+    }
+
+    if (WIFSIGNALED(status)) {
+        printf("%-16s killed by signal %d (%s)\n",
+               corpus->name,
+               WTERMSIG(status),
+               strsignal(WTERMSIG(status)));
+        return false;
+    }
+
+    return WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv)
+{
+    bench_init(argv[0]);
+
+    size_t          n_corpora = argc > 1 ? (size_t)argc - 1 : ARRAY_SIZE(generated_corpora);
+    bench_corpus_t* corpora   = calloc(n_corpora, sizeof(bench_corpus_t));
+
+    for (size_t i = 0; i < n_corpora; ++i) {
+        if (argc > 1) {
+            if (!corpus_load_file(&corpora[i], argv[i + 1])) {
+                return EXIT_FAILURE;
+            }
+        } else {
+            corpora[i].name = generated_corpora[i].name;
+            corpora[i].cols = BENCH_COLS;
+            corpora[i].rows = BENCH_ROWS;
+            corpora[i].data = Vector_new_char();
+            generated_corpora[i].generate(&corpora[i].data);
+        }
+    }
+
+    printf("%-16s %12s %10s %9s %12s %14s\n",
+           "corpus",
+           "size",
+           "MB/s",
+           "ns/byte",
+           "allocs/MiB",
+           "RSS growth");
+
+    bool ok = true;
+    for (size_t i = 0; i < n_corpora; ++i) {
+        ok &= corpus_run_isolated(&corpora[i]);
+        Vector_destroy_char(&corpora[i].data);
+    }
+
+    free(corpora);
+    bench_cleanup();
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}